@@ -287,6 +287,19 @@ struct scanner
   /* the brightness/contrast LUT for dumb scanners */
   unsigned char lut[256];
 
+  /* reused by rotate between pages, per side */
+  unsigned char * deskew_scratch[2];
+  size_t deskew_scratch_size[2];
+
+  /* back side processed along with the front, and its final size */
+  int post_done;
+  SANE_Parameters post_params;
+
+  /* time spent in buffer_xxx functions, usec: this page and batch */
+  long post_usec[2];
+  long post_usec_tot[2];
+  int post_pages[2];
+
   /* --------------------------------------------------------------------- */
   /* values which are set by calibration functions                         */
   int c_res;
@@ -538,26 +551,13 @@ static SANE_Status copy_simplex(struct scanner *s, unsigned char * buf, int len,
 static SANE_Status copy_duplex(struct scanner *s, unsigned char * buf, int len);
 static SANE_Status copy_line(struct scanner *s, unsigned char * buf, int side);
 
-static SANE_Status buffer_despeck(struct scanner *s, int side);
-static SANE_Status buffer_deskew(struct scanner *s, int side);
-static SANE_Status buffer_crop(struct scanner *s, int side);
-
-int * getTransitionsY (struct scanner *s, int side, int top);
-int * getTransitionsX (struct scanner *s, int side, int top);
-
-SANE_Status getEdgeIterate (int width, int height, int resolution,
-  int * buff, double * finSlope, int * finXInter, int * finYInter);
-
-SANE_Status getEdgeSlope (int width, int height, int * top, int * bot,
-  double slope, int * finXInter, int * finYInter);
-
-SANE_Status rotateOnCenter (struct scanner *s, int side,
-  int centerX, int centerY, double slope);
+static void post_process(struct scanner *s, int both);
+static void post_side(struct scanner *s, int side, SANE_Parameters * params);
+static SANE_Status buffer_despeck(struct scanner *s, int side, SANE_Parameters * params);
+static SANE_Status buffer_deskew(struct scanner *s, int side, SANE_Parameters * params);
+static SANE_Status buffer_crop(struct scanner *s, int side, SANE_Parameters * params);
 
-static SANE_Status getLine (int height, int width, int * buff,
- int slopes, double minSlope, double maxSlope,
- int offsets, int minOffset, int maxOffset,
- double * finSlope, int * finOffset, int * finDensity);
+static void magic_params(struct scanner *s, SANE_Parameters * params);
 
 static SANE_Status load_lut (unsigned char * lut, int in_bits, int out_bits,
   int out_min, int out_max, int slope, int offset);
@@ -44,7 +44,7 @@
 
 /* Please increase version number with every change 
    (don't forget to update dll.desc) */
-#define DLL_VERSION "1.0.13"
+#define DLL_VERSION "1.0.14"
 
 #ifdef _AIX
 # include "lalloca.h"		/* MUST come first for AIX! */
@@ -96,7 +96,16 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <dirent.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#ifdef USE_PTHREAD
+# include <pthread.h>
+# define DLL_PROBE_THREADS
+#endif
 
 #include "../include/sane/sane.h"
 #include "../include/sane/sanei.h"
@@ -163,6 +172,11 @@ struct backend
   u_int inited:1;		/* has the backend been initialized? */
   void *handle;			/* handle returned by dlopen() */
   void *(*op[NUM_OPS]) (void);
+  int probe_state;		/* see probe_backends() */
+  u_int probe_late:1;		/* probe took longer than probe_timeout */
+  SANE_Status probe_status;
+  const SANE_Device **probe_list;
+  double probe_start;
 };
 
 #define BE_ENTRY(be,func)       sane_##be##_##func
@@ -203,7 +217,8 @@ struct backend
     BE_ENTRY(name,cancel),                      \
     BE_ENTRY(name,set_io_mode),                 \
     BE_ENTRY(name,get_select_fd)                \
-  }                                             \
+  },                                            \
+  0, 0, 0, 0, 0                                 \
 }
 
 #ifndef __BEOS__
@@ -211,7 +226,7 @@ struct backend
 #include "dll-preload.h"
 #else
 static struct backend preloaded_backends[] = {
- { 0, 0, 0, 0, 0, 0, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }}
+ { 0, 0, 0, 0, 0, 0, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, 0, 0, 0, 0, 0}
 };
 #endif
 #endif
@@ -240,6 +255,34 @@ static struct alias *first_alias;
 static SANE_Auth_Callback auth_callback;
 static struct backend *first_backend;
 
+/* "option" lines of dll.conf and dll.d */
+#define DLL_PROBE_TIMEOUT 10
+static int probe_threads = 0;	/* 0: probe the backends one by one */
+static int probe_timeout = DLL_PROBE_TIMEOUT;	/* seconds per backend */
+static char *hint_file;
+
+/* "backend:device" names found by the last sane_get_devices(), also
+   kept in hint_file across processes */
+static char **hints;
+static int hints_len;
+
+enum
+{
+  PROBE_IDLE = 0,
+  PROBE_QUEUED,
+  PROBE_RUNNING,
+  PROBE_DONE
+};
+
+#ifdef DLL_PROBE_THREADS
+static pthread_mutex_t probe_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t probe_cond = PTHREAD_COND_INITIALIZER;
+static struct backend **probe_queue;
+static int probe_queue_len, probe_queue_next;
+static int probe_workers;	/* threads that still take jobs */
+static SANE_Bool probe_local_only;
+#endif
+
 #ifndef __BEOS__
 static const char *op_name[] = {
   "init", "exit", "get_devices", "open", "close", "get_option_descriptor",
@@ -724,6 +767,60 @@ add_alias (const char *line_param)
 }
 
 
+static void
+read_option (SANE_String_Const cp)
+{
+  char *name, *value, *end;
+  const char *home;
+  long l;
+
+  cp = sanei_config_get_string (cp, &name);
+  if (!name)
+    return;
+  sanei_config_get_string (cp, &value);
+  if (!value || value[0] == '#')
+    {
+      DBG (1, "sane_init/read_option: option `%s' needs a value\n", name);
+      free (name);
+      if (value)
+	free (value);
+      return;
+    }
+
+  if (strcmp (name, "probe_threads") == 0
+      || strcmp (name, "probe_timeout") == 0)
+    {
+      l = strtol (value, &end, 10);
+      if (end == value || (*end && *end != '#') || l < 0 || l > 1024)
+	DBG (1, "sane_init/read_option: invalid value `%s' for %s\n",
+	     value, name);
+      else if (strcmp (name, "probe_threads") == 0)
+	probe_threads = l;
+      else
+	probe_timeout = l;
+    }
+  else if (strcmp (name, "hint_file") == 0)
+    {
+      if (hint_file)
+	free (hint_file);
+      home = getenv ("HOME");
+      if (strncmp (value, "~/", 2) == 0 && home)
+	{
+	  hint_file = malloc (strlen (home) + strlen (value));
+	  if (hint_file)
+	    sprintf (hint_file, "%s%s", home, value + 1);
+	}
+      else
+	hint_file = strdup (value);
+    }
+  else
+    DBG (1, "sane_init/read_option: unknown option `%s'\n", name);
+
+  DBG (3, "sane_init/read_option: %s %s\n", name, value);
+  free (name);
+  free (value);
+}
+
 static void
 read_config (const char *conffile)
 {
@@ -763,7 +860,10 @@ read_config (const char *conffile)
       comment = strchr (backend_name, '#');
       if (comment)
         *comment = '\0';
-      add_backend (backend_name, 0);
+      if (strcmp (backend_name, "option") == 0)
+        read_option (cp);
+      else
+        add_backend (backend_name, 0);
       free (backend_name);
     }
   fclose (fp);
@@ -846,6 +946,424 @@ read_dlld (void)
   DBG (5, "sane_init/read_dlld: done.\n");
 }
 
+static void
+free_hints (void)
+{
+  while (hints_len > 0)
+    free (hints[--hints_len]);
+  if (hints)
+    free (hints);
+  hints = NULL;
+}
+
+static SANE_Status
+add_hint (char ***list, int *len, const char *be_name, const char *dev_name)
+{
+  char **new_list;
+  char *hint;
+
+  hint = malloc (strlen (be_name) + 1 + strlen (dev_name) + 1);
+  new_list = realloc (*list, (*len + 1) * sizeof (*new_list));
+  if (!hint || !new_list)
+    {
+      if (hint)
+	free (hint);
+      if (new_list)
+	*list = new_list;
+      return SANE_STATUS_NO_MEM;
+    }
+  sprintf (hint, "%s:%s", be_name, dev_name);
+  new_list[(*len)++] = hint;
+  *list = new_list;
+  return SANE_STATUS_GOOD;
+}
+
+#ifdef DLL_PROBE_THREADS
+/* Does any hint name a device of backend BE_NAME? */
+static int
+has_hint (const char *be_name)
+{
+  size_t len = strlen (be_name);
+  int i;
+
+  for (i = 0; i < hints_len; ++i)
+    if (strncmp (hints[i], be_name, len) == 0 && hints[i][len] == ':')
+      return 1;
+  return 0;
+}
+#endif
+
+/* Returns the "backend:device" hint for FULL_NAME, which is either
+   empty (any device will do) or a device name without its backend. */
+static const char *
+find_hint (const char *full_name)
+{
+  int i;
+
+  if (!full_name[0])
+    return hints_len > 0 ? hints[0] : NULL;
+
+  for (i = 0; i < hints_len; ++i)
+    if (strcmp (strchr (hints[i], ':') + 1, full_name) == 0)
+      return hints[i];
+  return NULL;
+}
+
+static void
+load_hints (void)
+{
+  char line[PATH_MAX];
+  char *colon;
+  FILE *fp;
+
+  fp = fopen (hint_file, "r");
+  if (!fp)
+    {
+      DBG (2, "sane_init/load_hints: couldn't open %s: %s\n", hint_file,
+	   strerror (errno));
+      return;
+    }
+
+  while (fgets (line, sizeof (line), fp))
+    {
+      line[strcspn (line, "\r\n")] = '\0';
+      if (line[0] == '#')
+	continue;
+      colon = strchr (line, ':');
+      if (!colon || colon == line)
+	continue;
+      *colon = '\0';
+      if (add_hint (&hints, &hints_len, line, colon + 1) != SANE_STATUS_GOOD)
+	break;
+    }
+  fclose (fp);
+
+  DBG (3, "sane_init/load_hints: %d devices listed in %s\n", hints_len,
+       hint_file);
+}
+
+/* Replaces the hints by LIST and rewrites hint_file if they changed.
+   The file is replaced atomically so that concurrent frontends never
+   see half of it. */
+static void
+update_hints (char **list, int len)
+{
+  char *tmp, *slash;
+  int i, unchanged;
+  FILE *fp;
+
+  for (i = 0; i < len && i < hints_len; ++i)
+    if (strcmp (list[i], hints[i]) != 0)
+      break;
+  unchanged = (i == len && i == hints_len);
+  free_hints ();
+  hints = list;
+  hints_len = len;
+  if (unchanged || !hint_file)
+    return;
+
+  tmp = malloc (strlen (hint_file) + 32);
+  if (!tmp)
+    return;
+  sprintf (tmp, "%s.%ld", hint_file, (long) getpid ());
+
+  fp = fopen (tmp, "w");
+  if (!fp && errno == ENOENT)
+    {
+      /* create the directory of the hint file, but not its parents */
+      slash = strrchr (tmp, '/');
+      if (slash && slash != tmp)
+	{
+	  *slash = '\0';
+	  mkdir (tmp, 0700);
+	  *slash = '/';
+	  fp = fopen (tmp, "w");
+	}
+    }
+  if (!fp)
+    {
+      DBG (1, "update_hints: couldn't create %s: %s\n", tmp,
+	   strerror (errno));
+      free (tmp);
+      return;
+    }
+
+  fprintf (fp, "# devices found by the SANE dll backend, see sane-dll(5)\n");
+  for (i = 0; i < hints_len; ++i)
+    fprintf (fp, "%s\n", hints[i]);
+
+  if (fclose (fp) != 0 || rename (tmp, hint_file) != 0)
+    {
+      DBG (1, "update_hints: couldn't write %s: %s\n", hint_file,
+	   strerror (errno));
+      unlink (tmp);
+    }
+  else
+    DBG (3, "update_hints: wrote %d devices to %s\n", hints_len, hint_file);
+  free (tmp);
+}
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Initializes BE if necessary and asks it for its devices. */
+static SANE_Status
+probe (struct backend *be, const SANE_Device *** list, SANE_Bool local_only)
+{
+  SANE_Status status;
+
+  *list = NULL;
+  if (!be->inited)
+    {
+      status = init (be);
+      if (status != SANE_STATUS_GOOD)
+	return status;
+    }
+  return (*(op_get_devs_t)be->op[OP_GET_DEVS]) (list, local_only);
+}
+
+/* Returns the probe state of BE.  PROBE_RUNNING means that a thread
+   is still busy with the backend because it didn't answer within
+   probe_timeout: it must neither be used nor unloaded then.  The
+   result of a finished probe is handed out only once. */
+static int
+probe_result (struct backend *be, const SANE_Device *** list,
+	      SANE_Status * status)
+{
+#ifdef DLL_PROBE_THREADS
+  int state;
+
+  pthread_mutex_lock (&probe_lock);
+  state = be->probe_state;
+  if (state == PROBE_DONE)
+    {
+      if (list)
+	*list = be->probe_list;
+      if (status)
+	*status = be->probe_status;
+      be->probe_state = PROBE_IDLE;
+    }
+  pthread_mutex_unlock (&probe_lock);
+  return state;
+#else
+  (void) be;
+  (void) list;
+  (void) status;
+  return PROBE_IDLE;
+#endif
+}
+
+#ifdef DLL_PROBE_THREADS
+static void *
+probe_worker (void *arg)
+{
+  const SANE_Device **list;
+  struct backend *be;
+  SANE_Status status;
+  SANE_Bool local_only;
+
+  (void) arg;
+
+  pthread_mutex_lock (&probe_lock);
+  while (probe_queue_next < probe_queue_len)
+    {
+      be = probe_queue[probe_queue_next++];
+      be->probe_state = PROBE_RUNNING;
+      be->probe_start = now ();
+      local_only = probe_local_only;
+      pthread_mutex_unlock (&probe_lock);
+
+      status = probe (be, &list, local_only);
+
+      pthread_mutex_lock (&probe_lock);
+      be->probe_status = status;
+      be->probe_list = list;
+      be->probe_state = PROBE_DONE;
+      pthread_cond_broadcast (&probe_cond);
+      if (be->probe_late)
+	{
+	  /* another thread has taken over the queue in the meantime */
+	  DBG (1, "probe_worker: backend `%s' answered after %.1f s\n",
+	       be->name, now () - be->probe_start);
+	  pthread_mutex_unlock (&probe_lock);
+	  return NULL;
+	}
+    }
+  probe_workers--;
+  pthread_cond_broadcast (&probe_cond);
+  pthread_mutex_unlock (&probe_lock);
+  return NULL;
+}
+
+/* Must be called with probe_lock held. */
+static int
+probe_spawn (void)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  int rc;
+
+  pthread_attr_init (&attr);
+  pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+  rc = pthread_create (&thread, &attr, probe_worker, NULL);
+  pthread_attr_destroy (&attr);
+  if (rc != 0)
+    {
+      DBG (1, "probe_spawn: pthread_create failed: %s\n", strerror (rc));
+      return -1;
+    }
+  probe_workers++;
+  return 0;
+}
+
+/* Probes the backends in QUEUE on up to probe_threads threads while
+   the calling thread takes care of the preloaded backends in LOCAL,
+   which share the sanei code with each other.  A backend that doesn't
+   answer within probe_timeout seconds is written off: its thread is
+   left alone and a new one takes over the rest of the queue.  Returns
+   once every backend has answered or has been written off. */
+static void
+probe_backends (struct backend **queue, int len, struct backend **local,
+		int local_len, SANE_Bool local_only)
+{
+  const SANE_Device **list;
+  struct backend *be;
+  struct timespec ts;
+  SANE_Status status;
+  double t, deadline;
+  int i, pending;
+
+  pthread_mutex_lock (&probe_lock);
+  for (i = 0; i < len; ++i)
+    {
+      queue[i]->probe_state = PROBE_QUEUED;
+      queue[i]->probe_late = 0;
+    }
+  probe_queue = queue;
+  probe_queue_len = len;
+  probe_queue_next = 0;
+  probe_local_only = local_only;
+  while (probe_workers < probe_threads && probe_workers < len)
+    if (probe_spawn () < 0)
+      break;
+  DBG (3, "probe_backends: %d backends on %d threads, %d locally\n", len,
+       probe_workers, local_len);
+  pthread_mutex_unlock (&probe_lock);
+
+  for (i = 0; i < local_len; ++i)
+    {
+      status = probe (local[i], &list, local_only);
+      pthread_mutex_lock (&probe_lock);
+      local[i]->probe_status = status;
+      local[i]->probe_list = list;
+      local[i]->probe_state = PROBE_DONE;
+      pthread_mutex_unlock (&probe_lock);
+    }
+
+  pthread_mutex_lock (&probe_lock);
+  for (;;)
+    {
+      t = now ();
+      pending = 0;
+      deadline = 0;
+      for (i = 0; i < len; ++i)
+	{
+	  be = queue[i];
+	  if (be->probe_state == PROBE_QUEUED)
+	    pending++;
+	  else if (be->probe_state != PROBE_RUNNING || be->probe_late)
+	    continue;
+	  else if (probe_timeout > 0 && t >= be->probe_start + probe_timeout)
+	    {
+	      DBG (1, "probe_backends: backend `%s' didn't answer within "
+		   "%d s, giving up on it\n", be->name, probe_timeout);
+	      be->probe_late = 1;
+	      probe_workers--;
+	      if (probe_queue_next < probe_queue_len)
+		probe_spawn ();
+	    }
+	  else
+	    {
+	      pending++;
+	      if (probe_timeout > 0
+		  && (!deadline || be->probe_start + probe_timeout < deadline))
+		deadline = be->probe_start + probe_timeout;
+	    }
+	}
+
+      if (!pending && probe_workers == 0)
+	break;
+
+      if (probe_workers == 0 && probe_queue_next < probe_queue_len)
+	{
+	  /* no threads left, do the rest of the queue ourselves */
+	  be = probe_queue[probe_queue_next++];
+	  be->probe_state = PROBE_RUNNING;
+	  be->probe_start = now ();
+	  pthread_mutex_unlock (&probe_lock);
+	  status = probe (be, &list, local_only);
+	  pthread_mutex_lock (&probe_lock);
+	  be->probe_status = status;
+	  be->probe_list = list;
+	  be->probe_state = PROBE_DONE;
+	  continue;
+	}
+
+      if (deadline)
+	{
+	  ts.tv_sec = (time_t) deadline;
+	  ts.tv_nsec = (long) ((deadline - ts.tv_sec) * 1e9);
+	  pthread_cond_timedwait (&probe_cond, &probe_lock, &ts);
+	}
+      else
+	pthread_cond_wait (&probe_cond, &probe_lock);
+    }
+  probe_queue = NULL;
+  probe_queue_len = probe_queue_next = 0;
+  pthread_mutex_unlock (&probe_lock);
+}
+
+/* Probes all backends that aren't still busy from an earlier call.
+   The results are picked up by sane_get_devices() in list order.  */
+static void
+probe_all (SANE_Bool local_only)
+{
+  struct backend *be, **queue, **local;
+  int n, len, local_len, pass;
+
+  for (n = 0, be = first_backend; be; be = be->next)
+    n++;
+  queue = malloc (2 * n * sizeof (*queue));
+  if (!queue)
+    return;			/* sane_get_devices() falls back to serial */
+  local = queue + n;
+
+  len = local_len = 0;
+  pthread_mutex_lock (&probe_lock);
+  /* start the backends that found devices last time first */
+  for (pass = 0; pass < 2; ++pass)
+    for (be = first_backend; be; be = be->next)
+      {
+	if (be->probe_state == PROBE_RUNNING || has_hint (be->name) == pass)
+	  continue;
+	if (be->permanent)
+	  local[local_len++] = be;
+	else
+	  queue[len++] = be;
+      }
+  pthread_mutex_unlock (&probe_lock);
+
+  probe_backends (queue, len, local, local_len, local_only);
+  free (queue);
+}
+#endif /* DLL_PROBE_THREADS */
+
 SANE_Status
 sane_init (SANE_Int * version_code, SANE_Auth_Callback authorize)
 {
@@ -894,6 +1412,14 @@ sane_init (SANE_Int * version_code, SANE_Auth_Callback authorize)
   read_dlld ();
   read_config (DLL_CONFIG_FILE);
 
+  if (hint_file)
+    load_hints ();
+#ifndef DLL_PROBE_THREADS
+  if (probe_threads > 1)
+    DBG (1, "sane_init: probe_threads needs pthread support, "
+	 "probing backends one by one\n");
+#endif
+
   fp = sanei_config_open (DLL_ALIASES_FILE);
   if (!fp)
     return SANE_STATUS_GOOD;	/* don't insist on aliases file */
@@ -947,6 +1473,13 @@ sane_exit (void)
   for (be = first_backend; be; be = next)
     {
       next = be->next;
+      if (probe_result (be, NULL, NULL) == PROBE_RUNNING)
+	{
+	  /* its probe thread may still return, so keep it around */
+	  DBG (1, "sane_exit: backend `%s' is still busy, not unloading it\n",
+	       be->name);
+	  continue;
+	}
       if (be->loaded)
 	{
 	  if (be->inited)
@@ -1012,23 +1545,17 @@ sane_exit (void)
       devlist_size = 0;
       devlist_len = 0;
     }
+
+  free_hints ();
+  if (hint_file)
+    free (hint_file);
+  hint_file = NULL;
+  probe_threads = 0;
+  probe_timeout = DLL_PROBE_TIMEOUT;
+
   DBG (3, "sane_exit: finished\n");
 }
 
-/* Note that a call to get_devices() implies that we'll have to load
-   all backends.  To avoid this, you can call sane_open() directly
-   (assuming you know the name of the backend/device).  This is
-   appropriate for the command-line interface of SANE, for example.
- */
-SANE_Status
-sane_get_devices (const SANE_Device *** device_list, SANE_Bool local_only)
-{
-  const SANE_Device **be_list;
-  struct backend *be;
-  SANE_Status status;
-  char *full_name;
-  int i, num_devs;
-  size_t len;
 #define ASSERT_SPACE(n)                                                    \
   {                                                                        \
     if (devlist_len + (n) > devlist_size)                                  \
@@ -1043,6 +1570,94 @@ sane_get_devices (const SANE_Device *** device_list, SANE_Bool local_only)
       }                                                                    \
   }
 
+/* Appends the devices BE_LIST of backend BE to devlist. */
+static SANE_Status
+add_devices (struct backend *be, const SANE_Device ** be_list)
+{
+  char *full_name;
+  int i, num_devs;
+  size_t len;
+
+  /* count the number of devices for this backend: */
+  for (num_devs = 0; be_list[num_devs]; ++num_devs)
+    ;
+
+  ASSERT_SPACE (num_devs);
+
+  for (i = 0; i < num_devs; ++i)
+    {
+      SANE_Device *dev;
+      char *mem;
+      struct alias *alias;
+
+      for (alias = first_alias; alias != NULL; alias = alias->next)
+	{
+	  len = strlen (be->name);
+	  if (strlen (alias->oldname) <= len)
+	    continue;
+	  if (strncmp (alias->oldname, be->name, len) == 0
+	      && alias->oldname[len] == ':'
+	      && strcmp (&alias->oldname[len + 1], be_list[i]->name) == 0)
+	    break;
+	}
+
+      if (alias)
+	{
+	  if (!alias->newname)	/* hidden device */
+	    continue;
+
+	  len = strlen (alias->newname);
+	  mem = malloc (sizeof (*dev) + len + 1);
+	  if (!mem)
+	    return SANE_STATUS_NO_MEM;
+
+	  full_name = mem + sizeof (*dev);
+	  strcpy (full_name, alias->newname);
+	}
+      else
+	{
+	  /* create a new device entry with a device name that is the
+	     sum of the backend name a colon and the backend's device
+	     name: */
+	  len = strlen (be->name) + 1 + strlen (be_list[i]->name);
+	  mem = malloc (sizeof (*dev) + len + 1);
+	  if (!mem)
+	    return SANE_STATUS_NO_MEM;
+
+	  full_name = mem + sizeof (*dev);
+	  strcpy (full_name, be->name);
+	  strcat (full_name, ":");
+	  strcat (full_name, be_list[i]->name);
+	}
+
+      dev = (SANE_Device *) mem;
+      dev->name = full_name;
+      dev->vendor = be_list[i]->vendor;
+      dev->model = be_list[i]->model;
+      dev->type = be_list[i]->type;
+
+      devlist[devlist_len++] = dev;
+    }
+  return SANE_STATUS_GOOD;
+}
+
+/* Note that a call to get_devices() implies that we'll have to load
+   all backends.  To avoid this, you can call sane_open() directly
+   (assuming you know the name of the backend/device).  This is
+   appropriate for the command-line interface of SANE, for example.
+   With "option probe_threads" the backends are probed concurrently.
+ */
+SANE_Status
+sane_get_devices (const SANE_Device *** device_list, SANE_Bool local_only)
+{
+  const SANE_Device **be_list;
+  struct backend *be;
+  SANE_Status status;
+  char **new_hints = NULL;
+  int i, new_hints_len = 0, hints_ok = 1;
+  size_t len;
+  double start = now ();
+
   DBG (3, "sane_get_devices\n");
 
   if (devlist)
@@ -1050,95 +1665,78 @@ sane_get_devices (const SANE_Device *** device_list, SANE_Bool local_only)
       free ((void *) devlist[i]);
   devlist_len = 0;
 
+#ifdef DLL_PROBE_THREADS
+  if (probe_threads > 1)
+    probe_all (local_only);
+#endif
+
   for (be = first_backend; be; be = be->next)
     {
-      if (!be->inited)
-	if (init (be) != SANE_STATUS_GOOD)
-	  continue;
-
-      status = (*(op_get_devs_t)be->op[OP_GET_DEVS]) (&be_list, local_only);
-      if (status != SANE_STATUS_GOOD || !be_list)
-	continue;
-
-      /* count the number of devices for this backend: */
-      for (num_devs = 0; be_list[num_devs]; ++num_devs);
-
-      ASSERT_SPACE (num_devs);
-
-      for (i = 0; i < num_devs; ++i)
+      switch (probe_result (be, &be_list, &status))
 	{
-	  SANE_Device *dev;
-	  char *mem;
-	  struct alias *alias;
+	case PROBE_DONE:
+	  break;
 
-	  for (alias = first_alias; alias != NULL; alias = alias->next)
-	    {
-	      len = strlen (be->name);
-	      if (strlen (alias->oldname) <= len)
-		continue;
-	      if (strncmp (alias->oldname, be->name, len) == 0
-		  && alias->oldname[len] == ':'
-		  && strcmp (&alias->oldname[len + 1], be_list[i]->name) == 0)
-		break;
-	    }
+	case PROBE_RUNNING:
+	  /* remember its devices from last time until it answers */
+	  DBG (2, "sane_get_devices: skipping busy backend `%s'\n", be->name);
+	  len = strlen (be->name);
+	  for (i = 0; i < hints_len && hints_ok; ++i)
+	    if (strncmp (hints[i], be->name, len) == 0
+		&& hints[i][len] == ':')
+	      hints_ok = (add_hint (&new_hints, &new_hints_len, be->name,
+				    hints[i] + len + 1) == SANE_STATUS_GOOD);
+	  continue;
 
-	  if (alias)
-	    {
-	      if (!alias->newname)	/* hidden device */
-		continue;
+	default:
+	  status = probe (be, &be_list, local_only);
+	  break;
+	}
 
-	      len = strlen (alias->newname);
-	      mem = malloc (sizeof (*dev) + len + 1);
-	      if (!mem)
-		return SANE_STATUS_NO_MEM;
+      if (status != SANE_STATUS_GOOD || !be_list)
+	continue;
 
-	      full_name = mem + sizeof (*dev);
-	      strcpy (full_name, alias->newname);
-	    }
-	  else
-	    {
-	      /* create a new device entry with a device name that is the
-	         sum of the backend name a colon and the backend's device
-	         name: */
-	      len = strlen (be->name) + 1 + strlen (be_list[i]->name);
-	      mem = malloc (sizeof (*dev) + len + 1);
-	      if (!mem)
-		return SANE_STATUS_NO_MEM;
-
-	      full_name = mem + sizeof (*dev);
-	      strcpy (full_name, be->name);
-	      strcat (full_name, ":");
-	      strcat (full_name, be_list[i]->name);
-	    }
+      for (i = 0; be_list[i] && hints_ok; ++i)
+	hints_ok = (add_hint (&new_hints, &new_hints_len, be->name,
+			      be_list[i]->name) == SANE_STATUS_GOOD);
 
-	  dev = (SANE_Device *) mem;
-	  dev->name = full_name;
-	  dev->vendor = be_list[i]->vendor;
-	  dev->model = be_list[i]->model;
-	  dev->type = be_list[i]->type;
+      status = add_devices (be, be_list);
+      if (status != SANE_STATUS_GOOD)
+	break;
+    }
 
-	  devlist[devlist_len++] = dev;
-	}
+  if (hints_ok)
+    update_hints (new_hints, new_hints_len);
+  else
+    {
+      while (new_hints_len > 0)
+	free (new_hints[--new_hints_len]);
+      if (new_hints)
+	free (new_hints);
     }
+  if (be)
+    return status;
 
   /* terminate device list with NULL entry: */
   ASSERT_SPACE (1);
   devlist[devlist_len++] = 0;
 
   *device_list = (const SANE_Device **) devlist;
-  DBG (3, "sane_get_devices: found %d devices\n", devlist_len - 1);
+  DBG (3, "sane_get_devices: found %d devices in %.2f s\n", devlist_len - 1,
+       now () - start);
   return SANE_STATUS_GOOD;
 }
 
 SANE_Status
 sane_open (SANE_String_Const full_name, SANE_Handle * meta_handle)
 {
-  const char *be_name, *dev_name;
+  const char *be_name, *dev_name, *hint;
   struct meta_scanner *s;
   SANE_Handle handle;
   struct backend *be;
   SANE_Status status;
   struct alias *alias;
+  size_t len;
 
   DBG (3, "sane_open: trying to open `%s'\n", full_name);
 
@@ -1153,6 +1751,19 @@ sane_open (SANE_String_Const full_name, SANE_Handle * meta_handle)
 	}
     }
 
+  /* an empty name or one that doesn't start with a known backend may
+     be a device found last time */
+  dev_name = strchr (full_name, ':');
+  len = dev_name ? (size_t) (dev_name - full_name) : strlen (full_name);
+  for (be = first_backend; be && len; be = be->next)
+    if (strlen (be->name) == len && strncmp (be->name, full_name, len) == 0)
+      break;
+  if (!be && (hint = find_hint (full_name)) != NULL)
+    {
+      DBG (3, "sane_open: using `%s' from the device hints\n", hint);
+      full_name = hint;
+    }
+
   dev_name = strchr (full_name, ':');
   if (dev_name)
     {
@@ -1191,6 +1802,12 @@ sane_open (SANE_String_Const full_name, SANE_Handle * meta_handle)
 	return status;
     }
 
+  if (probe_result (be, NULL, NULL) == PROBE_RUNNING)
+    {
+      DBG (1, "sane_open: backend `%s' is still busy probing\n", be->name);
+      return SANE_STATUS_DEVICE_BUSY;
+    }
+
   if (!be->inited)
     {
       status = init (be);
@@ -550,6 +550,10 @@
 #include <ctype.h> /*isspace*/
 #include <math.h> /*tan*/
 #include <unistd.h> /*usleep*/
+#include <sys/time.h> /*gettimeofday*/
+#ifdef USE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "../include/sane/sanei_backend.h"
 #include "../include/sane/sanei_scsi.h"
@@ -6401,6 +6405,8 @@ sane_start (SANE_Handle handle)
       s->buff_tx[0]=0;
       s->buff_tx[1]=0;
 
+      s->post_done=0;
+
       /* reset jpeg just in case... */
       s->jpeg_stage = JPEG_STAGE_HEAD;
       s->jpeg_ff_offset = 0;
@@ -6451,6 +6457,11 @@ sane_start (SANE_Handle handle)
               DBG (5, "sane_start: ERROR: cannot load buffers\n");
               return ret;
           }
+
+          s->post_usec_tot[0]=0;
+          s->post_usec_tot[1]=0;
+          s->post_pages[0]=0;
+          s->post_pages[1]=0;
     
           s->started=1;
       }
@@ -6479,36 +6490,54 @@ sane_start (SANE_Handle handle)
    * so we block and buffer. yuck */
   if( must_fully_buffer(s) ){
 
-    /* get image */
-    while(!s->eof_rx[s->side] && !ret){
-      SANE_Int len = 0;
-      ret = sane_read((SANE_Handle)s, NULL, 0, &len);
+    /* the back was buffered and processed along with the front */
+    if(s->side == SIDE_BACK && s->post_done){
+      DBG (5, "sane_start: OK: back side already done\n");
+      s->params = s->post_params;
+      s->post_done = 0;
     }
+    else{
+      /* when the whole back of a duplex page fits in our buffer, get it
+       * now too, so both sides can be processed at once. */
+      int both = s->side == SIDE_FRONT
+        && s->source == SOURCE_ADF_DUPLEX
+        && !s->hwdeskewcrop
+        && s->buff_tot[SIDE_BACK] == s->bytes_tot[SIDE_BACK];
 
-    /* check for errors */
-    if (ret != SANE_STATUS_GOOD) {
-      DBG (5, "sane_start: ERROR: cannot buffer image\n");
-      goto errors;
-    }
+      /* get image */
+      while(!s->eof_rx[s->side] && !ret){
+        SANE_Int len = 0;
+        ret = sane_read((SANE_Handle)s, NULL, 0, &len);
+      }
 
-    DBG (5, "sane_start: OK: done buffering\n");
+      /* get back image, sane_read needs to think we are on the back */
+      if(both){
+        s->side = SIDE_BACK;
+        while(!s->eof_rx[SIDE_BACK] && !ret){
+          SANE_Int len = 0;
+          ret = sane_read((SANE_Handle)s, NULL, 0, &len);
+        }
+        s->side = SIDE_FRONT;
+      }
 
-    /* hardware deskew will tell image size after transfer */
-    ret = get_pixelsize(s,1);
-    if (ret != SANE_STATUS_GOOD) {
-      DBG (5, "sane_start: ERROR: cannot get final pixelsize\n");
-      return ret;
-    }
+      /* check for errors */
+      if (ret != SANE_STATUS_GOOD) {
+        DBG (5, "sane_start: ERROR: cannot buffer image\n");
+        goto errors;
+      }
 
-    /* finished buffering, adjust image as required */
-    if(s->swdeskew && (!s->hwdeskewcrop || s->req_driv_crop)){
-      buffer_deskew(s,s->side);
-    }
-    if(s->swcrop && (!s->hwdeskewcrop || s->req_driv_crop)){
-      buffer_crop(s,s->side);
-    }
-    if(s->swdespeck){
-      buffer_despeck(s,s->side);
+      DBG (5, "sane_start: OK: done buffering\n");
+
+      /* hardware deskew will tell image size after transfer */
+      ret = get_pixelsize(s,1);
+      if (ret != SANE_STATUS_GOOD) {
+        DBG (5, "sane_start: ERROR: cannot get final pixelsize\n");
+        return ret;
+      }
+
+      /* finished buffering, adjust image as required */
+      post_process(s,both);
+      s->post_done = both;
     }
 
   }
@@ -8229,6 +8258,8 @@ sane_exit (void)
   for (dev = fujitsu_devList; dev; dev = next) {
       disconnect_fd(dev);
       next = dev->next;
+      free (dev->deskew_scratch[SIDE_FRONT]);
+      free (dev->deskew_scratch[SIDE_BACK]);
       free (dev);
   }
 
@@ -9014,34 +9045,164 @@ sane_get_select_fd (SANE_Handle h, SANE_Int *fdp)
  * @@ Section 7 - Image processing functions
  */
 
-/* Look in image for likely upper and left paper edges, then rotate
- * image so that upper left corner of paper is upper left of image.
- * FIXME: should we do this before we binarize instead of after? */
-static SANE_Status
-buffer_deskew(struct fujitsu *s, int side)
+/* run one of the functions below on a side, and add up the time taken */
+static void
+post_step(struct fujitsu *s, int side, SANE_Parameters *params,
+  SANE_Status (*step)(struct fujitsu *s, int side, SANE_Parameters *params))
 {
-  SANE_Status ret = SANE_STATUS_GOOD;
+  struct timeval start, end;
+  long usec;
 
-  int bg_color = 0xd6;
+  gettimeofday(&start,NULL);
+  step(s,side,params);
+  gettimeofday(&end,NULL);
 
-  DBG (10, "buffer_deskew: start\n");
+  usec = (end.tv_sec - start.tv_sec) * 1000000L + end.tv_usec - start.tv_usec;
+  s->post_usec[side] += usec;
+
+  DBG (15, "post_step: side %d took %ld usec\n", side, usec);
+}
+
+#ifdef USE_PTHREAD
+struct post_job {
+  struct fujitsu *s;
+  SANE_Status (*step)(struct fujitsu *s, int side, SANE_Parameters *params);
+};
+
+static void *
+post_back(void *arg)
+{
+  struct post_job *job = arg;
+
+  post_step(job->s,SIDE_BACK,&job->s->post_params,job->step);
+  return NULL;
+}
+#endif
+
+/* run a step on the current side, and on the back if doing both sides.
+ * if 'parallel' is set, the back runs in a second thread (when we have
+ * threads), so the steps must not touch data of the other side. */
+static void
+post_run(struct fujitsu *s, int both, int parallel,
+  SANE_Status (*step)(struct fujitsu *s, int side, SANE_Parameters *params))
+{
+#ifdef USE_PTHREAD
+  if(both && parallel){
+    struct post_job job;
+    pthread_t thread;
+
+    job.s = s;
+    job.step = step;
+
+    if(!pthread_create(&thread,NULL,post_back,&job)){
+      post_step(s,s->side,&s->params,step);
+      pthread_join(thread,NULL);
+      return;
+    }
+    DBG (5, "post_run: cannot start thread, doing sides in turn\n");
+  }
+#else
+  (void) parallel;
+#endif
+
+  post_step(s,s->side,&s->params,step);
+  if(both){
+    post_step(s,SIDE_BACK,&s->post_params,step);
+  }
+}
+
+/* adjust the buffered image as the user requested. when 'both' is set,
+ * the back side of the duplex page is also buffered, and is done now
+ * too, with its size kept in s->post_params until its sane_start.
+ * finding skew and edges on the back uses the front data, so that runs
+ * first, but rotation and despeck of the two sides runs in parallel. */
+static void
+post_process(struct fujitsu *s, int both)
+{
+  int side;
+
+  DBG (10, "post_process: start %d\n", both);
+
+  s->post_usec[s->side] = 0;
+  if(both){
+    s->post_usec[SIDE_BACK] = 0;
+    s->post_params = s->params;
+  }
+
+  if(s->swdeskew && (!s->hwdeskewcrop || s->req_driv_crop)){
+    post_run(s,both,0,get_deskew);
+    post_run(s,both,1,buffer_deskew);
+  }
+  if(s->swcrop && (!s->hwdeskewcrop || s->req_driv_crop)){
+    post_run(s,both,0,get_crop);
+    post_run(s,both,1,buffer_crop);
+  }
+  if(s->swdespeck){
+    post_run(s,both,1,buffer_despeck);
+  }
+
+  for(side=0;side<2;side++){
+    if(side != s->side && !both)
+      continue;
+
+    s->post_usec_tot[side] += s->post_usec[side];
+    s->post_pages[side]++;
+
+    DBG (10, "post_process: side %d took %ld usec, average %ld over %d pages\n",
+      side, s->post_usec[side], s->post_usec_tot[side] / s->post_pages[side],
+      s->post_pages[side]);
+  }
+
+  DBG (10, "post_process: finish\n");
+}
+
+/* Look in image for likely upper and left paper edges, to find the
+ * angle and center for deskew. */
+static SANE_Status
+get_deskew(struct fujitsu *s, int side, SANE_Parameters *params)
+{
+  DBG (10, "get_deskew: start %d\n", side);
 
   /*only find skew on first image from a page, or if first image had error */
-  if(s->side == SIDE_FRONT || s->source == SOURCE_ADF_BACK || s->deskew_stat){
+  if(side == SIDE_FRONT || s->source == SOURCE_ADF_BACK
+    || s->deskew_stat[SIDE_FRONT]){
 
-    s->deskew_stat = sanei_magic_findSkew(
-      &s->params,s->buffers[side],s->resolution_x,s->resolution_y,
-      &s->deskew_vals[0],&s->deskew_vals[1],&s->deskew_slope);
+    s->deskew_stat[side] = sanei_magic_findSkew(
+      params,s->buffers[side],s->resolution_x,s->resolution_y,
+      &s->deskew_vals[side][0],&s->deskew_vals[side][1],
+      &s->deskew_slope[side]);
   
-    if(s->deskew_stat){
-      DBG (5, "buffer_deskew: bad findSkew, bailing\n");
-      goto cleanup;
+    if(s->deskew_stat[side]){
+      DBG (5, "get_deskew: bad findSkew\n");
     }
   }
   /* backside images can use a 'flipped' version of frontside data */
   else{
-    s->deskew_slope *= -1;
-    s->deskew_vals[0] = s->params.pixels_per_line - s->deskew_vals[0];
+    s->deskew_stat[side] = SANE_STATUS_GOOD;
+    s->deskew_slope[side] = -s->deskew_slope[SIDE_FRONT];
+    s->deskew_vals[side][0] = params->pixels_per_line
+      - s->deskew_vals[SIDE_FRONT][0];
+    s->deskew_vals[side][1] = s->deskew_vals[SIDE_FRONT][1];
+  }
+
+  DBG (10, "get_deskew: finish\n");
+  return s->deskew_stat[side];
+}
+
+/* Rotate image so that upper left corner of paper is upper left of image.
+ * FIXME: should we do this before we binarize instead of after? */
+static SANE_Status
+buffer_deskew(struct fujitsu *s, int side, SANE_Parameters *params)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+
+  int bg_color = 0xd6;
+
+  DBG (10, "buffer_deskew: start\n");
+
+  if(s->deskew_stat[side]){
+    DBG (5, "buffer_deskew: no skew found, bailing\n");
+    goto cleanup;
   }
 
   /* tweak the bg color based on scanner settings */
@@ -9054,8 +9215,9 @@ buffer_deskew(struct fujitsu *s, int side)
   else if(s->bg_color == COLOR_BLACK || s->hwdeskewcrop || s->overscan)
     bg_color = 0;
 
-  ret = sanei_magic_rotate(&s->params,s->buffers[side],
-    s->deskew_vals[0],s->deskew_vals[1],s->deskew_slope,bg_color);
+  ret = sanei_magic_rotate2(params,s->buffers[side],
+    s->deskew_vals[side][0],s->deskew_vals[side][1],s->deskew_slope[side],
+    bg_color,&s->deskew_scratch[side],&s->deskew_scratch_size[side]);
 
   if(ret){
     DBG(5,"buffer_deskew: rotate error: %d",ret);
@@ -9068,46 +9230,68 @@ buffer_deskew(struct fujitsu *s, int side)
   return ret;
 }
 
-/* Look in image for likely left/right/bottom paper edges, then crop image.
- * Does not attempt to rotate the image, that should be done first.
- * FIXME: should we do this before we binarize instead of after? */
+/* Look in image for likely left/right/bottom paper edges to crop at. */
 static SANE_Status
-buffer_crop(struct fujitsu *s, int side)
+get_crop(struct fujitsu *s, int side, SANE_Parameters *params)
 {
-  SANE_Status ret = SANE_STATUS_GOOD;
-
-  DBG (10, "buffer_crop: start\n");
+  DBG (10, "get_crop: start %d\n", side);
 
   /*only find edges on first image from a page, or if first image had error */
-  if(s->side == SIDE_FRONT || s->source == SOURCE_ADF_BACK || s->crop_stat){
+  if(side == SIDE_FRONT || s->source == SOURCE_ADF_BACK
+    || s->crop_stat[SIDE_FRONT]){
 
-    s->crop_stat = sanei_magic_findEdges(
-      &s->params,s->buffers[side],s->resolution_x,s->resolution_y,
-      &s->crop_vals[0],&s->crop_vals[1],&s->crop_vals[2],&s->crop_vals[3]);
+    s->crop_stat[side] = sanei_magic_findEdges(
+      params,s->buffers[side],s->resolution_x,s->resolution_y,
+      &s->crop_vals[side][0],&s->crop_vals[side][1],
+      &s->crop_vals[side][2],&s->crop_vals[side][3]);
 
-    if(s->crop_stat){
-      DBG (5, "buffer_crop: bad edges, bailing\n");
+    if(s->crop_stat[side]){
+      DBG (5, "get_crop: bad edges\n");
       goto cleanup;
     }
   
-    DBG (15, "buffer_crop: t:%d b:%d l:%d r:%d\n",
-      s->crop_vals[0],s->crop_vals[1],s->crop_vals[2],s->crop_vals[3]);
+    DBG (15, "get_crop: t:%d b:%d l:%d r:%d\n",
+      s->crop_vals[side][0],s->crop_vals[side][1],
+      s->crop_vals[side][2],s->crop_vals[side][3]);
 
     /* we dont listen to the 'top' value, since fujitsu does not pad the top */
-    s->crop_vals[0] = 0;
+    s->crop_vals[side][0] = 0;
   }
   /* backside images can use a 'flipped' version of frontside data */
   else{
-    int left  = s->crop_vals[2];
-    int right = s->crop_vals[3];
+    s->crop_stat[side] = SANE_STATUS_GOOD;
+    s->crop_vals[side][0] = s->crop_vals[SIDE_FRONT][0];
+    s->crop_vals[side][1] = s->crop_vals[SIDE_FRONT][1];
+    s->crop_vals[side][2] = params->pixels_per_line
+      - s->crop_vals[SIDE_FRONT][3];
+    s->crop_vals[side][3] = params->pixels_per_line
+      - s->crop_vals[SIDE_FRONT][2];
+  }
 
-    s->crop_vals[2] = s->params.pixels_per_line - right;
-    s->crop_vals[3] = s->params.pixels_per_line - left;
+  cleanup:
+  DBG (10, "get_crop: finish\n");
+  return s->crop_stat[side];
+}
+
+/* Crop image to the edges found above.
+ * Does not attempt to rotate the image, that should be done first.
+ * FIXME: should we do this before we binarize instead of after? */
+static SANE_Status
+buffer_crop(struct fujitsu *s, int side, SANE_Parameters *params)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+
+  DBG (10, "buffer_crop: start\n");
+
+  if(s->crop_stat[side]){
+    DBG (5, "buffer_crop: no edges found, bailing\n");
+    goto cleanup;
   }
 
   /* now crop the image */
-  ret = sanei_magic_crop(&s->params,s->buffers[side],
-      s->crop_vals[0],s->crop_vals[1],s->crop_vals[2],s->crop_vals[3]);
+  ret = sanei_magic_crop(params,s->buffers[side],
+      s->crop_vals[side][0],s->crop_vals[side][1],
+      s->crop_vals[side][2],s->crop_vals[side][3]);
 
   if(ret){
     DBG (5, "buffer_crop: bad crop, bailing\n");
@@ -9116,7 +9300,7 @@ buffer_crop(struct fujitsu *s, int side)
   }
 
   /* update image size counter to new, smaller size */
-  s->bytes_rx[side] = s->params.lines * s->params.bytes_per_line;
+  s->bytes_rx[side] = params->lines * params->bytes_per_line;
   s->buff_rx[side] = s->bytes_rx[side];
  
   cleanup:
@@ -9128,13 +9312,13 @@ buffer_crop(struct fujitsu *s, int side)
  * Replace the spots with the average color of the surrounding pixels.
  * FIXME: should we do this before we binarize instead of after? */
 static SANE_Status
-buffer_despeck(struct fujitsu *s, int side)
+buffer_despeck(struct fujitsu *s, int side, SANE_Parameters *params)
 {
   SANE_Status ret = SANE_STATUS_GOOD;
 
   DBG (10, "buffer_despeck: start\n");
 
-  ret = sanei_magic_despeck(&s->params,s->buffers[side],s->swdespeck);
+  ret = sanei_magic_despeck(params,s->buffers[side],s->swdespeck);
   if(ret){
     DBG (5, "buffer_despeck: bad despeck, bailing\n");
     ret = SANE_STATUS_GOOD;
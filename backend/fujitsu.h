@@ -543,12 +543,24 @@ struct fujitsu
 
   /* --------------------------------------------------------------------- */
   /* values used by the software enhancment code (deskew, crop, etc)       */
-  SANE_Status deskew_stat;
-  int deskew_vals[2];
-  double deskew_slope;
+  /* kept per side, the back of a duplex page reuses the front values    */
+  SANE_Status deskew_stat[2];
+  int deskew_vals[2][2];
+  double deskew_slope[2];
+  unsigned char * deskew_scratch[2]; /* reused by rotate between pages */
+  size_t deskew_scratch_size[2];
 
-  SANE_Status crop_stat;
-  int crop_vals[4];
+  SANE_Status crop_stat[2];
+  int crop_vals[2][4];
+
+  /* back side processed along with the front, and its final size */
+  int post_done;
+  SANE_Parameters post_params;
+
+  /* time spent in the above, usec: this page and whole batch, per side */
+  long post_usec[2];
+  long post_usec_tot[2];
+  int post_pages[2];
 
   /* --------------------------------------------------------------------- */
   /* values used by the compression functions, esp. jpeg with duplex       */
@@ -813,9 +825,12 @@ static SANE_Status setup_buffers (struct fujitsu *s);
 
 static SANE_Status get_hardware_status (struct fujitsu *s, SANE_Int option);
 
-static SANE_Status buffer_deskew(struct fujitsu *s, int side);
-static SANE_Status buffer_crop(struct fujitsu *s, int side);
-static SANE_Status buffer_despeck(struct fujitsu *s, int side);
+static void post_process(struct fujitsu *s, int both);
+static SANE_Status get_deskew(struct fujitsu *s, int side, SANE_Parameters *params);
+static SANE_Status get_crop(struct fujitsu *s, int side, SANE_Parameters *params);
+static SANE_Status buffer_deskew(struct fujitsu *s, int side, SANE_Parameters *params);
+static SANE_Status buffer_crop(struct fujitsu *s, int side, SANE_Parameters *params);
+static SANE_Status buffer_despeck(struct fujitsu *s, int side, SANE_Parameters *params);
 
 static void hexdump (int level, char *comment, unsigned char *p, int l);
 
@@ -66,6 +66,16 @@
 #include "../include/sane/sanei_magic.h"
 #include "genesys_devices.c"
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 static SANE_Int num_devices = 0;
 static Genesys_Device *first_dev = 0;
 static Genesys_Scanner *first_handle = 0;
@@ -76,6 +86,13 @@ static Genesys_Device **new_dev = 0;
 static SANE_Int new_dev_len = 0;
 /* Number of entries alloced for new_dev */
 static SANE_Int new_dev_alloced = 0;
+/* kB the reader task may read ahead of the frontend, from the read_ahead
+   option of genesys.conf; 0 to read from the scanner in sane_read */
+static SANE_Word read_ahead_kb = 0;
+static SANE_Range read_ahead_range = { 0, 262144, 0 };
+/* convert 8 and 16 bit lines one filter after the other like lineart,
+   from the staged_lines option of genesys.conf */
+static SANE_Bool staged_lines = SANE_FALSE;
 
 static SANE_String_Const mode_list[] = {
   SANE_VALUE_SCAN_MODE_COLOR,
@@ -3146,92 +3163,198 @@ genesys_send_shading_coefficient (Genesys_Device * dev)
 }
 
 
+/* the key a calibration for the current settings gets */
+static SANE_Status
+genesys_calibration_key (Genesys_Device * dev, Genesys_Calibration_Key * key)
+{
+  SANE_Status status;
+
+  memset (key, 0, sizeof (*key));
+  key->ccd_type = dev->model->ccd_type;
+  key->dac_type = dev->model->dac_type;
+  key->xres = dev->settings.xres;
+  key->channels = (dev->settings.scan_mode == SCAN_MODE_COLOR) ? 3 : 1;
+  key->scan_method = dev->settings.scan_method;
+  if (dev->model->cmd_set->calculate_current_setup)
+    {
+      status = dev->model->cmd_set->calculate_current_setup (dev);
+      if (status != SANE_STATUS_GOOD)
+	return status;
+      key->half_ccd = dev->current_setup.half_ccd ? 1 : 0;
+    }
+  return SANE_STATUS_GOOD;
+}
+
+static unsigned int
+genesys_calibration_bucket (Genesys_Calibration_Key * key)
+{
+  const uint8_t *p = (const uint8_t *) key;
+  uint32_t hash = 2166136261U;
+  size_t i;
+
+  for (i = 0; i < sizeof (*key); i++)
+    hash = (hash ^ p[i]) * 16777619U;
+  return hash % GENESYS_CALIBRATION_BUCKETS;
+}
+
+static void
+genesys_index_calibration (Genesys_Device * dev,
+			   Genesys_Calibration_Cache * cache)
+{
+  Genesys_Calibration_Cache **bucket;
+
+  bucket = &dev->calib_store.index[genesys_calibration_bucket (&cache->key)];
+  cache->hash_next = *bucket;
+  *bucket = cache;
+}
+
+static void
+genesys_unindex_calibration (Genesys_Device * dev,
+			     Genesys_Calibration_Cache * cache)
+{
+  Genesys_Calibration_Cache **link;
+
+  link = &dev->calib_store.index[genesys_calibration_bucket (&cache->key)];
+  for (; *link; link = &(*link)->hash_next)
+    if (*link == cache)
+      {
+	*link = cache->hash_next;
+	break;
+      }
+  cache->hash_next = NULL;
+}
+
 /**
- * search calibration cache list for an entry matching required scan.
- * If one is found, set device calibration with it
+ * search calibration cache for an entry the command set accepts for the
+ * required scan. Entries made for the same key are tried first; the
+ * others only when none of them fits, since a command set may accept
+ * entries made for other settings (other resolutions on CIS sensors).
  * @param dev scanner's device
+ * @param for_overwrite the entry will be replaced, don't check its age
+ * @param found set to the matching entry, NULL if there is none
  * @return SANE_STATUS_UNSUPPORTED if no matching cache entry has been
- * found, SANE_STATUS_GOOD if one has been found and used.
+ * found, SANE_STATUS_GOOD if one has been found.
  */
 static SANE_Status
-genesys_restore_calibration (Genesys_Device * dev)
+genesys_find_calibration (Genesys_Device * dev, SANE_Bool for_overwrite,
+			  Genesys_Calibration_Cache ** found)
 {
   SANE_Status status;
+  Genesys_Calibration_Key key;
   Genesys_Calibration_Cache *cache;
+  int pass, same;
 
-  DBGSTART;
-
+  *found = NULL;
   /* if no cache or no function to evaluate cache entry ther can be no match */
   if (!dev->model->cmd_set->is_compatible_calibration
       || dev->calibration_cache == NULL)
     return SANE_STATUS_UNSUPPORTED;
 
-  /* we walk the link list of calibration cache in search for a
-   * matching one */
-  for (cache = dev->calibration_cache; cache; cache = cache->next)
+  RIE (genesys_calibration_key (dev, &key));
+
+  for (pass = 0; pass < 2; pass++)
     {
-      status = dev->model->cmd_set->is_compatible_calibration (dev, cache,
-							       SANE_FALSE);
-      /* SANE_STATUS_GOOD, a matching cache has been found 
-       * so we use it to populate calibration data
-       */
-      if (status == SANE_STATUS_GOOD)
+      cache = pass ? dev->calibration_cache
+	: dev->calib_store.index[genesys_calibration_bucket (&key)];
+      for (; cache; cache = pass ? cache->next : cache->hash_next)
 	{
-	  memcpy (&dev->frontend, &cache->frontend, sizeof (dev->frontend));
-          /* we don't restore the gamma fields */
-          /* XXX STEF XXX
-	  memcpy (&dev->sensor, &cache->sensor, offsetof (Genesys_Sensor, red_gamma));
-          */
-	  memcpy (dev->sensor.regs_0x10_0x1d, cache->sensor.regs_0x10_0x1d, 6);
-	  free (dev->dark_average_data);
-	  free (dev->white_average_data);
+	  same = !memcmp (&cache->key, &key, sizeof (key));
+	  if (pass ? same : !same)
+	    continue;
+
+	  status = dev->model->cmd_set->is_compatible_calibration (dev, cache,
+								   for_overwrite);
+	  /* SANE_STATUS_UNSUPPORTED means tested cache entry doesn't
+	   * match, anything else but SANE_STATUS_GOOD is a fatal error */
+	  if (status == SANE_STATUS_UNSUPPORTED)
+	    continue;
+	  if (status != SANE_STATUS_GOOD)
+	    {
+	      DBG (DBG_error,
+		   "genesys_find_calibration: fail while checking compatibility: %s\n",
+		   sane_strstatus (status));
+	      return status;
+	    }
+	  DBG (DBG_proc, "genesys_find_calibration: entry %u matches%s\n",
+	       cache->id, pass ? " (made for other settings)" : "");
+	  *found = cache;
+	  return SANE_STATUS_GOOD;
+	}
+    }
+  return SANE_STATUS_UNSUPPORTED;
+}
+
+/**
+ * search calibration cache for an entry matching required scan.
+ * If one is found, set device calibration with it
+ * @param dev scanner's device
+ * @return SANE_STATUS_UNSUPPORTED if no matching cache entry has been
+ * found, SANE_STATUS_GOOD if one has been found and used.
+ */
+static SANE_Status
+genesys_restore_calibration (Genesys_Device * dev)
+{
+  SANE_Status status;
+  Genesys_Calibration_Cache *cache;
 
-	  dev->average_size = cache->average_size;
-	  dev->calib_pixels = cache->calib_pixels;
-	  dev->calib_channels = cache->calib_channels;
+  DBGSTART;
 
-	  dev->dark_average_data = (uint8_t *) malloc (cache->average_size);
-	  dev->white_average_data = (uint8_t *) malloc (cache->average_size);
+  status = genesys_find_calibration (dev, SANE_FALSE, &cache);
+  if (status == SANE_STATUS_UNSUPPORTED)
+    {
+      dev->calib_store.misses++;
+      DBG (DBG_info,
+	   "genesys_restore_calibration: nothing found (%u hits, %u misses)\n",
+	   dev->calib_store.hits, dev->calib_store.misses);
+      return status;
+    }
+  if (status != SANE_STATUS_GOOD)
+    return status;
 
-	  if (!dev->dark_average_data || !dev->white_average_data)
-	    return SANE_STATUS_NO_MEM;
+  memcpy (&dev->frontend, &cache->frontend, sizeof (dev->frontend));
+  /* we don't restore the gamma fields */
+  /* XXX STEF XXX
+     memcpy (&dev->sensor, &cache->sensor, offsetof (Genesys_Sensor, red_gamma));
+   */
+  memcpy (dev->sensor.regs_0x10_0x1d, cache->sensor.regs_0x10_0x1d, 6);
+  free (dev->dark_average_data);
+  free (dev->white_average_data);
 
-	  memcpy (dev->dark_average_data,
-		  cache->dark_average_data, dev->average_size);
-	  memcpy (dev->white_average_data,
-		  cache->white_average_data, dev->average_size);
+  dev->average_size = cache->average_size;
+  dev->calib_pixels = cache->calib_pixels;
+  dev->calib_channels = cache->calib_channels;
 
+  dev->dark_average_data = (uint8_t *) malloc (cache->average_size);
+  dev->white_average_data = (uint8_t *) malloc (cache->average_size);
 
-        if(dev->model->cmd_set->send_shading_data==NULL)
-          {
-            status = genesys_send_shading_coefficient (dev);
-            if (status != SANE_STATUS_GOOD)
-              {
-                DBG (DBG_error,
-                     "genesys_restore_calibration: failed to send shading calibration coefficients: %s\n",
-                     sane_strstatus (status));
-                return status;
-              }
-          }
+  if (!dev->dark_average_data || !dev->white_average_data)
+    return SANE_STATUS_NO_MEM;
 
-	  DBG (DBG_proc, "genesys_restore_calibration: restored\n");
-	  return SANE_STATUS_GOOD;
-	}
+  memcpy (dev->dark_average_data,
+	  cache->dark_average_data, dev->average_size);
+  memcpy (dev->white_average_data,
+	  cache->white_average_data, dev->average_size);
 
-      /* here status is either SANE_STATUS_UNSUPPORTED which mean tested cache
-       * entry doesn't match, or an fatal error */
-      if (status != SANE_STATUS_UNSUPPORTED)
+  if (dev->model->cmd_set->send_shading_data == NULL)
+    {
+      status = genesys_send_shading_coefficient (dev);
+      if (status != SANE_STATUS_GOOD)
 	{
 	  DBG (DBG_error,
-	       "genesys_restore_calibration: fail while checking compatibility: %s\n",
+	       "genesys_restore_calibration: failed to send shading calibration coefficients: %s\n",
 	       sane_strstatus (status));
 	  return status;
 	}
     }
-  DBG (DBG_proc, "genesys_restore_calibration: completed(nothing found)\n");
-  return SANE_STATUS_UNSUPPORTED;
+
+  dev->calib_store.hits++;
+  DBG (DBG_info, "genesys_restore_calibration: restored (%u hits, %u misses)\n",
+       dev->calib_store.hits, dev->calib_store.misses);
+  return SANE_STATUS_GOOD;
 }
 
+static void genesys_append_calibration (Genesys_Device * dev,
+					Genesys_Calibration_Cache * cache);
 
 static SANE_Status
 genesys_save_calibration (Genesys_Device * dev)
@@ -3247,31 +3370,19 @@ genesys_save_calibration (Genesys_Device * dev)
   if (!dev->model->cmd_set->is_compatible_calibration)
     return SANE_STATUS_UNSUPPORTED;
 
-  if (dev->calibration_cache != NULL)
-    {
-      for (cache = dev->calibration_cache; cache; cache = cache->next)
-	{
-	  status = dev->model->cmd_set->is_compatible_calibration (dev, cache, SANE_TRUE);
-	  if (status == SANE_STATUS_UNSUPPORTED)
-	    {
-	      continue;
-	    }
-	  else if (status != SANE_STATUS_GOOD)
-	    {
-	      DBG (DBG_error,
-		   "genesys_save_calibration: fail while checking compatibility: %s\n",
-		   sane_strstatus (status));
-	      return status;
-	    }
-	  break;
-	}
-    }
+  status = genesys_find_calibration (dev, SANE_TRUE, &cache);
+  if (status != SANE_STATUS_GOOD && status != SANE_STATUS_UNSUPPORTED)
+    return status;
 
   /* if we found on overridable cache, we reuse it */
   if (cache)
     {
-          free(cache->dark_average_data);
-          free(cache->white_average_data);
+      genesys_unindex_calibration (dev, cache);
+      if (!cache->mapped)
+	{
+	  free (cache->dark_average_data);
+	  free (cache->white_average_data);
+	}
     }
   else
     {
@@ -3282,11 +3393,25 @@ genesys_save_calibration (Genesys_Device * dev)
 
       memset (cache, 0, sizeof (Genesys_Calibration_Cache));
 
+      cache->id = dev->calib_store.next_id++;
       cache->next = dev->calibration_cache;
       dev->calibration_cache = cache;
     }
 
   cache->average_size = dev->average_size;
+  cache->mapped = SANE_FALSE;
+  cache->dark_average_data = NULL;
+  cache->white_average_data = NULL;
+
+  memcpy (&cache->used_setup, &dev->current_setup, sizeof (cache->used_setup));
+  memcpy (&cache->frontend, &dev->frontend, sizeof (cache->frontend));
+  memcpy (&cache->sensor, &dev->sensor, sizeof (cache->sensor));
+
+  /* indexed even if the key is incomplete, so that it can be freed */
+  status = genesys_calibration_key (dev, &cache->key);
+  genesys_index_calibration (dev, cache);
+  if (status != SANE_STATUS_GOOD)
+    return status;
 
   cache->dark_average_data = (uint8_t *) malloc (cache->average_size);
   if (!cache->dark_average_data)
@@ -3295,10 +3420,6 @@ genesys_save_calibration (Genesys_Device * dev)
   if (!cache->white_average_data)
     return SANE_STATUS_NO_MEM;
 
-  memcpy (&cache->used_setup, &dev->current_setup, sizeof (cache->used_setup));
-  memcpy (&cache->frontend, &dev->frontend, sizeof (cache->frontend));
-  memcpy (&cache->sensor, &dev->sensor, sizeof (cache->sensor));
-
   cache->calib_pixels = dev->calib_pixels;
   cache->calib_channels = dev->calib_channels;
   memcpy (cache->dark_average_data, dev->dark_average_data, cache->average_size);
@@ -3308,6 +3429,9 @@ genesys_save_calibration (Genesys_Device * dev)
   cache->last_calibration = time.tv_sec;
 #endif
 
+  /* store it right away, sane_close only compacts the file */
+  genesys_append_calibration (dev, cache);
+
   DBGCOMPLETED;
   return SANE_STATUS_GOOD;
 }
@@ -4616,6 +4740,204 @@ genesys_fill_segmented_buffer (Genesys_Device * dev, uint8_t *work_buffer_dst, s
     return SANE_STATUS_GOOD;
 }
 
+/* reads size bytes of scan data, through the line interpolation or
+   segment reordering the scan needs */
+static SANE_Status
+genesys_read_scan_data (Genesys_Device * dev, uint8_t * buffer, size_t size)
+{
+  /* due to sensors and motors, not all data can be directly used. It
+   * may have to be read from another intermediate buffer and then processed.
+   * There are currently 3 intermediate stages:
+   * - handling of odd/even sensors
+   * - handling of line interpolation for motors that can't have low 
+   *   enough dpi
+   * - handling of multi-segments sensors
+   *  
+   * This is also the place where full duplex data will be handled.
+   */
+  if (dev->line_interp>0)
+    {
+      /* line interpolation */
+      return genesys_fill_line_interp_buffer (dev, buffer, size);
+    }
+  else if (dev->segnb>1)
+    {
+      /* multi-segment sensors processing */
+      return genesys_fill_segmented_buffer (dev, buffer, size);
+    }
+  /* regular case with no extra copy */
+  return dev->model->cmd_set->bulk_read_data (dev, 0x45, buffer, size);
+}
+
+/* the reader task: reads the whole scan from the scanner into the ring,
+   in the same transfer sizes genesys_fill_read_buffer would use */
+static int
+genesys_read_ahead_task (void *arg)
+{
+  Genesys_Device *dev = arg;
+  Genesys_Read_Ahead *ra = &dev->read_ahead;
+  SANE_Status status = SANE_STATUS_GOOD;
+  uint8_t *buffer;
+  size_t size, chunk;
+
+  chunk = dev->read_buffer.size & ~0xff;
+  if (chunk == 0)
+    chunk = 0x100;
+  buffer = malloc (chunk);
+  if (!buffer)
+    return SANE_STATUS_NO_MEM;
+
+  while (ra->left > 0)
+    {
+      size = chunk;
+      if (ra->left < size)
+	{
+	  size = ra->left;
+	  /*round up to a multiple of 256 bytes */
+	  size += (size & 0xff) ? 0x100 : 0x00;
+	  size &= ~0xff;
+	}
+
+      status = genesys_read_scan_data (dev, buffer, size);
+      if (status != SANE_STATUS_GOOD)
+	{
+	  DBG (DBG_error,
+	       "genesys_read_ahead_task: failed to read %lu bytes (%s)\n",
+	       (u_long) size, sane_strstatus (status));
+	  status = SANE_STATUS_IO_ERROR;
+	  break;
+	}
+      if (size > ra->left)
+	size = ra->left;
+      ra->left -= size;
+
+      if (sanei_thread_ring_fill (ra->ring) + size > ra->size)
+	ra->full++;
+      status = sanei_thread_ring_write (ra->ring, buffer, size);
+      if (status != SANE_STATUS_GOOD)
+	break;
+    }
+
+  free (buffer);
+  return status;
+}
+
+/* starts the reader task for a scan if reading ahead is configured */
+static SANE_Status
+genesys_read_ahead_start (Genesys_Device * dev)
+{
+  Genesys_Read_Ahead *ra = &dev->read_ahead;
+  size_t size = (size_t) read_ahead_kb * 1024;
+  SANE_Status status;
+
+  ra->active = SANE_FALSE;
+  ra->reads = ra->empty = ra->full = 0;
+  ra->fill_sum = ra->fill_max = 0;
+  if (size == 0)
+    return SANE_STATUS_GOOD;
+
+  /* the end of a document is detected between reads, from sane_read */
+  if (dev->model->is_sheetfed == SANE_TRUE)
+    {
+      DBG (DBG_info,
+	   "genesys_read_ahead_start: no read ahead for sheetfed scanners\n");
+      return SANE_STATUS_GOOD;
+    }
+  /* a reader process couldn't share the usb device and our counters */
+  if (sanei_thread_is_forked ())
+    {
+      DBG (DBG_info,
+	   "genesys_read_ahead_start: no read ahead without threads\n");
+      return SANE_STATUS_GOOD;
+    }
+
+  if (ra->ring && ra->size != size)
+    {
+      sanei_thread_ring_free (ra->ring);
+      ra->ring = NULL;
+    }
+  if (!ra->ring)
+    {
+      RIE (sanei_thread_ring_new (size, &ra->ring));
+      ra->size = size;
+    }
+
+  ra->left = dev->read_bytes_left;
+  DBG (DBG_info,
+       "genesys_read_ahead_start: reading %lu bytes through a ring of %lu kB\n",
+       (u_long) ra->left, (u_long) (ra->size / 1024));
+  RIE (sanei_thread_ring_start (ra->ring, genesys_read_ahead_task, dev));
+  ra->active = SANE_TRUE;
+  return SANE_STATUS_GOOD;
+}
+
+/* ends the reader task if it runs, and tells how the ring was used */
+static SANE_Status
+genesys_read_ahead_stop (Genesys_Device * dev)
+{
+  Genesys_Read_Ahead *ra = &dev->read_ahead;
+  SANE_Status status;
+
+  if (!ra->active)
+    return SANE_STATUS_GOOD;
+  status = sanei_thread_ring_stop (ra->ring);
+  ra->active = SANE_FALSE;
+
+  DBG (DBG_info,
+       "genesys_read_ahead_stop: ring of %lu kB, %lu reads, "
+       "average fill %lu kB, highest %lu kB, found empty %lu times, "
+       "full %lu times, task status %s\n",
+       (u_long) (ra->size / 1024), ra->reads,
+       (u_long) (ra->reads ? ra->fill_sum / ra->reads / 1024 : 0),
+       (u_long) (ra->fill_max / 1024), ra->empty, ra->full,
+       sane_strstatus (status));
+  return status;
+}
+
+/* fills read_buffer from the ring, waiting for the reader task if the
+   ring is empty */
+static SANE_Status
+genesys_fill_from_ring (Genesys_Device * dev)
+{
+  Genesys_Read_Ahead *ra = &dev->read_ahead;
+  SANE_Status status;
+  size_t space, size, fill;
+  uint8_t *work_buffer_dst;
+
+  space = dev->read_buffer.size - dev->read_buffer.avail;
+  if (space == 0)
+    return SANE_STATUS_GOOD;
+  work_buffer_dst = sanei_genesys_buffer_get_write_pos (&(dev->read_buffer),
+							space);
+
+  fill = sanei_thread_ring_fill (ra->ring);
+  ra->reads++;
+  ra->fill_sum += fill;
+  if (fill > ra->fill_max)
+    ra->fill_max = fill;
+  if (fill == 0)
+    ra->empty++;
+  DBG (DBG_io2, "genesys_fill_from_ring: %lu of %lu bytes in the ring\n",
+       (u_long) fill, (u_long) ra->size);
+
+  status = sanei_thread_ring_read (ra->ring, work_buffer_dst, space, &size);
+  if (status == SANE_STATUS_EOF)
+    return SANE_STATUS_GOOD;
+  if (status != SANE_STATUS_GOOD)
+    {
+      DBG (DBG_error, "genesys_fill_from_ring: reader task failed (%s)\n",
+	   sane_strstatus (status));
+      return status;
+    }
+
+  if (size > dev->read_bytes_left)
+    size = dev->read_bytes_left;
+  dev->read_bytes_left -= size;
+
+  RIE (sanei_genesys_buffer_produce (&(dev->read_buffer), size));
+  return SANE_STATUS_GOOD;
+}
+
 /**
  *
  */
@@ -4638,6 +4960,9 @@ genesys_fill_read_buffer (Genesys_Device * dev)
 	return status;
     }
 
+  if (dev->read_ahead.active)
+    return genesys_fill_from_ring (dev);
+
   space = dev->read_buffer.size - dev->read_buffer.avail;
 
   work_buffer_dst = sanei_genesys_buffer_get_write_pos (&(dev->read_buffer),
@@ -4668,31 +4993,7 @@ genesys_fill_read_buffer (Genesys_Device * dev)
 
   /* size is already maxed to our needs. for most models bulk_read_data
      will read as much data as requested. */
-
-  /* due to sensors and motors, not all data can be directly used. It
-   * may have to be read from another intermediate buffer and then processed.
-   * There are currently 3 intermediate stages:
-   * - handling of odd/even sensors
-   * - handling of line interpolation for motors that can't have low 
-   *   enough dpi
-   * - handling of multi-segments sensors
-   *  
-   * This is also the place where full duplex data will be handled.
-   */
-  if (dev->line_interp>0)
-    {
-      /* line interpolation */
-      status = genesys_fill_line_interp_buffer (dev, work_buffer_dst, size);
-    }
-  else if (dev->segnb>1)
-    {
-      /* multi-segment sensors processing */
-      status = genesys_fill_segmented_buffer (dev, work_buffer_dst, size);
-    }
-  else /* regular case with no extra copy */
-    {
-      status = dev->model->cmd_set->bulk_read_data (dev, 0x45, work_buffer_dst, size);
-    }
+  status = genesys_read_scan_data (dev, work_buffer_dst, size);
   if (status != SANE_STATUS_GOOD)
     {
       DBG (DBG_error,
@@ -4713,176 +5014,30 @@ genesys_fill_read_buffer (Genesys_Device * dev)
   return SANE_STATUS_GOOD;
 }
 
-/* this function does the effective data read in a manner that suits 
-   the scanner. It does data reordering and resizing if need.  
-   It also manages EOF and I/O errors, and line distance correction.
-   */
+/* converts the lines in read_buffer step by step, through lines_buffer,
+   shrink_buffer and out_buffer as needed, and moves up to *len bytes of
+   the result to destination. */
 static SANE_Status
-genesys_read_ordered_data (Genesys_Device * dev, SANE_Byte * destination,
-			   size_t * len)
+genesys_read_staged_data (Genesys_Device * dev, SANE_Byte * destination,
+			  size_t * len, unsigned int *ccd_shift,
+			  unsigned int shift_count, unsigned int needs_reorder,
+			  unsigned int needs_ccd, unsigned int needs_shrink,
+			  unsigned int needs_reverse)
 {
   SANE_Status status;
   size_t bytes, extra;
   unsigned int channels, depth, src_pixels;
-  unsigned int ccd_shift[12], shift_count;
   uint8_t *work_buffer_src;
   uint8_t *work_buffer_dst;
   unsigned int dst_lines;
   unsigned int step_1_mode;
-  unsigned int needs_reorder;
-  unsigned int needs_ccd;
-  unsigned int needs_shrink;
-  unsigned int needs_reverse;
   Genesys_Buffer *src_buffer;
   Genesys_Buffer *dst_buffer;
 
-  DBGSTART;
-  if (dev->read_active != SANE_TRUE)
-    {
-      DBG (DBG_error, "genesys_read_ordered_data: read not active!\n");
-      *len = 0;
-      return SANE_STATUS_INVAL;
-    }
-
-
-  DBG (DBG_info, "genesys_read_ordered_data: dumping current_setup:\n"
-       "\tpixels: %d\n"
-       "\tlines: %d\n"
-       "\tdepth: %d\n"
-       "\tchannels: %d\n"
-       "\texposure_time: %d\n"
-       "\txres: %g\n"
-       "\tyres: %g\n"
-       "\thalf_ccd: %s\n"
-       "\tstagger: %d\n"
-       "\tmax_shift: %d\n",
-       dev->current_setup.pixels,
-       dev->current_setup.lines,
-       dev->current_setup.depth,
-       dev->current_setup.channels,
-       dev->current_setup.exposure_time,
-       dev->current_setup.xres,
-       dev->current_setup.yres,
-       dev->current_setup.half_ccd ? "yes" : "no",
-       dev->current_setup.stagger, dev->current_setup.max_shift);
-
-  /* prepare conversion */
-  /* current settings */
   channels = dev->current_setup.channels;
   depth = dev->current_setup.depth;
-
   src_pixels = dev->current_setup.pixels;
 
-  needs_reorder = 1;
-  if (channels != 3 && depth != 16)
-    needs_reorder = 0;
-#ifndef WORDS_BIGENDIAN
-  if (channels != 3 && depth == 16)
-    needs_reorder = 0;
-  if (channels == 3 && depth == 16 && !dev->model->is_cis &&
-      dev->model->line_mode_color_order == COLOR_ORDER_RGB)
-    needs_reorder = 0;
-#endif
-  if (channels == 3 && depth == 8 && !dev->model->is_cis &&
-      dev->model->line_mode_color_order == COLOR_ORDER_RGB)
-    needs_reorder = 0;
-
-  needs_ccd = dev->current_setup.max_shift > 0;
-  needs_shrink = dev->settings.pixels != src_pixels;
-  needs_reverse = depth == 1;
-
-  DBG (DBG_info,
-       "genesys_read_ordered_data: using filters:%s%s%s%s\n",
-       needs_reorder ? " reorder" : "",
-       needs_ccd ? " ccd" : "",
-       needs_shrink ? " shrink" : "",
-       needs_reverse ? " reverse" : "");
-
-  DBG (DBG_info,
-       "genesys_read_ordered_data: frontend requested %lu bytes\n",
-       (u_long) * len);
-
-  DBG (DBG_info,
-       "genesys_read_ordered_data: bytes_to_read=%lu, total_bytes_read=%lu\n",
-       (u_long) dev->total_bytes_to_read, (u_long) dev->total_bytes_read);
-  /* is there data left to scan */
-  if (dev->total_bytes_read >= dev->total_bytes_to_read)
-    {
-      DBG (DBG_proc,
-	   "genesys_read_ordered_data: nothing more to scan: EOF\n");
-      *len = 0;
-      return SANE_STATUS_EOF;
-    }
-
-  DBG (DBG_info, "genesys_read_ordered_data: %lu lines left by output\n",
-       ((dev->total_bytes_to_read - dev->total_bytes_read) * 8UL) /
-       (dev->settings.pixels * channels * depth));
-  DBG (DBG_info, "genesys_read_ordered_data: %lu lines left by input\n",
-       ((dev->read_bytes_left + dev->read_buffer.avail) * 8UL) /
-       (src_pixels * channels * depth));
-
-  if (channels == 1)
-    {
-      ccd_shift[0] = 0;
-      ccd_shift[1] = dev->current_setup.stagger;
-      shift_count = 2;
-    }
-  else
-    {
-      ccd_shift[0] =
-	((dev->ld_shift_r * dev->settings.yres) /
-	 dev->motor.base_ydpi);
-      ccd_shift[1] =
-	((dev->ld_shift_g * dev->settings.yres) /
-	 dev->motor.base_ydpi);
-      ccd_shift[2] =
-	((dev->ld_shift_b * dev->settings.yres) /
-	 dev->motor.base_ydpi);
-
-      ccd_shift[3] = ccd_shift[0] + dev->current_setup.stagger;
-      ccd_shift[4] = ccd_shift[1] + dev->current_setup.stagger;
-      ccd_shift[5] = ccd_shift[2] + dev->current_setup.stagger;
-
-      shift_count = 6;
-    }
-
-
-/* convert data */
-/*
-  0. fill_read_buffer
--------------- read_buffer ----------------------
-  1a). (opt)uncis                    (assumes color components to be laid out
-                                    planar)
-  1b). (opt)reverse_RGB              (assumes pixels to be BGR or BBGGRR))
--------------- lines_buffer ----------------------
-  2a). (opt)line_distance_correction (assumes RGB or RRGGBB)
-  2b). (opt)unstagger                (assumes pixels to be depth*channels/8
-                                      bytes long, unshrinked)
-------------- shrink_buffer ---------------------
-  3. (opt)shrink_lines             (assumes component separation in pixels)
--------------- out_buffer -----------------------
-  4. memcpy to destination (for lineart with bit reversal)
-*/
-/*FIXME: for lineart we need sub byte addressing in buffers, or conversion to 
-  bytes at 0. and back to bits at 4.
-Problems with the first approach:
-  - its not clear how to check if we need to output an incomplete byte
-    because it is the last one.
- */
-/*FIXME: add lineart support for gl646. in the meantime add logic to convert 
-  from gray to lineart at the end? would suffer the above problem, 
-  total_bytes_to_read and total_bytes_read help in that case.
- */
-
-  status = genesys_fill_read_buffer (dev);
-
-  if (status != SANE_STATUS_GOOD)
-    {
-      DBG (DBG_error,
-	   "genesys_read_ordered_data: genesys_fill_read_buffer failed\n");
-      return status;
-    }
-
   src_buffer = &(dev->read_buffer);
 
 /* maybe reorder components/bytes */
@@ -5135,49 +5290,323 @@ Problems with the first approach:
 					      src_pixels,
 					      dev->settings.pixels, channels);
 
-	  if (status != SANE_STATUS_GOOD)
-	    {
-	      DBG (DBG_error,
-		   "genesys_read_ordered_data: failed to shrink lines(%s)\n",
-		   sane_strstatus (status));
-	      return SANE_STATUS_IO_ERROR;
-	    }
+	  if (status != SANE_STATUS_GOOD)
+	    {
+	      DBG (DBG_error,
+		   "genesys_read_ordered_data: failed to shrink lines(%s)\n",
+		   sane_strstatus (status));
+	      return SANE_STATUS_IO_ERROR;
+	    }
+
+          /* we just consumed this many bytes*/
+	  bytes = (dst_lines * src_pixels * channels * depth) / 8;
+	  RIE (sanei_genesys_buffer_consume (src_buffer, bytes));
+
+          /* we just created this many bytes*/
+	  bytes = (dst_lines * dev->settings.pixels * channels * depth) / 8;
+	  RIE (sanei_genesys_buffer_produce (dst_buffer, bytes));
+
+	}
+      src_buffer = dst_buffer;
+    }
+
+  /* move data to destination */
+  bytes = src_buffer->avail;
+  if (bytes > *len)
+    bytes = *len;
+  work_buffer_src = sanei_genesys_buffer_get_read_pos (src_buffer);
+
+  if (needs_reverse)
+    {
+      status = genesys_reverse_bits (work_buffer_src, destination, bytes);
+      if (status != SANE_STATUS_GOOD)
+	{
+	  DBG (DBG_error,
+	       "genesys_read_ordered_data: failed to reverse bits(%s)\n",
+	       sane_strstatus (status));
+	  return SANE_STATUS_IO_ERROR;
+	}
+      *len = bytes;
+    }
+  else
+    {
+      memcpy (destination, work_buffer_src, bytes);
+      *len = bytes;
+    }
+
+  RIE (sanei_genesys_buffer_consume (src_buffer, bytes));
+  return SANE_STATUS_GOOD;
+}
+
+/* converts as many whole lines from read_buffer as fit with
+   genesys_fused_lines, straight to destination when no partial line is
+   left over in out_buffer, and moves up to *len bytes of the result to
+   destination. */
+static SANE_Status
+genesys_read_fused_data (Genesys_Device * dev, SANE_Byte * destination,
+			 size_t * len, unsigned int *ccd_shift,
+			 unsigned int shift_count)
+{
+  SANE_Status status;
+  size_t bytes, extra, src_bpl, dst_bpl;
+  unsigned int channels, depth, src_pixels, lines;
+  int is_cis, is_bgr;
+  uint8_t *work_buffer_dst;
+  Genesys_Buffer *src_buffer = &(dev->read_buffer);
+  Genesys_Buffer *dst_buffer = &(dev->out_buffer);
+
+  channels = dev->current_setup.channels;
+  depth = dev->current_setup.depth;
+  src_pixels = dev->current_setup.pixels;
+  is_cis = channels == 3 && dev->model->is_cis;
+  is_bgr = channels == 3
+    && dev->model->line_mode_color_order == COLOR_ORDER_BGR;
+
+  src_bpl = (src_pixels * channels * depth) / 8;
+  dst_bpl = (dev->settings.pixels * channels * depth) / 8;
+
+/*extra lines are needed by the ccd shift, and should not be consumed*/
+  extra = ccd_shift ? dev->current_setup.max_shift * src_bpl : 0;
+  bytes = src_buffer->avail;
+  lines = bytes > extra ? (bytes - extra) / src_bpl : 0;
+
+  if (dst_buffer->avail == 0 && *len >= dst_bpl)
+    {
+      if (lines > *len / dst_bpl)
+	lines = *len / dst_bpl;
+      work_buffer_dst = destination;
+    }
+  else
+    {
+      if (lines > (dst_buffer->size - dst_buffer->avail) / dst_bpl)
+	lines = (dst_buffer->size - dst_buffer->avail) / dst_bpl;
+      work_buffer_dst =
+	sanei_genesys_buffer_get_write_pos (dst_buffer, lines * dst_bpl);
+    }
+
+  DBG (DBG_info, "genesys_read_fused_data: converting %d lines%s\n", lines,
+       work_buffer_dst == destination ? " to destination" : "");
+
+  if (lines != 0)
+    {
+      if (depth == 8)
+	status = genesys_fused_lines_8 (sanei_genesys_buffer_get_read_pos
+					(src_buffer), work_buffer_dst, lines,
+					src_pixels, dev->settings.pixels,
+					channels, ccd_shift, shift_count,
+					is_cis, is_bgr);
+      else
+	status = genesys_fused_lines_16 (sanei_genesys_buffer_get_read_pos
+					 (src_buffer), work_buffer_dst, lines,
+					 src_pixels, dev->settings.pixels,
+					 channels, ccd_shift, shift_count,
+					 is_cis, is_bgr);
+      if (status != SANE_STATUS_GOOD)
+	{
+	  DBG (DBG_error,
+	       "genesys_read_fused_data: failed to convert lines(%s)\n",
+	       sane_strstatus (status));
+	  return SANE_STATUS_IO_ERROR;
+	}
+      RIE (sanei_genesys_buffer_consume (src_buffer, lines * src_bpl));
+    }
+
+  if (work_buffer_dst == destination)
+    {
+      *len = lines * dst_bpl;
+      return SANE_STATUS_GOOD;
+    }
+
+  RIE (sanei_genesys_buffer_produce (dst_buffer, lines * dst_bpl));
+  bytes = dst_buffer->avail;
+  if (bytes > *len)
+    bytes = *len;
+  memcpy (destination, sanei_genesys_buffer_get_read_pos (dst_buffer), bytes);
+  *len = bytes;
+  RIE (sanei_genesys_buffer_consume (dst_buffer, bytes));
+  return SANE_STATUS_GOOD;
+}
+
+/* this function does the effective data read in a manner that suits 
+   the scanner. It does data reordering and resizing if need.  
+   It also manages EOF and I/O errors, and line distance correction.
+   */
+static SANE_Status
+genesys_read_ordered_data (Genesys_Device * dev, SANE_Byte * destination,
+			   size_t * len)
+{
+  SANE_Status status;
+  unsigned int channels, depth, src_pixels;
+  unsigned int ccd_shift[12], shift_count;
+  unsigned int needs_reorder;
+  unsigned int needs_ccd;
+  unsigned int needs_shrink;
+  unsigned int needs_reverse;
+
+  DBGSTART;
+  if (dev->read_active != SANE_TRUE)
+    {
+      DBG (DBG_error, "genesys_read_ordered_data: read not active!\n");
+      *len = 0;
+      return SANE_STATUS_INVAL;
+    }
+
+
+  DBG (DBG_info, "genesys_read_ordered_data: dumping current_setup:\n"
+       "\tpixels: %d\n"
+       "\tlines: %d\n"
+       "\tdepth: %d\n"
+       "\tchannels: %d\n"
+       "\texposure_time: %d\n"
+       "\txres: %g\n"
+       "\tyres: %g\n"
+       "\thalf_ccd: %s\n"
+       "\tstagger: %d\n"
+       "\tmax_shift: %d\n",
+       dev->current_setup.pixels,
+       dev->current_setup.lines,
+       dev->current_setup.depth,
+       dev->current_setup.channels,
+       dev->current_setup.exposure_time,
+       dev->current_setup.xres,
+       dev->current_setup.yres,
+       dev->current_setup.half_ccd ? "yes" : "no",
+       dev->current_setup.stagger, dev->current_setup.max_shift);
+
+  /* prepare conversion */
+  /* current settings */
+  channels = dev->current_setup.channels;
+  depth = dev->current_setup.depth;
+
+  src_pixels = dev->current_setup.pixels;
+
+  needs_reorder = 1;
+  if (channels != 3 && depth != 16)
+    needs_reorder = 0;
+#ifndef WORDS_BIGENDIAN
+  if (channels != 3 && depth == 16)
+    needs_reorder = 0;
+  if (channels == 3 && depth == 16 && !dev->model->is_cis &&
+      dev->model->line_mode_color_order == COLOR_ORDER_RGB)
+    needs_reorder = 0;
+#endif
+  if (channels == 3 && depth == 8 && !dev->model->is_cis &&
+      dev->model->line_mode_color_order == COLOR_ORDER_RGB)
+    needs_reorder = 0;
+
+  needs_ccd = dev->current_setup.max_shift > 0;
+  needs_shrink = dev->settings.pixels != src_pixels;
+  needs_reverse = depth == 1;
+
+  DBG (DBG_info,
+       "genesys_read_ordered_data: using filters:%s%s%s%s\n",
+       needs_reorder ? " reorder" : "",
+       needs_ccd ? " ccd" : "",
+       needs_shrink ? " shrink" : "",
+       needs_reverse ? " reverse" : "");
+
+  DBG (DBG_info,
+       "genesys_read_ordered_data: frontend requested %lu bytes\n",
+       (u_long) * len);
+
+  DBG (DBG_info,
+       "genesys_read_ordered_data: bytes_to_read=%lu, total_bytes_read=%lu\n",
+       (u_long) dev->total_bytes_to_read, (u_long) dev->total_bytes_read);
+  /* is there data left to scan */
+  if (dev->total_bytes_read >= dev->total_bytes_to_read)
+    {
+      DBG (DBG_proc,
+	   "genesys_read_ordered_data: nothing more to scan: EOF\n");
+      *len = 0;
+      return SANE_STATUS_EOF;
+    }
+
+  DBG (DBG_info, "genesys_read_ordered_data: %lu lines left by output\n",
+       ((dev->total_bytes_to_read - dev->total_bytes_read) * 8UL) /
+       (dev->settings.pixels * channels * depth));
+  DBG (DBG_info, "genesys_read_ordered_data: %lu lines left by input\n",
+       ((dev->read_bytes_left + dev->read_buffer.avail) * 8UL) /
+       (src_pixels * channels * depth));
+
+  if (channels == 1)
+    {
+      ccd_shift[0] = 0;
+      ccd_shift[1] = dev->current_setup.stagger;
+      shift_count = 2;
+    }
+  else
+    {
+      ccd_shift[0] =
+	((dev->ld_shift_r * dev->settings.yres) /
+	 dev->motor.base_ydpi);
+      ccd_shift[1] =
+	((dev->ld_shift_g * dev->settings.yres) /
+	 dev->motor.base_ydpi);
+      ccd_shift[2] =
+	((dev->ld_shift_b * dev->settings.yres) /
+	 dev->motor.base_ydpi);
+
+      ccd_shift[3] = ccd_shift[0] + dev->current_setup.stagger;
+      ccd_shift[4] = ccd_shift[1] + dev->current_setup.stagger;
+      ccd_shift[5] = ccd_shift[2] + dev->current_setup.stagger;
+
+      shift_count = 6;
+    }
 
-          /* we just consumed this many bytes*/
-	  bytes = (dst_lines * src_pixels * channels * depth) / 8;
-	  RIE (sanei_genesys_buffer_consume (src_buffer, bytes));
 
-          /* we just created this many bytes*/
-	  bytes = (dst_lines * dev->settings.pixels * channels * depth) / 8;
-	  RIE (sanei_genesys_buffer_produce (dst_buffer, bytes));
+/* convert data */
+/*
+  0. fill_read_buffer
+-------------- read_buffer ----------------------
+  1a). (opt)uncis                    (assumes color components to be laid out
+                                    planar)
+  1b). (opt)reverse_RGB              (assumes pixels to be BGR or BBGGRR))
+-------------- lines_buffer ----------------------
+  2a). (opt)line_distance_correction (assumes RGB or RRGGBB)
+  2b). (opt)unstagger                (assumes pixels to be depth*channels/8
+                                      bytes long, unshrinked)
+------------- shrink_buffer ---------------------
+  3. (opt)shrink_lines             (assumes component separation in pixels)
+-------------- out_buffer -----------------------
+  4. memcpy to destination (for lineart with bit reversal)
 
-	}
-      src_buffer = dst_buffer;
-    }
+  for 8 and 16 bit data, genesys_fused_lines does 1. to 3. in one pass
+  from read_buffer to destination, or to out_buffer if a partial line
+  has to be kept.
+*/
+/*FIXME: for lineart we need sub byte addressing in buffers, or conversion to 
+  bytes at 0. and back to bits at 4.
+Problems with the first approach:
+  - its not clear how to check if we need to output an incomplete byte
+    because it is the last one.
+ */
+/*FIXME: add lineart support for gl646. in the meantime add logic to convert 
+  from gray to lineart at the end? would suffer the above problem, 
+  total_bytes_to_read and total_bytes_read help in that case.
+ */
 
-  /* move data to destination */
-  bytes = src_buffer->avail;
-  if (bytes > *len)
-    bytes = *len;
-  work_buffer_src = sanei_genesys_buffer_get_read_pos (src_buffer);
+  status = genesys_fill_read_buffer (dev);
 
-  if (needs_reverse)
+  if (status != SANE_STATUS_GOOD)
     {
-      status = genesys_reverse_bits (work_buffer_src, destination, bytes);
-      if (status != SANE_STATUS_GOOD)
-	{
-	  DBG (DBG_error,
-	       "genesys_read_ordered_data: failed to reverse bits(%s)\n",
-	       sane_strstatus (status));
-	  return SANE_STATUS_IO_ERROR;
-	}
-      *len = bytes;
+      DBG (DBG_error,
+	   "genesys_read_ordered_data: genesys_fill_read_buffer failed\n");
+      return status;
     }
+
+/* lineart can't be addressed per component, the other depths get all
+   the filters done in one pass unless the staged_lines option asks for
+   the separate passes */
+  if (depth == 1 || staged_lines)
+    status = genesys_read_staged_data (dev, destination, len, ccd_shift,
+				       shift_count, needs_reorder, needs_ccd,
+				       needs_shrink, needs_reverse);
   else
-    {
-      memcpy (destination, work_buffer_src, bytes);
-      *len = bytes;
-    }
+    status = genesys_read_fused_data (dev, destination, len,
+				      needs_ccd ? ccd_shift : NULL,
+				      shift_count);
+  if (status != SANE_STATUS_GOOD)
+    return status;
 
   /* avoid signaling some extra data because we have treated a full block
    * on the last block */
@@ -5187,11 +5616,10 @@ Problems with the first approach:
   /* count bytes sent to frontend */
   dev->total_bytes_read += *len;
 
-  RIE (sanei_genesys_buffer_consume (src_buffer, bytes));
-  
   /* end scan if all needed data have been read */
    if(dev->total_bytes_read >= dev->total_bytes_to_read)
     {
+      genesys_read_ahead_stop (dev);
       dev->model->cmd_set->end_scan (dev, dev->reg, SANE_TRUE);
       if (dev->model->is_sheetfed == SANE_TRUE)
         {
@@ -5200,7 +5628,7 @@ Problems with the first approach:
     }
 
   DBG (DBG_proc, "genesys_read_ordered_data: completed, %lu bytes read\n",
-       (u_long) bytes);
+       (u_long) * len);
   return SANE_STATUS_GOOD;
 }
 
@@ -6184,6 +6612,10 @@ SANE_Status
 probe_genesys_devices (void)
 {
   SANEI_Config config;
+  SANE_Option_Descriptor read_ahead_option;
+  SANE_Option_Descriptor staged_lines_option;
+  SANE_Option_Descriptor *options[2];
+  void *values[2];
   SANE_Status status;
 
   DBGSTART;
@@ -6192,10 +6624,36 @@ probe_genesys_devices (void)
   new_dev_len = 0;
   new_dev_alloced = 0;
 
-  /* set configuration options structure : no option for this backend */
-  config.descriptors = NULL;
-  config.values = NULL;
-  config.count = 0;
+  /* set configuration options structure */
+  memset (&read_ahead_option, 0, sizeof (read_ahead_option));
+  read_ahead_option.name = "read_ahead";
+  read_ahead_option.desc = "kB to read from the scanner ahead of the frontend";
+  read_ahead_option.type = SANE_TYPE_INT;
+  read_ahead_option.unit = SANE_UNIT_NONE;
+  read_ahead_option.size = sizeof (SANE_Word);
+  read_ahead_option.cap = SANE_CAP_SOFT_SELECT;
+  read_ahead_option.constraint_type = SANE_CONSTRAINT_RANGE;
+  read_ahead_option.constraint.range = &read_ahead_range;
+  options[0] = &read_ahead_option;
+  values[0] = &read_ahead_kb;
+  read_ahead_kb = 0;
+
+  memset (&staged_lines_option, 0, sizeof (staged_lines_option));
+  staged_lines_option.name = "staged_lines";
+  staged_lines_option.desc =
+    "convert 8 and 16 bit lines one filter after the other";
+  staged_lines_option.type = SANE_TYPE_BOOL;
+  staged_lines_option.unit = SANE_UNIT_NONE;
+  staged_lines_option.size = sizeof (SANE_Bool);
+  staged_lines_option.cap = SANE_CAP_SOFT_SELECT;
+  staged_lines_option.constraint_type = SANE_CONSTRAINT_NONE;
+  options[1] = &staged_lines_option;
+  values[1] = &staged_lines;
+  staged_lines = SANE_FALSE;
+
+  config.descriptors = options;
+  config.values = values;
+  config.count = 2;
 
   /* generic configure and attach function */
   status = sanei_configure_attach (GENESYS_CONFIG_FILE, &config,
@@ -6217,15 +6675,55 @@ probe_genesys_devices (void)
    Genesys_Calibration_Cache change, but it must be changed if there are
    changes that don't change size -- at least for now, as we store most 
    of Genesys_Calibration_Cache as is.
+   Version 2 files start with a Genesys_Calibration_Header, followed by
+   Genesys_Calibration_Record's, each followed by its white and dark
+   average data. A record replaces an earlier one with the same id.
 */
-#define CALIBRATION_VERSION 1
+#define CALIBRATION_VERSION 2
+
+typedef struct
+{
+  uint8_t version;		/* first byte, as in version 1 files */
+  uint8_t reserved[3];
+  uint32_t record_size;		/* sizeof (Genesys_Calibration_Record) */
+  uint32_t hits;
+  uint32_t misses;
+} Genesys_Calibration_Header;
+
+typedef struct
+{
+  uint32_t id;
+  uint32_t average_size;
+  Genesys_Calibration_Key key;
+  Genesys_Current_Setup used_setup;
+  time_t last_calibration;
+  Genesys_Frontend frontend;
+  /* the gamma (and later) fields are not stored */
+  uint8_t sensor[offsetof (Genesys_Sensor, red_gamma)];
+  uint32_t calib_pixels;
+  uint32_t calib_channels;
+} Genesys_Calibration_Record;
+
+/* version 1 files had no key, make one from what the entry was used for */
+static void
+genesys_calibration_key_v1 (Genesys_Device * dev,
+			    Genesys_Calibration_Cache * cache)
+{
+  memset (&cache->key, 0, sizeof (cache->key));
+  cache->key.ccd_type = dev->model->ccd_type;
+  cache->key.dac_type = dev->model->dac_type;
+  cache->key.xres = (int32_t) cache->used_setup.xres;
+  cache->key.half_ccd = cache->used_setup.half_ccd ? 1 : 0;
+  cache->key.channels = cache->used_setup.channels;
+  cache->key.scan_method = cache->used_setup.scan_method;
+}
 
 /**
- * reads previously cached calibration data
- * from file
+ * reads calibration data from a version 1 file, which held the records
+ * one after the other with no index
  */
-SANE_Status
-sanei_genesys_read_calibration (Genesys_Device * dev)
+static SANE_Status
+genesys_read_calibration_v1 (Genesys_Device * dev)
 {
   FILE *fp;
   uint8_t vers = 0;
@@ -6244,7 +6742,7 @@ sanei_genesys_read_calibration (Genesys_Device * dev)
 
   /* these two checks ensure that most bad things cannot happen */
   fread (&vers, 1, 1, fp);
-  if (vers != CALIBRATION_VERSION)
+  if (vers != 1)
     {
       DBG (DBG_info, "Calibration: Bad version\n");
       fclose (fp);
@@ -6263,13 +6761,13 @@ sanei_genesys_read_calibration (Genesys_Device * dev)
 
   while (!feof (fp) && status==SANE_STATUS_GOOD)
     {
-      DBG (DBG_info, "sanei_genesys_read_calibration: reading one record\n");
+      DBG (DBG_info, "genesys_read_calibration_v1: reading one record\n");
       cache = (struct Genesys_Calibration_Cache *) malloc (sizeof (*cache));
 
       if (!cache)
 	{
 	  DBG (DBG_error,
-	       "sanei_genesys_read_calibration: could not allocate cache struct\n");
+	       "genesys_read_calibration_v1: could not allocate cache struct\n");
 	  break;
 	}
 
@@ -6279,7 +6777,7 @@ sanei_genesys_read_calibration (Genesys_Device * dev)
 	  if ((x) < 1)							\
 	    {								\
 	      free(cache);						\
-	      DBG (DBG_warn, "sanei_genesys_read_calibration: partial calibration record\n"); \
+	      DBG (DBG_warn, "genesys_read_calibration_v1: partial calibration record\n"); \
               status=SANE_STATUS_EOF;                                   \
 	      break;							\
 	    }								\
@@ -6310,14 +6808,14 @@ sanei_genesys_read_calibration (Genesys_Device * dev)
 	  FREE_IFNOT_NULL (cache->dark_average_data);
 	  free (cache);
 	  DBG (DBG_error,
-	       "sanei_genesys_read_calibration: could not allocate space for average data\n");
+	       "genesys_read_calibration_v1: could not allocate space for average data\n");
 	  break;
 	}
 
       if (fread (cache->white_average_data, cache->average_size, 1, fp) < 1)
 	{
           status=SANE_STATUS_EOF;
-	  DBG (DBG_warn, "sanei_genesys_read_calibration: partial calibration record\n");
+	  DBG (DBG_warn, "genesys_read_calibration_v1: partial calibration record\n");
 	  free (cache->white_average_data);
 	  free (cache->dark_average_data);
 	  free (cache);
@@ -6325,7 +6823,7 @@ sanei_genesys_read_calibration (Genesys_Device * dev)
 	}
       if (fread (cache->dark_average_data, cache->average_size, 1, fp) < 1)
 	{
-	  DBG (DBG_warn, "sanei_genesys_read_calibration: partial calibration record\n");
+	  DBG (DBG_warn, "genesys_read_calibration_v1: partial calibration record\n");
 	  free (cache->white_average_data);
 	  free (cache->dark_average_data);
 	  free (cache);
@@ -6333,7 +6831,11 @@ sanei_genesys_read_calibration (Genesys_Device * dev)
 	  break;
 	}
 #undef BILT1
-      DBG (DBG_info, "sanei_genesys_read_calibration: adding record to list\n");
+      DBG (DBG_info, "genesys_read_calibration_v1: adding record to list\n");
+      cache->mapped = SANE_FALSE;
+      cache->id = dev->calib_store.next_id++;
+      genesys_calibration_key_v1 (dev, cache);
+      genesys_index_calibration (dev, cache);
       cache->next = dev->calibration_cache;
       dev->calibration_cache = cache;
     }
@@ -6343,43 +6845,366 @@ sanei_genesys_read_calibration (Genesys_Device * dev)
   return status;
 }
 
+/* gets the contents of the calibration file, mapped if possible */
+static SANE_Status
+genesys_map_calibration (Genesys_Device * dev)
+{
+  Genesys_Calibration_Store *store = &dev->calib_store;
+  struct stat st;
+  ssize_t got;
+  size_t pos;
+  int fd;
+
+  fd = open (dev->calib_file, O_RDONLY);
+  if (fd < 0)
+    {
+      DBG (DBG_info, "Calibration: Cannot open %s\n", dev->calib_file);
+      return SANE_STATUS_IO_ERROR;
+    }
+  if (fstat (fd, &st) < 0 || st.st_size <= 0)
+    {
+      close (fd);
+      return SANE_STATUS_EOF;
+    }
+  store->map_size = st.st_size;
+
+#ifdef HAVE_MMAP
+  store->map = mmap (NULL, store->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (store->map != MAP_FAILED)
+    {
+      store->mmapped = SANE_TRUE;
+      close (fd);
+      return SANE_STATUS_GOOD;
+    }
+  DBG (DBG_info, "genesys_map_calibration: mmap failed: %s\n",
+       strerror (errno));
+#endif
+
+  store->map = malloc (store->map_size);
+  if (!store->map)
+    {
+      close (fd);
+      return SANE_STATUS_NO_MEM;
+    }
+  for (pos = 0; pos < store->map_size; pos += got)
+    {
+      got = read (fd, store->map + pos, store->map_size - pos);
+      if (got <= 0)
+	break;
+    }
+  store->map_size = pos;
+  close (fd);
+  return SANE_STATUS_GOOD;
+}
+
 static void
-write_calibration (Genesys_Device * dev)
+genesys_unmap_calibration (Genesys_Calibration_Store * store)
 {
-  FILE *fp;
-  uint8_t vers = 0;
-  uint32_t size = 0;
-  struct Genesys_Calibration_Cache *cache;
+  if (!store->map)
+    return;
+#ifdef HAVE_MMAP
+  if (store->mmapped)
+    munmap (store->map, store->map_size);
+  else
+#endif
+    free (store->map);
+  store->map = NULL;
+  store->map_size = 0;
+  store->mmapped = SANE_FALSE;
+}
+
+/* frees the calibration cache entries and the file they may point into */
+static void
+genesys_free_calibration_cache (Genesys_Device * dev)
+{
+  Genesys_Calibration_Cache *cache, *next_cache;
+
+  for (cache = dev->calibration_cache; cache; cache = next_cache)
+    {
+      next_cache = cache->next;
+      if (!cache->mapped)
+	{
+	  free (cache->dark_average_data);
+	  free (cache->white_average_data);
+	}
+      free (cache);
+    }
+  dev->calibration_cache = NULL;
+  memset (dev->calib_store.index, 0, sizeof (dev->calib_store.index));
+  genesys_unmap_calibration (&dev->calib_store);
+}
+
+/**
+ * reads previously cached calibration data
+ * from file
+ */
+SANE_Status
+sanei_genesys_read_calibration (Genesys_Device * dev)
+{
+  Genesys_Calibration_Store *store = &dev->calib_store;
+  Genesys_Calibration_Header header;
+  Genesys_Calibration_Record record;
+  Genesys_Calibration_Cache *cache;
+  SANE_Status status;
+  size_t pos, data;
+  int records = 0, entries = 0;
 
   DBGSTART;
-  fp = fopen (dev->calib_file, "wb");
+  status = genesys_map_calibration (dev);
+  if (status != SANE_STATUS_GOOD)
+    {
+      DBGCOMPLETED;
+      return status;
+    }
+
+  if (store->map[0] == 1)
+    {
+      /* the next sane_close writes it in the current format */
+      genesys_unmap_calibration (store);
+      store->rewrite = SANE_TRUE;
+      status = genesys_read_calibration_v1 (dev);
+      DBGCOMPLETED;
+      return status;
+    }
+
+  /* these two checks ensure that most bad things cannot happen */
+  memset (&header, 0, sizeof (header));
+  if (store->map_size >= sizeof (header))
+    memcpy (&header, store->map, sizeof (header));
+  if (header.version != CALIBRATION_VERSION)
+    {
+      DBG (DBG_info, "Calibration: Bad version\n");
+      genesys_unmap_calibration (store);
+      store->rewrite = SANE_TRUE;
+      DBGCOMPLETED;
+      return SANE_STATUS_INVAL;
+    }
+  if (header.record_size != sizeof (Genesys_Calibration_Record))
+    {
+      DBG (DBG_info,
+	   "Calibration: Size of calibration cache struct differs\n");
+      genesys_unmap_calibration (store);
+      store->rewrite = SANE_TRUE;
+      DBGCOMPLETED;
+      return SANE_STATUS_INVAL;
+    }
+  store->hits = header.hits;
+  store->misses = header.misses;
+
+  /* the average data is used from the mapping, only the entries are
+   * allocated */
+  for (pos = sizeof (header); pos + sizeof (record) <= store->map_size;
+       pos = data + 2 * (size_t) record.average_size)
+    {
+      memcpy (&record, store->map + pos, sizeof (record));
+      data = pos + sizeof (record);
+      if (record.average_size > (store->map_size - data) / 2)
+	break;
+      records++;
+
+      for (cache = dev->calibration_cache; cache; cache = cache->next)
+	if (cache->id == record.id)
+	  break;
+      if (cache)
+	genesys_unindex_calibration (dev, cache);
+      else
+	{
+	  cache = malloc (sizeof (*cache));
+	  if (!cache)
+	    {
+	      DBG (DBG_error,
+		   "sanei_genesys_read_calibration: could not allocate cache struct\n");
+	      status = SANE_STATUS_NO_MEM;
+	      break;
+	    }
+	  memset (cache, 0, sizeof (*cache));
+	  cache->id = record.id;
+	  cache->next = dev->calibration_cache;
+	  dev->calibration_cache = cache;
+	  entries++;
+	}
+
+      memcpy (&cache->used_setup, &record.used_setup,
+	      sizeof (cache->used_setup));
+      cache->last_calibration = record.last_calibration;
+      memcpy (&cache->key, &record.key, sizeof (cache->key));
+      memcpy (&cache->frontend, &record.frontend, sizeof (cache->frontend));
+      memcpy (&cache->sensor, record.sensor, sizeof (record.sensor));
+      cache->calib_pixels = record.calib_pixels;
+      cache->calib_channels = record.calib_channels;
+      cache->average_size = record.average_size;
+      cache->white_average_data = store->map + data;
+      cache->dark_average_data = store->map + data + record.average_size;
+      cache->mapped = SANE_TRUE;
+      genesys_index_calibration (dev, cache);
+
+      if (record.id >= store->next_id)
+	store->next_id = record.id + 1;
+    }
+  if (status == SANE_STATUS_GOOD && pos != store->map_size)
+    {
+      /* appending after it would lose the records that follow */
+      DBG (DBG_warn,
+	   "sanei_genesys_read_calibration: partial calibration record\n");
+      store->rewrite = SANE_TRUE;
+      status = SANE_STATUS_EOF;
+    }
+  store->file_size = store->map_size;
+
+  DBG (DBG_info,
+       "sanei_genesys_read_calibration: %d entries from %d records, "
+       "%u hits, %u misses\n", entries, records, store->hits, store->misses);
+  DBGCOMPLETED;
+  return status;
+}
+
+static int
+genesys_write_calibration_header (Genesys_Device * dev, FILE * fp)
+{
+  Genesys_Calibration_Header header;
+
+  memset (&header, 0, sizeof (header));
+  header.version = CALIBRATION_VERSION;
+  header.record_size = sizeof (Genesys_Calibration_Record);
+  header.hits = dev->calib_store.hits;
+  header.misses = dev->calib_store.misses;
+  return fwrite (&header, sizeof (header), 1, fp) == 1 ? 0 : -1;
+}
+
+static int
+genesys_write_calibration_record (Genesys_Calibration_Cache * cache,
+				  FILE * fp)
+{
+  Genesys_Calibration_Record record;
+
+  memset (&record, 0, sizeof (record));
+  record.id = cache->id;
+  record.average_size = cache->average_size;
+  memcpy (&record.key, &cache->key, sizeof (record.key));
+  memcpy (&record.used_setup, &cache->used_setup, sizeof (record.used_setup));
+  record.last_calibration = cache->last_calibration;
+  memcpy (&record.frontend, &cache->frontend, sizeof (record.frontend));
+  memcpy (record.sensor, &cache->sensor, sizeof (record.sensor));
+  record.calib_pixels = cache->calib_pixels;
+  record.calib_channels = cache->calib_channels;
+
+  if (fwrite (&record, sizeof (record), 1, fp) != 1)
+    return -1;
+  if (cache->average_size
+      && (fwrite (cache->white_average_data, cache->average_size, 1, fp) != 1
+	  || fwrite (cache->dark_average_data, cache->average_size, 1, fp) != 1))
+    return -1;
+  return 0;
+}
+
+/* adds the record of an entry at the end of the calibration file */
+static void
+genesys_append_calibration (Genesys_Device * dev,
+			    Genesys_Calibration_Cache * cache)
+{
+  Genesys_Calibration_Store *store = &dev->calib_store;
+  FILE *fp;
+  long end;
+
+  /* written as a whole at sane_close */
+  if (store->rewrite)
+    return;
+
+  fp = fopen (dev->calib_file, "ab");
   if (!fp)
     {
-      DBG (DBG_info, "write_calibration: Cannot open %s for writing\n", dev->calib_file);
+      DBG (DBG_info, "genesys_append_calibration: Cannot open %s for writing\n",
+	   dev->calib_file);
       return;
     }
+  fseek (fp, 0, SEEK_END);
+  end = ftell (fp);
+  if ((end == 0 && genesys_write_calibration_header (dev, fp) < 0)
+      || genesys_write_calibration_record (cache, fp) < 0)
+    {
+      DBG (DBG_warn, "genesys_append_calibration: failed to write %s\n",
+	   dev->calib_file);
+      store->rewrite = SANE_TRUE;
+    }
+  store->file_size = ftell (fp);
+  fclose (fp);
+  DBG (DBG_info, "genesys_append_calibration: entry %u stored\n", cache->id);
+}
 
-  vers = CALIBRATION_VERSION;
-  fwrite (&vers, 1, 1, fp);
-  size = sizeof (struct Genesys_Calibration_Cache);
-  fwrite (&size, 4, 1, fp);
+/**
+ * brings the calibration file up to date: only the counters if the
+ * records were appended as they were made, the whole file if it has
+ * to be converted or if more than half of it is overwritten records.
+ */
+static void
+write_calibration (Genesys_Device * dev)
+{
+  Genesys_Calibration_Store *store = &dev->calib_store;
+  Genesys_Calibration_Cache *cache;
+  size_t live = sizeof (Genesys_Calibration_Header);
+  char *tmp_file;
+  FILE *fp;
+  int failed = 0;
 
+  DBGSTART;
   for (cache = dev->calibration_cache; cache; cache = cache->next)
+    live += sizeof (Genesys_Calibration_Record) + 2 * cache->average_size;
+
+  /* nothing calibrated, nothing to keep */
+  if (!store->rewrite && store->file_size == 0 && !dev->calibration_cache)
+    return;
+
+  if (!store->rewrite && store->file_size >= live
+      && store->file_size - live <= live)
     {
-      fwrite (&cache->used_setup, sizeof (cache->used_setup), 1, fp);
-      fwrite (&cache->last_calibration, sizeof (cache->last_calibration), 1, fp);
-      fwrite (&cache->frontend, sizeof (cache->frontend), 1, fp);
-      /* the gamma (and later) fields are not stored */
-      fwrite (&cache->sensor, offsetof (Genesys_Sensor, red_gamma), 1, fp);
+      fp = fopen (dev->calib_file, "r+b");
+      if (!fp)
+	{
+	  DBG (DBG_info, "write_calibration: Cannot open %s for writing\n",
+	       dev->calib_file);
+	  return;
+	}
+      genesys_write_calibration_header (dev, fp);
+      fclose (fp);
+      DBGCOMPLETED;
+      return;
+    }
+
+  /* the file may be mapped: write a new one and put it in place */
+  tmp_file = malloc (strlen (dev->calib_file) + 5);
+  if (!tmp_file)
+    return;
+  sprintf (tmp_file, "%s.new", dev->calib_file);
+  fp = fopen (tmp_file, "wb");
+  if (!fp)
+    {
+      DBG (DBG_info, "write_calibration: Cannot open %s for writing\n", tmp_file);
+      free (tmp_file);
+      return;
+    }
+
+  failed = genesys_write_calibration_header (dev, fp);
+  for (cache = dev->calibration_cache; cache && !failed; cache = cache->next)
+    if (cache->white_average_data && cache->dark_average_data)
+      failed = genesys_write_calibration_record (cache, fp);
+  if (fclose (fp) != 0)
+    failed = -1;
 
-      fwrite (&cache->calib_pixels, sizeof (cache->calib_pixels), 1, fp);
-      fwrite (&cache->calib_channels, sizeof (cache->calib_channels), 1, fp);
-      fwrite (&cache->average_size, sizeof (cache->average_size), 1, fp);
-      fwrite (cache->white_average_data, cache->average_size, 1, fp);
-      fwrite (cache->dark_average_data, cache->average_size, 1, fp);
+  if (failed || rename (tmp_file, dev->calib_file) < 0)
+    {
+      DBG (DBG_warn, "write_calibration: failed to write %s\n", tmp_file);
+      unlink (tmp_file);
+    }
+  else
+    {
+      DBG (DBG_info, "write_calibration: %lu bytes written, %lu dropped\n",
+	   (u_long) live, (u_long) (store->file_size > live
+				    ? store->file_size - live : 0));
+      store->file_size = live;
+      store->rewrite = SANE_FALSE;
     }
+  free (tmp_file);
   DBGCOMPLETED;
-  fclose (fp);
 }
 
 /** @brief buffer scanned picture
@@ -6436,6 +7261,21 @@ genesys_buffer_image(Genesys_Scanner *s)
       return SANE_STATUS_NO_MEM;
     }
 
+  /* deskew, and crop when nothing changes the image before it, look
+   * for edges in the raw image: search them while it is read */
+  sanei_magic_edgesFinish (s->edges);
+  s->edges = NULL;
+  if (s->dev->settings.dynamic_lineart == SANE_FALSE
+      && (s->val[OPT_SWDESKEW].b == SANE_TRUE
+	  || (s->val[OPT_SWCROP].b == SANE_TRUE
+	      && s->val[OPT_SWDESPECK].b == SANE_FALSE)))
+    {
+      if (sanei_magic_edgesStart (&s->params, &s->edges) != SANE_STATUS_GOOD)
+	{
+	  s->edges = NULL;
+	}
+    }
+
   /* loop reading data until we reach maximum or EOF */
   total = 0;
   while (total < maximum && status != SANE_STATUS_EOF)
@@ -6453,6 +7293,13 @@ genesys_buffer_image(Genesys_Scanner *s)
 	       sane_strstatus (status));
 	  return status;
 	}
+      if (s->edges
+	  && sanei_magic_edgesFeed (s->edges, dev->img_buffer + total, len)
+	  != SANE_STATUS_GOOD)
+	{
+	  sanei_magic_edgesFinish (s->edges);
+	  s->edges = NULL;
+	}
       total += len;
 
       /* do we need to enlarge read buffer ? */
@@ -6550,6 +7397,9 @@ sane_init (SANE_Int * version_code, SANE_Auth_Callback authorize)
   /* init sanei_magic */
   sanei_magic_init();
 
+  /* init the reader tasks used to read ahead */
+  sanei_thread_init ();
+
   DBG (DBG_info, "sane_init: %s endian machine\n",
 #ifdef WORDS_BIGENDIAN
        "big"
@@ -6592,6 +7442,9 @@ sane_exit (void)
     free (devlist);
   devlist = 0;
 
+  /* rings are freed in sane_close */
+  sanei_thread_pool_exit ();
+
   DBGCOMPLETED;
 }
 
@@ -6760,17 +7613,21 @@ sane_open (SANE_String_Const devicename, SANE_Handle * handle)
 
   s->dev = dev;
   s->scanning = SANE_FALSE;
+  s->edges = NULL;
   s->dev->read_buffer.buffer = NULL;
   s->dev->lines_buffer.buffer = NULL;
   s->dev->shrink_buffer.buffer = NULL;
   s->dev->out_buffer.buffer = NULL;
   s->dev->binarize_buffer.buffer = NULL;
   s->dev->local_buffer.buffer = NULL;
+  s->dev->read_ahead.ring = NULL;
+  s->dev->read_ahead.active = SANE_FALSE;
   s->dev->parking = SANE_FALSE;
   s->dev->read_active = SANE_FALSE;
   s->dev->white_average_data = NULL;
   s->dev->dark_average_data = NULL;
   s->dev->calibration_cache = NULL;
+  memset (&s->dev->calib_store, 0, sizeof (s->dev->calib_store));
   s->dev->calib_file = NULL;
   s->dev->img_buffer = NULL;
   s->dev->line_interp = 0;
@@ -6840,7 +7697,6 @@ void
 sane_close (SANE_Handle handle)
 {
   Genesys_Scanner *prev, *s;
-  Genesys_Calibration_Cache *cache, *next_cache;
   SANE_Status status;
   SANE_Range *range;
 
@@ -6883,21 +7739,18 @@ sane_close (SANE_Handle handle)
     
   /* here is the place to store calibration cache */
   write_calibration (s->dev);
+  genesys_free_calibration_cache (s->dev);
 
-  for (cache = s->dev->calibration_cache; cache; cache = next_cache)
-    {
-      next_cache = cache->next;
-      free (cache->dark_average_data);
-      free (cache->white_average_data);
-      free (cache);
-    }
-
+  genesys_read_ahead_stop (s->dev);
+  sanei_thread_ring_free (s->dev->read_ahead.ring);
+  s->dev->read_ahead.ring = NULL;
   sanei_genesys_buffer_free (&(s->dev->read_buffer));
   sanei_genesys_buffer_free (&(s->dev->lines_buffer));
   sanei_genesys_buffer_free (&(s->dev->shrink_buffer));
   sanei_genesys_buffer_free (&(s->dev->out_buffer));
   sanei_genesys_buffer_free (&(s->dev->binarize_buffer));
   sanei_genesys_buffer_free (&(s->dev->local_buffer));
+  sanei_magic_edgesFinish (s->edges);
   FREE_IFNOT_NULL (s->dev->white_average_data);
   FREE_IFNOT_NULL (s->dev->dark_average_data);
   FREE_IFNOT_NULL (s->dev->calib_file);
@@ -7065,17 +7918,9 @@ get_option_value (Genesys_Scanner * s, int option, void *val)
     case OPT_NEED_CALIBRATION_SW:
       /* scanner needs calibration for current mode unless a matching
        * calibration cache is found */
-      *(SANE_Bool *) val = SANE_TRUE;
-      for (cache = s->dev->calibration_cache; cache; cache = cache->next)
-	{
-	  if (s->dev->model->
-	      cmd_set->is_compatible_calibration (s->dev, cache,
-						  SANE_FALSE) ==
-	      SANE_STATUS_GOOD)
-	    {
-	      *(SANE_Bool *) val = SANE_FALSE;
-	    }
-	}
+      *(SANE_Bool *) val =
+	genesys_find_calibration (s->dev, SANE_FALSE, &cache)
+	!= SANE_STATUS_GOOD;
       break;
     default:
       DBG (DBG_warn, "get_option_value: can't get unknown option %d\n",
@@ -7093,7 +7938,6 @@ set_option_value (Genesys_Scanner * s, int option, void *val,
   SANE_Word *table;
   unsigned int i;
   SANE_Range *x_range, *y_range;
-  Genesys_Calibration_Cache *cache, *next_cache;
 
   switch (option)
     {
@@ -7379,17 +8223,11 @@ set_option_value (Genesys_Scanner * s, int option, void *val,
       break;
     case OPT_CLEAR_CALIBRATION:
       /* clear calibration cache */
-      if (s->dev->calibration_cache != NULL)
-	{
-	  for (cache = s->dev->calibration_cache; cache; cache = next_cache)
-	    {
-	      next_cache = cache->next;
-	      free (cache->dark_average_data);
-	      free (cache->white_average_data);
-	      free (cache);
-	    }
-	}
-      s->dev->calibration_cache = NULL;
+      genesys_free_calibration_cache (s->dev);
+      s->dev->calib_store.file_size = 0;
+      s->dev->calib_store.rewrite = SANE_FALSE;
+      s->dev->calib_store.hits = 0;
+      s->dev->calib_store.misses = 0;
       /* remove file */
       unlink (s->dev->calib_file);
       /* signals that sensors will have to be read again */
@@ -7556,6 +8394,7 @@ sane_start (SANE_Handle handle)
 
   RIE (calc_parameters (s));
   RIE (genesys_start_scan (s->dev, s->val[OPT_LAMP_OFF].w));
+  RIE (genesys_read_ahead_start (s->dev));
 
   s->scanning = SANE_TRUE;
 
@@ -7749,6 +8588,9 @@ sane_cancel (SANE_Handle handle)
 
   DBGSTART;
 
+  /* the reader task may be using the scanner */
+  genesys_read_ahead_stop (s->dev);
+
   /* end binary logging if needed */
   if (s->dev->binary!=NULL)
     {
@@ -48,6 +48,7 @@
 #define GENESYS_H
 
 #include "genesys_low.h"
+#include "../include/sane/sanei_magic.h"
 
 #define FREE_IFNOT_NULL(x)		if(x!=NULL) { free(x); x=NULL;}
 
@@ -141,6 +142,7 @@ typedef struct Genesys_Scanner
   Option_Value last_val[NUM_OPTIONS];	   /**< Option values as read by the frontend. used for sensors. */
   SANE_Parameters params;		   /**< SANE Parameters */
   SANE_Int bpp_list[5];			   /**< */
+  SANEI_Magic_Edges *edges;		   /**< edge search fed while buffering */
 } Genesys_Scanner;
 
 #endif /* not GENESYS_H */
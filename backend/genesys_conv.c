@@ -334,15 +334,25 @@ genesys_crop(Genesys_Scanner *s)
 
   DBG (DBG_proc, "%s: start\n", __FUNCTION__);
 
-  /* first find edges if any */
-  status = sanei_magic_findEdges (&s->params,
-				  dev->img_buffer,
-				  dev->settings.xres,
-				  dev->settings.yres,
-				  &top,
-                                  &bottom,
-                                  &left,
-                                  &right);
+  /* first find edges if any, they may have been searched while reading */
+  if (s->edges)
+    {
+      status = sanei_magic_edgesFind (s->edges,
+				      dev->settings.xres,
+				      dev->settings.yres,
+				      &top, &bottom, &left, &right);
+      sanei_magic_edgesFinish (s->edges);
+      s->edges = NULL;
+    }
+  else
+    status = sanei_magic_findEdges (&s->params,
+				    dev->img_buffer,
+				    dev->settings.xres,
+				    dev->settings.yres,
+				    &top,
+				    &bottom,
+				    &left,
+				    &right);
   if (status != SANE_STATUS_GOOD)
     {
       DBG (DBG_info, "%s: bad or no edges, bailing\n", __FUNCTION__);
@@ -389,13 +399,23 @@ genesys_deskew(Genesys_Scanner *s)
     {
       bg=0xff;
     }
-  status = sanei_magic_findSkew (&s->params,
-				 dev->img_buffer,
-				 dev->sensor.optical_res,
-				 dev->sensor.optical_res,
-                                 &x,
-                                 &y,
-                                 &slope);
+  if (s->edges)
+    {
+      status = sanei_magic_edgesSkew (s->edges,
+				      dev->sensor.optical_res,
+				      dev->sensor.optical_res,
+				      &x, &y, &slope);
+      sanei_magic_edgesFinish (s->edges);
+      s->edges = NULL;
+    }
+  else
+    status = sanei_magic_findSkew (&s->params,
+				   dev->img_buffer,
+				   dev->sensor.optical_res,
+				   dev->sensor.optical_res,
+				   &x,
+				   &y,
+				   &slope);
   if (status!=SANE_STATUS_GOOD)
     {
       DBG (DBG_error, "%s: bad findSkew, bailing\n", __FUNCTION__);
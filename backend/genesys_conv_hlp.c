@@ -343,3 +343,164 @@ FUNC_NAME(genesys_shrink_lines) (
     }
     return SANE_STATUS_GOOD;
 }
+
+/*
+ * reorder, reverse_ccd and shrink_lines in a single pass over each line:
+ * every output component is fetched straight from the raw data as the
+ * scanner sent it (planar for cis, little endian for 16 bit), so none of
+ * the intermediate buffers are needed. is_cis and is_bgr only apply to
+ * color data. ccd_shift is NULL if there is no
+ * line distance or staggering to undo; otherwise the max_shift lines
+ * following the last line must be present in src_data.
+ */
+#ifdef DOUBLE_BYTE
+#  define FUSED_GET(p) ((p)[0] | ((p)[1] << 8))
+#else
+#  define FUSED_GET(p) (*(p))
+#endif
+#define FUSED_PUT(v) \
+    do { \
+	COMPONENT_TYPE fused_val = (v); \
+	memcpy (dst, &fused_val, BYTES_PER_COMPONENT); \
+	dst += BYTES_PER_COMPONENT; \
+    } while (0)
+
+static SANE_Status 
+FUNC_NAME(genesys_fused_lines) (
+    uint8_t *src_data, 
+    uint8_t *dst_data, 
+    unsigned int lines, 
+    unsigned int src_pixels,
+    unsigned int dst_pixels, 
+    unsigned int channels,
+    unsigned int *ccd_shift,
+    unsigned int shift_count,
+    int is_cis,
+    int is_bgr) 
+{
+    unsigned int dst_x, src_x, y, c, cnt;
+    unsigned int avg[3];
+    unsigned int count;
+    unsigned int pitch = src_pixels * channels * BYTES_PER_COMPONENT;
+    unsigned int step, off;
+    unsigned int start[6];
+    uint8_t *pos[6];
+    uint8_t **q;
+    uint8_t *dst = dst_data;
+
+/* 
+ * cache efficiency:
+   the ccd shifts alternate between even and odd pixels, so all we need
+   besides the lines themselves are pointers to the components of an even
+   and of an odd pixel, 6 entries at most. each output line is written
+   once, each input component read once (except for averaging, where the
+   sum stays in registers).
+ */
+    step = is_cis ? BYTES_PER_COMPONENT : channels * BYTES_PER_COMPONENT;
+    for (c = 0; c < 2 * channels; c++) {
+	start[c] = (is_bgr ? 2 - c % channels : c % channels) 
+	    * (is_cis ? src_pixels : 1) * BYTES_PER_COMPONENT;
+	if (ccd_shift)
+	    start[c] += ccd_shift[c % shift_count] * pitch;
+    }
+
+    for(y = 0; y < lines; y++) {
+	for (c = 0; c < 2 * channels; c++)
+	    pos[c] = src_data + y * pitch + start[c];
+
+	if (src_pixels == dst_pixels && channels == 1) {
+/*copy*/
+	    for (src_x = 0, off = 0; src_x + 1 < src_pixels; src_x += 2) {
+		FUSED_PUT(FUSED_GET(pos[0] + off));
+		off += step;
+		FUSED_PUT(FUSED_GET(pos[1] + off));
+		off += step;
+	    }
+	    if (src_x < src_pixels)
+		FUSED_PUT(FUSED_GET(pos[0] + off));
+	} else if (src_pixels == dst_pixels) {
+	    for (src_x = 0, off = 0; src_x + 1 < src_pixels; src_x += 2) {
+		FUSED_PUT(FUSED_GET(pos[0] + off));
+		FUSED_PUT(FUSED_GET(pos[1] + off));
+		FUSED_PUT(FUSED_GET(pos[2] + off));
+		off += step;
+		FUSED_PUT(FUSED_GET(pos[3] + off));
+		FUSED_PUT(FUSED_GET(pos[4] + off));
+		FUSED_PUT(FUSED_GET(pos[5] + off));
+		off += step;
+	    }
+	    if (src_x < src_pixels) {
+		FUSED_PUT(FUSED_GET(pos[0] + off));
+		FUSED_PUT(FUSED_GET(pos[1] + off));
+		FUSED_PUT(FUSED_GET(pos[2] + off));
+	    }
+	} else if (src_pixels > dst_pixels && channels == 1) {
+/*average. unlike genesys_shrink_lines, every line starts at its first
+  pixel*/
+	    cnt = src_pixels / 2;
+	    src_x = 0;
+	    off = 0;
+	    for (dst_x = 0; dst_x < dst_pixels; dst_x++) {
+		count = 0;
+		avg[0] = 0;
+		while (cnt < src_pixels && src_x < src_pixels) {
+		    cnt += dst_pixels;
+		    avg[0] += FUSED_GET(pos[src_x & 1] + off);
+		    off += step;
+		    src_x++;
+		    count++;
+		}
+		cnt -= src_pixels;
+		FUSED_PUT(avg[0] / count);
+	    }
+	} else if (src_pixels > dst_pixels) {
+	    cnt = src_pixels / 2;
+	    src_x = 0;
+	    off = 0;
+	    for (dst_x = 0; dst_x < dst_pixels; dst_x++) {
+		count = 0;
+		avg[0] = avg[1] = avg[2] = 0;
+		while (cnt < src_pixels && src_x < src_pixels) {
+		    cnt += dst_pixels;
+
+		    q = pos + (src_x & 1) * 3;
+		    avg[0] += FUSED_GET(q[0] + off);
+		    avg[1] += FUSED_GET(q[1] + off);
+		    avg[2] += FUSED_GET(q[2] + off);
+		    off += step;
+		    src_x++;
+		    count++;
+		}
+		cnt -= src_pixels;
+
+		FUSED_PUT(avg[0] / count);
+		FUSED_PUT(avg[1] / count);
+		FUSED_PUT(avg[2] / count);
+	    }
+	} else {
+/*interpolate. copy pixels*/
+	    cnt = dst_pixels / 2;
+	    dst_x = 0;
+	    off = 0;
+	    for (src_x = 0; src_x < src_pixels; src_x++) {
+		q = pos + (src_x & 1) * channels;
+		for (c = 0; c < channels; c++)
+		    avg[c] = FUSED_GET(q[c] + off);
+		off += step;
+		while ((cnt < dst_pixels || src_x + 1 == src_pixels) && 
+		       dst_x < dst_pixels) {
+		    cnt += src_pixels;
+
+		    for (c = 0; c < channels; c++) 
+			FUSED_PUT(avg[c]);
+		    dst_x++;
+		}
+		cnt -= dst_pixels;
+	    }
+	}
+    }
+    return SANE_STATUS_GOOD;
+}
+
+#undef FUSED_PUT
+#undef FUSED_GET
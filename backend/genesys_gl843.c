@@ -255,6 +255,9 @@ gl843_bulk_write_register (Genesys_Device * dev, Genesys_Register_Set * reg,
   return status;
 }
 
+/* bulk-in transfers kept in flight when a read needs more than one */
+#define GL843_BULK_TRANSFERS 4
+
 static SANE_Status
 gl843_bulk_read_data (Genesys_Device * dev, uint8_t addr,
 		      uint8_t * data, size_t len)
@@ -302,6 +305,36 @@ gl843_bulk_read_data (Genesys_Device * dev, uint8_t addr,
       return status;
     }
 
+  /* the ASIC sends all LEN bytes without further commands, so queue
+     the transfers instead of leaving the bus idle between them.  Without
+     asynchronous transfers a stream gains nothing over the loop below */
+  if (len > 0xF000 && sanei_usb_stream_async (dev->dn)
+      && sanei_usb_stream_start (dev->dn, len, 0xF000,
+				 GL843_BULK_TRANSFERS) == SANE_STATUS_GOOD)
+    {
+      size = len;
+      status = sanei_usb_stream_read (dev->dn, data, &size);
+      sanei_usb_stream_stop (dev->dn);
+      if (status == SANE_STATUS_EOF)
+	{
+	  size = 0;
+	  status = SANE_STATUS_GOOD;
+	}
+      if (status != SANE_STATUS_GOOD)
+	{
+	  DBG (DBG_error,
+	       "gl843_bulk_read_data failed while streaming bulk data: %s\n",
+	       sane_strstatus (status));
+	  return status;
+	}
+      DBG (DBG_io2, "gl843_bulk_read_data streamed %lu bytes\n",
+	   (u_long) size);
+
+      /* a short transfer ends the stream, read the rest one by one */
+      len -= size;
+      data += size;
+    }
+
   while (len)
     {
       if (len > 0xF000)
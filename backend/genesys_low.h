@@ -78,6 +78,7 @@
 
 #include "../include/sane/sanei_backend.h"
 #include "../include/sane/sanei_usb.h"
+#include "../include/sane/sanei_thread.h"
 
 #include "../include/_stdint.h"
 
@@ -630,11 +631,33 @@ typedef struct Genesys_Buffer
   size_t avail;	/* data bytes currently in buffer */
 } Genesys_Buffer;
 
+/**
+ * What a calibration cache entry was made for.  Entries are indexed by
+ * it, so that only those made for the same settings are checked by the
+ * command set's is_compatible_calibration.
+ */
+typedef struct Genesys_Calibration_Key
+{
+  int32_t ccd_type;		/**> sensor of the model */
+  int32_t dac_type;		/**> analog frontend of the model */
+  int32_t xres;			/**> requested x resolution */
+  int32_t half_ccd;		/**> half ccd mode, if the chip tells */
+  int32_t channels;		/**> 3 for color, 1 otherwise */
+  int32_t scan_method;		/**> flatbed or XPA */
+} Genesys_Calibration_Key;
+
+#define GENESYS_CALIBRATION_BUCKETS 32
+
 struct Genesys_Calibration_Cache
 {
   Genesys_Current_Setup used_setup;/* used to check if entry is compatible */
   time_t last_calibration;
 
+  Genesys_Calibration_Key key;
+  uint32_t id;			/**> record id in the calibration file */
+  SANE_Bool mapped;		/**> average data points into the file mapping */
+  struct Genesys_Calibration_Cache *hash_next;
+
   Genesys_Frontend frontend;
   Genesys_Sensor sensor;
 
@@ -647,6 +670,41 @@ struct Genesys_Calibration_Cache
   struct Genesys_Calibration_Cache *next;
 };
 
+/**
+ * The calibration file as read at sane_open: records are appended to it
+ * when a calibration is saved, and it is compacted at sane_close once
+ * the records that were overwritten take more room than the live ones.
+ */
+typedef struct
+{
+  uint8_t *map;			/**> file contents, NULL if none */
+  size_t map_size;
+  SANE_Bool mmapped;		/**> map comes from mmap(), not malloc() */
+  size_t file_size;		/**> bytes in the file, appends included */
+  SANE_Bool rewrite;		/**> file unusable or old, rewrite at close */
+  uint32_t next_id;
+  uint32_t hits;		/**> scans that used a cached calibration */
+  uint32_t misses;		/**> scans that found none */
+  Genesys_Calibration_Cache *index[GENESYS_CALIBRATION_BUCKETS];
+} Genesys_Calibration_Store;
+
+/**
+ * Reading ahead: during a scan, a reader task moves the data from the
+ * scanner into a ring while the frontend works on earlier data.
+ */
+typedef struct
+{
+  SANEI_Thread_Ring *ring;	/**> kept across scans, NULL if not used yet */
+  size_t size;			/**> bytes the ring holds */
+  SANE_Bool active;		/**> the reader task runs for this scan */
+  size_t left;			/**> bytes the task has still to read */
+  unsigned long reads;		/**> times read_buffer was filled from the ring */
+  unsigned long empty;		/**> ... and found it empty */
+  unsigned long full;		/**> times the task found the ring full */
+  size_t fill_sum;		/**> bytes in the ring, summed over reads */
+  size_t fill_max;		/**> most bytes seen in the ring */
+} Genesys_Read_Ahead;
+
 /**
  * Describes the current device status for the backend
  * session. This should be more accurately called
@@ -700,6 +758,7 @@ struct Genesys_Device
   Genesys_Buffer local_buffer;    /**> local buffer for gray data during dynamix lineart */
 
   size_t read_bytes_left;	/**> bytes to read from scanner */
+  Genesys_Read_Ahead read_ahead;
 
   size_t total_bytes_read;	/**> total bytes read sent to frontend */
   size_t total_bytes_to_read;	/**> total bytes read to be sent to frontend */
@@ -711,6 +770,7 @@ struct Genesys_Device
   unsigned char lineart_lut[256];
 
   Genesys_Calibration_Cache *calibration_cache;
+  Genesys_Calibration_Store calib_store;
 
   struct Genesys_Device *next;
 
@@ -65,6 +65,12 @@
 
 #define TUNE_CALIBRATOR
 
+/* Keep image samples in 16 bit instead of unsigned int, halves the memory
+   of the line buffers at high resolutions */
+#if 0
+#define GT68XX_16BIT_SAMPLES
+#endif
+
 /* Send coarse white or black calibration to stdout */
 #if 0
 #define SAVE_WHITE_CALIBRATION
@@ -1098,7 +1104,7 @@ sane_init (SANE_Int * version_code, SANE_Auth_Callback authorize)
   SANE_Char line[PATH_MAX];
   SANE_Char *word;
   SANE_String_Const cp;
-  SANE_Int linenumber;
+  SANE_Int linenumber, unpack;
   FILE *fp;
 
   DBG_INIT ();
@@ -1112,6 +1118,13 @@ sane_init (SANE_Int * version_code, SANE_Auth_Callback authorize)
 
   sanei_usb_init ();
 
+  unpack = gt68xx_unpack_init ();
+  DBG (5, "sane_init: unpacking with%s%s%s%s, %d bit samples\n",
+       (unpack & GT68XX_UNPACK_USE_SSE2) ? " SSE2" : "",
+       (unpack & GT68XX_UNPACK_USE_AVX2) ? " AVX2" : "",
+       (unpack & GT68XX_UNPACK_USE_NEON) ? " NEON" : "",
+       unpack ? "" : " plain C", (int) sizeof (GT68xx_Sample) * 8);
+
   num_devices = 0;
   first_dev = 0;
   first_handle = 0;
@@ -1873,7 +1886,7 @@ sane_start (SANE_Handle handle)
   GT68xx_Scan_Parameters scan_params;
   SANE_Status status;
   SANE_Int i, gamma_size;
-  unsigned int *buffer_pointers[3];
+  GT68xx_Sample *buffer_pointers[3];
   SANE_Bool document;
 
   DBG (5, "sane_start: start\n");
@@ -2045,7 +2058,7 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len,
 {
   GT68xx_Scanner *s = handle;
   SANE_Status status;
-  static unsigned int *buffer_pointers[3];
+  static GT68xx_Sample *buffer_pointers[3];
   SANE_Int inflate_x;
   SANE_Bool lineart;
   SANE_Int i, color, colors;
@@ -2133,7 +2146,7 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len,
           /* mirror lines */
           if (s->dev->model->flags & GT68XX_FLAG_MIRROR_X)
             {
-              unsigned int swap;
+              GT68xx_Sample swap;
 
               for (color = 0; color < colors; color++)
                 {
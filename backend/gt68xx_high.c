@@ -47,6 +47,7 @@
 
 #include "gt68xx_high.h"
 #include "gt68xx_mid.c"
+#include "gt68xx_shading.c"
 
 #include <unistd.h>
 #include <math.h>
@@ -82,6 +83,7 @@ gt68xx_calibrator_new (SANE_Int width,
 
   cal->k_white = NULL;
   cal->k_black = NULL;
+  cal->k_factor = NULL;
   cal->white_line = NULL;
   cal->black_line = NULL;
   cal->width = width;
@@ -94,10 +96,12 @@ gt68xx_calibrator_new (SANE_Int width,
 
   cal->k_white = (unsigned int *) malloc (width * sizeof (unsigned int));
   cal->k_black = (unsigned int *) malloc (width * sizeof (unsigned int));
+  cal->k_factor = (uint64_t *) malloc (width * sizeof (uint64_t));
   cal->white_line = (double *) malloc (width * sizeof (double));
   cal->black_line = (double *) malloc (width * sizeof (double));
 
-  if (!cal->k_white || !cal->k_black | !cal->white_line || !cal->black_line)
+  if (!cal->k_white || !cal->k_black | !cal->k_factor || !cal->white_line
+      || !cal->black_line)
     {
       DBG (5, "gt68xx_calibrator_new: no memory for calibration data\n");
       gt68xx_calibrator_free (cal);
@@ -108,6 +112,7 @@ gt68xx_calibrator_new (SANE_Int width,
     {
       cal->k_white[i] = 0;
       cal->k_black[i] = 0;
+      cal->k_factor[i] = 0;
       cal->white_line[i] = 0.0;
       cal->black_line[i] = 0.0;
     }
@@ -145,6 +150,12 @@ gt68xx_calibrator_free (GT68xx_Calibrator * cal)
       cal->k_black = NULL;
     }
 
+  if (cal->k_factor)
+    {
+      free (cal->k_factor);
+      cal->k_factor = NULL;
+    }
+
   if (cal->white_line)
     {
       free (cal->white_line);
@@ -164,7 +175,8 @@ gt68xx_calibrator_free (GT68xx_Calibrator * cal)
 }
 
 SANE_Status
-gt68xx_calibrator_add_white_line (GT68xx_Calibrator * cal, unsigned int *line)
+gt68xx_calibrator_add_white_line (GT68xx_Calibrator * cal,
+				  GT68xx_Sample * line)
 {
   SANE_Int i;
   SANE_Int width = cal->width;
@@ -209,7 +221,8 @@ gt68xx_calibrator_eval_white (GT68xx_Calibrator * cal, double factor)
 }
 
 SANE_Status
-gt68xx_calibrator_add_black_line (GT68xx_Calibrator * cal, unsigned int *line)
+gt68xx_calibrator_add_black_line (GT68xx_Calibrator * cal,
+				  GT68xx_Sample * line)
 {
   SANE_Int i;
   SANE_Int width = cal->width;
@@ -273,6 +286,8 @@ gt68xx_calibrator_finish_setup (GT68xx_Calibrator * cal)
 #endif /* TUNE_CALIBRATOR */
     }
 
+  gt68xx_calibrator_update_factors (cal);
+
 #ifdef TUNE_CALIBRATOR
   ave_black /= width;
   ave_diff /= width;
@@ -284,40 +299,31 @@ gt68xx_calibrator_finish_setup (GT68xx_Calibrator * cal)
 }
 
 SANE_Status
-gt68xx_calibrator_process_line (GT68xx_Calibrator * cal, unsigned int *line)
+gt68xx_calibrator_update_factors (GT68xx_Calibrator * cal)
 {
-  int i;
-  int width = cal->width;
-  unsigned int white_level = cal->white_level;
+  if (cal->white_level <= 65535)
+    gt68xx_shading_factors (cal->k_factor, cal->k_white, cal->width,
+			    cal->white_level);
+  return SANE_STATUS_GOOD;
+}
 
-  for (i = 0; i < width; ++i)
-    {
-      unsigned int src_value = line[i];
-      unsigned int black = cal->k_black[i];
-      unsigned int value;
+SANE_Status
+gt68xx_calibrator_process_line (GT68xx_Calibrator * cal,
+				GT68xx_Sample * line)
+{
+  int min_clip = 0, max_clip = 0;
+
+  if (cal->white_level <= 65535)
+    gt68xx_shading_line (line, cal->k_black, cal->k_factor, cal->width,
+			 &min_clip, &max_clip);
+  else
+    gt68xx_shading_line_div (line, cal->k_black, cal->k_white, cal->width,
+			     cal->white_level, &min_clip, &max_clip);
 
-      if (src_value > black)
-	{
-	  value = (src_value - black) * white_level / cal->k_white[i];
-	  if (value > 0xffff)
-	    {
-	      value = 0xffff;
-#ifdef TUNE_CALIBRATOR
-	      cal->max_clip_count++;
-#endif /* TUNE_CALIBRATOR */
-	    }
-	}
-      else
-	{
-	  value = 0;
 #ifdef TUNE_CALIBRATOR
-	  if (src_value < black)
-	    cal->min_clip_count++;
+  cal->min_clip_count += min_clip;
+  cal->max_clip_count += max_clip;
 #endif /* TUNE_CALIBRATOR */
-	}
-
-      line[i] = value;
-    }
 
   return SANE_STATUS_GOOD;
 }
@@ -650,7 +656,7 @@ gt68xx_scanner_create_gray_calibrators (GT68xx_Scanner * scanner,
 
 static SANE_Status
 gt68xx_scanner_calibrate_color_white_line (GT68xx_Scanner * scanner,
-					   unsigned int **buffer_pointers)
+					   GT68xx_Sample ** buffer_pointers)
 {
 
   gt68xx_calibrator_add_white_line (scanner->cal_r, buffer_pointers[0]);
@@ -662,7 +668,7 @@ gt68xx_scanner_calibrate_color_white_line (GT68xx_Scanner * scanner,
 
 static SANE_Status
 gt68xx_scanner_calibrate_gray_white_line (GT68xx_Scanner * scanner,
-					  unsigned int **buffer_pointers)
+					  GT68xx_Sample ** buffer_pointers)
 {
   gt68xx_calibrator_add_white_line (scanner->cal_gray, buffer_pointers[0]);
   return SANE_STATUS_GOOD;
@@ -670,7 +676,7 @@ gt68xx_scanner_calibrate_gray_white_line (GT68xx_Scanner * scanner,
 
 static SANE_Status
 gt68xx_scanner_calibrate_color_black_line (GT68xx_Scanner * scanner,
-					   unsigned int **buffer_pointers)
+					   GT68xx_Sample ** buffer_pointers)
 {
   gt68xx_calibrator_add_black_line (scanner->cal_r, buffer_pointers[0]);
   gt68xx_calibrator_add_black_line (scanner->cal_g, buffer_pointers[1]);
@@ -681,7 +687,7 @@ gt68xx_scanner_calibrate_color_black_line (GT68xx_Scanner * scanner,
 
 static SANE_Status
 gt68xx_scanner_calibrate_gray_black_line (GT68xx_Scanner * scanner,
-					  unsigned int **buffer_pointers)
+					  GT68xx_Sample ** buffer_pointers)
 {
   gt68xx_calibrator_add_black_line (scanner->cal_gray, buffer_pointers[0]);
   return SANE_STATUS_GOOD;
@@ -695,7 +701,7 @@ gt68xx_scanner_calibrate (GT68xx_Scanner * scanner,
   GT68xx_Scan_Parameters params;
   GT68xx_Scan_Request req;
   SANE_Int i;
-  unsigned int *buffer_pointers[3];
+  GT68xx_Sample *buffer_pointers[3];
   GT68xx_AFE_Parameters *afe = scanner->dev->afe;
   GT68xx_Exposure_Parameters *exposure = scanner->dev->exposure;
 
@@ -924,7 +930,7 @@ gt68xx_scanner_start_scan (GT68xx_Scanner * scanner,
 
 SANE_Status
 gt68xx_scanner_read_line (GT68xx_Scanner * scanner,
-			  unsigned int **buffer_pointers)
+			  GT68xx_Sample ** buffer_pointers)
 {
   SANE_Status status;
 
@@ -1023,7 +1029,7 @@ struct GT68xx_Afe_Values
  * @param buffer scanned line
  */
 static void
-gt68xx_afe_ccd_calc (GT68xx_Afe_Values * values, unsigned int *buffer)
+gt68xx_afe_ccd_calc (GT68xx_Afe_Values * values, GT68xx_Sample * buffer)
 {
   SANE_Int start_black;
   SANE_Int end_black;
@@ -1092,7 +1098,7 @@ gt68xx_afe_ccd_calc (GT68xx_Afe_Values * values, unsigned int *buffer)
 static SANE_Bool
 gt68xx_afe_ccd_adjust_offset_gain (SANE_String_Const color_name,
 				   GT68xx_Afe_Values * values,
-				   unsigned int *buffer, SANE_Byte * offset,
+				   GT68xx_Sample * buffer, SANE_Byte * offset,
 				   SANE_Byte * pga, SANE_Byte * old_offset,
 				   SANE_Byte * old_pga)
 {
@@ -1192,7 +1198,7 @@ static SANE_Status
 gt68xx_wait_lamp_stable (GT68xx_Scanner * scanner, 
 			 GT68xx_Scan_Parameters * params,
 			 GT68xx_Scan_Request *request,
-			 unsigned int *buffer_pointers[3],
+			 GT68xx_Sample * buffer_pointers[3],
 			 GT68xx_Afe_Values *values,
 			 SANE_Bool dont_move)
 {
@@ -1302,7 +1308,7 @@ gt68xx_afe_ccd_auto (GT68xx_Scanner * scanner,
   GT68xx_Scan_Request request;
   int i;
   GT68xx_Afe_Values values;
-  unsigned int *buffer_pointers[3];
+  GT68xx_Sample *buffer_pointers[3];
   GT68xx_AFE_Parameters *afe = scanner->dev->afe, old_afe;
   SANE_Bool gray_done = SANE_FALSE;
   SANE_Bool red_done = SANE_FALSE, green_done = SANE_FALSE, blue_done =
@@ -1490,7 +1496,7 @@ gt68xx_afe_ccd_auto (GT68xx_Scanner * scanner,
 
 static void
 gt68xx_afe_cis_calc_black (GT68xx_Afe_Values * values,
-			   unsigned int *black_buffer)
+			   GT68xx_Sample * black_buffer)
 {
   SANE_Int start_black;
   SANE_Int end_black;
@@ -1521,7 +1527,7 @@ gt68xx_afe_cis_calc_black (GT68xx_Afe_Values * values,
 
 static void
 gt68xx_afe_cis_calc_white (GT68xx_Afe_Values * values,
-			   unsigned int *white_buffer)
+			   GT68xx_Sample * white_buffer)
 {
   SANE_Int start_white;
   SANE_Int end_white;
@@ -1555,8 +1561,8 @@ gt68xx_afe_cis_calc_white (GT68xx_Afe_Values * values,
 static SANE_Bool
 gt68xx_afe_cis_adjust_gain_offset (SANE_String_Const color_name,
 				   GT68xx_Afe_Values * values,
-				   unsigned int *black_buffer,
-				   unsigned int *white_buffer,
+				   GT68xx_Sample * black_buffer,
+				   GT68xx_Sample * white_buffer,
 				   GT68xx_AFE_Parameters * afe,
 				   GT68xx_AFE_Parameters * old_afe)
 {
@@ -1683,7 +1689,7 @@ finish:
 static SANE_Bool
 gt68xx_afe_cis_adjust_exposure (SANE_String_Const color_name,
 				GT68xx_Afe_Values * values,
-				unsigned int *white_buffer, SANE_Int border,
+				GT68xx_Sample * white_buffer, SANE_Int border,
 				SANE_Int * exposure_time)
 {
   SANE_Int exposure_change = 0;
@@ -1719,12 +1725,12 @@ gt68xx_afe_cis_adjust_exposure (SANE_String_Const color_name,
 static SANE_Status
 gt68xx_afe_cis_read_lines (GT68xx_Afe_Values * values,
 			   GT68xx_Scanner * scanner, SANE_Bool lamp,
-			   SANE_Bool first, unsigned int *r_buffer,
-			   unsigned int *g_buffer, unsigned int *b_buffer)
+			   SANE_Bool first, GT68xx_Sample * r_buffer,
+			   GT68xx_Sample * g_buffer, GT68xx_Sample * b_buffer)
 {
   SANE_Status status;
   int line;
-  unsigned int *buffer_pointers[3];
+  GT68xx_Sample *buffer_pointers[3];
   GT68xx_Scan_Request request;
   GT68xx_Scan_Parameters params;
 
@@ -1814,11 +1820,11 @@ gt68xx_afe_cis_read_lines (GT68xx_Afe_Values * values,
 	    return status;
 	  }
 	memcpy (r_buffer + values->calwidth * line, buffer_pointers[0],
-		values->calwidth * sizeof (unsigned int));
+		values->calwidth * sizeof (GT68xx_Sample));
 	memcpy (g_buffer + values->calwidth * line, buffer_pointers[1],
-		values->calwidth * sizeof (unsigned int));
+		values->calwidth * sizeof (GT68xx_Sample));
 	memcpy (b_buffer + values->calwidth * line, buffer_pointers[2],
-		values->calwidth * sizeof (unsigned int));
+		values->calwidth * sizeof (GT68xx_Sample));
       }
 
   status = gt68xx_scanner_stop_scan (scanner);
@@ -1843,8 +1849,8 @@ gt68xx_afe_cis_auto (GT68xx_Scanner * scanner)
   GT68xx_Exposure_Parameters *exposure = scanner->dev->exposure;
   SANE_Int red_done, green_done, blue_done;
   SANE_Bool first = SANE_TRUE;
-  unsigned int *r_gbuffer = 0, *g_gbuffer = 0, *b_gbuffer = 0;
-  unsigned int *r_obuffer = 0, *g_obuffer = 0, *b_obuffer = 0;
+  GT68xx_Sample *r_gbuffer = 0, *g_gbuffer = 0, *b_gbuffer = 0;
+  GT68xx_Sample *r_obuffer = 0, *g_obuffer = 0, *b_obuffer = 0;
 
   DBG (5, "gt68xx_afe_cis_auto: start\n");
 
@@ -1858,17 +1864,17 @@ gt68xx_afe_cis_auto (GT68xx_Scanner * scanner)
 				  r_gbuffer, g_gbuffer, b_gbuffer));
 
   r_gbuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (GT68xx_Sample));
   g_gbuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (GT68xx_Sample));
   b_gbuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (GT68xx_Sample));
   r_obuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (GT68xx_Sample));
   g_obuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (GT68xx_Sample));
   b_obuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (GT68xx_Sample));
   if (!r_gbuffer || !g_gbuffer || !b_gbuffer || !r_obuffer || !g_obuffer
       || !b_obuffer)
     return SANE_STATUS_NO_MEM;
@@ -2003,6 +2009,7 @@ gt68xx_calibrator_create_copy (GT68xx_Calibrator ** calibrator,
       (*calibrator)->white_line[i]=reference->white_line[i+offset];
       (*calibrator)->black_line[i]=reference->black_line[i+offset];
     }
+  gt68xx_calibrator_update_factors (*calibrator);
 
   return status;
 }
@@ -2043,7 +2050,7 @@ gt68xx_sheetfed_scanner_calibrate (GT68xx_Scanner * scanner)
   GT68xx_Scan_Request request;
   GT68xx_Scan_Parameters params;
   int count, i, x, y, white;
-  unsigned int *buffer_pointers[3];
+  GT68xx_Sample *buffer_pointers[3];
 #ifdef DEBUG_CALIBRATION
   FILE *fcal;
   char title[50];
@@ -2686,6 +2693,7 @@ gt68xx_read_calibration (GT68xx_Scanner * scanner)
 	     fcal);
       fread (scanner->calibrations[i].red->black_line, sizeof (double), width,
 	     fcal);
+      gt68xx_calibrator_update_factors (scanner->calibrations[i].red);
 
       fread (&width, sizeof (SANE_Int), 1, fcal);
       fread (&level, sizeof (SANE_Int), 1, fcal);
@@ -2698,6 +2706,7 @@ gt68xx_read_calibration (GT68xx_Scanner * scanner)
 	     width, fcal);
       fread (scanner->calibrations[i].green->black_line, sizeof (double),
 	     width, fcal);
+      gt68xx_calibrator_update_factors (scanner->calibrations[i].green);
 
       fread (&width, sizeof (SANE_Int), 1, fcal);
       fread (&level, sizeof (SANE_Int), 1, fcal);
@@ -2710,6 +2719,7 @@ gt68xx_read_calibration (GT68xx_Scanner * scanner)
 	     width, fcal);
       fread (scanner->calibrations[i].blue->black_line, sizeof (double),
 	     width, fcal);
+      gt68xx_calibrator_update_factors (scanner->calibrations[i].blue);
 
       fread (&width, sizeof (SANE_Int), 1, fcal);
       if (width > 0)
@@ -2725,6 +2735,7 @@ gt68xx_read_calibration (GT68xx_Scanner * scanner)
 		 width, fcal);
 	  fread (scanner->calibrations[i].gray->black_line, sizeof (double),
 		 width, fcal);
+	  gt68xx_calibrator_update_factors (scanner->calibrations[i].gray);
 	}
       /* prepare for nex resolution */
       i++;
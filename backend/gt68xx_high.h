@@ -57,6 +57,7 @@ struct GT68xx_Calibrator
 {
   unsigned int *k_white;	/**< White point vector */
   unsigned int *k_black;	/**< Black point vector */
+  uint64_t *k_factor;		/**< white_level * 2^32 / k_white */
 
   double *white_line;		/**< White average */
   double *black_line;		/**< Black average */
@@ -122,7 +123,7 @@ static SANE_Status gt68xx_calibrator_free (GT68xx_Calibrator * cal);
  */
 static SANE_Status
 gt68xx_calibrator_add_white_line (GT68xx_Calibrator * cal,
-				  unsigned int *line);
+				  GT68xx_Sample * line);
 
 /** Calculate the white point for the calibrator.
  *
@@ -152,7 +153,7 @@ gt68xx_calibrator_eval_white (GT68xx_Calibrator * cal, double factor);
  */
 static SANE_Status
 gt68xx_calibrator_add_black_line (GT68xx_Calibrator * cal,
-				  unsigned int *line);
+				  GT68xx_Sample * line);
 
 /** Calculate the black point for the calibrator.
  *
@@ -181,6 +182,18 @@ gt68xx_calibrator_eval_black (GT68xx_Calibrator * cal, double factor);
  */
 static SANE_Status gt68xx_calibrator_finish_setup (GT68xx_Calibrator * cal);
 
+/** Compute the multipliers used by gt68xx_calibrator_process_line().
+ *
+ * Done by gt68xx_calibrator_finish_setup(); must be called again
+ * whenever k_white is set in another way.
+ *
+ * @param cal Calibrator object.
+ *
+ * @return
+ * - #SANE_STATUS_GOOD - the multipliers are computed.
+ */
+static SANE_Status gt68xx_calibrator_update_factors (GT68xx_Calibrator * cal);
+
 /** Process the image line through the calibrator.
  *
  * This function must be called only after gt68xx_calibrator_finish_setup().
@@ -193,7 +206,8 @@ static SANE_Status gt68xx_calibrator_finish_setup (GT68xx_Calibrator * cal);
  * - #SANE_STATUS_GOOD - the image line was processed successfully.
  */
 static SANE_Status
-gt68xx_calibrator_process_line (GT68xx_Calibrator * cal, unsigned int *line);
+gt68xx_calibrator_process_line (GT68xx_Calibrator * cal,
+				GT68xx_Sample * line);
 
 /** List of SANE options
  */
@@ -339,7 +353,7 @@ gt68xx_scanner_start_scan (GT68xx_Scanner * scanner,
  */
 static SANE_Status
 gt68xx_scanner_read_line (GT68xx_Scanner * scanner,
-			  unsigned int **buffer_pointers);
+			  GT68xx_Sample ** buffer_pointers);
 
 /** Stop scanning the image.
  *
@@ -44,6 +44,7 @@
 
 #include "gt68xx_mid.h"
 #include "gt68xx_low.c"
+#include "gt68xx_unpack.c"
 
 /** @file
  * @brief Image data unpacking.
@@ -69,7 +70,7 @@ gt68xx_delay_buffer_init (GT68xx_Delay_Buffer * delay,
       return SANE_STATUS_INVAL;
     }
 
-  bytes_per_line = pixels_per_line * sizeof (unsigned int);
+  bytes_per_line = pixels_per_line * sizeof (GT68xx_Sample);
 
   delay->line_count = line_count = delay_count + 1;
   delay->read_index = 0;
@@ -86,7 +87,7 @@ gt68xx_delay_buffer_init (GT68xx_Delay_Buffer * delay,
     delay->mem_block[i] = i % 256;
 
   delay->lines =
-    (unsigned int **) malloc (sizeof (unsigned int *) * line_count);
+    (GT68xx_Sample **) malloc (sizeof (GT68xx_Sample *) * line_count);
   if (!delay->lines)
     {
       free (delay->mem_block);
@@ -97,7 +98,7 @@ gt68xx_delay_buffer_init (GT68xx_Delay_Buffer * delay,
 
   for (i = 0; i < line_count; ++i)
     delay->lines[i] =
-      (unsigned int *) (delay->mem_block + i * bytes_per_line);
+      (GT68xx_Sample *) (delay->mem_block + i * bytes_per_line);
 
   return SANE_STATUS_GOOD;
 }
@@ -136,95 +137,13 @@ gt68xx_delay_buffer_done (GT68xx_Delay_Buffer * delay)
    while (SANE_FALSE)
 
 
-static inline void
-unpack_8_mono (SANE_Byte * src, unsigned int *dst, SANE_Int pixels_per_line)
-{
-  for (; pixels_per_line > 0; ++src, ++dst, --pixels_per_line)
-    {
-      *dst = (((unsigned int) *src) << 8) | *src;
-    }
-}
-
-static inline void
-unpack_8_rgb (SANE_Byte * src, unsigned int *dst, SANE_Int pixels_per_line)
-{
-  for (; pixels_per_line > 0; src += 3, ++dst, --pixels_per_line)
-    {
-      *dst = (((unsigned int) *src) << 8) | *src;
-    }
-}
-
-/* 12-bit routines use the fact that pixels_per_line is aligned */
-
-static inline void
-unpack_12_le_mono (SANE_Byte * src, unsigned int *dst,
-		   SANE_Int pixels_per_line)
-{
-  for (; pixels_per_line > 0; src += 3, dst += 2, pixels_per_line -= 2)
-    {
-      dst[0] = ((((unsigned int) (src[1] & 0x0f)) << 12)
-		| (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
-      dst[1] = ((((unsigned int) src[2]) << 8)
-		| (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
-    }
-}
-
-static inline void
-unpack_12_le_rgb (SANE_Byte * src,
-		  unsigned int *dst1,
-		  unsigned int *dst2,
-		  unsigned int *dst3, SANE_Int pixels_per_line)
-{
-  for (; pixels_per_line > 0; pixels_per_line -= 2)
-    {
-      *dst1++ = ((((unsigned int) (src[1] & 0x0f)) << 12)
-		 | (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
-      *dst2++ = ((((unsigned int) src[2]) << 8)
-		 | (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
-      src += 3;
-
-      *dst3++ = ((((unsigned int) (src[1] & 0x0f)) << 12)
-		 | (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
-      *dst1++ = ((((unsigned int) src[2]) << 8)
-		 | (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
-      src += 3;
-
-      *dst2++ = ((((unsigned int) (src[1] & 0x0f)) << 12)
-		 | (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
-      *dst3++ = ((((unsigned int) src[2]) << 8)
-		 | (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
-      src += 3;
-    }
-}
-
-static inline void
-unpack_16_le_mono (SANE_Byte * src, unsigned int *dst,
-		   SANE_Int pixels_per_line)
-{
-  for (; pixels_per_line > 0; src += 2, dst++, --pixels_per_line)
-    {
-      *dst = (((unsigned int) src[1]) << 8) | src[0];
-    }
-}
-
-static inline void
-unpack_16_le_rgb (SANE_Byte * src, unsigned int *dst,
-		  SANE_Int pixels_per_line)
-{
-  for (; pixels_per_line > 0; src += 6, ++dst, --pixels_per_line)
-    {
-      *dst = (((unsigned int) src[1]) << 8) | src[0];
-    }
-}
-
-
 static SANE_Status
 line_read_gray_8 (GT68xx_Line_Reader * reader,
-		  unsigned int **buffer_pointers_return)
+		  GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  GT68xx_Sample *buffer;
 
   size = reader->params.scan_bpl;
 
@@ -239,11 +158,11 @@ line_read_gray_8 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_gray_double_8 (GT68xx_Line_Reader * reader,
-			 unsigned int **buffer_pointers_return)
+			 GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  GT68xx_Sample *buffer;
   int i;
 
   size = reader->params.scan_bpl;
@@ -265,11 +184,11 @@ line_read_gray_double_8 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_gray_12 (GT68xx_Line_Reader * reader,
-		   unsigned int **buffer_pointers_return)
+		   GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  GT68xx_Sample *buffer;
 
   size = reader->params.scan_bpl;
   RIE (gt68xx_device_read (reader->dev, reader->pixel_buffer, &size));
@@ -283,11 +202,11 @@ line_read_gray_12 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_gray_double_12 (GT68xx_Line_Reader * reader,
-			  unsigned int **buffer_pointers_return)
+			  GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  GT68xx_Sample *buffer;
   int i;
 
   size = reader->params.scan_bpl;
@@ -309,11 +228,11 @@ line_read_gray_double_12 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_gray_16 (GT68xx_Line_Reader * reader,
-		   unsigned int **buffer_pointers_return)
+		   GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  GT68xx_Sample *buffer;
 
   size = reader->params.scan_bpl;
   RIE (gt68xx_device_read (reader->dev, reader->pixel_buffer, &size));
@@ -327,11 +246,11 @@ line_read_gray_16 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_gray_double_16 (GT68xx_Line_Reader * reader,
-			  unsigned int **buffer_pointers_return)
+			  GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  GT68xx_Sample *buffer;
   int i;
 
   size = reader->params.scan_bpl;
@@ -354,7 +273,7 @@ line_read_gray_double_16 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_8_line_mode (GT68xx_Line_Reader * reader,
-			   unsigned int **buffer_pointers_return)
+			   GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -388,7 +307,7 @@ line_read_rgb_8_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_double_8_line_mode (GT68xx_Line_Reader * reader,
-				  unsigned int **buffer_pointers_return)
+				  GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -434,7 +353,7 @@ line_read_rgb_double_8_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_8_line_mode (GT68xx_Line_Reader * reader,
-			   unsigned int **buffer_pointers_return)
+			   GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -467,7 +386,7 @@ line_read_bgr_8_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_12_line_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -503,7 +422,7 @@ line_read_rgb_12_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_double_12_line_mode (GT68xx_Line_Reader * reader,
-				   unsigned int **buffer_pointers_return)
+				   GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -552,7 +471,7 @@ line_read_rgb_double_12_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_16_line_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -588,7 +507,7 @@ line_read_rgb_16_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_double_16_line_mode (GT68xx_Line_Reader * reader,
-				   unsigned int **buffer_pointers_return)
+				   GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -637,7 +556,7 @@ line_read_rgb_double_16_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_12_line_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -673,7 +592,7 @@ line_read_bgr_12_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_16_line_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -709,7 +628,7 @@ line_read_bgr_16_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_8_pixel_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -743,7 +662,7 @@ line_read_rgb_8_pixel_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_12_pixel_mode (GT68xx_Line_Reader * reader,
-			     unsigned int **buffer_pointers_return)
+			     GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -771,7 +690,7 @@ line_read_rgb_12_pixel_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_16_pixel_mode (GT68xx_Line_Reader * reader,
-			     unsigned int **buffer_pointers_return)
+			     GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -807,7 +726,7 @@ line_read_rgb_16_pixel_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_8_pixel_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -841,7 +760,7 @@ line_read_bgr_8_pixel_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_12_pixel_mode (GT68xx_Line_Reader * reader,
-			     unsigned int **buffer_pointers_return)
+			     GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -869,7 +788,7 @@ line_read_bgr_12_pixel_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_16_pixel_mode (GT68xx_Line_Reader * reader,
-			     unsigned int **buffer_pointers_return)
+			     GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -1174,7 +1093,7 @@ gt68xx_line_reader_free (GT68xx_Line_Reader * reader)
 
 SANE_Status
 gt68xx_line_reader_read (GT68xx_Line_Reader * reader,
-			 unsigned int **buffer_pointers_return)
+			 GT68xx_Sample ** buffer_pointers_return)
 {
   SANE_Status status;
 
@@ -51,6 +51,19 @@
 #include "gt68xx_low.h"
 #include "../include/sane/sane.h"
 
+/**
+ * Type of the image samples, from unpacking to sane_read().
+ *
+ * The samples are scaled to 16 bit.  With GT68XX_16BIT_SAMPLES defined they
+ * are also stored in 16 bit, which halves the memory taken by the delay
+ * buffers and the calibration lines.
+ */
+#ifdef GT68XX_16BIT_SAMPLES
+typedef uint16_t GT68xx_Sample;
+#else
+typedef unsigned int GT68xx_Sample;
+#endif
+
 typedef struct GT68xx_Delay_Buffer GT68xx_Delay_Buffer;
 typedef struct GT68xx_Line_Reader GT68xx_Line_Reader;
 
@@ -59,7 +72,7 @@ struct GT68xx_Delay_Buffer
   SANE_Int line_count;
   SANE_Int read_index;
   SANE_Int write_index;
-  unsigned int **lines;
+  GT68xx_Sample **lines;
   SANE_Byte *mem_block;
 };
 
@@ -68,7 +81,7 @@ struct GT68xx_Delay_Buffer
  *
  * This object handles reading the image data from the scanner line by line and
  * converting it to internal format.  Internally each image sample is
- * represented as <code>unsigned int</code> value, scaled to 16-bit range
+ * represented as #GT68xx_Sample value, scaled to 16-bit range
  * (0-65535).  For color images the data for each primary color is stored as
  * separate lines.
  */
@@ -96,7 +109,7 @@ struct GT68xx_Line_Reader
   SANE_Bool delays_initialized;
 
     SANE_Status (*read) (GT68xx_Line_Reader * reader,
-			 unsigned int **buffer_pointers_return);
+			 GT68xx_Sample ** buffer_pointers_return);
 };
 
 /**
@@ -147,7 +160,7 @@ static SANE_Status gt68xx_line_reader_free (GT68xx_Line_Reader * reader);
  */
 static SANE_Status
 gt68xx_line_reader_read (GT68xx_Line_Reader * reader,
-			 unsigned int **buffer_pointers_return);
+			 GT68xx_Sample ** buffer_pointers_return);
 
 #endif /* not GT68XX_MID_H */
 
@@ -0,0 +1,136 @@
+/* sane - Scanner Access Now Easy.
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+*/
+
+/** @file
+ * @brief Shading correction of one calibrator channel.
+ *
+ * Included by gt68xx_high.c and by tools/gt68xx_bench.c, which compares
+ * both ways of doing it.
+ */
+
+/** Compute the multipliers that replace the division by k_white.
+ *
+ * k_factor[i] is white_level * 2^32 / k_white[i], rounded up.  For a
+ * 16 bit value n, (n * k_factor[i]) >> 32 is then exactly
+ * n * white_level / k_white[i]: the rounding adds less than
+ * n * k_white[i] / 2^32 / k_white[i] < 1 / k_white[i] to the quotient,
+ * too little to reach the next integer.  white_level must be 65535 at
+ * most, so that the products fit in 64 bits.
+ */
+static void
+gt68xx_shading_factors (uint64_t * k_factor, const unsigned int *k_white,
+			int width, unsigned int white_level)
+{
+  int i;
+
+  for (i = 0; i < width; ++i)
+    {
+      uint64_t diff = k_white[i] ? k_white[i] : 1;
+      k_factor[i] = (((uint64_t) white_level << 32) + diff - 1) / diff;
+    }
+}
+
+/** Shading correction with the multipliers.
+ *
+ * The line holds 16 bit values.  There are no branches in the loop, so
+ * that compilers can vectorize it.  The clip counts are added to
+ * min_clip (values below black) and max_clip (values above white).
+ */
+static void
+gt68xx_shading_line (GT68xx_Sample * line, const unsigned int *k_black,
+		     const uint64_t * k_factor, int width,
+		     int *min_clip, int *max_clip)
+{
+  int i;
+  int low = 0, high = 0;
+
+  for (i = 0; i < width; ++i)
+    {
+      unsigned int src_value = line[i];
+      unsigned int black = k_black[i];
+      unsigned int diff = (src_value > black) ? src_value - black : 0;
+      uint64_t value = ((uint64_t) diff * k_factor[i]) >> 32;
+
+      high += (value > 0xffff);
+      low += (src_value < black);
+      line[i] = (value > 0xffff) ? 0xffff : (GT68xx_Sample) value;
+    }
+  *min_clip += low;
+  *max_clip += high;
+}
+
+/** Shading correction with a division per value.
+ *
+ * For white levels above 65535, and the reference for the above.
+ */
+static void
+gt68xx_shading_line_div (GT68xx_Sample * line, const unsigned int *k_black,
+			 const unsigned int *k_white, int width,
+			 unsigned int white_level, int *min_clip,
+			 int *max_clip)
+{
+  int i;
+
+  for (i = 0; i < width; ++i)
+    {
+      unsigned int src_value = line[i];
+      unsigned int black = k_black[i];
+      unsigned int value;
+
+      if (src_value > black)
+	{
+	  value = (src_value - black) * white_level / k_white[i];
+	  if (value > 0xffff)
+	    {
+	      value = 0xffff;
+	      (*max_clip)++;
+	    }
+	}
+      else
+	{
+	  value = 0;
+	  if (src_value < black)
+	    (*min_clip)++;
+	}
+
+      line[i] = value;
+    }
+}
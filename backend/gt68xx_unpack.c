@@ -0,0 +1,540 @@
+/* sane - Scanner Access Now Easy.
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+*/
+
+/** @file
+ * @brief Unpacking of image data into lines of samples.
+ *
+ * Included by gt68xx_mid.c and by tools/gt68xx_bench.c.  Each unpacker
+ * lets a vector kernel do as much of the line as it can and does the rest
+ * pixel by pixel.  The SSE2 and NEON kernels are built when the compiler
+ * targets these instruction sets, the AVX2 ones are built with the target
+ * attribute and only used if the CPU has AVX2.  gt68xx_unpack_init()
+ * selects them.  All kernels expect a little endian host.
+ */
+
+#if defined (__SSE2__)
+#define GT68XX_UNPACK_SSE2
+#include <emmintrin.h>
+#endif
+
+#if (defined (__x86_64__) || defined (__i386__)) \
+  && (defined (__clang__) || __GNUC__ > 4 \
+      || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define GT68XX_UNPACK_AVX2
+#include <immintrin.h>
+#define GT68XX_AVX2 __attribute__ ((target ("avx2")))
+#endif
+
+#if defined (__ARM_NEON) && defined (__BYTE_ORDER__) \
+  && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define GT68XX_UNPACK_NEON
+#include <arm_neon.h>
+#endif
+
+#define GT68XX_UNPACK_USE_SSE2 0x01
+#define GT68XX_UNPACK_USE_AVX2 0x02
+#define GT68XX_UNPACK_USE_NEON 0x04
+
+/** Kernels in use, a combination of the GT68XX_UNPACK_USE_* flags */
+static int gt68xx_unpack_use = 0;
+
+/** Pixels per channel that unpack_12_le_rgb() unpacks at once */
+#define GT68XX_UNPACK_BLOCK 32
+
+/** Select the kernels this host can run.
+ *
+ * @return the GT68XX_UNPACK_USE_* flags of the selected kernels
+ */
+static int
+gt68xx_unpack_init (void)
+{
+  int use = 0;
+
+#ifdef GT68XX_UNPACK_SSE2
+  use |= GT68XX_UNPACK_USE_SSE2;
+#endif
+#ifdef GT68XX_UNPACK_AVX2
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    use |= GT68XX_UNPACK_USE_AVX2;
+#endif
+#ifdef GT68XX_UNPACK_NEON
+  use |= GT68XX_UNPACK_USE_NEON;
+#endif
+  gt68xx_unpack_use = use;
+  return use;
+}
+
+#ifdef GT68XX_UNPACK_SSE2
+/* stores 8 values */
+static inline void
+store_8_sse2 (GT68xx_Sample * dst, __m128i v)
+{
+#ifdef GT68XX_16BIT_SAMPLES
+  _mm_storeu_si128 ((__m128i *) dst, v);
+#else
+  __m128i zero = _mm_setzero_si128 ();
+
+  _mm_storeu_si128 ((__m128i *) dst, _mm_unpacklo_epi16 (v, zero));
+  _mm_storeu_si128 ((__m128i *) (dst + 4), _mm_unpackhi_epi16 (v, zero));
+#endif
+}
+
+static SANE_Int
+unpack_8_mono_sse2 (SANE_Byte * src, GT68xx_Sample * dst,
+		    SANE_Int pixels_per_line)
+{
+  SANE_Int i;
+
+  for (i = 0; i + 16 <= pixels_per_line; i += 16)
+    {
+      __m128i v = _mm_loadu_si128 ((__m128i *) (src + i));
+
+      store_8_sse2 (dst + i, _mm_unpacklo_epi8 (v, v));
+      store_8_sse2 (dst + i + 8, _mm_unpackhi_epi8 (v, v));
+    }
+  return i;
+}
+
+static SANE_Int
+unpack_16_le_mono_sse2 (SANE_Byte * src, GT68xx_Sample * dst,
+			SANE_Int pixels_per_line)
+{
+  SANE_Int i;
+
+  for (i = 0; i + 8 <= pixels_per_line; i += 8)
+    store_8_sse2 (dst + i, _mm_loadu_si128 ((__m128i *) (src + 2 * i)));
+  return i;
+}
+#endif /* GT68XX_UNPACK_SSE2 */
+
+#ifdef GT68XX_UNPACK_AVX2
+/* The AVX2 kernels make 8 values in each 128 bit lane, from two
+   separately loaded pieces of the source, with the byte shuffle. */
+
+static inline GT68XX_AVX2 __m256i
+load_2_avx2 (SANE_Byte * low, SANE_Byte * high)
+{
+  return _mm256_inserti128_si256 (_mm256_castsi128_si256
+				  (_mm_loadu_si128 ((__m128i *) low)),
+				  _mm_loadu_si128 ((__m128i *) high), 1);
+}
+
+/* stores 16 values */
+static inline GT68XX_AVX2 void
+store_16_avx2 (GT68xx_Sample * dst, __m256i v)
+{
+#ifdef GT68XX_16BIT_SAMPLES
+  _mm256_storeu_si256 ((__m256i *) dst, v);
+#else
+  _mm256_storeu_si256 ((__m256i *) dst,
+		       _mm256_cvtepu16_epi32 (_mm256_castsi256_si128 (v)));
+  _mm256_storeu_si256 ((__m256i *) (dst + 8),
+		       _mm256_cvtepu16_epi32 (_mm256_extracti128_si256 (v,
+									1)));
+#endif
+}
+
+static GT68XX_AVX2 SANE_Int
+unpack_8_rgb_avx2 (SANE_Byte * src, GT68xx_Sample * dst,
+		   SANE_Int pixels_per_line)
+{
+  /* pixels 0-5 of a lane from the first piece, 6 and 7 from the second,
+     which starts 6 bytes later */
+  __m128i first = _mm_setr_epi8 (0, 0, 3, 3, 6, 6, 9, 9, 12, 12, 15, 15,
+				 -1, -1, -1, -1);
+  __m128i second = _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1,
+				  -1, -1, -1, -1, 12, 12, 15, 15);
+  __m256i mask_1 = _mm256_inserti128_si256 (_mm256_castsi128_si256 (first),
+					    first, 1);
+  __m256i mask_2 = _mm256_inserti128_si256 (_mm256_castsi128_si256 (second),
+					    second, 1);
+  SANE_Int i;
+
+  for (i = 0; i + 16 <= pixels_per_line; i += 16, src += 48)
+    {
+      __m256i a = load_2_avx2 (src, src + 24);
+      __m256i b = load_2_avx2 (src + 6, src + 30);
+
+      store_16_avx2 (dst + i,
+		     _mm256_or_si256 (_mm256_shuffle_epi8 (a, mask_1),
+				      _mm256_shuffle_epi8 (b, mask_2)));
+    }
+  return i;
+}
+
+static GT68XX_AVX2 SANE_Int
+unpack_12_le_mono_avx2 (SANE_Byte * src, GT68xx_Sample * dst,
+			SANE_Int pixels_per_line)
+{
+  /* Each pixel gets the two bytes that hold its 12 bits: bytes 0 and 1 of
+     a group of three for even pixels, bytes 1 and 2 for odd ones.  The
+     upper lane starts 4 bytes into its piece. */
+  __m256i mask = _mm256_setr_epi8 (0, 1, 1, 2, 3, 4, 4, 5,
+				   6, 7, 7, 8, 9, 10, 10, 11,
+				   4, 5, 5, 6, 7, 8, 8, 9,
+				   10, 11, 11, 12, 13, 14, 14, 15);
+  __m256i even = _mm256_set1_epi32 (0x00000fff);
+  __m256i odd = _mm256_set1_epi32 ((int) 0xffff0000);
+  SANE_Int i;
+
+  for (i = 0; i + 16 <= pixels_per_line; i += 16, src += 24)
+    {
+      __m256i w = _mm256_shuffle_epi8 (load_2_avx2 (src, src + 8), mask);
+      __m256i v = _mm256_or_si256 (_mm256_and_si256 (w, even),
+				   _mm256_and_si256 (_mm256_srli_epi16 (w, 4),
+						     odd));
+
+      store_16_avx2 (dst + i, _mm256_or_si256 (_mm256_slli_epi16 (v, 4),
+					       _mm256_srli_epi16 (v, 8)));
+    }
+  return i;
+}
+
+static GT68XX_AVX2 SANE_Int
+unpack_16_le_rgb_avx2 (SANE_Byte * src, GT68xx_Sample * dst,
+		       SANE_Int pixels_per_line)
+{
+  /* pixels 0-2 of a lane from the first piece, 3-5 from the second at 16
+     bytes, 6 and 7 from the third at 28 bytes */
+  __m128i first = _mm_setr_epi8 (0, 1, 6, 7, 12, 13, -1, -1,
+				 -1, -1, -1, -1, -1, -1, -1, -1);
+  __m128i second = _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, 2, 3,
+				  8, 9, 14, 15, -1, -1, -1, -1);
+  __m128i third = _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1,
+				 -1, -1, -1, -1, 8, 9, 14, 15);
+  __m256i mask_1 = _mm256_inserti128_si256 (_mm256_castsi128_si256 (first),
+					    first, 1);
+  __m256i mask_2 = _mm256_inserti128_si256 (_mm256_castsi128_si256 (second),
+					    second, 1);
+  __m256i mask_3 = _mm256_inserti128_si256 (_mm256_castsi128_si256 (third),
+					    third, 1);
+  SANE_Int i;
+
+  for (i = 0; i + 16 <= pixels_per_line; i += 16, src += 96)
+    {
+      __m256i a = load_2_avx2 (src, src + 48);
+      __m256i b = load_2_avx2 (src + 16, src + 64);
+      __m256i c = load_2_avx2 (src + 28, src + 76);
+
+      store_16_avx2 (dst + i,
+		     _mm256_or_si256 (_mm256_or_si256
+				      (_mm256_shuffle_epi8 (a, mask_1),
+				       _mm256_shuffle_epi8 (b, mask_2)),
+				      _mm256_shuffle_epi8 (c, mask_3)));
+    }
+  return i;
+}
+#endif /* GT68XX_UNPACK_AVX2 */
+
+#ifdef GT68XX_UNPACK_NEON
+/* The interleaved loads of the stride 3 kernels read a few bytes beyond
+   the last pixel they unpack, so these leave at least one pixel to the
+   plain loop. */
+
+/* stores 8 values */
+static inline void
+store_8_neon (GT68xx_Sample * dst, uint16x8_t v)
+{
+#ifdef GT68XX_16BIT_SAMPLES
+  vst1q_u16 (dst, v);
+#else
+  vst1q_u32 ((uint32_t *) dst, vmovl_u16 (vget_low_u16 (v)));
+  vst1q_u32 ((uint32_t *) dst + 4, vmovl_u16 (vget_high_u16 (v)));
+#endif
+}
+
+/* each byte b of v as b * 257 */
+static inline void
+store_8_bytes_neon (GT68xx_Sample * dst, uint8x16_t v)
+{
+  uint8x16x2_t twice = vzipq_u8 (v, v);
+
+  store_8_neon (dst, vreinterpretq_u16_u8 (twice.val[0]));
+  store_8_neon (dst + 8, vreinterpretq_u16_u8 (twice.val[1]));
+}
+
+static SANE_Int
+unpack_8_mono_neon (SANE_Byte * src, GT68xx_Sample * dst,
+		    SANE_Int pixels_per_line)
+{
+  SANE_Int i;
+
+  for (i = 0; i + 16 <= pixels_per_line; i += 16)
+    store_8_bytes_neon (dst + i, vld1q_u8 (src + i));
+  return i;
+}
+
+static SANE_Int
+unpack_8_rgb_neon (SANE_Byte * src, GT68xx_Sample * dst,
+		   SANE_Int pixels_per_line)
+{
+  SANE_Int i;
+
+  for (i = 0; i + 16 < pixels_per_line; i += 16)
+    store_8_bytes_neon (dst + i, vld3q_u8 (src + 3 * i).val[0]);
+  return i;
+}
+
+static SANE_Int
+unpack_12_le_mono_neon (SANE_Byte * src, GT68xx_Sample * dst,
+			SANE_Int pixels_per_line)
+{
+  SANE_Int i;
+
+  for (i = 0; i + 16 <= pixels_per_line; i += 16, src += 24)
+    {
+      uint8x8x3_t b = vld3_u8 (src);
+      uint16x8_t middle = vmovl_u8 (b.val[1]);
+      uint16x8x2_t pixels;
+      uint16x8_t even, odd;
+
+      even = vorrq_u16 (vmovl_u8 (b.val[0]),
+			vshlq_n_u16 (vandq_u16 (middle, vdupq_n_u16 (0x0f)),
+				     8));
+      odd = vorrq_u16 (vshrq_n_u16 (middle, 4),
+		       vshlq_n_u16 (vmovl_u8 (b.val[2]), 4));
+      pixels = vzipq_u16 (vorrq_u16 (vshlq_n_u16 (even, 4),
+				     vshrq_n_u16 (even, 8)),
+			  vorrq_u16 (vshlq_n_u16 (odd, 4),
+				     vshrq_n_u16 (odd, 8)));
+      store_8_neon (dst + i, pixels.val[0]);
+      store_8_neon (dst + i + 8, pixels.val[1]);
+    }
+  return i;
+}
+
+static SANE_Int
+unpack_16_le_mono_neon (SANE_Byte * src, GT68xx_Sample * dst,
+			SANE_Int pixels_per_line)
+{
+  SANE_Int i;
+
+  for (i = 0; i + 8 <= pixels_per_line; i += 8)
+    store_8_neon (dst + i, vreinterpretq_u16_u8 (vld1q_u8 (src + 2 * i)));
+  return i;
+}
+
+static SANE_Int
+unpack_16_le_rgb_neon (SANE_Byte * src, GT68xx_Sample * dst,
+		       SANE_Int pixels_per_line)
+{
+  SANE_Int i;
+
+  /* the source is 16 bit aligned: it is in a malloc'ed buffer */
+  for (i = 0; i + 8 < pixels_per_line; i += 8)
+    store_8_neon (dst + i, vld3q_u16 ((uint16_t *) (src + 6 * i)).val[0]);
+  return i;
+}
+#endif /* GT68XX_UNPACK_NEON */
+
+static inline void
+unpack_8_mono (SANE_Byte * src, GT68xx_Sample * dst,
+	       SANE_Int pixels_per_line)
+{
+  SANE_Int done = 0;
+
+#ifdef GT68XX_UNPACK_SSE2
+  if (gt68xx_unpack_use & GT68XX_UNPACK_USE_SSE2)
+    done = unpack_8_mono_sse2 (src, dst, pixels_per_line);
+#endif
+#ifdef GT68XX_UNPACK_NEON
+  if (gt68xx_unpack_use & GT68XX_UNPACK_USE_NEON)
+    done = unpack_8_mono_neon (src, dst, pixels_per_line);
+#endif
+  src += done;
+  dst += done;
+  pixels_per_line -= done;
+
+  for (; pixels_per_line > 0; ++src, ++dst, --pixels_per_line)
+    {
+      *dst = (((unsigned int) *src) << 8) | *src;
+    }
+}
+
+static inline void
+unpack_8_rgb (SANE_Byte * src, GT68xx_Sample * dst, SANE_Int pixels_per_line)
+{
+  SANE_Int done = 0;
+
+#ifdef GT68XX_UNPACK_AVX2
+  if (gt68xx_unpack_use & GT68XX_UNPACK_USE_AVX2)
+    done = unpack_8_rgb_avx2 (src, dst, pixels_per_line);
+#endif
+#ifdef GT68XX_UNPACK_NEON
+  if (gt68xx_unpack_use & GT68XX_UNPACK_USE_NEON)
+    done = unpack_8_rgb_neon (src, dst, pixels_per_line);
+#endif
+  src += 3 * done;
+  dst += done;
+  pixels_per_line -= done;
+
+  for (; pixels_per_line > 0; src += 3, ++dst, --pixels_per_line)
+    {
+      *dst = (((unsigned int) *src) << 8) | *src;
+    }
+}
+
+/* 12-bit routines use the fact that pixels_per_line is aligned */
+
+static inline void
+unpack_12_le_mono (SANE_Byte * src, GT68xx_Sample * dst,
+		   SANE_Int pixels_per_line)
+{
+  SANE_Int done = 0;
+
+#ifdef GT68XX_UNPACK_AVX2
+  if (gt68xx_unpack_use & GT68XX_UNPACK_USE_AVX2)
+    done = unpack_12_le_mono_avx2 (src, dst, pixels_per_line);
+#endif
+#ifdef GT68XX_UNPACK_NEON
+  if (gt68xx_unpack_use & GT68XX_UNPACK_USE_NEON)
+    done = unpack_12_le_mono_neon (src, dst, pixels_per_line);
+#endif
+  src += done / 2 * 3;
+  dst += done;
+  pixels_per_line -= done;
+
+  for (; pixels_per_line > 0; src += 3, dst += 2, pixels_per_line -= 2)
+    {
+      dst[0] = ((((unsigned int) (src[1] & 0x0f)) << 12)
+		| (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
+      dst[1] = ((((unsigned int) src[2]) << 8)
+		| (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
+    }
+}
+
+static inline void
+unpack_12_le_rgb (SANE_Byte * src,
+		  GT68xx_Sample * dst1,
+		  GT68xx_Sample * dst2,
+		  GT68xx_Sample * dst3, SANE_Int pixels_per_line)
+{
+  /* With a kernel for unpack_12_le_mono(), unpack blocks of the line into
+     red, green, blue order first and sort the values out afterwards. */
+  if (gt68xx_unpack_use & (GT68XX_UNPACK_USE_AVX2 | GT68XX_UNPACK_USE_NEON))
+    {
+      GT68xx_Sample block[3 * GT68XX_UNPACK_BLOCK];
+      SANE_Int i;
+
+      for (; pixels_per_line >= GT68XX_UNPACK_BLOCK;
+	   pixels_per_line -= GT68XX_UNPACK_BLOCK)
+	{
+	  unpack_12_le_mono (src, block, 3 * GT68XX_UNPACK_BLOCK);
+	  for (i = 0; i < GT68XX_UNPACK_BLOCK; ++i)
+	    {
+	      *dst1++ = block[3 * i];
+	      *dst2++ = block[3 * i + 1];
+	      *dst3++ = block[3 * i + 2];
+	    }
+	  src += 3 * GT68XX_UNPACK_BLOCK / 2 * 3;
+	}
+    }
+
+  for (; pixels_per_line > 0; pixels_per_line -= 2)
+    {
+      *dst1++ = ((((unsigned int) (src[1] & 0x0f)) << 12)
+		 | (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
+      *dst2++ = ((((unsigned int) src[2]) << 8)
+		 | (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
+      src += 3;
+
+      *dst3++ = ((((unsigned int) (src[1] & 0x0f)) << 12)
+		 | (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
+      *dst1++ = ((((unsigned int) src[2]) << 8)
+		 | (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
+      src += 3;
+
+      *dst2++ = ((((unsigned int) (src[1] & 0x0f)) << 12)
+		 | (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
+      *dst3++ = ((((unsigned int) src[2]) << 8)
+		 | (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
+      src += 3;
+    }
+}
+
+static inline void
+unpack_16_le_mono (SANE_Byte * src, GT68xx_Sample * dst,
+		   SANE_Int pixels_per_line)
+{
+  SANE_Int done = 0;
+
+#ifdef GT68XX_UNPACK_SSE2
+  if (gt68xx_unpack_use & GT68XX_UNPACK_USE_SSE2)
+    done = unpack_16_le_mono_sse2 (src, dst, pixels_per_line);
+#endif
+#ifdef GT68XX_UNPACK_NEON
+  if (gt68xx_unpack_use & GT68XX_UNPACK_USE_NEON)
+    done = unpack_16_le_mono_neon (src, dst, pixels_per_line);
+#endif
+  src += 2 * done;
+  dst += done;
+  pixels_per_line -= done;
+
+  for (; pixels_per_line > 0; src += 2, dst++, --pixels_per_line)
+    {
+      *dst = (((unsigned int) src[1]) << 8) | src[0];
+    }
+}
+
+static inline void
+unpack_16_le_rgb (SANE_Byte * src, GT68xx_Sample * dst,
+		  SANE_Int pixels_per_line)
+{
+  SANE_Int done = 0;
+
+#ifdef GT68XX_UNPACK_AVX2
+  if (gt68xx_unpack_use & GT68XX_UNPACK_USE_AVX2)
+    done = unpack_16_le_rgb_avx2 (src, dst, pixels_per_line);
+#endif
+#ifdef GT68XX_UNPACK_NEON
+  if (gt68xx_unpack_use & GT68XX_UNPACK_USE_NEON)
+    done = unpack_16_le_rgb_neon (src, dst, pixels_per_line);
+#endif
+  src += 6 * done;
+  dst += done;
+  pixels_per_line -= done;
+
+  for (; pixels_per_line > 0; src += 6, ++dst, --pixels_per_line)
+    {
+      *dst = (((unsigned int) src[1]) << 8) | src[0];
+    }
+}
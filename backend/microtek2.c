@@ -915,6 +915,13 @@ cancel_scan(Microtek2_Scanner *ms)
        sanei_thread_waitpid(ms->pid, NULL);
       }
 
+    /* a reader thread does not get to drop its queued commands */
+    if ( ms->readahead )
+      {
+        sanei_scsi_readahead_stop(ms->readahead);
+        ms->readahead = NULL;
+      }
+
     return status;
 }
 
@@ -4669,30 +4676,68 @@ static SANE_Status
 scsi_read_image(Microtek2_Scanner *ms, uint8_t *buffer, int bytes_per_pixel)
 {
     uint8_t cmd[RI_CMD_L];
-    SANE_Bool endiantype;
     SANE_Status status;
     size_t size;
-    size_t i;
-    uint8_t tmp;
 
 
     DBG(30, "scsi_read_image:  ms=%p, buffer=%p\n", (void *) ms, buffer);
 
+    memset(cmd, 0, sizeof(cmd));
+    scsi_read_image_cmd(ms, ms->transfer_length, cmd);
+
+    size = ms->transfer_length;
+    status = sanei_scsi_cmd(ms->sfd, cmd, sizeof(cmd), buffer, &size);
+
+    if ( buffer )
+        swap_image_bytes(ms, buffer, size, bytes_per_pixel);
+
+    if ( status != SANE_STATUS_GOOD )
+        DBG(1, "scsi_read_image: '%s'\n", sane_strstatus(status));
+
+    if ( md_dump > 3 )
+        dump_area2(buffer, ms->transfer_length, "readimageresult");
+
+    return status;
+}
+
+
+/*---------- scsi_read_image_cmd() -------------------------------------------*/
+
+static size_t
+scsi_read_image_cmd(void *arg, size_t length, u_char *cmd)
+{
+    Microtek2_Scanner *ms = (Microtek2_Scanner *) arg;
+    SANE_Bool endiantype;
+
+
     ENDIAN_TYPE(endiantype)
     RI_SET_CMD(cmd);
     RI_SET_PCORMAC(cmd, endiantype);
     RI_SET_COLOR(cmd, ms->current_read_color);
-    RI_SET_TRANSFERLENGTH(cmd, ms->transfer_length);
+    RI_SET_TRANSFERLENGTH(cmd, length);
 
-    DBG(30, "scsi_read_image: transferlength=%d\n", ms->transfer_length);
+    DBG(30, "scsi_read_image: transferlength=%lu\n", (u_long) length);
 
     if ( md_dump >= 2 )
         dump_area2(cmd, RI_CMD_L, "readimagecmd");
 
-    size = ms->transfer_length;
-    status = sanei_scsi_cmd(ms->sfd, cmd, sizeof(cmd), buffer, &size);
+    return RI_CMD_L;
+}
+
+
+/*---------- swap_image_bytes() ----------------------------------------------*/
 
-    if ( buffer && ( ms->dev->model_flags & MD_PHANTOM_C6 ) && endiantype )
+static void
+swap_image_bytes(Microtek2_Scanner *ms, uint8_t *buffer, size_t size,
+                 int bytes_per_pixel)
+{
+    SANE_Bool endiantype;
+    size_t i;
+    uint8_t tmp;
+
+
+    ENDIAN_TYPE(endiantype)
+    if ( ( ms->dev->model_flags & MD_PHANTOM_C6 ) && endiantype )
       {
 	switch(bytes_per_pixel)
 	  {
@@ -4709,14 +4754,6 @@ scsi_read_image(Microtek2_Scanner *ms, uint8_t *buffer, int bytes_per_pixel)
 		    DBG(1, "scsi_read_image: Unexpected bytes_per_pixel=%d\n", bytes_per_pixel);
 	  }
       }
-
-    if ( status != SANE_STATUS_GOOD )
-        DBG(1, "scsi_read_image: '%s'\n", sane_strstatus(status));
-
-    if ( md_dump > 3 )
-        dump_area2(buffer, ms->transfer_length, "readimageresult");
-
-    return status;
 }
 
 
@@ -7151,17 +7188,12 @@ reader_process(void *data)
     Microtek2_Scanner *ms = (Microtek2_Scanner *) data;
 
     SANE_Status status;
-    Microtek2_Info *mi;
-    Microtek2_Device *md;
     struct SIGACTION act;
     sigset_t sigterm_set;
     static uint8_t *temp_current = NULL;
 
     DBG(30, "reader_process: ms=%p\n", (void *) ms);
 
-    md = ms->dev;
-    mi = &md->info[md->scan_source];
-
     if (sanei_thread_is_forked()) close(ms->fd[0]);
 
     sigemptyset (&sigterm_set);
@@ -7183,21 +7215,80 @@ reader_process(void *data)
             temp_current = ms->temporary_buffer;
       }
 
+    /* keep the next strips coming while this one is processed */
+    if ( ms->src_remaining_lines > 0 )
+      {
+        sigprocmask (SIG_BLOCK, &sigterm_set, 0);
+        status = sanei_scsi_readahead_start(ms->sfd, scsi_read_image_cmd, ms,
+                           (size_t) ms->src_remaining_lines * ms->bpl,
+                           (size_t) ms->src_max_lines * ms->bpl,
+                           MD_READAHEAD_DEPTH, &ms->readahead);
+        sigprocmask (SIG_UNBLOCK, &sigterm_set, 0);
+        if ( status != SANE_STATUS_GOOD )
+            return SANE_STATUS_IO_ERROR;
+      }
+
+    status = read_strips(ms, &sigterm_set, &temp_current);
+
+    sigprocmask (SIG_BLOCK, &sigterm_set, 0);
+    sanei_scsi_readahead_stop(ms->readahead);
+    ms->readahead = NULL;
+    sigprocmask (SIG_UNBLOCK, &sigterm_set, 0);
+    if ( status != SANE_STATUS_GOOD )
+        return status;
+
+    fclose(ms->fp);
+    return SANE_STATUS_GOOD;
+}
+
+
+/*---------- read_strips() ---------------------------------------------------*/
+
+static SANE_Status
+read_strips(Microtek2_Scanner *ms, sigset_t *sigterm_set,
+            uint8_t **temp_current)
+{
+    SANE_Status status;
+    Microtek2_Info *mi;
+    Microtek2_Device *md;
+    const u_char *data;
+    size_t size;
+
+
+    DBG(30, "read_strips: ms=%p\n", (void *) ms);
+
+    md = ms->dev;
+    mi = &md->info[md->scan_source];
+
     while ( ms->src_remaining_lines > 0 )
       {
        
         ms->src_lines_to_read = MIN(ms->src_remaining_lines, ms->src_max_lines);
         ms->transfer_length = ms->src_lines_to_read * ms->bpl;
 
-        DBG(30, "reader_process: transferlength=%d, lines=%d, linelength=%d, "
+        DBG(30, "read_strips: transferlength=%d, lines=%d, linelength=%d, "
                 "real_bpl=%d, srcbuf=%p\n", ms->transfer_length,
                  ms->src_lines_to_read, ms->bpl, ms->real_bpl, ms->buf.src_buf);
 
-        sigprocmask (SIG_BLOCK, &sigterm_set, 0);
-        status = scsi_read_image(ms, ms->buf.src_buf, (ms->depth > 8) ? 2 : 1);
-        sigprocmask (SIG_UNBLOCK, &sigterm_set, 0);
+        sigprocmask (SIG_BLOCK, sigterm_set, 0);
+        status = sanei_scsi_readahead_next(ms->readahead, &data, &size);
+        sigprocmask (SIG_UNBLOCK, sigterm_set, 0);
+        if ( status == SANE_STATUS_GOOD && size != (size_t) ms->transfer_length )
+          {
+            DBG(1, "read_strips: got %lu bytes instead of %d\n",
+                   (u_long) size, ms->transfer_length);
+            status = SANE_STATUS_IO_ERROR;
+          }
         if ( status != SANE_STATUS_GOOD ) 
+          {
+            DBG(1, "read_strips: '%s'\n", sane_strstatus(status));
             return SANE_STATUS_IO_ERROR;
+          }
+
+        memcpy(ms->buf.src_buf, data, size);
+        swap_image_bytes(ms, ms->buf.src_buf, size, (ms->depth > 8) ? 2 : 1);
+        if ( md_dump > 3 )
+            dump_area2(ms->buf.src_buf, size, "readimageresult");
 
         ms->src_remaining_lines -= ms->src_lines_to_read;
 
@@ -7208,7 +7299,7 @@ reader_process(void *data)
               if ( ! mi->onepass )
                 /* TODO */
                 {
-                  DBG(1, "reader_process: 3 pass not yet supported\n");
+                  DBG(1, "read_strips: 3 pass not yet supported\n");
                   return SANE_STATUS_IO_ERROR;
                 }
               else 
@@ -7237,7 +7328,7 @@ reader_process(void *data)
                             return status;
                         break;
                       default:
-                        DBG(1, "reader_process: format %d\n", mi->data_format);
+                        DBG(1, "read_strips: format %d\n", mi->data_format);
                         return SANE_STATUS_IO_ERROR;
                     }      
                 }
@@ -7255,7 +7346,7 @@ reader_process(void *data)
               break;
 	    case MS_MODE_LINEARTFAKE:
               if ( ms->auto_adjust == 1 )
-                  status = auto_adjust_proc_data(ms, &temp_current);
+                  status = auto_adjust_proc_data(ms, temp_current);
               else
                   status = lineartfake_proc_data(ms);
 
@@ -7263,12 +7354,11 @@ reader_process(void *data)
                   return status;
               break;
             default:
-              DBG(1, "reader_process: Unknown scan mode %d\n", ms->mode);
+              DBG(1, "read_strips: Unknown scan mode %d\n", ms->mode);
               return SANE_STATUS_IO_ERROR;
           }
       }
 
-    fclose(ms->fp);
     return SANE_STATUS_GOOD;
 }
 
@@ -106,6 +106,7 @@
 #define MD_MIDTONE_DEFAULT      128
 #define MD_HIGHLIGHT_DEFAULT    255
 #define MD_EXPOSURE_DEFAULT     0
+#define MD_READAHEAD_DEPTH      3       /* READ IMAGE commands kept queued */
 #define M_BRIGHTNESS_DEFAULT	128
 #define M_CONTRAST_DEFAULT      128
 #define M_SHADOW_DEFAULT        0
@@ -1145,6 +1146,7 @@ typedef struct Microtek2_Scanner {
     int fd[2];                /* file descriptors for pipe */
     SANE_Pid pid;             /* pid of child process */
     FILE *fp;
+    SANEI_SCSI_Readahead *readahead;  /* queued READ IMAGE commands */
 
 } Microtek2_Scanner;
 
@@ -1288,6 +1290,9 @@ read_cx_shading(Microtek2_Scanner *);
 static int
 reader_process(void *);
 
+static SANE_Status
+read_strips(Microtek2_Scanner *, sigset_t *, uint8_t **);
+
 static SANE_Status
 restore_gamma_options(SANE_Option_Descriptor *, Option_Value *);
 
@@ -1344,6 +1349,12 @@ scsi_read_gamma(Microtek2_Scanner *); */
 static SANE_Status
 scsi_read_image(Microtek2_Scanner *, uint8_t *, int);
 
+static size_t
+scsi_read_image_cmd(void *, size_t, u_char *);
+
+static void
+swap_image_bytes(Microtek2_Scanner *, uint8_t *, size_t, int);
+
 static SANE_Status
 scsi_read_image_info(Microtek2_Scanner *);
 
@@ -87,6 +87,7 @@ static AvahiServiceBrowser *avahi_browser = NULL;
 #include "../include/sane/sanei_net.h"
 #include "../include/sane/sanei_codec_bin.h"
 #include "net.h"
+#include "net_swap.c"
 
 #define BACKEND_NAME    net
 #include "../include/sane/sanei_backend.h"
@@ -105,45 +106,34 @@ static AvahiServiceBrowser *avahi_browser = NULL;
 #if defined (HAVE_GETADDRINFO) && defined (HAVE_GETNAMEINFO)
 # define NET_USES_AF_INDEP
 # ifdef ENABLE_IPV6
-#  define NET_VERSION "1.0.14 (AF-indep+IPv6)"
+#  define NET_VERSION "1.0.17 (AF-indep+IPv6)"
 # else
-#  define NET_VERSION "1.0.14 (AF-indep)"
+#  define NET_VERSION "1.0.17 (AF-indep)"
 # endif /* ENABLE_IPV6 */
 #else
 # undef ENABLE_IPV6
-# define NET_VERSION "1.0.14"
+# define NET_VERSION "1.0.17"
 #endif /* HAVE_GETADDRINFO && HAVE_GETNAMEINFO */
 
+/* Size of the receive buffer for the data connection.  As many
+   records as the socket has ready are read into it at once, so most
+   calls to sane_read() don't need a system call.  */
+#define NET_READ_BUF_SIZE (256 * 1024)
+
 static SANE_Auth_Callback auth_callback;
 static Net_Device *first_device;
 static Net_Scanner *first_handle;
 static const SANE_Device **devlist;
 static int client_big_endian; /* 1 == big endian; 0 == little endian */
-static int server_big_endian; /* 1 == big endian; 0 == little endian */
-static int depth; /* bits per pixel */
 static int connect_timeout = -1; /* timeout for connection to saned */
+static SANE_Bool use_compression; /* ask saned to compress image data */
+static int device_list_ttl;	/* seconds a host's device list is reused */
+static int device_list_hits, device_list_misses;
 
 #ifndef NET_USES_AF_INDEP
 static int saned_port;
 #endif /* !NET_USES_AF_INDEP */
 
-/* This variable is only needed, if the depth is 16bit/channel and
-   client/server have different endianness.  A value of -1 means, that there's
-   no hang over; otherwise the value has to be casted to SANE_Byte.  hang_over
-   means, that there is a remaining byte from a previous call to sane_read,
-   which could not be byte-swapped, e.g. because the frontend requested an odd
-   number of bytes.
-*/
-static int hang_over;
-
-/* This variable is only needed, if the depth is 16bit/channel and
-   client/server have different endianness.  A value of -1 means, that there's
-   no left over; otherwise the value has to be casted to SANE_Byte.  left_over
-   means, that there is a remaining byte from a previous call to sane_read,
-   which already is in the the correct byte order, but could not be returned,
-   e.g.  because the frontend requested only one byte per call.
-*/
-static int left_over;
 
 
 #ifdef NET_USES_AF_INDEP
@@ -320,7 +310,7 @@ connect_dev (Net_Device * dev)
 {
   struct addrinfo *addrp;
 
-  SANE_Word version_code;
+  SANE_Word version_code, features;
   SANE_Init_Reply reply;
   SANE_Status status = SANE_STATUS_IO_ERROR;
   SANE_Init_Req req;
@@ -392,7 +382,7 @@ static SANE_Status
 connect_dev (Net_Device * dev)
 {
   struct sockaddr_in *sin;
-  SANE_Word version_code;
+  SANE_Word version_code, features;
   SANE_Init_Reply reply;
   SANE_Status status = SANE_STATUS_IO_ERROR;
   SANE_Init_Req req;
@@ -485,7 +475,10 @@ connect_dev (Net_Device * dev)
 
   /* exchange version codes with the server: */
   req.version_code = SANE_VERSION_CODE (V_MAJOR, V_MINOR,
-					SANEI_NET_PROTOCOL_VERSION);
+					SANEI_NET_PROTOCOL_VERSION
+					| (use_compression
+					   ? SANEI_NET_FEATURE_COMPRESSION
+					   : 0));
   req.username = getlogin ();
   DBG (2, "connect_dev: net_init (user=%s, local version=%d.%d.%d)\n",
        req.username, V_MAJOR, V_MINOR, SANEI_NET_PROTOCOL_VERSION);
@@ -521,6 +514,8 @@ connect_dev (Net_Device * dev)
       status = SANE_STATUS_IO_ERROR;
       goto fail;
     }
+  features = SANE_VERSION_BUILD (version_code) & SANEI_NET_FEATURE_MASK;
+  version_code &= ~SANEI_NET_FEATURE_MASK;
   if (SANE_VERSION_BUILD (version_code) != SANEI_NET_PROTOCOL_VERSION
       && SANE_VERSION_BUILD (version_code) != 2)
     {
@@ -531,6 +526,10 @@ connect_dev (Net_Device * dev)
       goto fail;
     }
   dev->wire.version = SANE_VERSION_BUILD (version_code);
+  dev->compression = (features & SANEI_NET_FEATURE_COMPRESSION) != 0;
+  if (use_compression)
+    DBG (2, "connect_dev: server %s image data compression\n",
+	 dev->compression ? "supports" : "doesn't support");
   DBG (4, "connect_dev: done\n");
   return SANE_STATUS_GOOD;
 
@@ -630,9 +629,27 @@ do_cancel (Net_Scanner * s)
       close (s->data);
       s->data = -1;
     }
+  s->read_buf_pos = s->read_buf_len = 0;
+  s->zout_pos = s->zout_len = 0;
+  s->compressed = 0;
   return SANE_STATUS_CANCELLED;
 }
 
+/* Read as much as the data socket has ready into the (empty) receive
+   buffer.  Returns the result of read().  */
+static ssize_t
+fill_read_buf (Net_Scanner * s)
+{
+  ssize_t nread;
+
+  s->read_buf_pos = s->read_buf_len = 0;
+  nread = read (s->data, s->read_buf, NET_READ_BUF_SIZE);
+  if (nread > 0)
+    s->read_buf_len = nread;
+  DBG (4, "fill_read_buf: read %ld bytes\n", (long) nread);
+  return nread;
+}
+
 static void
 do_authorization (Net_Device * dev, SANE_String resource)
 {
@@ -1045,6 +1062,44 @@ sane_init (SANE_Int * version_code, SANE_Auth_Callback authorize)
 	      continue;
 	    }
 
+	  if (strstr(device_name, "device_list_ttl") != NULL)
+	    {
+	      optval = strchr(device_name, '=');
+
+	      if (!optval)
+		continue;
+
+	      optval = sanei_config_skip_whitespace (++optval);
+	      if ((optval != NULL) && (*optval != '\0'))
+		{
+		  device_list_ttl = atoi(optval);
+
+		  DBG (2, "sane_init: device lists are reused for %d seconds\n",
+		       device_list_ttl);
+		}
+
+	      continue;
+	    }
+
+	  if (strstr(device_name, "compression") != NULL)
+	    {
+	      optval = strchr(device_name, '=');
+
+	      if (!optval)
+		continue;
+
+	      optval = sanei_config_skip_whitespace (++optval);
+	      if ((optval != NULL) && (*optval != '\0'))
+		{
+		  use_compression = (strncmp (optval, "yes", 3) == 0);
+
+		  DBG (2, "sane_init: image data compression %s\n",
+		       use_compression ? "requested" : "disabled");
+		}
+
+	      continue;
+	    }
+
 	  DBG (2, "sane_init: trying to add %s\n", device_name);
 	  add_device (device_name, 0);
 	}
@@ -1112,12 +1167,154 @@ sane_init (SANE_Int * version_code, SANE_Auth_Callback authorize)
   return SANE_STATUS_GOOD;
 }
 
+static void
+free_host_devices (Net_Device * dev)
+{
+  int i;
+
+  if (!dev->devices)
+    return;
+
+  for (i = 0; dev->devices[i]; ++i)
+    {
+      if (dev->devices[i]->vendor)
+	free ((void *) dev->devices[i]->vendor);
+      if (dev->devices[i]->model)
+	free ((void *) dev->devices[i]->model);
+      if (dev->devices[i]->type)
+	free ((void *) dev->devices[i]->type);
+      free ((void *) dev->devices[i]);
+    }
+  free (dev->devices);
+  dev->devices = 0;
+}
+
+/* Ask the saned on DEV for its devices and store them in dev->devices,
+   named "host:device".  */
+static SANE_Status
+fetch_host_devices (Net_Device * dev)
+{
+  SANE_Get_Devices_Reply reply;
+  SANE_Status status;
+  char *full_name;
+  int i, num_devs;
+  size_t len;
+
+  if (dev->ctl < 0)
+    {
+      status = connect_dev (dev);
+      if (status != SANE_STATUS_GOOD)
+	{
+	  DBG (1, "sane_get_devices: ignoring failure to connect to %s\n",
+	       dev->name);
+	  return status;
+	}
+    }
+  sanei_w_call (&dev->wire, SANE_NET_GET_DEVICES,
+		(WireCodecFunc) sanei_w_void, 0,
+		(WireCodecFunc) sanei_w_get_devices_reply, &reply);
+  if (reply.status != SANE_STATUS_GOOD)
+    {
+      DBG (1, "sane_get_devices: ignoring rpc-returned status %s\n",
+	   sane_strstatus (reply.status));
+      sanei_w_free (&dev->wire,
+		    (WireCodecFunc) sanei_w_get_devices_reply, &reply);
+      return reply.status;
+    }
+
+  /* count the number of devices for this backend: */
+  for (num_devs = 0; reply.device_list[num_devs]; ++num_devs);
+
+  dev->devices = calloc (num_devs + 1, sizeof (dev->devices[0]));
+  if (!dev->devices)
+    {
+      DBG (1, "sane_get_devices: not enough free memory\n");
+      sanei_w_free (&dev->wire,
+		    (WireCodecFunc) sanei_w_get_devices_reply, &reply);
+      return SANE_STATUS_NO_MEM;
+    }
+
+  for (i = 0; i < num_devs; ++i)
+    {
+      SANE_Device *rdev;
+      char *mem;
+#ifdef ENABLE_IPV6
+      SANE_Bool IPv6 = SANE_FALSE;
+#endif /* ENABLE_IPV6 */
+
+      /* create a new device entry with a device name that is the
+	 sum of the backend name a colon and the backend's device
+	 name: */
+      len = strlen (dev->name) + 1 + strlen (reply.device_list[i]->name);
+
+#ifdef ENABLE_IPV6
+      if (strchr (dev->name, ':') != NULL)
+	{
+	  len += 2;
+	  IPv6 = SANE_TRUE;
+	}
+#endif /* ENABLE_IPV6 */
+
+      mem = malloc (sizeof (*rdev) + len + 1);
+      if (!mem)
+	{
+	  DBG (1, "sane_get_devices: not enough free memory\n");
+	  sanei_w_free (&dev->wire,
+			(WireCodecFunc) sanei_w_get_devices_reply, &reply);
+	  free_host_devices (dev);
+	  return SANE_STATUS_NO_MEM;
+	}
+
+      memset (mem, 0, sizeof (*rdev) + len);
+      full_name = mem + sizeof (*rdev);
+
+#ifdef ENABLE_IPV6
+      if (IPv6 == SANE_TRUE)
+	strcat (full_name, "[");
+#endif /* ENABLE_IPV6 */
+
+      strcat (full_name, dev->name);
+
+#ifdef ENABLE_IPV6
+      if (IPv6 == SANE_TRUE)
+	strcat (full_name, "]");
+#endif /* ENABLE_IPV6 */
+
+      strcat (full_name, ":");
+      strcat (full_name, reply.device_list[i]->name);
+      DBG (3, "sane_get_devices: got %s\n", full_name);
+
+      rdev = (SANE_Device *) mem;
+      rdev->name = full_name;
+      rdev->vendor = strdup (reply.device_list[i]->vendor);
+      rdev->model = strdup (reply.device_list[i]->model);
+      rdev->type = strdup (reply.device_list[i]->type);
+
+      /* entries are in place before the check, so that
+	 free_host_devices() cleans up after a failure */
+      dev->devices[i] = rdev;
+
+      if ((!rdev->vendor) || (!rdev->model) || (!rdev->type))
+	{
+	  DBG (1, "sane_get_devices: not enough free memory\n");
+	  sanei_w_free (&dev->wire,
+			(WireCodecFunc) sanei_w_get_devices_reply, &reply);
+	  free_host_devices (dev);
+	  return SANE_STATUS_NO_MEM;
+	}
+    }
+  /* now free up the rpc return value: */
+  sanei_w_free (&dev->wire,
+		(WireCodecFunc) sanei_w_get_devices_reply, &reply);
+
+  return SANE_STATUS_GOOD;
+}
+
 void
 sane_exit (void)
 {
   Net_Scanner *handle, *next_handle;
   Net_Device *dev, *next_device;
-  int i;
 
   DBG (1, "sane_exit: exiting\n");
 
@@ -1156,22 +1353,13 @@ sane_exit (void)
 	freeaddrinfo(dev->addr);
 #endif /* NET_USES_AF_INDEP */
 
+      free_host_devices (dev);
       free (dev);
     }
   if (devlist)
-    {
-      for (i = 0; devlist[i]; ++i)
-	{
-	  if (devlist[i]->vendor)
-	    free ((void *) devlist[i]->vendor);
-	  if (devlist[i]->model)
-	    free ((void *) devlist[i]->model);
-	  if (devlist[i]->type)
-	    free ((void *) devlist[i]->type);
-	  free ((void *) devlist[i]);
-	}
-      free (devlist);
-    }
+    free (devlist);
+  DBG (2, "sane_exit: device list cache: %d hits, %d misses\n",
+       device_list_hits, device_list_misses);
   DBG (3, "sane_exit: finished.\n");
 }
 
@@ -1180,18 +1368,19 @@ sane_exit (void)
    sane_open() directly (assuming you know the name of the
    backend/device).  This is appropriate for the command-line
    interface of SANE, for example.
+
+   With device_list_ttl set, the list a host returned is reused for
+   that many seconds instead of asking the host again.
  */
 SANE_Status
 sane_get_devices (const SANE_Device *** device_list, SANE_Bool local_only)
 {
   static int devlist_size = 0, devlist_len = 0;
   static const SANE_Device *empty_devlist[1] = { 0 };
-  SANE_Get_Devices_Reply reply;
   SANE_Status status;
   Net_Device *dev;
-  char *full_name;
-  int i, num_devs;
-  size_t len;
+  time_t now;
+  int i;
 #define ASSERT_SPACE(n)                                                    \
   {                                                                        \
     if (devlist_len + (n) > devlist_size)                                  \
@@ -1220,128 +1409,45 @@ sane_get_devices (const SANE_Device *** device_list, SANE_Bool local_only)
   if (devlist)
     {
       DBG (2, "sane_get_devices: freeing devlist\n");
-      for (i = 0; devlist[i]; ++i)
-	{
-	  if (devlist[i]->vendor)
-	    free ((void *) devlist[i]->vendor);
-	  if (devlist[i]->model)
-	    free ((void *) devlist[i]->model);
-	  if (devlist[i]->type)
-	    free ((void *) devlist[i]->type);
-	  free ((void *) devlist[i]);
-	}
       free (devlist);
       devlist = 0;
     }
   devlist_len = 0;
   devlist_size = 0;
 
+  now = time (NULL);
+
   for (dev = first_device; dev; dev = dev->next)
     {
-      if (dev->ctl < 0)
+      if (device_list_ttl > 0 && dev->devices
+	  && now - dev->devices_time < device_list_ttl)
 	{
-	  status = connect_dev (dev);
-	  if (status != SANE_STATUS_GOOD)
-	    {
-	      DBG (1, "sane_get_devices: ignoring failure to connect to %s\n",
-		   dev->name);
-	      continue;
-	    }
+	  device_list_hits++;
+	  DBG (2, "sane_get_devices: device list cache hit for %s "
+	       "(%d hits, %d misses)\n", dev->name,
+	       device_list_hits, device_list_misses);
 	}
-      sanei_w_call (&dev->wire, SANE_NET_GET_DEVICES,
-		    (WireCodecFunc) sanei_w_void, 0,
-		    (WireCodecFunc) sanei_w_get_devices_reply, &reply);
-      if (reply.status != SANE_STATUS_GOOD)
+      else
 	{
-	  DBG (1, "sane_get_devices: ignoring rpc-returned status %s\n",
-	       sane_strstatus (reply.status));
-	  sanei_w_free (&dev->wire,
-			(WireCodecFunc) sanei_w_get_devices_reply, &reply);
-	  continue;
+	  device_list_misses++;
+	  DBG (2, "sane_get_devices: device list cache miss for %s "
+	       "(%d hits, %d misses)\n", dev->name,
+	       device_list_hits, device_list_misses);
+
+	  free_host_devices (dev);
+	  status = fetch_host_devices (dev);
+	  if (status == SANE_STATUS_NO_MEM)
+	    return status;
+	  if (status != SANE_STATUS_GOOD)
+	    continue;
+	  dev->devices_time = now;
 	}
 
-      /* count the number of devices for this backend: */
-      for (num_devs = 0; reply.device_list[num_devs]; ++num_devs);
-
-      ASSERT_SPACE (num_devs);
-
-      for (i = 0; i < num_devs; ++i)
+      for (i = 0; dev->devices[i]; ++i)
 	{
-	  SANE_Device *rdev;
-	  char *mem;
-#ifdef ENABLE_IPV6
-	  SANE_Bool IPv6 = SANE_FALSE;
-#endif /* ENABLE_IPV6 */
-
-	  /* create a new device entry with a device name that is the
-	     sum of the backend name a colon and the backend's device
-	     name: */
-	  len = strlen (dev->name) + 1 + strlen (reply.device_list[i]->name);
-
-#ifdef ENABLE_IPV6
-	  if (strchr (dev->name, ':') != NULL)
-	    {
-	      len += 2;
-	      IPv6 = SANE_TRUE;
-	    }
-#endif /* ENABLE_IPV6 */
-
-	  mem = malloc (sizeof (*dev) + len + 1);
-	  if (!mem)
-	    {
-	      DBG (1, "sane_get_devices: not enough free memory\n");
-	      sanei_w_free (&dev->wire,
-			    (WireCodecFunc) sanei_w_get_devices_reply,
-			    &reply);
-	      return SANE_STATUS_NO_MEM;
-	    }
-
-	  memset (mem, 0, sizeof (*dev) + len);
-	  full_name = mem + sizeof (*dev);
-	  
-#ifdef ENABLE_IPV6
-	  if (IPv6 == SANE_TRUE)
-	    strcat (full_name, "[");
-#endif /* ENABLE_IPV6 */
-
-	  strcat (full_name, dev->name);
-
-#ifdef ENABLE_IPV6	  
-	  if (IPv6 == SANE_TRUE)
-	    strcat (full_name, "]");
-#endif /* ENABLE_IPV6 */
-
-	  strcat (full_name, ":");
-	  strcat (full_name, reply.device_list[i]->name);
-	  DBG (3, "sane_get_devices: got %s\n", full_name);
-
-	  rdev = (SANE_Device *) mem;
-	  rdev->name = full_name;
-	  rdev->vendor = strdup (reply.device_list[i]->vendor);
-	  rdev->model = strdup (reply.device_list[i]->model);
-	  rdev->type = strdup (reply.device_list[i]->type);
-
-	  if ((!rdev->vendor) || (!rdev->model) || (!rdev->type))
-	    {
-	      DBG (1, "sane_get_devices: not enough free memory\n");
-	      if (rdev->vendor)
-		free ((void *) rdev->vendor);
-	      if (rdev->model)
-		free ((void *) rdev->model);
-	      if (rdev->type)
-		free ((void *) rdev->type);
-	      free (rdev);
-	      sanei_w_free (&dev->wire,
-			    (WireCodecFunc) sanei_w_get_devices_reply,
-			    &reply);
-	      return SANE_STATUS_NO_MEM;
-	    }
-
-	  devlist[devlist_len++] = rdev;
+	  ASSERT_SPACE (1);
+	  devlist[devlist_len++] = dev->devices[i];
 	}
-      /* now free up the rpc return value: */
-      sanei_w_free (&dev->wire,
-		    (WireCodecFunc) sanei_w_get_devices_reply, &reply);
     }
 
   /* terminate device list with NULL entry: */
@@ -1667,6 +1773,12 @@ sane_close (SANE_Handle handle)
       DBG (2, "sane_close: closing data pipe\n");
       close (s->data);
     }
+  if (s->read_buf)
+    free (s->read_buf);
+  if (s->zin)
+    free (s->zin);
+  if (s->zout)
+    free (s->zout);
   free (s);
   DBG (2, "sane_close: done\n");
 }
@@ -1847,7 +1959,7 @@ sane_get_parameters (SANE_Handle handle, SANE_Parameters * params)
 
   status = reply.status;
   *params = reply.params;
-  depth = reply.params.depth;
+  s->depth = reply.params.depth;
   sanei_w_free (&s->hw->wire,
 		(WireCodecFunc) sanei_w_get_parameters_reply, &reply);
 
@@ -1875,8 +1987,8 @@ sane_start (SANE_Handle handle)
 
   DBG (3, "sane_start\n");
 
-  hang_over = -1;
-  left_over = -1;
+  s->hang_over = -1;
+  s->left_over = -1;
 
   if (s->data >= 0)
     {
@@ -1884,6 +1996,16 @@ sane_start (SANE_Handle handle)
       return SANE_STATUS_INVAL;
     }
 
+  if (!s->read_buf)
+    {
+      s->read_buf = malloc (NET_READ_BUF_SIZE);
+      if (!s->read_buf)
+	{
+	  DBG (1, "sane_start: not enough memory for receive buffer\n");
+	  return SANE_STATUS_NO_MEM;
+	}
+    }
+
   /* Do this ahead of time so in case anything fails, we can
      recover gracefully (without hanging our server).  */
 
@@ -1928,12 +2050,12 @@ sane_start (SANE_Handle handle)
       port = reply.port;
       if (reply.byte_order == 0x1234)
 	{
-	  server_big_endian = 0;
+	  s->server_big_endian = 0;
 	  DBG (1, "sane_start: server has little endian byte order\n");
 	}
       else
 	{
-	  server_big_endian = 1;
+	  s->server_big_endian = 1;
 	  DBG (1, "sane_start: server has big endian byte order\n");
 	}
 
@@ -1990,6 +2112,12 @@ sane_start (SANE_Handle handle)
   s->data = fd;
   s->reclen_buf_offset = 0;
   s->bytes_remaining = 0;
+  s->select_fd_used = 0;
+  s->read_buf_pos = s->read_buf_len = 0;
+  s->compressed = 0;
+  s->zout_pos = s->zout_len = 0;
+  s->wire_bytes = s->image_bytes = 0;
+  s->zclock = 0;
   DBG (3, "sane_start: done (%s)\n", sane_strstatus (status));
   return status;
 }
@@ -2010,8 +2138,8 @@ sane_start (SANE_Handle handle)
 
   DBG (3, "sane_start\n");
 
-  hang_over = -1;
-  left_over = -1;
+  s->hang_over = -1;
+  s->left_over = -1;
 
   if (s->data >= 0)
     {
@@ -2019,6 +2147,16 @@ sane_start (SANE_Handle handle)
       return SANE_STATUS_INVAL;
     }
 
+  if (!s->read_buf)
+    {
+      s->read_buf = malloc (NET_READ_BUF_SIZE);
+      if (!s->read_buf)
+	{
+	  DBG (1, "sane_start: not enough memory for receive buffer\n");
+	  return SANE_STATUS_NO_MEM;
+	}
+    }
+
   /* Do this ahead of time so in case anything fails, we can
      recover gracefully (without hanging our server).  */
   len = sizeof (sin);
@@ -2046,12 +2184,12 @@ sane_start (SANE_Handle handle)
       port = reply.port;
       if (reply.byte_order == 0x1234)
 	{
-	  server_big_endian = 0;
+	  s->server_big_endian = 0;
 	  DBG (1, "sane_start: server has little endian byte order\n");
 	}
       else
 	{
-	  server_big_endian = 1;
+	  s->server_big_endian = 1;
 	  DBG (1, "sane_start: server has big endian byte order\n");
 	}
 
@@ -2097,228 +2235,398 @@ sane_start (SANE_Handle handle)
   s->data = fd;
   s->reclen_buf_offset = 0;
   s->bytes_remaining = 0;
+  s->select_fd_used = 0;
+  s->read_buf_pos = s->read_buf_len = 0;
+  s->compressed = 0;
+  s->zout_pos = s->zout_len = 0;
+  s->wire_bytes = s->image_bytes = 0;
+  s->zclock = 0;
   DBG (3, "sane_start: done (%s)\n", sane_strstatus (status));
   return status;
 }
 #endif /* NET_USES_AF_INDEP */
 
 
-SANE_Status
-sane_read (SANE_Handle handle, SANE_Byte * data, SANE_Int max_length,
-	   SANE_Int * length)
+/* Unpack a completely received compressed record into s->zout.  */
+static SANE_Status
+decompress_record (Net_Scanner * s)
 {
-  Net_Scanner *s = handle;
-  ssize_t nread;
-  SANE_Int cnt;
-  SANE_Int start_cnt;
-  SANE_Int end_cnt;
-  SANE_Byte swap_buf;
-  SANE_Byte temp_hang_over;
-  int is_even;
+  clock_t c = clock ();
+  size_t size;
+  long len;
 
-  DBG (3, "sane_read: handle=%p, data=%p, max_length=%d, length=%p\n",
-       handle, data, max_length, (void *) length);
-  if (!length)
+  size = (((u_long) s->zin[0] << 24) | ((u_long) s->zin[1] << 16)
+	  | ((u_long) s->zin[2] << 8) | ((u_long) s->zin[3] << 0));
+
+  /* don't let a broken server make us allocate up to 4 GB */
+  if (size > SANEI_NET_MAX_RECORD)
     {
-      DBG (1, "sane_read: length == NULL\n");
-      return SANE_STATUS_INVAL;
+      DBG (1, "decompress_record: record of %lu bytes is too large\n",
+	   (u_long) size);
+      return SANE_STATUS_IO_ERROR;
     }
 
-  is_even = 1;
-  *length = 0;
-
-  /* If there's a left over, i.e. a byte already in the correct byte order,
-     return it immediately; otherwise read may fail with a SANE_STATUS_EOF and
-     the caller never can read the last byte */
-  if ((depth == 16) && (server_big_endian != client_big_endian))
+  if (s->zout_size < size)
     {
-      if (left_over > -1)
+      SANE_Byte *p = realloc (s->zout, size);
+
+      if (!p)
 	{
-	  DBG (3, "sane_read: left_over from previous call, return "
-	       "immediately\n");
-	  /* return the byte, we've currently scanned; hang_over becomes 
-	     left_over */
-	  *data = (SANE_Byte) left_over;
-	  left_over = -1;
-	  *length = 1;
-	  return SANE_STATUS_GOOD;
+	  DBG (1, "decompress_record: not enough memory\n");
+	  return SANE_STATUS_NO_MEM;
 	}
+      s->zout = p;
+      s->zout_size = size;
+    }
+
+  len = sanei_net_decompress (s->zin + 4, s->zin_len - 4, s->zout, size);
+  if (len < 0 || (size_t) len != size)
+    {
+      DBG (1, "decompress_record: corrupt record\n");
+      return SANE_STATUS_IO_ERROR;
     }
+  s->zclock += clock () - c;
+
+  DBG (4, "decompress_record: %lu bytes from %lu\n", (u_long) size,
+       (u_long) s->zin_len);
+  s->image_bytes += size;
+  s->zout_pos = 0;
+  s->zout_len = size;
+  s->compressed = 0;
+  return SANE_STATUS_GOOD;
+}
+
+/* Copy image data from the data connection, in server byte order.  */
+static SANE_Status
+read_data (Net_Scanner * s, SANE_Byte * data, SANE_Int max_length,
+	   SANE_Int * length)
+{
+  ssize_t nread;
+
+  *length = 0;
 
   if (s->data < 0)
     {
-      DBG (1, "sane_read: data pipe doesn't exist, scan cancelled?\n");
+      DBG (1, "read_data: data pipe doesn't exist, scan cancelled?\n");
       return SANE_STATUS_CANCELLED;
     }
 
-  if (s->bytes_remaining == 0)
+  /* Serve as many records as fit into the caller's buffer from the
+     receive buffer.  Only go to the socket when the receive buffer is
+     empty and nothing has been returned yet, so the non-blocking
+     semantics stay the same as with one read() per record.  */
+  nread = 0;
+  while (nread < max_length)
     {
-      /* boy, is this painful or what? */
-      
-      DBG (4, "sane_read: reading packet length\n");
-      nread = read (s->data, s->reclen_buf + s->reclen_buf_offset,
-		    4 - s->reclen_buf_offset);
-      if (nread < 0)
+      size_t avail = s->read_buf_len - s->read_buf_pos;
+      SANE_Byte *dst;
+      ssize_t n;
+
+      /* data left from a decompressed record */
+      if (s->zout_pos < s->zout_len)
 	{
-	  DBG (3, "sane_read: read failed (%s)\n", strerror (errno));
-	  if (errno == EAGAIN)
+	  n = max_length - nread;
+	  if ((size_t) n > s->zout_len - s->zout_pos)
+	    n = s->zout_len - s->zout_pos;
+	  memcpy (data + nread, s->zout + s->zout_pos, n);
+	  s->zout_pos += n;
+	  nread += n;
+	  continue;
+	}
+
+      if (s->bytes_remaining == 0)
+	{
+	  /* don't start a new record, or hit the error signal, while
+	     there is data to return */
+	  if (nread > 0
+	      && (s->reclen_buf_offset != 0 || avail < 4
+		  || memcmp (s->read_buf + s->read_buf_pos,
+			     "\377\377\377\377", 4) == 0))
+	    break;
+
+	  if (avail == 0)
 	    {
-	      DBG (3, "sane_read: try again later\n");
-	      return SANE_STATUS_GOOD;
+	      DBG (4, "read_data: reading packet length\n");
+	      if (s->select_fd_used)
+		n = read (s->data, s->reclen_buf + s->reclen_buf_offset,
+			  4 - s->reclen_buf_offset);
+	      else
+		n = fill_read_buf (s);
+	      if (n < 0)
+		{
+		  DBG (3, "read_data: read failed (%s)\n", strerror (errno));
+		  if (errno == EAGAIN)
+		    {
+		      DBG (3, "read_data: try again later\n");
+		      return SANE_STATUS_GOOD;
+		    }
+		  else
+		    {
+		      DBG (1, "read_data: cancelling read\n");
+		      do_cancel (s);
+		      return SANE_STATUS_IO_ERROR;
+		    }
+		}
+	      if (n == 0)
+		{
+		  DBG (4, "read_data: enough for now\n");
+		  return SANE_STATUS_GOOD;
+		}
+	      if (s->select_fd_used)
+		s->reclen_buf_offset += n;
 	    }
-	  else
+
+	  /* complete the record length from the receive buffer */
+	  avail = s->read_buf_len - s->read_buf_pos;
+	  n = 4 - s->reclen_buf_offset;
+	  if ((size_t) n > avail)
+	    n = avail;
+	  memcpy (s->reclen_buf + s->reclen_buf_offset,
+		  s->read_buf + s->read_buf_pos, n);
+	  s->read_buf_pos += n;
+	  s->reclen_buf_offset += n;
+	  DBG (4, "read_data: got %d from 4 bytes of packet length\n",
+	       s->reclen_buf_offset);
+	  if (s->reclen_buf_offset < 4)
 	    {
-	      DBG (1, "sane_read: cancelling read\n");
-	      do_cancel (s);
-	      return SANE_STATUS_IO_ERROR;
+	      if (s->select_fd_used)
+		{
+		  DBG (4, "read_data: enough for now\n");
+		  return SANE_STATUS_GOOD;
+		}
+	      continue;
 	    }
-	}
-      DBG (4, "sane_read: read %lu bytes, %d from 4 total\n", (u_long) nread,
-	   s->reclen_buf_offset);
-      s->reclen_buf_offset += nread;
-      if (s->reclen_buf_offset < 4)
-	{
-	  DBG (4, "sane_read: enough for now\n");
-	  return SANE_STATUS_GOOD;
-	}
-
-      s->reclen_buf_offset = 0;
-      s->bytes_remaining = (((u_long) s->reclen_buf[0] << 24)
-			    | ((u_long) s->reclen_buf[1] << 16)
-			    | ((u_long) s->reclen_buf[2] << 8)
-			    | ((u_long) s->reclen_buf[3] << 0));
-      DBG (3, "sane_read: next record length=%ld bytes\n",
-	   (long) s->bytes_remaining);
-      if (s->bytes_remaining == 0xffffffff)
-	{
-	  char ch;
 
-	  DBG (2, "sane_read: received error signal\n");
+	  s->reclen_buf_offset = 0;
+	  s->bytes_remaining = (((u_long) s->reclen_buf[0] << 24)
+				| ((u_long) s->reclen_buf[1] << 16)
+				| ((u_long) s->reclen_buf[2] << 8)
+				| ((u_long) s->reclen_buf[3] << 0));
+	  DBG (3, "read_data: next record length=%ld bytes\n",
+	       (long) s->bytes_remaining);
+	  if (s->bytes_remaining == 0xffffffff)
+	    {
+	      char ch;
 
-	  /* turn off non-blocking I/O (s->data will be closed anyhow): */
-	  fcntl (s->data, F_SETFL, 0);
+	      DBG (2, "read_data: received error signal\n");
 
-	  /* read the status byte: */
-	  if (read (s->data, &ch, sizeof (ch)) != 1)
+	      if (s->read_buf_pos < s->read_buf_len)
+		ch = s->read_buf[s->read_buf_pos++];
+	      else
+		{
+		  /* turn off non-blocking I/O (s->data will be closed
+		     anyhow): */
+		  fcntl (s->data, F_SETFL, 0);
+
+		  /* read the status byte: */
+		  if (read (s->data, &ch, sizeof (ch)) != 1)
+		    {
+		      DBG (1, "read_data: failed to read error code\n");
+		      ch = SANE_STATUS_IO_ERROR;
+		    }
+		}
+	      DBG (1, "read_data: error code %s\n",
+		   sane_strstatus ((SANE_Status) ch));
+	      if (s->hw->compression)
+		DBG (2, "read_data: received %lu bytes for %lu bytes of "
+		     "image data (ratio %.2f), %.3f s CPU time\n",
+		     s->wire_bytes, s->image_bytes,
+		     s->wire_bytes ? (double) s->image_bytes / s->wire_bytes
+		     : 0.0, (double) s->zclock / CLOCKS_PER_SEC);
+	      do_cancel (s);
+	      return (SANE_Status) ch;
+	    }
+	  s->wire_bytes += 4;
+	  if (s->bytes_remaining & SANEI_NET_RECORD_COMPRESSED)
 	    {
-	      DBG (1, "sane_read: failed to read error code\n");
-	      ch = SANE_STATUS_IO_ERROR;
+	      s->bytes_remaining &= ~SANEI_NET_RECORD_COMPRESSED;
+	      if (!s->hw->compression || s->bytes_remaining < 4
+		  || s->bytes_remaining > SANEI_NET_MAX_RECORD)
+		{
+		  DBG (1, "read_data: unexpected compressed record\n");
+		  do_cancel (s);
+		  return SANE_STATUS_IO_ERROR;
+		}
+	      if (s->zin_size < s->bytes_remaining)
+		{
+		  SANE_Byte *p = realloc (s->zin, s->bytes_remaining);
+
+		  if (!p)
+		    {
+		      DBG (1, "read_data: not enough memory\n");
+		      do_cancel (s);
+		      return SANE_STATUS_NO_MEM;
+		    }
+		  s->zin = p;
+		  s->zin_size = s->bytes_remaining;
+		}
+	      s->zin_len = 0;
+	      s->compressed = 1;
 	    }
-	  DBG (1, "sane_read: error code %s\n",
-	       sane_strstatus ((SANE_Status) ch));
-	  do_cancel (s);
-	  return (SANE_Status) ch;
+	  continue;
 	}
-    }
 
-  if (max_length > (SANE_Int) s->bytes_remaining)
-    max_length = s->bytes_remaining;
-
-  nread = read (s->data, data, max_length);
-  
-  if (nread < 0)
-    {
-      DBG (2, "sane_read: error code %s\n", strerror (errno));
-      if (errno == EAGAIN)
-	return SANE_STATUS_GOOD;
+      /* compressed records are collected completely before they are
+	 decompressed */
+      if (s->compressed)
+	{
+	  dst = s->zin + s->zin_len;
+	  n = s->bytes_remaining;
+	}
       else
 	{
-	  DBG (1, "sane_read: cancelling scan\n");
-	  do_cancel (s);
-	  return SANE_STATUS_IO_ERROR;
+	  dst = data + nread;
+	  n = max_length - nread;
+	  if (n > (SANE_Int) s->bytes_remaining)
+	    n = s->bytes_remaining;
 	}
-    }
 
-  s->bytes_remaining -= nread;
-
-  *length = nread;
-  /* Check whether we are scanning with a depth of 16 bits/pixel and whether
-     server and client have different byte order. If this is true, then it's
-     neccessary to check whether read returned an odd number. If an odd number
-     has been returned, we must save the last byte.
-  */
-  if ((depth == 16) && (server_big_endian != client_big_endian))
-    {
-      DBG (1,"sane_read: client/server have different byte order; "
-	   "must swap\n");
-      /* special case: 1 byte scanned and hang_over */
-      if ((nread == 1) && (hang_over > -1))
+      if (avail > 0)
 	{
-	  /* return the byte, we've currently scanned; hang_over becomes 
-	     left_over */
-	  left_over = hang_over;
-	  hang_over = -1;
-	  return SANE_STATUS_GOOD;
+	  if ((size_t) n > avail)
+	    n = avail;
+	  memcpy (dst, s->read_buf + s->read_buf_pos, n);
+	  s->read_buf_pos += n;
 	}
-      /* check whether an even or an odd number of bytes has been scanned */
-      if ((nread % 2) == 0)
-        is_even = 1;
+      else if (nread > 0)
+	break;
       else
-        is_even = 0;
-      /* check, whether there's a hang over from a previous call;
-	 in this case we memcopy the data up one byte */
-      if ((nread > 1) && (hang_over > -1))
 	{
-	  /* store last byte */
-	  temp_hang_over = *(data + nread - 1);
-	  memmove (data + 1, data, nread - 1);
-	  *data = (SANE_Byte) hang_over;
-	  /* what happens with the last byte depends on whether the number
-	     of bytes is even or odd */
-	  if (is_even == 1)
+	  /* large requests go straight into the caller's buffer */
+	  if (s->select_fd_used || n >= NET_READ_BUF_SIZE)
+	    n = read (s->data, dst, n);
+	  else
 	    {
-	      /* number of bytes is even; no new hang_over, exchange last
-		 byte with hang over; last byte becomes left_over */
-	      left_over = *(data + nread - 1);
-	      *(data + nread - 1) = temp_hang_over;
-	      hang_over = -1;
-	      start_cnt = 0;
-	      /* last byte already swapped */
-	      end_cnt = nread - 2;
+	      n = fill_read_buf (s);
+	      if (n > 0)
+		continue;
 	    }
-	  else
+
+	  if (n < 0)
 	    {
-	      /* number of bytes is odd; last byte becomes new hang_over */
-	      hang_over = temp_hang_over;
-	      left_over = -1;
-	      start_cnt = 0;
-	      end_cnt = nread - 1;
+	      DBG (2, "read_data: error code %s\n", strerror (errno));
+	      if (errno == EAGAIN)
+		return SANE_STATUS_GOOD;
+	      else
+		{
+		  DBG (1, "read_data: cancelling scan\n");
+		  do_cancel (s);
+		  return SANE_STATUS_IO_ERROR;
+		}
 	    }
+	  if (n == 0)
+	    break;
 	}
-      else if (nread == 1)
-	{
-	  /* if only one byte has been read, save it as hang_over and return
-	     length=0 */
-	  hang_over = (int) *data;
-	  *length = 0;
-	  return SANE_STATUS_GOOD;
-	}
-      else
+
+      s->bytes_remaining -= n;
+      s->wire_bytes += n;
+
+      if (s->compressed)
 	{
-	  /* no hang_over; test for even or odd byte number */
-	  if(is_even == 1)
-	    {
-	      start_cnt = 0;
-	      end_cnt = *length;
-	    }
-	  else
+	  s->zin_len += n;
+	  if (s->bytes_remaining == 0)
 	    {
-	      start_cnt = 0;
-	      hang_over = *(data + *length - 1);
-	      *length -= 1;
-	      end_cnt = *length;
+	      SANE_Status status = decompress_record (s);
+
+	      if (status != SANE_STATUS_GOOD)
+		{
+		  do_cancel (s);
+		  return status;
+		}
 	    }
+	  continue;
 	}
-      /* swap the bytes */
-      for (cnt = start_cnt; cnt < end_cnt - 1; cnt += 2)
+
+      s->image_bytes += n;
+      nread += n;
+
+      /* the old one-record-per-call behaviour */
+      if (s->select_fd_used)
+	break;
+    }
+
+  *length = nread;
+  DBG (3, "read_data: %lu bytes read, %lu remaining\n", (u_long) nread,
+       (u_long) s->bytes_remaining);
+
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sane_read (SANE_Handle handle, SANE_Byte * data, SANE_Int max_length,
+	   SANE_Int * length)
+{
+  Net_Scanner *s = handle;
+  SANE_Status status;
+  SANE_Int offset, nread;
+
+  DBG (3, "sane_read: handle=%p, data=%p, max_length=%d, length=%p\n",
+       handle, data, max_length, (void *) length);
+  if (!length)
+    {
+      DBG (1, "sane_read: length == NULL\n");
+      return SANE_STATUS_INVAL;
+    }
+
+  *length = 0;
+
+  if ((s->depth != 16) || (s->server_big_endian == client_big_endian))
+    return read_data (s, data, max_length, length);
+
+  /* Client and server have different byte order, so the samples must be
+     swapped.  An odd byte at the end of a read is kept as hang_over and
+     goes in front of the next read; left_over is a swapped byte that
+     didn't fit into a one-byte buffer.  Both are per handle.  */
+
+  /* If there's a left over, return it immediately; otherwise read may
+     fail with a SANE_STATUS_EOF and the caller never can read the last
+     byte */
+  if (s->left_over > -1)
+    {
+      DBG (3, "sane_read: left_over from previous call, return "
+	   "immediately\n");
+      *data = (SANE_Byte) s->left_over;
+      s->left_over = -1;
+      *length = 1;
+      return SANE_STATUS_GOOD;
+    }
+
+  offset = 0;
+  if (s->hang_over > -1)
+    {
+      if (max_length < 2)
 	{
-	  swap_buf = *(data + cnt);
-	  *(data + cnt) = *(data + cnt + 1);
-	  *(data + cnt + 1) = swap_buf;
+	  SANE_Byte byte;
+
+	  status = read_data (s, &byte, 1, &nread);
+	  if (status != SANE_STATUS_GOOD || nread == 0)
+	    return status;
+	  *data = byte;
+	  s->left_over = s->hang_over;
+	  s->hang_over = -1;
+	  *length = 1;
+	  return SANE_STATUS_GOOD;
 	}
+      *data = (SANE_Byte) s->hang_over;
+      offset = 1;
+    }
+
+  status = read_data (s, data + offset, max_length - offset, &nread);
+  if (status != SANE_STATUS_GOOD)
+    return status;
+
+  nread += offset;
+  s->hang_over = -1;
+  if (nread % 2)
+    {
+      s->hang_over = data[nread - 1];
+      nread--;
     }
-  DBG (3, "sane_read: %lu bytes read, %lu remaining\n", (u_long) nread,
-       (u_long) s->bytes_remaining);
+
+  DBG (4, "sane_read: client/server have different byte order; "
+       "swapping %d bytes\n", nread);
+  swap_16 (data, nread);
+  *length = nread;
 
   return SANE_STATUS_GOOD;
 }
@@ -2372,6 +2680,10 @@ sane_get_select_fd (SANE_Handle handle, SANE_Int * fd)
       return SANE_STATUS_INVAL;
     }
 
+  /* Data held in the receive buffer wouldn't wake up select(), so stop
+     reading ahead of the current record from now on.  */
+  s->select_fd_used = 1;
+
   *fd = s->data;
   DBG (3, "sane_get_select_fd: done; *fd = %d\n", *fd);
   return SANE_STATUS_GOOD;
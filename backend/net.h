@@ -45,6 +45,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <time.h>
 
 #include "../include/sane/sanei_wire.h"
 #include "../include/sane/config.h"
@@ -62,6 +63,9 @@ typedef struct Net_Device
     int ctl;			/* socket descriptor (or -1) */
     Wire wire;
     int auth_active;
+    int compression;		/* server compresses image data */
+    const SANE_Device **devices;	/* last device list of this host */
+    time_t devices_time;	/* when devices was fetched */
   }
 Net_Device;
 
@@ -79,6 +83,28 @@ typedef struct Net_Scanner
     int reclen_buf_offset;
     u_char reclen_buf[4];
     size_t bytes_remaining;	/* how many bytes left in this record? */
+    int select_fd_used;		/* frontend waits on the data socket */
+
+    /* byte order conversion of 16 bit samples: */
+    int depth;			/* bits per sample */
+    int server_big_endian;	/* 1 == big endian; 0 == little endian */
+    int hang_over;		/* odd byte not yet swapped, or -1 */
+    int left_over;		/* swapped byte not yet returned, or -1 */
+
+    /* receive buffer for the data socket: */
+    SANE_Byte *read_buf;
+    size_t read_buf_pos;	/* first unconsumed byte */
+    size_t read_buf_len;	/* end of valid data */
+
+    /* compressed records: */
+    int compressed;		/* current record is compressed */
+    SANE_Byte *zin;		/* compressed record being received */
+    size_t zin_size, zin_len;
+    SANE_Byte *zout;		/* decompressed data not yet returned */
+    size_t zout_size, zout_pos, zout_len;
+    u_long wire_bytes;		/* bytes received for this scan */
+    u_long image_bytes;		/* bytes of image data for this scan */
+    clock_t zclock;		/* CPU time spent decompressing */
 
     /* device (host) info: */
     Net_Device *hw;
@@ -0,0 +1,65 @@
+/* sane - Scanner Access Now Easy.
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+*/
+
+/* Byte swapping of 16 bit image data for the net backend.  Included by
+   net.c and by tools/net_swap_bench.c.  */
+
+/* Swap the bytes of n / 2 16 bit samples in place.  Whole 32 bit words
+   are swapped at once, which compilers turn into vector code.  */
+static void
+swap_16 (SANE_Byte * data, SANE_Int n)
+{
+  uint32_t w;
+  SANE_Int i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      memcpy (&w, data + i, sizeof (w));
+      w = ((w & 0x00ff00ffU) << 8) | ((w >> 8) & 0x00ff00ffU);
+      memcpy (data + i, &w, sizeof (w));
+    }
+  for (; i + 2 <= n; i += 2)
+    {
+      SANE_Byte tmp = data[i];
+      data[i] = data[i + 1];
+      data[i + 1] = tmp;
+    }
+}
@@ -55,6 +55,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -76,6 +77,9 @@
 
 #define TEST_CONFIG_FILE "test.conf"
 
+/* bytes between the reader task and sane_read() */
+#define RING_SIZE (4 * BUFFER_SIZE)
+
 static SANE_Bool inited = SANE_FALSE;
 static SANE_Device **sane_device_list = 0;
 static Test_Device *first_test_device = 0;
@@ -110,6 +114,12 @@ static SANE_Range read_delay_duration_range = {
   1000
 };
 
+static SANE_Range device_rate_range = {
+  0,
+  1024 * 1024,			/* 1 GB/s */
+  1
+};
+
 static SANE_Range int_constraint_range = {
   4,
   192,
@@ -214,6 +224,8 @@ static SANE_Bool init_read_limit = SANE_FALSE;
 static SANE_Word init_read_limit_size = 1;
 static SANE_Bool init_read_delay = SANE_FALSE;
 static SANE_Word init_read_delay_duration = 1000;
+static SANE_Bool init_direct_read = SANE_FALSE;
+static SANE_Word init_device_rate = 0;
 static SANE_String init_read_status_code = "Default";
 static SANE_Bool init_fuzzy_parameters = SANE_FALSE;
 static SANE_Word init_ppl_loss = 0;
@@ -537,6 +549,37 @@ init_options (Test_Device * test_device)
   od->constraint.range = &read_delay_duration_range;
   test_device->val[opt_read_delay_duration].w = init_read_delay_duration;
 
+  /* opt_direct_read */
+  od = &test_device->opt[opt_direct_read];
+  od->name = "direct-read";
+  od->title = SANE_I18N ("Read without a reader task");
+  od->desc = SANE_I18N ("Copy the test picture straight into the buffer "
+			"passed to sane_read() instead of having a reader "
+			"process or thread send it. No select file "
+			"descriptor is offered in this mode.");
+  od->type = SANE_TYPE_BOOL;
+  od->unit = SANE_UNIT_NONE;
+  od->size = sizeof (SANE_Word);
+  od->cap = SANE_CAP_SOFT_DETECT | SANE_CAP_SOFT_SELECT;
+  od->constraint_type = SANE_CONSTRAINT_NONE;
+  od->constraint.range = 0;
+  test_device->val[opt_direct_read].w = init_direct_read;
+
+  /* opt_device_rate */
+  od = &test_device->opt[opt_device_rate];
+  od->name = "device-rate";
+  od->title = SANE_I18N ("Device rate");
+  od->desc = SANE_I18N ("Simulate a scanner that delivers this many "
+			"kilobytes per second, a whole line at a time. "
+			"0 delivers the data as fast as possible.");
+  od->type = SANE_TYPE_INT;
+  od->unit = SANE_UNIT_NONE;
+  od->size = sizeof (SANE_Word);
+  od->cap = SANE_CAP_SOFT_DETECT | SANE_CAP_SOFT_SELECT;
+  od->constraint_type = SANE_CONSTRAINT_RANGE;
+  od->constraint.range = &device_rate_range;
+  test_device->val[opt_device_rate].w = init_device_rate;
+
   /* opt_read_status_code */
   od = &test_device->opt[opt_read_status_code];
   od->name = "read-return-value";
@@ -1245,16 +1288,14 @@ read_option (SANE_String line, SANE_String option_string,
 }
 
 static SANE_Status
-reader_process (Test_Device * test_device, SANE_Int fd)
+reader_process (Test_Device * test_device)
 {
   SANE_Status status;
   SANE_Word byte_count = 0, bytes_total;
   SANE_Byte *buffer = 0;
-  ssize_t bytes_written = 0;
-  size_t buffer_size = 0, write_count = 0;
+  size_t buffer_size = 0, write_count;
 
-  DBG (2, "(child) reader_process: test_device=%p, fd=%d\n",
-       (void *) test_device, fd);
+  DBG (2, "(child) reader_process: test_device=%p\n", (void *) test_device);
 
   bytes_total = test_device->lines * test_device->bytes_per_line;
   status = init_picture_buffer (test_device, &buffer, &buffer_size);
@@ -1266,44 +1307,30 @@ reader_process (Test_Device * test_device, SANE_Int fd)
 
   while (byte_count < bytes_total)
     {
-      if (write_count == 0)
-	{
-	  write_count = buffer_size;
-	  if (byte_count + (SANE_Word) write_count > bytes_total)
-	    write_count = bytes_total - byte_count;
+      write_count = buffer_size;
+      if (byte_count + (SANE_Word) write_count > bytes_total)
+	write_count = bytes_total - byte_count;
 
-	  if (test_device->val[opt_read_delay].w == SANE_TRUE)
-	    usleep (test_device->val[opt_read_delay_duration].w);
-	}
-      bytes_written = write (fd, buffer, write_count);
-      if (bytes_written < 0)
+      if (test_device->val[opt_read_delay].w == SANE_TRUE)
+	usleep (test_device->val[opt_read_delay_duration].w);
+
+      status = sanei_thread_ring_write (test_device->ring, buffer,
+					write_count);
+      if (status != SANE_STATUS_GOOD)
 	{
-	  DBG (1, "(child) reader_process: write returned %s\n",
-	       strerror (errno));
-	  return SANE_STATUS_IO_ERROR;
+	  DBG (1, "(child) reader_process: sanei_thread_ring_write "
+	       "returned %s\n", sane_strstatus (status));
+	  free (buffer);
+	  return status;
 	}
-      byte_count += bytes_written;
-      DBG (4, "(child) reader_process: wrote %ld bytes of %lu (%d total)\n",
-	   (long) bytes_written, (u_long) write_count, byte_count);
-      write_count -= bytes_written;
+      byte_count += write_count;
+      DBG (4, "(child) reader_process: wrote %lu bytes (%d total)\n",
+	   (u_long) write_count, byte_count);
     }
 
   free (buffer);
-
-  if (sanei_thread_is_forked ())
-    {
-	  DBG (4, "(child) reader_process: finished,  wrote %d bytes, expected %d "
-       "bytes, now waiting\n", byte_count, bytes_total);
-	  while (SANE_TRUE)
-	    sleep (10);
-	  DBG (4, "(child) reader_process: this should have never happened...");
-	  close (fd);
-    }
-  else
-    {
-	  DBG (4, "(child) reader_process: finished,  wrote %d bytes, expected %d "
+  DBG (4, "(child) reader_process: finished, wrote %d bytes, expected %d "
        "bytes\n", byte_count, bytes_total);
-    }
   return SANE_STATUS_GOOD;
 }
 
@@ -1314,26 +1341,11 @@ static int
 reader_task (void *data)
 {
   SANE_Status status;
-  struct SIGACTION act;
   struct Test_Device *test_device = (struct Test_Device *) data;
 
-  DBG (2, "reader_task started\n");
-  if (sanei_thread_is_forked ())
-    {
-      DBG (3, "reader_task started (forked)\n");
-      close (test_device->pipe);
-      test_device->pipe = -1;
-
-    }
-  else
-    {
-      DBG (3, "reader_task started (as thread)\n");
-    }
-
-  memset (&act, 0, sizeof (act));
-  sigaction (SIGTERM, &act, 0);
-
-  status = reader_process (test_device, test_device->reader_fds);
+  DBG (2, "reader_task started (%s)\n",
+       sanei_thread_is_forked ()? "forked" : "as thread");
+  status = reader_process (test_device);
   DBG (2, "(child) reader_task: reader_process finished (%s)\n",
        sane_strstatus (status));
   return (int) status;
@@ -1346,44 +1358,81 @@ finish_pass (Test_Device * test_device)
 
   DBG (2, "finish_pass: test_device=%p\n", (void *) test_device);
   test_device->scanning = SANE_FALSE;
-  if (test_device->pipe >= 0)
+  if (test_device->ring)
     {
-      DBG (2, "finish_pass: closing pipe\n");
-      close (test_device->pipe);
-      DBG (2, "finish_pass: pipe closed\n");
-      test_device->pipe = -1;
+      SANE_Status status;
+
+      DBG (2, "finish_pass: stopping reader task\n");
+      status = sanei_thread_ring_stop (test_device->ring);
+      DBG (2, "finish_pass: reader task ended with status: %s\n",
+	   sane_strstatus (status));
     }
-  if (test_device->reader_pid != -1)
+  if (test_device->picture)
     {
-      int status;
-      SANE_Pid pid;
+      free (test_device->picture);
+      test_device->picture = 0;
+    }
+  return return_status;
+}
 
-      DBG (2, "finish_pass: terminating reader process %ld\n",
-	   (long) test_device->reader_pid);
-      sanei_thread_kill (test_device->reader_pid);
-      pid = sanei_thread_waitpid (test_device->reader_pid, &status);
-      if (pid == -1)
-	{
-	  DBG (1,
-	       "finish_pass: sanei_thread_waitpid failed, already terminated? (%s)\n",
-	       strerror (errno));
-	}
-      else
+/* Limits *count to the whole lines a scanner running at device-rate
+   kB/s would have delivered by now.  Waits for the next line if there
+   is none yet, unless in non-blocking mode, where *count becomes 0. */
+static void
+wait_for_device (Test_Device * test_device, size_t * count)
+{
+  double line_usec, elapsed;
+  SANE_Word bpl = test_device->bytes_per_line;
+  SANE_Int lines, ready;
+  struct timeval now;
+
+  if (test_device->val[opt_device_rate].w <= 0)
+    return;
+
+  line_usec = bpl * 1000000.0 / (test_device->val[opt_device_rate].w * 1024.0);
+  gettimeofday (&now, 0);
+  elapsed = (now.tv_sec - test_device->start.tv_sec) * 1000000.0
+    + (now.tv_usec - test_device->start.tv_usec);
+  lines = (SANE_Int) (elapsed / line_usec);
+  if (lines > test_device->lines)
+    lines = test_device->lines;
+  ready = lines * bpl - test_device->bytes_total;
+
+  if (ready <= 0)
+    {
+      if (test_device->non_blocking)
 	{
-	  DBG (2, "finish_pass: reader process terminated with status: %s\n",
-	       sane_strstatus (status));
+	  *count = 0;
+	  return;
 	}
-      test_device->reader_pid = -1;
+      lines = test_device->bytes_total / bpl + 1;
+      usleep ((useconds_t) (lines * line_usec - elapsed));
+      ready = lines * bpl - test_device->bytes_total;
     }
-  /* this happens when running in thread context... */
-  if (test_device->reader_fds >= 0)
+  if (*count > (size_t) ready)
+    *count = ready;
+}
+
+/* direct-read: copies the next COUNT bytes of the repeating picture to
+   DATA, as the reader task would have sent them. */
+static void
+direct_read (Test_Device * test_device, SANE_Byte * data, size_t count)
+{
+  size_t offset = test_device->bytes_total % test_device->picture_size;
+  size_t chunk;
+
+  while (count > 0)
     {
-      DBG (2, "finish_pass: closing reader pipe\n");
-      close (test_device->reader_fds);
-      DBG (2, "finish_pass: reader pipe closed\n");
-      test_device->reader_fds = -1;
+      if (offset == 0 && test_device->val[opt_read_delay].w == SANE_TRUE)
+	usleep (test_device->val[opt_read_delay_duration].w);
+      chunk = test_device->picture_size - offset;
+      if (chunk > count)
+	chunk = count;
+      memcpy (data, test_device->picture + offset, chunk);
+      data += chunk;
+      count -= chunk;
+      offset = 0;
     }
-  return return_status;
 }
 
 static void
@@ -1556,6 +1605,12 @@ sane_init (SANE_Int * __sane_unused__ version_code, SANE_Auth_Callback __sane_un
 	  if (read_option (line, "read-delay-duration", param_int,
 			   &init_read_delay_duration) == SANE_STATUS_GOOD)
 	    continue;
+	  if (read_option (line, "direct-read", param_bool,
+			   &init_direct_read) == SANE_STATUS_GOOD)
+	    continue;
+	  if (read_option (line, "device-rate", param_int,
+			   &init_device_rate) == SANE_STATUS_GOOD)
+	    continue;
 	  if (read_option (line, "read-status-code", param_string,
 			   &init_read_status_code) == SANE_STATUS_GOOD)
 	    continue;
@@ -1638,8 +1693,8 @@ sane_init (SANE_Int * __sane_unused__ version_code, SANE_Auth_Callback __sane_un
       test_device->eof = SANE_FALSE;
       test_device->scanning = SANE_FALSE;
       test_device->cancelled = SANE_FALSE;
-      test_device->reader_pid = -1;
-      test_device->pipe = -1;
+      test_device->ring = 0;
+      test_device->picture = 0;
       DBG (4, "sane_init: new device: `%s' is a %s %s %s\n",
 	   test_device->sane.name, test_device->sane.vendor,
 	   test_device->sane.model, test_device->sane.type);
@@ -1670,6 +1725,8 @@ sane_exit (void)
       DBG (4, "sane_exit: freeing device %s\n", test_device->name);
       previous_device = test_device;
       test_device = test_device->next;
+      if (previous_device->ring)
+	sanei_thread_ring_free (previous_device->ring);
       if (previous_device->name)
 	free (previous_device->name);
       free (previous_device);
@@ -1679,6 +1736,7 @@ sane_exit (void)
     free (sane_device_list);
   sane_device_list = NULL;
   first_test_device = NULL;
+  sanei_thread_pool_exit ();
   inited = SANE_FALSE;
   return;
 }
@@ -1790,6 +1848,13 @@ sane_close (SANE_Handle handle)
       DBG (1, "sane_close: handle %p not open\n", (void *) handle);
       return;
     }
+  if (test_device->scanning)
+    finish_pass (test_device);
+  if (test_device->ring)
+    {
+      sanei_thread_ring_free (test_device->ring);
+      test_device->ring = 0;
+    }
   test_device->open = SANE_FALSE;
   return;
 }
@@ -1966,6 +2031,7 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	case opt_read_limit_size:	/* Int */
 	case opt_ppl_loss:
 	case opt_read_delay_duration:
+	case opt_device_rate:
 	case opt_int:
 	case opt_int_constraint_range:
 	  if (test_device->val[option].w == *(SANE_Int *) value)
@@ -1992,6 +2058,7 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	       *(SANE_Bool *) value == SANE_TRUE ? "true" : "false");
 	  break;
 	case opt_invert_endianess:	/* Bool */
+	case opt_direct_read:
 	case opt_non_blocking:
 	case opt_select_fd:
 	case opt_bool_soft_select_soft_detect:
@@ -2255,6 +2322,7 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	case opt_invert_endianess:
 	case opt_read_limit:
 	case opt_read_delay:
+	case opt_direct_read:
 	case opt_fuzzy_parameters:
 	case opt_non_blocking:
 	case opt_select_fd:
@@ -2286,6 +2354,7 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	case opt_read_limit_size:
 	case opt_ppl_loss:
 	case opt_read_delay_duration:
+	case opt_device_rate:
 	case opt_int:
 	case opt_int_constraint_range:
 	case opt_int_constraint_word_list:
@@ -2481,7 +2550,7 @@ SANE_Status
 sane_start (SANE_Handle handle)
 {
   Test_Device *test_device = handle;
-  int pipe_descriptor[2];
+  SANE_Status status;
 
   DBG (2, "sane_start: handle=%p\n", handle);
   if (!inited)
@@ -2553,29 +2622,46 @@ sane_start (SANE_Handle handle)
       return SANE_STATUS_INVAL;
     }
 
-  if (pipe (pipe_descriptor) < 0)
+  test_device->non_blocking = SANE_FALSE;
+  gettimeofday (&test_device->start, 0);
+
+  if (test_device->val[opt_direct_read].w == SANE_TRUE)
     {
-      DBG (1, "sane_start: pipe failed (%s)\n", strerror (errno));
-      return SANE_STATUS_IO_ERROR;
+      status = init_picture_buffer (test_device, &test_device->picture,
+				    &test_device->picture_size);
+      if (status != SANE_STATUS_GOOD)
+	{
+	  test_device->picture = 0;
+	  test_device->scanning = SANE_FALSE;
+	  return status;
+	}
+      DBG (2, "sane_start: reading directly from a %lu byte picture\n",
+	   (u_long) test_device->picture_size);
+      return SANE_STATUS_GOOD;
     }
 
-  /* create reader routine as new process or thread */
-  test_device->pipe = pipe_descriptor[0];
-  test_device->reader_fds = pipe_descriptor[1];
-  test_device->reader_pid =
-    sanei_thread_begin (reader_task, (void *) test_device);
-
-  if (test_device->reader_pid == -1)
+  if (!test_device->ring)
     {
-      DBG (1, "sane_start: sanei_thread_begin failed (%s)\n",
-	   strerror (errno));
-      return SANE_STATUS_NO_MEM;
+      status = sanei_thread_ring_new (RING_SIZE, &test_device->ring);
+      if (status != SANE_STATUS_GOOD)
+	{
+	  DBG (1, "sane_start: sanei_thread_ring_new failed (%s)\n",
+	       sane_strstatus (status));
+	  test_device->ring = 0;
+	  test_device->scanning = SANE_FALSE;
+	  return status;
+	}
     }
 
-  if (sanei_thread_is_forked ())
+  /* run the reader routine in a thread of the pool or in a new process */
+  status = sanei_thread_ring_start (test_device->ring, reader_task,
+				    (void *) test_device);
+  if (status != SANE_STATUS_GOOD)
     {
-      close (test_device->reader_fds);
-      test_device->reader_fds = -1;
+      DBG (1, "sane_start: sanei_thread_ring_start failed (%s)\n",
+	   sane_strstatus (status));
+      test_device->scanning = SANE_FALSE;
+      return status;
     }
 
   return SANE_STATUS_GOOD;
@@ -2587,6 +2673,7 @@ sane_read (SANE_Handle handle, SANE_Byte * data,
 	   SANE_Int max_length, SANE_Int * length)
 {
   Test_Device *test_device = handle;
+  SANE_Status status;
   SANE_Int max_scan_length;
   ssize_t bytes_read;
   size_t read_count;
@@ -2677,11 +2764,42 @@ sane_read (SANE_Handle handle, SANE_Byte * data,
     }
   read_count = max_scan_length;
 
-  bytes_read = read (test_device->pipe, data, read_count);
+  wait_for_device (test_device, &read_count);
+  if (read_count == 0)
+    {
+      DBG (2, "sane_read: no line ready yet, try again\n");
+      return SANE_STATUS_GOOD;
+    }
+
+  if (test_device->picture)
+    {
+      if (read_count > (size_t) (bytes_total - test_device->bytes_total))
+	read_count = bytes_total - test_device->bytes_total;
+      direct_read (test_device, data, read_count);
+      bytes_read = read_count;
+    }
+  else
+    {
+      size_t count;
+
+      status = sanei_thread_ring_read (test_device->ring, data, read_count,
+				       &count);
+      if (status == SANE_STATUS_GOOD && count == 0)
+	{
+	  DBG (2, "sane_read: no data available, try again\n");
+	  return SANE_STATUS_GOOD;
+	}
+      if (status != SANE_STATUS_GOOD && status != SANE_STATUS_EOF)
+	{
+	  DBG (1, "sane_read: reader task failed: %s\n",
+	       sane_strstatus (status));
+	  return status;
+	}
+      bytes_read = count;
+    }
   if (bytes_read == 0
       || (bytes_read + test_device->bytes_total >= bytes_total))
     {
-      SANE_Status status;
       DBG (2, "sane_read: EOF reached\n");
       status = finish_pass (test_device);
       if (status != SANE_STATUS_GOOD)
@@ -2701,19 +2819,6 @@ sane_read (SANE_Handle handle, SANE_Byte * data,
       if (bytes_read == 0)
 	return SANE_STATUS_EOF;
     }
-  else if (bytes_read < 0)
-    {
-      if (errno == EAGAIN)
-	{
-	  DBG (2, "sane_read: no data available, try again\n");
-	  return SANE_STATUS_GOOD;
-	}
-      else
-	{
-	  DBG (1, "sane_read: read returned error: %s\n", strerror (errno));
-	  return SANE_STATUS_IO_ERROR;
-	}
-    }
   *length = bytes_read;
   test_device->bytes_total += bytes_read;
 
@@ -2790,12 +2895,14 @@ sane_set_io_mode (SANE_Handle handle, SANE_Bool non_blocking)
     }
   if (test_device->val[opt_non_blocking].w == SANE_TRUE)
     {
-      if (fcntl (test_device->pipe,
-		 F_SETFL, non_blocking ? O_NONBLOCK : 0) < 0)
+      if (!test_device->picture
+	  && sanei_thread_ring_set_io_mode (test_device->ring, non_blocking)
+	  != SANE_STATUS_GOOD)
 	{
 	  DBG (1, "sane_set_io_mode: can't set io mode");
 	  return SANE_STATUS_INVAL;
 	}
+      test_device->non_blocking = non_blocking;
     }
   else
     {
@@ -2832,9 +2939,10 @@ sane_get_select_fd (SANE_Handle handle, SANE_Int * fd)
       DBG (1, "sane_get_select_fd: not scanning\n");
       return SANE_STATUS_INVAL;
     }
-  if (test_device->val[opt_select_fd].w == SANE_TRUE)
+  if (test_device->val[opt_select_fd].w == SANE_TRUE
+      && !test_device->picture)
     {
-      *fd = test_device->pipe;
+      *fd = sanei_thread_ring_get_select_fd (test_device->ring);
       return SANE_STATUS_GOOD;
     }
   return SANE_STATUS_UNSUPPORTED;
@@ -75,6 +75,8 @@ typedef enum
   opt_read_limit_size,
   opt_read_delay,
   opt_read_delay_duration,
+  opt_direct_read,
+  opt_device_rate,
   opt_read_status_code,
   opt_ppl_loss,
   opt_fuzzy_parameters,
@@ -126,10 +128,11 @@ typedef struct Test_Device
   SANE_Bool loaded[num_options];
   SANE_Parameters params;
   SANE_String name;
-  SANE_Pid reader_pid;
-  SANE_Int reader_fds;
-  SANE_Int pipe;
-  FILE *pipe_handle;
+  SANEI_Thread_Ring *ring;
+  SANE_Byte *picture;		/* direct-read: the repeating picture */
+  size_t picture_size;
+  struct timeval start;		/* of the pass, for device-rate */
+  SANE_Bool non_blocking;
   SANE_Word pass;
   SANE_Word bytes_per_line;
   SANE_Word pixels_per_line;
@@ -47,6 +47,7 @@
 #endif /* HAVE_GETADDRINFO && HAVE_GETNAMEINFO */
 
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
@@ -72,9 +73,11 @@
 
 #include <sys/param.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 
 #include <sys/wait.h>
@@ -223,6 +226,14 @@ int numchildren;
 #define SANED_CONFIG_FILE "saned.conf"
 #define SANED_PID_FILE    "/var/run/saned.pid"
 
+#define SANED_DATA_BUFFER_SIZE      (256 * 1024)
+#define SANED_DATA_BUFFER_MIN       8192
+#define SANED_DATA_BUFFER_MAX       SANEI_NET_MAX_RECORD
+#define SANED_DATA_BUFFER_HIGHWATER (64 * 1024)
+
+#define SANED_MAX_WORKERS           64
+#define SANED_WORKER_SESSIONS       100
+
 #define SANED_SERVICE_NAME   "sane-port"
 #define SANED_SERVICE_PORT   6566
 #define SANED_SERVICE_PORT_S "6566"
@@ -254,13 +265,56 @@ byte_order;
 /* The default-user name.  This is not used to imply any rights.  All
    it does is save a remote user some work by reducing the amount of
    text s/he has to type when authentication is requested.  */
-static const char *default_username = "saned-user";
+static const char saned_user[] = "saned-user";
+static const char *default_username = saned_user;
 static char *remote_ip;
 
 /* data port range */
 static in_port_t data_port_lo;
 static in_port_t data_port_hi;
 
+/* data connection buffering */
+static size_t data_buffer_size = SANED_DATA_BUFFER_SIZE;
+static size_t data_buffer_highwater = SANED_DATA_BUFFER_HIGHWATER;
+
+/* compression of the image data, if the client asks for it */
+static SANE_Bool data_compression_allowed = SANE_TRUE;
+static SANE_Bool data_compression;
+
+/* don't bother compressing records smaller than this */
+#define SANED_COMPRESS_MIN 256
+
+/* Pre-forked workers for standalone mode: each one runs sane_init()
+   once and then serves connections the parent hands over through a
+   socketpair, so clients don't wait for the backends to be loaded.  */
+#ifdef SCM_RIGHTS
+# define SANED_WORKER_POOL
+#endif
+
+typedef struct
+{
+  pid_t pid;			/* 0 once the worker has been reaped */
+  int chan;			/* parent end of the socketpair, or -1 */
+  int idle;			/* worker waits for a connection */
+}
+Worker;
+
+static int max_workers;		/* 0: fork one child per connection */
+static int worker_sessions = SANED_WORKER_SESSIONS;
+static Worker *workers;
+
+/* Device list cache: the list is reused for device_list_ttl seconds,
+   unless a device node was added or removed in the meantime.  */
+static int device_list_ttl;
+static SANE_Device **cached_devices;
+static time_t cached_devices_time;
+static time_t cached_hotplug_time;
+static int device_list_hits, device_list_misses;
+
+/* set in workers, where sane_init() has been called already */
+static SANE_Bool backend_ready;
+static SANE_Word backend_version_code;
+
 #ifdef SANED_USES_AF_INDEP
 static union {
   struct sockaddr_storage ss;
@@ -326,6 +380,137 @@ saned_debug_call (int level, const char *fmt, ...)
 }
 
 
+/* Latest modification time of the directories holding device nodes;
+   it changes when a scanner is plugged in or removed.  */
+static time_t
+hotplug_time (void)
+{
+  char path[PATH_MAX];
+  struct dirent *de;
+  struct stat st;
+  time_t t = 0;
+  DIR *dir;
+
+  if (stat ("/dev", &st) == 0)
+    t = st.st_mtime;
+
+  /* USB device nodes live in one directory per bus */
+  dir = opendir ("/dev/bus/usb");
+  if (dir)
+    {
+      while ((de = readdir (dir)) != NULL)
+	{
+	  if (de->d_name[0] == '.')
+	    continue;
+	  snprintf (path, sizeof (path), "/dev/bus/usb/%s", de->d_name);
+	  if (stat (path, &st) == 0 && st.st_mtime > t)
+	    t = st.st_mtime;
+	}
+      closedir (dir);
+    }
+
+  return t;
+}
+
+static void
+free_cached_devices (void)
+{
+  int i;
+
+  if (!cached_devices)
+    return;
+
+  for (i = 0; cached_devices[i]; i++)
+    {
+      free ((void *) cached_devices[i]->name);
+      free ((void *) cached_devices[i]->vendor);
+      free ((void *) cached_devices[i]->model);
+      free ((void *) cached_devices[i]->type);
+      free (cached_devices[i]);
+    }
+  free (cached_devices);
+  cached_devices = NULL;
+}
+
+/* Keep a copy of LIST, the backend's list is only valid until its
+   next sane_get_devices() call.  */
+static SANE_Status
+cache_devices (const SANE_Device ** list)
+{
+  SANE_Device *d;
+  int i, n;
+
+  for (n = 0; list[n]; n++)
+    ;
+
+  cached_devices = calloc (n + 1, sizeof (cached_devices[0]));
+  if (!cached_devices)
+    return SANE_STATUS_NO_MEM;
+
+  for (i = 0; i < n; i++)
+    {
+      d = calloc (1, sizeof (*d));
+      if (!d)
+	{
+	  free_cached_devices ();
+	  return SANE_STATUS_NO_MEM;
+	}
+      cached_devices[i] = d;
+      d->name = strdup (list[i]->name ? list[i]->name : "");
+      d->vendor = strdup (list[i]->vendor ? list[i]->vendor : "");
+      d->model = strdup (list[i]->model ? list[i]->model : "");
+      d->type = strdup (list[i]->type ? list[i]->type : "");
+      if (!d->name || !d->vendor || !d->model || !d->type)
+	{
+	  free_cached_devices ();
+	  return SANE_STATUS_NO_MEM;
+	}
+    }
+
+  return SANE_STATUS_GOOD;
+}
+
+static SANE_Status
+get_devices (const SANE_Device *** device_list)
+{
+  SANE_Status status;
+  time_t now, hotplug;
+
+  if (device_list_ttl <= 0)
+    return sane_get_devices (device_list, SANE_TRUE);
+
+  now = time (NULL);
+  hotplug = hotplug_time ();
+
+  /* a device node changed within the second the list was fetched in
+     may not have been seen, so such a list isn't reused */
+  if (cached_devices && now - cached_devices_time < device_list_ttl
+      && hotplug == cached_hotplug_time && hotplug < cached_devices_time)
+    {
+      device_list_hits++;
+      DBG (DBG_MSG, "get_devices: device list cache hit (%d hits, %d misses)\n",
+	   device_list_hits, device_list_misses);
+      *device_list = (const SANE_Device **) cached_devices;
+      return SANE_STATUS_GOOD;
+    }
+
+  device_list_misses++;
+  DBG (DBG_MSG, "get_devices: device list cache miss%s (%d hits, %d misses)\n",
+       (cached_devices && hotplug != cached_hotplug_time) ? " after hotplug" : "",
+       device_list_hits, device_list_misses);
+
+  free_cached_devices ();
+  status = sane_get_devices (device_list, SANE_TRUE);
+  if (status == SANE_STATUS_GOOD
+      && cache_devices (*device_list) == SANE_STATUS_GOOD)
+    {
+      cached_devices_time = now;
+      cached_hotplug_time = hotplug;
+    }
+
+  return status;
+}
+
 static void
 reset_watchdog (void)
 {
@@ -467,6 +652,10 @@ quit (int signum)
     if (handle[i].inuse)
       sane_close (handle[i].handle);
 
+  if (device_list_ttl > 0)
+    DBG (DBG_MSG, "quit: device list cache: %d hits, %d misses\n",
+	 device_list_hits, device_list_misses);
+  free_cached_devices ();
   sane_exit ();
   sanei_w_exit (&wire);
   if (handle)
@@ -1325,7 +1514,7 @@ check_host (int fd)
 static int
 init (Wire * w)
 {
-  SANE_Word word, be_version_code;
+  SANE_Word word, be_version_code, features;
   SANE_Init_Reply reply;
   SANE_Status status;
   SANE_Init_Req req;
@@ -1367,6 +1556,15 @@ init (Wire * w)
   if (req.username)
     default_username = strdup (req.username);
 
+  /* optional protocol features requested by the client */
+  features = SANE_VERSION_BUILD (req.version_code) & SANEI_NET_FEATURE_MASK;
+  if (!data_compression_allowed)
+    features &= ~SANEI_NET_FEATURE_COMPRESSION;
+  features &= SANEI_NET_FEATURE_COMPRESSION;
+  data_compression = (features & SANEI_NET_FEATURE_COMPRESSION) != 0;
+  if (data_compression)
+    DBG (DBG_MSG, "init: client requested image data compression\n");
+
   sanei_w_free (w, (WireCodecFunc) sanei_w_init_req, &req);
   if (w->status)
     {
@@ -1375,12 +1573,14 @@ init (Wire * w)
     }
 
   reply.version_code = SANE_VERSION_CODE (V_MAJOR, V_MINOR,
-					  SANEI_NET_PROTOCOL_VERSION);
+					  SANEI_NET_PROTOCOL_VERSION | features);
 
   DBG (DBG_WARN, "init: access granted to %s@%s\n",
        default_username, remote_ip);
 
-  if (status == SANE_STATUS_GOOD)
+  if (status == SANE_STATUS_GOOD && backend_ready)
+    be_version_code = backend_version_code;
+  else if (status == SANE_STATUS_GOOD)
     {
       status = sane_init (&be_version_code, auth_callback);
       if (status != SANE_STATUS_GOOD)
@@ -1394,6 +1594,12 @@ init (Wire * w)
 	       SANE_VERSION_MAJOR (be_version_code), V_MAJOR);
 	  status = SANE_STATUS_INVAL;
 	}
+      else if (status == SANE_STATUS_GOOD)
+	{
+	  /* later sessions of a pool worker reuse the backends */
+	  backend_ready = SANE_TRUE;
+	  backend_version_code = be_version_code;
+	}
     }
   reply.status = status;
   if (status != SANE_STATUS_GOOD)
@@ -1637,14 +1843,74 @@ store_reclen (SANE_Byte * buf, size_t buf_size, int i, size_t reclen)
   return i;
 }
 
+/* Copy LEN bytes to the ring buffer at index I, wrapping around at the
+   end.  Returns the index behind the copied data.  */
+static int
+copy_to_ring (SANE_Byte * buf, size_t buf_size, int i,
+	      const SANE_Byte * data, size_t len)
+{
+  size_t n = len;
+
+  if (i + n > buf_size)
+    n = buf_size - i;
+  memcpy (buf + i, data, n);
+  memcpy (buf, data + n, len - n);
+  i += len;
+  if (i >= (int) buf_size)
+    i -= buf_size;
+  return i;
+}
+
+/* Write as much of the ring buffer contents as the data socket
+   accepts, using a single writev() for both halves of a wrapped
+   buffer.  Returns the number of bytes written, 0 if the socket
+   would block, or -1 on error.  */
+static long int
+write_data (int data_fd, SANE_Byte * buf, size_t buf_size,
+	    int writer, size_t bytes_in_buf)
+{
+  struct iovec iov[2];
+  long int nwritten;
+  int iovcnt = 1;
+
+  iov[0].iov_base = buf + writer;
+  iov[0].iov_len = bytes_in_buf;
+  if (writer + bytes_in_buf > buf_size)
+    {
+      iov[0].iov_len = buf_size - writer;
+      iov[1].iov_base = buf;
+      iov[1].iov_len = bytes_in_buf - iov[0].iov_len;
+      iovcnt = 2;
+    }
+
+  DBG (DBG_INFO, "do_scan: trying to write %lu bytes to client\n",
+       (u_long) bytes_in_buf);
+  do
+    nwritten = writev (data_fd, iov, iovcnt);
+  while (nwritten < 0 && errno == EINTR);
+  DBG (DBG_INFO, "do_scan: wrote %ld bytes to client\n", nwritten);
+
+  if (nwritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return 0;
+
+  return nwritten;
+}
+
 static void
 do_scan (Wire * w, int h, int data_fd)
 {
-  int num_fds, be_fd = -1, reader, writer, bytes_in_buf, status_dirty = 0;
+  int num_fds, be_fd = -1, reader, writer, status_dirty = 0, idle = 0;
   SANE_Handle be_handle = handle[h].handle;
-  struct timeval tv, *timeout = 0;
-  fd_set rd_set, rd_mask, wr_set, wr_mask;
-  SANE_Byte buf[8192];
+  struct timeval tv, *timeout;
+  struct timeval start, stop;
+  fd_set rd_set, wr_set;
+  SANE_Byte *buf;
+  size_t buf_size, bytes_in_buf, highwater;
+  u_long total_bytes = 0, num_reads = 0, num_writes = 0;
+  u_long wire_bytes = 0;
+  SANE_Byte *zbuf = NULL;
+  clock_t zclock = 0;
+  double elapsed;
   SANE_Status status;
   long int nwritten;
   SANE_Int length;
@@ -1652,42 +1918,91 @@ do_scan (Wire * w, int h, int data_fd)
   
   DBG (3, "do_scan: start\n");
 
-  FD_ZERO (&rd_mask);
-  FD_SET (w->io.fd, &rd_mask);
-  num_fds = w->io.fd + 1;
+  buf_size = data_buffer_size;
+  buf = malloc (buf_size);
+  if (!buf)
+    {
+      DBG (DBG_ERR, "do_scan: cannot allocate %lu bytes data buffer\n",
+	   (u_long) buf_size);
+      handle[h].docancel = 0;
+      handle[h].scanning = 0;
+      return;
+    }
+
+  if (data_compression)
+    {
+      zbuf = malloc (buf_size);
+      if (!zbuf)
+	DBG (DBG_ERR, "do_scan: no memory for compression, sending raw data\n");
+    }
+
+  /* the buffer must be able to hold a record and the status record */
+  highwater = data_buffer_highwater;
+  if (highwater > buf_size - 9)
+    highwater = buf_size - 9;
 
-  FD_ZERO (&wr_mask);
-  FD_SET (data_fd, &wr_mask);
+  DBG (DBG_MSG, "do_scan: %lu bytes buffer, high-water mark %lu bytes\n",
+       (u_long) buf_size, (u_long) highwater);
+
+  num_fds = w->io.fd + 1;
   if (data_fd >= num_fds)
     num_fds = data_fd + 1;
 
   sane_set_io_mode (be_handle, SANE_TRUE);
   if (sane_get_select_fd (be_handle, &be_fd) == SANE_STATUS_GOOD)
     {
-      FD_SET (be_fd, &rd_mask);
       if (be_fd >= num_fds)
 	num_fds = be_fd + 1;
     }
   else
-    {
-      memset (&tv, 0, sizeof (tv));
-      timeout = &tv;
-    }
+    be_fd = -1;
+
+  gettimeofday (&start, NULL);
 
   status = SANE_STATUS_GOOD;
-  reader = writer = bytes_in_buf = 0;
+  reader = writer = 0;
+  bytes_in_buf = 0;
   do
     {
-      rd_set = rd_mask;
-      wr_set = wr_mask;
+      int want_read, want_write;
+
+      if (bytes_in_buf == 0)
+	reader = writer = 0;
+
+      want_read = (status == SANE_STATUS_GOOD
+		   && buf_size - bytes_in_buf >= 9);
+
+      /* Coalesce records until the high-water mark is reached, unless
+	 the backend has nothing more to offer right now.  */
+      want_write = (bytes_in_buf > 0
+		    && (bytes_in_buf >= highwater || idle || !want_read
+			|| status != SANE_STATUS_GOOD));
+
+      FD_ZERO (&rd_set);
+      FD_ZERO (&wr_set);
+      FD_SET (w->io.fd, &rd_set);
+      if (want_read && be_fd >= 0)
+	FD_SET (be_fd, &rd_set);
+      if (want_write)
+	FD_SET (data_fd, &wr_set);
+
+      /* backends without a select fd have to be polled */
+      timeout = 0;
+      if (want_read && be_fd < 0)
+	{
+	  memset (&tv, 0, sizeof (tv));
+	  timeout = &tv;
+	}
+
       if (select (num_fds, &rd_set, &wr_set, 0, timeout) < 0)
 	{
+	  if (errno == EINTR)
+	    continue;
 	  if (be_fd >= 0 && errno == EBADF)
 	    {
 	      /* This normally happens when a backend closes a select
 		 filedescriptor when reaching the end of file.  So
 		 pass back this status to the client: */
-	      FD_CLR (be_fd, &rd_mask);
 	      be_fd = -1;
 	      /* only set status_dirty if EOF hasn't been already detected */
 	      if (status == SANE_STATUS_GOOD) 
@@ -1704,88 +2019,112 @@ do_scan (Wire * w, int h, int data_fd)
 	    }
 	}
 
-      if (bytes_in_buf)
+      if (want_read && (be_fd < 0 || FD_ISSET (be_fd, &rd_set)))
 	{
-	  if (FD_ISSET (data_fd, &wr_set))
+	  /* get more input data, one record per sane_read() */
+	  do
 	    {
-	      if (bytes_in_buf > 0)
-		{
-		  /* write more input data */
-		  nbytes = bytes_in_buf;
-		  if (writer + nbytes > sizeof (buf))
-		    nbytes = sizeof (buf) - writer;
-		  DBG (DBG_INFO, 
-		       "do_scan: trying to write %d bytes to client\n",
-		       nbytes);
-		  nwritten = write (data_fd, buf + writer, nbytes);
-		  DBG (DBG_INFO, 
-		       "do_scan: wrote %ld bytes to client\n", nwritten);
-		  if (nwritten < 0)
-		    {
-		      DBG (DBG_ERR, "do_scan: write failed (%s)\n",
-			   strerror (errno));
-		      status = SANE_STATUS_CANCELLED;
-		      break;
-		    }
-		  bytes_in_buf -= nwritten;
-		  writer += nwritten;
-		  if (writer == sizeof (buf))
-		    writer = 0;
-		}
-	    }
-	}
-      else if (status == SANE_STATUS_GOOD
-	       && (timeout || FD_ISSET (be_fd, &rd_set)))
-	{
-	  int i;
+	      int i;
 
-	  /* get more input data */
+	      /* reserve 4 bytes to store the length of the data record: */
+	      i = reader;
+	      reader += 4;
+	      if (reader >= (int) buf_size)
+		reader -= buf_size;
 
-	  /* reserve 4 bytes to store the length of the data record: */
-	  i = reader;
-	  reader += 4;
-	  if (reader >= (int) sizeof (buf))
-	    reader -= sizeof(buf);
+	      nbytes = buf_size - bytes_in_buf - 4;
+	      if (reader + nbytes > buf_size)
+		nbytes = buf_size - reader;
 
-	  assert (bytes_in_buf == 0);
-	  nbytes = sizeof (buf) - 4;
-	  if (reader + nbytes > sizeof (buf))
-	    nbytes = sizeof (buf) - reader;
+	      DBG (DBG_INFO,
+		   "do_scan: trying to read %lu bytes from scanner\n",
+		   (u_long) nbytes);
+	      status = sane_read (be_handle, buf + reader, nbytes, &length);
+	      DBG (DBG_INFO,
+		   "do_scan: read %d bytes from scanner\n", length);
 
-	  DBG (DBG_INFO,
-	       "do_scan: trying to read %d bytes from scanner\n", nbytes);
-	  status = sane_read (be_handle, buf + reader, nbytes, &length);
-	  DBG (DBG_INFO,
-	       "do_scan: read %d bytes from scanner\n", length);
+	      reset_watchdog ();
 
-	  reset_watchdog ();
+	      if (status != SANE_STATUS_GOOD)
+		{
+		  reader = i;	/* restore reader index */
+		  status_dirty = 1;
+		  DBG (DBG_MSG,
+		       "do_scan: status = `%s'\n", sane_strstatus(status));
+		  break;
+		}
 
-	  reader += length;
-	  if (reader >= (int) sizeof (buf))
-	    reader = 0;
-	  bytes_in_buf += length + 4;
+	      total_bytes += length;
+	      num_reads++;
 
-	  if (status != SANE_STATUS_GOOD)
-	    {
-	      reader = i;	/* restore reader index */
-	      status_dirty = 1;
-	      DBG (DBG_MSG,
-		   "do_scan: status = `%s'\n", sane_strstatus(status));
+	      if (zbuf && length >= SANED_COMPRESS_MIN)
+		{
+		  clock_t c = clock ();
+		  size_t zlen;
+
+		  /* only use the compressed block if it's smaller than
+		     the raw data, including its size word */
+		  zlen = sanei_net_compress (buf + reader, length, zbuf,
+					     length - 4);
+		  zclock += clock () - c;
+		  if (zlen > 0)
+		    {
+		      reader = store_reclen (buf, buf_size, i,
+					     (zlen + 4)
+					     | SANEI_NET_RECORD_COMPRESSED);
+		      reader = store_reclen (buf, buf_size, reader, length);
+		      reader = copy_to_ring (buf, buf_size, reader, zbuf,
+					     zlen);
+		      bytes_in_buf += zlen + 8;
+		      wire_bytes += zlen + 8;
+		      idle = 0;
+		      continue;
+		    }
+		}
+
+	      store_reclen (buf, buf_size, i, length);
+	      reader += length;
+	      if (reader >= (int) buf_size)
+		reader = 0;
+	      bytes_in_buf += length + 4;
+	      wire_bytes += length + 4;
+
+	      /* nothing more ready right now, send what we have */
+	      idle = (length == 0);
 	    }
-	  else
-	    store_reclen (buf, sizeof (buf), i, length);
+	  while (!idle && bytes_in_buf < highwater
+		 && buf_size - bytes_in_buf >= 9);
 	}
 
-      if (status_dirty && sizeof (buf) - bytes_in_buf >= 5)
+      if (status_dirty && buf_size - bytes_in_buf >= 5)
 	{
 	  status_dirty = 0;
-	  reader = store_reclen (buf, sizeof (buf), reader, 0xffffffff);
+	  reader = store_reclen (buf, buf_size, reader, 0xffffffff);
 	  buf[reader] = status;
 	  bytes_in_buf += 5;
 	  DBG (DBG_MSG, "do_scan: statuscode `%s' was added to buffer\n", 
 	       sane_strstatus(status));
 	}
 
+      if (want_write && FD_ISSET (data_fd, &wr_set))
+	{
+	  nwritten = write_data (data_fd, buf, buf_size, writer,
+				 bytes_in_buf);
+	  if (nwritten < 0)
+	    {
+	      DBG (DBG_ERR, "do_scan: write failed (%s)\n",
+		   strerror (errno));
+	      status = SANE_STATUS_CANCELLED;
+	      break;
+	    }
+	  if (nwritten > 0)
+	    num_writes++;
+	  bytes_in_buf -= nwritten;
+	  writer += nwritten;
+	  if (writer >= (int) buf_size)
+	    writer -= buf_size;
+	}
+
       if (FD_ISSET (w->io.fd, &rd_set))
 	{
 	  DBG (DBG_MSG,
@@ -1796,6 +2135,23 @@ do_scan (Wire * w, int h, int data_fd)
 	}
     }
   while (status == SANE_STATUS_GOOD || bytes_in_buf > 0 || status_dirty);
+
+  gettimeofday (&stop, NULL);
+  elapsed = (stop.tv_sec - start.tv_sec)
+    + (stop.tv_usec - start.tv_usec) / 1000000.0;
+  DBG (DBG_MSG, "do_scan: %lu bytes in %.3f s (%.0f bytes/s), "
+       "%lu reads, %lu writes\n", total_bytes, elapsed,
+       (elapsed > 0) ? total_bytes / elapsed : 0.0, num_reads, num_writes);
+  if (zbuf)
+    {
+      DBG (DBG_MSG, "do_scan: compressed to %lu bytes (ratio %.2f), "
+	   "%.3f s CPU time\n", wire_bytes,
+	   wire_bytes ? (double) total_bytes / wire_bytes : 0.0,
+	   (double) zclock / CLOCKS_PER_SEC);
+      free (zbuf);
+    }
+
+  free (buf);
   DBG (DBG_MSG, "do_scan: done, status=%s\n", sane_strstatus (status));
   handle[h].docancel = 0;
   handle[h].scanning = 0;
@@ -1830,8 +2186,7 @@ process_request (Wire * w)
 	SANE_Get_Devices_Reply reply;
 
 	reply.status =
-	  sane_get_devices ((const SANE_Device ***) &reply.device_list,
-			    SANE_TRUE);
+	  get_devices ((const SANE_Device ***) &reply.device_list);
 	sanei_w_reply (w, (WireCodecFunc) sanei_w_get_devices_reply, &reply);
       }
       break;
@@ -2132,7 +2487,7 @@ process_request (Wire * w)
 		     strerror (errno));
 		return 1;
 	      }
-	    fcntl (data_fd, F_SETFL, 1);      /* set non-blocking */
+	    fcntl (data_fd, F_SETFL, O_NONBLOCK);      /* set non-blocking */
 	    shutdown (data_fd, 0);
 	    do_scan (w, h, data_fd);
 	    close (data_fd);
@@ -2177,12 +2532,23 @@ wait_child (pid_t pid, int *status, int options)
   struct saned_child *c;
   struct saned_child *p = NULL;
   int ret;
+  int i;
 
   ret = waitpid(pid, status, options);
 
   if (ret <= 0)
     return ret;
 
+  for (i = 0; workers && i < max_workers; i++)
+    {
+      if (workers[i].pid == ret)
+	{
+	  workers[i].pid = 0;
+	  numchildren--;
+	  return ret;
+	}
+    }
+
 #ifdef WITH_AVAHI
   if ((avahi_pid > 0) && (ret == avahi_pid))
     {
@@ -2320,9 +2686,309 @@ handle_client (int fd)
     }
 }
 
+#ifdef SANED_WORKER_POOL
+/* Tell the worker at the other end of CHAN that it may hand over the
+   next connection.  */
+static int
+send_fd (int chan, int fd)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int))];
+  }
+  control;
+  char byte = 'c';
+  ssize_t n;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+  memcpy (CMSG_DATA (cmsg), &fd, sizeof (int));
+
+  do
+    n = sendmsg (chan, &msg, 0);
+  while (n < 0 && errno == EINTR);
+
+  return (n == 1) ? 0 : -1;
+}
+
+static int
+recv_fd (int chan)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int))];
+  }
+  control;
+  char byte;
+  ssize_t n;
+  int fd;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  do
+    n = recvmsg (chan, &msg, 0);
+  while (n < 0 && errno == EINTR);
+
+  if (n <= 0)
+    return -1;
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET
+      || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+      DBG (DBG_ERR, "recv_fd: no file descriptor received\n");
+      return -1;
+    }
+  memcpy (&fd, CMSG_DATA (cmsg), sizeof (int));
+
+  return fd;
+}
+
+/* Undo everything a connection left behind, so the next client of
+   this worker starts from scratch; only the backends stay loaded.  */
+static void
+end_session (void)
+{
+  int i;
+
+  alarm (0);
+
+  for (i = 0; i < num_handles; ++i)
+    if (handle[i].inuse)
+      sane_close (handle[i].handle);
+  if (handle)
+    free (handle);
+  handle = NULL;
+  num_handles = 0;
+
+  /* drop whatever is left in the wire buffer */
+  wire.direction = WIRE_DECODE;
+  sanei_w_set_dir (&wire, WIRE_ENCODE);
+  close (wire.io.fd);
+  wire.io.fd = -1;
+  wire.status = 0;
+
+  if (default_username != saned_user)
+    free ((void *) default_username);
+  default_username = saned_user;
+  if (remote_ip)
+    free (remote_ip);
+  remote_ip = NULL;
+
+  can_authorize = 0;
+  data_compression = SANE_FALSE;
+}
+
+static void
+run_worker (int chan)
+{
+  const SANE_Device **device_list;
+  SANE_Status status;
+  char ready = 'r';
+  int sessions = 0;
+  int fd;
+
+  signal (SIGINT, quit);
+  signal (SIGTERM, quit);
+
+  /* the dll backend loads the backends on the first sane_get_devices() */
+  status = sane_init (&backend_version_code, auth_callback);
+  if (status == SANE_STATUS_GOOD
+      && SANE_VERSION_MAJOR (backend_version_code) == V_MAJOR)
+    {
+      backend_ready = SANE_TRUE;
+      get_devices (&device_list);
+    }
+  else
+    DBG (DBG_ERR, "run_worker: failed to initialize backend (%s)\n",
+	 sane_strstatus (status));
+
+  DBG (DBG_MSG, "run_worker: worker %d ready\n", (int) getpid ());
+
+  while (1)
+    {
+      if (write (chan, &ready, 1) != 1)
+	break;
+
+      fd = recv_fd (chan);
+      if (fd < 0)
+	break;
+
+      DBG (DBG_DBG, "run_worker: session %d\n", sessions + 1);
+      handle_connection (fd);
+      end_session ();
+
+      if (worker_sessions > 0 && ++sessions >= worker_sessions)
+	break;
+    }
+
+  DBG (DBG_MSG, "run_worker: worker %d exiting after %d sessions\n",
+       (int) getpid (), sessions);
+  quit (0);
+}
+
+static void
+spawn_worker (Worker * wk, struct pollfd *fds, int nfds)
+{
+  int sv[2];
+  pid_t pid;
+  int i;
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+      DBG (DBG_ERR, "spawn_worker: socketpair() failed: %s\n",
+	   strerror (errno));
+      return;
+    }
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* worker */
+      close (sv[0]);
+      for (i = 0; i < nfds; i++)
+	close (fds[i].fd);
+      for (i = 0; i < max_workers; i++)
+	if (workers[i].chan >= 0)
+	  close (workers[i].chan);
+
+      if (log_to_syslog)
+	{
+	  closelog ();
+	  openlog ("saned", LOG_PID | LOG_CONS, LOG_DAEMON);
+	}
+
+      run_worker (sv[1]);
+      /* NOT REACHED */
+    }
+
+  close (sv[1]);
+  if (pid < 0)
+    {
+      DBG (DBG_ERR, "spawn_worker: fork() failed: %s\n", strerror (errno));
+      close (sv[0]);
+      return;
+    }
+
+  DBG (DBG_INFO, "spawn_worker: started worker %d\n", (int) pid);
+  wk->pid = pid;
+  wk->chan = sv[0];
+  wk->idle = 0;
+  numchildren++;
+}
+
+/* Start workers for empty slots; a slot is empty once its worker has
+   closed the channel and has been reaped.  */
+static void
+spawn_workers (struct pollfd *fds, int nfds)
+{
+  int i;
+
+  for (i = 0; i < max_workers; i++)
+    if (workers[i].pid == 0 && workers[i].chan < 0)
+      spawn_worker (&workers[i], fds, nfds);
+}
+
+static Worker *
+idle_worker (void)
+{
+  int i;
+
+  for (i = 0; i < max_workers; i++)
+    if (workers[i].chan >= 0 && workers[i].idle)
+      return &workers[i];
+
+  return NULL;
+}
+
+/* Read the ready notes of the workers; a closed channel means the
+   worker is about to exit (or has crashed).  */
+static void
+check_workers (struct pollfd *pfds)
+{
+  Worker *wk;
+  char byte;
+  ssize_t n;
+  int i;
+
+  for (i = 0, wk = workers; i < max_workers; i++, wk++)
+    {
+      if (wk->chan < 0 || pfds[i].fd != wk->chan
+	  || !(pfds[i].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL)))
+	continue;
+
+      n = read (wk->chan, &byte, 1);
+      if (n == 1)
+	{
+	  wk->idle = 1;
+	  continue;
+	}
+      if (n < 0 && errno == EINTR)
+	continue;
+
+      DBG (DBG_INFO, "check_workers: worker %d retired\n", (int) wk->pid);
+      close (wk->chan);
+      wk->chan = -1;
+      wk->idle = 0;
+    }
+}
+
+static void
+dispatch_connection (int fd)
+{
+  Worker *wk;
+
+  while ((wk = idle_worker ()) != NULL)
+    {
+      wk->idle = 0;
+      if (send_fd (wk->chan, fd) == 0)
+	{
+	  DBG (DBG_DBG, "dispatch_connection: handed connection to worker %d\n",
+	       (int) wk->pid);
+	  close (fd);
+	  return;
+	}
+
+      DBG (DBG_WARN, "dispatch_connection: worker %d unreachable: %s\n",
+	   (int) wk->pid, strerror (errno));
+      close (wk->chan);
+      wk->chan = -1;
+    }
+
+  DBG (DBG_ERR, "dispatch_connection: no idle worker, dropping connection\n");
+  close (fd);
+}
+#endif /* SANED_WORKER_POOL */
+
 static void
 bail_out (int error)
 {
+  int i;
+
   DBG (DBG_ERR, "%sbailing out, waiting for children...\n", (error) ? "FATAL ERROR; " : "");
 
 #ifdef WITH_AVAHI
@@ -2330,6 +2996,10 @@ bail_out (int error)
     kill (avahi_pid, SIGTERM);
 #endif /* WITH_AVAHI */
 
+  for (i = 0; workers && i < max_workers; i++)
+    if (workers[i].pid > 0)
+      kill (workers[i].pid, SIGTERM);
+
   while (numchildren > 0)
     wait_child (-1, NULL, 0);
 
@@ -2694,6 +3364,140 @@ read_config (void)
                   DBG (DBG_INFO, "read_config: data port range: %d - %d\n", data_port_lo, data_port_hi);
                 }
             }
+          else if (strstr(config_line, "data_buffer_size") != NULL)
+            {
+              optval = sanei_config_skip_whitespace (++optval);
+              if ((optval != NULL) && (*optval != '\0'))
+                {
+		  val = strtol (optval, &endval, 10);
+		  if (optval == endval)
+		    {
+		      DBG (DBG_ERR, "read_config: invalid value for data_buffer_size\n");
+		      continue;
+		    }
+		  else if ((val < SANED_DATA_BUFFER_MIN) || (val > SANED_DATA_BUFFER_MAX))
+		    {
+		      DBG (DBG_ERR, "read_config: data_buffer_size must be between %d and %d\n",
+			   SANED_DATA_BUFFER_MIN, SANED_DATA_BUFFER_MAX);
+		      continue;
+		    }
+
+		  data_buffer_size = val;
+
+                  DBG (DBG_INFO, "read_config: data buffer size: %lu\n", (u_long) data_buffer_size);
+                }
+            }
+          else if (strstr(config_line, "data_compression") != NULL)
+            {
+              optval = sanei_config_skip_whitespace (++optval);
+              if ((optval != NULL) && (*optval != '\0'))
+                {
+		  if (strncmp (optval, "no", 2) == 0)
+		    data_compression_allowed = SANE_FALSE;
+		  else if (strncmp (optval, "yes", 3) == 0)
+		    data_compression_allowed = SANE_TRUE;
+		  else
+		    {
+		      DBG (DBG_ERR, "read_config: invalid value for data_compression\n");
+		      continue;
+		    }
+
+                  DBG (DBG_INFO, "read_config: data compression %s\n",
+		       data_compression_allowed ? "allowed" : "disabled");
+                }
+            }
+          else if (strstr(config_line, "device_list_ttl") != NULL)
+            {
+              optval = sanei_config_skip_whitespace (++optval);
+              if ((optval != NULL) && (*optval != '\0'))
+                {
+		  val = strtol (optval, &endval, 10);
+		  if ((optval == endval) || (val < 0) || (val > INT_MAX))
+		    {
+		      DBG (DBG_ERR, "read_config: invalid value for device_list_ttl\n");
+		      continue;
+		    }
+
+		  device_list_ttl = val;
+
+                  DBG (DBG_INFO, "read_config: device list TTL: %d seconds\n", device_list_ttl);
+                }
+            }
+          else if (strstr(config_line, "max_workers") != NULL)
+            {
+              optval = sanei_config_skip_whitespace (++optval);
+              if ((optval != NULL) && (*optval != '\0'))
+                {
+		  val = strtol (optval, &endval, 10);
+		  if (optval == endval)
+		    {
+		      DBG (DBG_ERR, "read_config: invalid value for max_workers\n");
+		      continue;
+		    }
+		  else if ((val < 0) || (val > SANED_MAX_WORKERS))
+		    {
+		      DBG (DBG_ERR, "read_config: max_workers must be between 0 and %d\n",
+			   SANED_MAX_WORKERS);
+		      continue;
+		    }
+#ifndef SANED_WORKER_POOL
+		  if (val > 0)
+		    {
+		      DBG (DBG_ERR, "read_config: worker pool not supported on this platform\n");
+		      continue;
+		    }
+#endif /* !SANED_WORKER_POOL */
+
+		  max_workers = val;
+
+                  DBG (DBG_INFO, "read_config: max. workers: %d\n", max_workers);
+                }
+            }
+          else if (strstr(config_line, "worker_sessions") != NULL)
+            {
+              optval = sanei_config_skip_whitespace (++optval);
+              if ((optval != NULL) && (*optval != '\0'))
+                {
+		  val = strtol (optval, &endval, 10);
+		  if (optval == endval)
+		    {
+		      DBG (DBG_ERR, "read_config: invalid value for worker_sessions\n");
+		      continue;
+		    }
+		  else if ((val < 0) || (val > INT_MAX))
+		    {
+		      DBG (DBG_ERR, "read_config: worker_sessions is invalid\n");
+		      continue;
+		    }
+
+		  worker_sessions = val;
+
+                  DBG (DBG_INFO, "read_config: sessions per worker: %d\n", worker_sessions);
+                }
+            }
+          else if (strstr(config_line, "data_buffer_highwater") != NULL)
+            {
+              optval = sanei_config_skip_whitespace (++optval);
+              if ((optval != NULL) && (*optval != '\0'))
+                {
+		  val = strtol (optval, &endval, 10);
+		  if (optval == endval)
+		    {
+		      DBG (DBG_ERR, "read_config: invalid value for data_buffer_highwater\n");
+		      continue;
+		    }
+		  else if ((val < 1) || (val > SANED_DATA_BUFFER_MAX))
+		    {
+		      DBG (DBG_ERR, "read_config: data_buffer_highwater is invalid\n");
+		      continue;
+		    }
+
+		  data_buffer_highwater = val;
+
+                  DBG (DBG_INFO, "read_config: data buffer high-water mark: %lu\n",
+		       (u_long) data_buffer_highwater);
+                }
+            }
         }
       fclose (fp);
       DBG (DBG_INFO, "read_config: done reading config\n");
@@ -2924,6 +3728,7 @@ run_standalone (int argc, char **argv)
 {
   struct pollfd *fds = NULL;
   struct pollfd *fdp = NULL;
+  struct pollfd *pfds = NULL;
   int nfds;
   int fd = -1;
   int i;
@@ -3092,11 +3897,70 @@ run_standalone (int argc, char **argv)
   /* NOT REACHED (Avahi process) */
 #endif /* WITH_AVAHI */
 
+#ifdef SANED_WORKER_POOL
+  if (run_mode == SANED_RUN_ALONE && max_workers > 0)
+    {
+      workers = malloc (max_workers * sizeof (Worker));
+      if (workers == NULL)
+	{
+	  DBG (DBG_ERR, "run_standalone: cannot allocate worker pool\n");
+	  max_workers = 0;
+	}
+      else
+	{
+	  for (i = 0; i < max_workers; i++)
+	    {
+	      workers[i].pid = 0;
+	      workers[i].chan = -1;
+	      workers[i].idle = 0;
+	    }
+	  DBG (DBG_MSG, "run_standalone: using %d workers, %d sessions each\n",
+	       max_workers, worker_sessions);
+	}
+    }
+#endif /* SANED_WORKER_POOL */
+
   DBG (DBG_MSG, "run_standalone: waiting for control connection\n");
 
   while (1)
     {
-      ret = poll (fds, nfds, 500);
+#ifdef SANED_WORKER_POOL
+      if (workers)
+	{
+	  spawn_workers (fds, nfds);
+
+	  /* only accept connections an idle worker can take right away,
+	     the others wait in the listen queue */
+	  pfds = realloc (pfds, (nfds + max_workers) * sizeof (struct pollfd));
+	  if (pfds == NULL)
+	    {
+	      DBG (DBG_ERR, "run_standalone: cannot allocate poll set\n");
+	      bail_out (1);
+	    }
+	  for (i = 0; i < nfds; i++)
+	    {
+	      pfds[i].fd = fds[i].fd;
+	      pfds[i].events = idle_worker () ? POLLIN : 0;
+	      pfds[i].revents = 0;
+	    }
+	  for (i = 0; i < max_workers; i++)
+	    {
+	      pfds[nfds + i].fd = workers[i].chan;
+	      pfds[nfds + i].events = POLLIN;
+	      pfds[nfds + i].revents = 0;
+	    }
+
+	  ret = poll (pfds, nfds + max_workers, 500);
+	  if (ret > 0)
+	    {
+	      for (i = 0; i < nfds; i++)
+		fds[i].revents = pfds[i].revents;
+	      check_workers (pfds + nfds);
+	    }
+	}
+      else
+#endif /* SANED_WORKER_POOL */
+	ret = poll (fds, nfds, 500);
       if (ret < 0)
 	{
 	  if (errno == EINTR)
@@ -3136,6 +4000,11 @@ run_standalone (int argc, char **argv)
 	  else if (! (fdp->revents & POLLIN))
 	    continue;
 
+#ifdef SANED_WORKER_POOL
+	  if (workers && !idle_worker ())
+	    continue;
+#endif /* SANED_WORKER_POOL */
+
 	  fd = accept (fdp->fd, 0, 0);
 	  if (fd < 0)
 	    {
@@ -3145,6 +4014,10 @@ run_standalone (int argc, char **argv)
 
 	  if (run_mode == SANED_RUN_DEBUG)
 	    break; /* We have the only connection we're going to handle */
+#ifdef SANED_WORKER_POOL
+	  else if (workers)
+	    dispatch_connection (fd);
+#endif /* SANED_WORKER_POOL */
 	  else
 	    handle_client (fd);
 	}
@@ -3157,6 +4030,8 @@ run_standalone (int argc, char **argv)
     close (fdp->fd);
 
   free (fds);
+  if (pfds)
+    free (pfds);
 
   if (run_mode == SANED_RUN_DEBUG)
     {
@@ -40,6 +40,13 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <time.h>
 
 #include "../include/_stdint.h"
 
@@ -63,9 +70,7 @@ typedef struct
 {
   uint8_t *data;
   int width;    /*WARNING: this is in bytes, get pixel width from param*/
-  int height;
-  int x;
-  int y;
+  int height;   /* lines allocated so far */
 }
 Image;
 
@@ -76,6 +81,7 @@ Image;
 #define OPTION_BATCH_DOUBLE	1005
 #define OPTION_BATCH_INCREMENT	1006
 #define OPTION_BATCH_PROMPT    1007
+#define OPTION_BENCHMARK	1008
 
 #define BATCH_COUNT_UNLIMITED -1
 
@@ -100,14 +106,21 @@ static struct option basic_options[] = {
   {"accept-md5-only", no_argument, NULL, OPTION_MD5},
   {"icc-profile", required_argument, NULL, 'i'},
   {"dont-scan", no_argument, NULL, 'n'},
+  {"benchmark", optional_argument, NULL, OPTION_BENCHMARK},
   {0, 0, NULL, 0}
 };
 
 #define OUTPUT_PNM      0
 #define OUTPUT_TIFF     1
 
+#define BENCH_TEXT	1
+#define BENCH_CSV	2
+#define BENCH_JSON	3
+#define BENCH_SIZES	32	/* read size buckets, powers of two */
+
 #define BASE_OPTSTRING	"d:hi:Lf:B::nvVTAbp"
-#define STRIP_HEIGHT	256	/* # lines we increment image height */
+#define STRIP_HEIGHT	256	/* # lines we start an image buffer with */
+#define HEIGHT_DIGITS	10	/* room left for a height patched in later */
 
 static struct option *all_options;
 static int option_number_len;
@@ -120,6 +133,7 @@ static int all;
 static int output_format = OUTPUT_PNM;
 static int help;
 static int dont_scan = 0;
+static int benchmark = 0;
 static const char *prog_name;
 static int resolution_optind = -1, resolution_value = 0;
 
@@ -1123,9 +1137,14 @@ process_backend_option (SANE_Handle device, int optnum, const char *optarg)
   set_option (device, optnum, valuep);
 }
 
+/* if PAD is set, the height is padded to HEIGHT_DIGITS, so the header
+   can be rewritten in place once the real height is known */
 static void
-write_pnm_header (SANE_Frame format, int width, int height, int depth)
+write_pnm_header (SANE_Frame format, int width, int height, int depth,
+		  int pad)
 {
+  int digits = pad ? HEIGHT_DIGITS : 0;
+
   /* The netpbm-package does not define raw image data with maxval > 255. */
   /* But writing maxval 65535 for 16bit data gives at least a chance */
   /* to read the image. */
@@ -1135,16 +1154,16 @@ write_pnm_header (SANE_Frame format, int width, int height, int depth)
     case SANE_FRAME_GREEN:
     case SANE_FRAME_BLUE:
     case SANE_FRAME_RGB:
-      printf ("P6\n# SANE data follows\n%d %d\n%d\n", width, height,
-	      (depth <= 8) ? 255 : 65535);
+      printf ("P6\n# SANE data follows\n%d %*d\n%d\n", width, digits,
+	      height, (depth <= 8) ? 255 : 65535);
       break;
 
     default:
       if (depth == 1)
-	printf ("P4\n# SANE data follows\n%d %d\n", width, height);
+	printf ("P4\n# SANE data follows\n%d %*d\n", width, digits, height);
       else
-	printf ("P5\n# SANE data follows\n%d %d\n%d\n", width, height,
-		(depth <= 8) ? 255 : 65535);
+	printf ("P5\n# SANE data follows\n%d %*d\n%d\n", width, digits,
+		height, (depth <= 8) ? 255 : 65535);
       break;
     }
 #ifdef __EMX__			/* OS2 - write in binary mode. */
@@ -1152,34 +1171,85 @@ write_pnm_header (SANE_Frame format, int width, int height, int depth)
 #endif
 }
 
+static void
+write_header (SANE_Parameters * parm, int height, int pad)
+{
+  if (output_format == OUTPUT_TIFF)
+    sanei_write_tiff_header (parm->format, parm->pixels_per_line, height,
+			     parm->depth, resolution_value, icc_profile);
+  else
+    write_pnm_header (parm->format, parm->pixels_per_line, height,
+		      parm->depth, pad);
+}
+
+/* stdout opened for appending (scanimage >> file) is seekable, but
+   every write goes to the end, so the header can't be rewritten.  */
+static int
+stdout_appends (void)
+{
+#if defined (F_GETFL) && defined (O_APPEND)
+  int flags = fcntl (fileno (stdout), F_GETFL);
+
+  return flags >= 0 && (flags & O_APPEND);
+#else
+  return 0;
+#endif
+}
+
+/* make sure IMAGE has room for LINES lines. The buffer grows by
+   doubling, so a long image is not copied over and over again. */
 static void *
-advance (Image * image)
+reserve (Image * image, int lines)
 {
-  if (++image->x >= image->width)
+  size_t old_size, new_size;
+  int height;
+  uint8_t *data;
+
+  if (image->data && lines <= image->height)
+    return image->data;
+
+  if (!image->data)
+    height = lines > 0 ? lines : STRIP_HEIGHT;
+  else
+    for (height = image->height; height < lines; height *= 2)
+      ;
+
+  old_size = image->data ? (size_t) image->height * image->width : 0;
+  new_size = (size_t) height * image->width;
+
+  data = realloc (image->data, new_size);
+  if (!data)
     {
-      image->x = 0;
-      if (++image->y >= image->height || !image->data)
-	{
-	  size_t old_size = 0, new_size;
+      fprintf (stderr, "%s: can't allocate image buffer (%dx%d)\n",
+	       prog_name, image->width, height);
+      return NULL;
+    }
+  memset (data + old_size, 0, new_size - old_size);
 
-	  if (image->data)
-	    old_size = image->height * image->width;
+  image->data = data;
+  image->height = height;
+  return data;
+}
 
-	  image->height += STRIP_HEIGHT;
-	  new_size = image->height * image->width;
+/* copy SIZE bytes of image data from FROM to stdout */
+static SANE_Status
+copy_spill (FILE * from, size_t size)
+{
+  size_t len;
 
-	  if (image->data)
-	    image->data = realloc (image->data, new_size);
-	  else
-	    image->data = malloc (new_size);
-	  if (image->data)
-	    memset (image->data + old_size, 0, new_size - old_size);
+  rewind (from);
+  while (size > 0)
+    {
+      len = size < buffer_size ? size : buffer_size;
+      if (fread (buffer, 1, len, from) != len)
+	{
+	  fprintf (stderr, "%s: can't read temporary file\n", prog_name);
+	  return SANE_STATUS_IO_ERROR;
 	}
+      fwrite (buffer, 1, len, stdout);
+      size -= len;
     }
-  if (!image->data)
-    fprintf (stderr, "%s: can't allocate image buffer (%dx%d)\n",
-	     prog_name, image->width, image->height);
-  return image->data;
+  return SANE_STATUS_GOOD;
 }
 
 static SANE_Status
@@ -1189,12 +1259,15 @@ scan_it (void)
   SANE_Byte min = 0xff, max = 0;
   SANE_Parameters parm;
   SANE_Status status;
-  Image image = { 0, 0, 0, 0, 0 };
+  Image image = { 0, 0, 0 };
   static const char *format_name[] = {
     "gray", "RGB", "red", "green", "blue"
   };
   SANE_Word total_bytes = 0, expected_bytes;
   SANE_Int hang_over = -1;
+  FILE *out = stdout, *spill = NULL;
+  long header_pos = -1;
+  size_t frame_bytes = 0;
 
   do
     {
@@ -1262,21 +1335,30 @@ scan_it (void)
 	    case SANE_FRAME_GRAY:
 	      assert ((parm.depth == 1) || (parm.depth == 8)
 		      || (parm.depth == 16));
-	      if (parm.lines < 0)
-		{
-		  must_buffer = 1;
-		  offset = 0;
-		}
+	      if (parm.lines >= 0)
+		write_header (&parm, parm.lines, 0);
+
+	      /* The scanner doesn't know what the eventual image height
+		 will be (common for hand-held scanners).  If we can seek
+		 in the output and it isn't appended to, leave room for
+		 the height in the header and fill it in at the end, else
+		 keep the data in a temporary file until then.  */
+	      else if (!stdout_appends ()
+		       && (header_pos = ftell (stdout)) >= 0
+		       && fseek (stdout, header_pos, SEEK_SET) == 0)
+		write_header (&parm, 0, 1);
 	      else
 		{
-		  if (output_format == OUTPUT_TIFF)
-		    sanei_write_tiff_header (parm.format,
-					     parm.pixels_per_line, parm.lines,
-					     parm.depth, resolution_value,
-					     icc_profile);
-		  else
-		    write_pnm_header (parm.format, parm.pixels_per_line,
-				      parm.lines, parm.depth);
+		  header_pos = -1;
+		  spill = tmpfile ();
+		  if (!spill)
+		    {
+		      fprintf (stderr, "%s: can't create temporary file\n",
+			       prog_name);
+		      status = SANE_STATUS_IO_ERROR;
+		      goto cleanup;
+		    }
+		  out = spill;
 		}
 	      break;
 
@@ -1286,24 +1368,10 @@ scan_it (void)
 
 	  if (must_buffer)
 	    {
-	      /* We're either scanning a multi-frame image or the
-		 scanner doesn't know what the eventual image height
-		 will be (common for hand-held scanners).  In either
-		 case, we need to buffer all data before we can write
-		 the image.  */
-	      image.width = parm.bytes_per_line;
-
-	      if (parm.lines >= 0)
-		/* See advance(); we allocate one extra line so we
-		   don't end up realloc'ing in when the image has been
-		   filled in.  */
-		image.height = parm.lines - STRIP_HEIGHT + 1;
-	      else
-		image.height = 0;
-
-	      image.x = image.width - 1;
-	      image.y = -1;
-	      if (!advance (&image))
+	      /* We're scanning a multi-frame image, so we need to buffer
+		 all data before we can write the image.  */
+	      image.width = 3 * parm.bytes_per_line;
+	      if (!reserve (&image, parm.lines))
 		{
 		  status = SANE_STATUS_NO_MEM;
 		  goto cleanup;
@@ -1315,8 +1383,8 @@ scan_it (void)
 	  assert (parm.format >= SANE_FRAME_RED
 		  && parm.format <= SANE_FRAME_BLUE);
 	  offset = parm.format - SANE_FRAME_RED;
-	  image.x = image.y = 0;
 	}
+      frame_bytes = 0;
       hundred_percent = parm.bytes_per_line * parm.lines 
 	* ((parm.format == SANE_FRAME_RGB || parm.format == SANE_FRAME_GRAY) ? 1:3);
 
@@ -1340,64 +1408,31 @@ scan_it (void)
 		{
 		  fprintf (stderr, "%s: sane_read: %s\n",
 			   prog_name, sane_strstatus (status));
+		  if (spill)
+		    fclose (spill);
 		  return status;
 		}
 	      break;
 	    }
+	  frame_bytes += len;
 
 	  if (must_buffer)
 	    {
-	      switch (parm.format)
+	      /* interleave this frame's samples into the image */
+	      if (!reserve (&image, (frame_bytes + parm.bytes_per_line - 1)
+			    / parm.bytes_per_line))
 		{
-		case SANE_FRAME_RED:
-		case SANE_FRAME_GREEN:
-		case SANE_FRAME_BLUE:
-		  for (i = 0; i < len; ++i)
-		    {
-		      image.data[offset + 3 * i] = buffer[i];
-		      if (!advance (&image))
-			{
-			  status = SANE_STATUS_NO_MEM;
-			  goto cleanup;
-			}
-		    }
-		  offset += 3 * len;
-		  break;
-
-		case SANE_FRAME_RGB:
-		  for (i = 0; i < len; ++i)
-		    {
-		      image.data[offset + i] = buffer[i];
-		      if (!advance (&image))
-			  {
-			    status = SANE_STATUS_NO_MEM;
-			    goto cleanup;
-			  }
-		    }
-		  offset += len;
-		  break;
-
-		case SANE_FRAME_GRAY:
-		  for (i = 0; i < len; ++i)
-		    {
-		      image.data[offset + i] = buffer[i];
-		      if (!advance (&image))
-			  {
-			    status = SANE_STATUS_NO_MEM;
-			    goto cleanup;
-			  }
-		    }
-		  offset += len;
-		  break;
-
-                default:
-		  break;
+		  status = SANE_STATUS_NO_MEM;
+		  goto cleanup;
 		}
+	      for (i = 0; i < len; ++i)
+		image.data[offset + 3 * i] = buffer[i];
+	      offset += 3 * len;
 	    }
 	  else			/* ! must_buffer */
 	    {
 	      if ((output_format == OUTPUT_TIFF) || (parm.depth != 16))
-		fwrite (buffer, 1, len, stdout);
+		fwrite (buffer, 1, len, out);
 	      else
 		{
 #if !defined(WORDS_BIGENDIAN)
@@ -1408,7 +1443,7 @@ scan_it (void)
 		    {
 		      if (len > 0)
 			{
-			  fwrite (buffer, 1, 1, stdout);
+			  fwrite (buffer, 1, 1, out);
 			  buffer[0] = (SANE_Byte) hang_over;
 			  hang_over = -1;
 			  start = 1;
@@ -1429,7 +1464,7 @@ scan_it (void)
 		      len--;
 		    }
 #endif
-		  fwrite (buffer, 1, len, stdout);
+		  fwrite (buffer, 1, len, out);
 		}
 	    }
 
@@ -1448,33 +1483,28 @@ scan_it (void)
 
   if (must_buffer)
     {
-      image.height = image.y;
-
-      if (output_format == OUTPUT_TIFF)
-	sanei_write_tiff_header (parm.format, parm.pixels_per_line,
-				 image.height, parm.depth, resolution_value,
-				 icc_profile);
-      else
-	write_pnm_header (parm.format, parm.pixels_per_line,
-                          image.height, parm.depth);
-
-#if !defined(WORDS_BIGENDIAN)
-      /* multibyte pnm file may need byte swap to LE */
-      /* FIXME: other bit depths? */
-      if (output_format != OUTPUT_TIFF && parm.depth == 16)
+      image.height = frame_bytes / parm.bytes_per_line;
+      write_header (&parm, image.height, 0);
+      fwrite (image.data, 1, (size_t) image.height * image.width, stdout);
+    }
+  else if (header_pos >= 0)
+    {
+      /* now we know the height, put it into the header */
+      fflush (stdout);
+      if (fseek (stdout, header_pos, SEEK_SET) == 0)
 	{
-	  int i;
-	  for (i = 0; i < image.height * image.width; i += 2)
-	    {
-	      unsigned char LSB;
-	      LSB = image.data[i];
-	      image.data[i] = image.data[i + 1];
-	      image.data[i + 1] = LSB;
-	    }
+	  write_header (&parm, frame_bytes / parm.bytes_per_line, 1);
+	  fseek (stdout, 0, SEEK_END);
 	}
-#endif
-
-	fwrite (image.data, 1, image.height * image.width, stdout);
+      else
+	fprintf (stderr, "%s: can't rewrite image header\n", prog_name);
+    }
+  else if (spill)
+    {
+      write_header (&parm, frame_bytes / parm.bytes_per_line, 0);
+      if (copy_spill (spill, frame_bytes / parm.bytes_per_line
+		      * parm.bytes_per_line) != SANE_STATUS_GOOD)
+	status = SANE_STATUS_IO_ERROR;
     }
 
   /* flush the output buffer */
@@ -1483,6 +1513,8 @@ scan_it (void)
 cleanup:
   if (image.data)
     free (image.data);
+  if (spill)
+    fclose (spill);
 
 
   expected_bytes = parm.bytes_per_line * parm.lines *
@@ -1529,7 +1561,7 @@ test_it (void)
   int i, len;
   SANE_Parameters parm;
   SANE_Status status;
-  Image image = { 0, 0, 0, 0, 0 };
+  Image image = { 0, 0, 0 };
   static const char *format_name[] =
     { "gray", "RGB", "red", "green", "blue" };
 
@@ -1616,6 +1648,242 @@ cleanup:
 }
 
 
+/* what --benchmark measures for one page, times in seconds */
+typedef struct
+{
+  double start;			/* in sane_start */
+  double first_byte;		/* after sane_start, until data arrives */
+  double read;			/* after the first data until EOF */
+  double read_sum;		/* in sane_read */
+  double read_max;
+  double cpu;
+  size_t bytes;
+  size_t first_len;		/* read along with the first byte */
+  int reads;
+  int sizes[BENCH_SIZES];	/* reads of up to 2^i bytes */
+}
+Bench;
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* scan one page, all frames, throwing the data away */
+static SANE_Status
+bench_page (Bench * b)
+{
+  SANE_Parameters parm;
+  SANE_Status status;
+  SANE_Int len;
+  clock_t cpu = clock ();
+  double t, first = 0, done;
+  int i;
+
+  memset (b, 0, sizeof (*b));
+
+  do
+    {
+      t = now ();
+#ifdef SANE_STATUS_WARMING_UP
+      do
+	{
+	  status = sane_start (device);
+	}
+      while (status == SANE_STATUS_WARMING_UP);
+#else
+      status = sane_start (device);
+#endif
+      done = now ();
+      b->start += done - t;
+      if (status != SANE_STATUS_GOOD)
+	return status;
+
+      status = sane_get_parameters (device, &parm);
+      if (status != SANE_STATUS_GOOD)
+	return status;
+
+      for (;;)
+	{
+	  t = now ();
+	  status = sane_read (device, buffer, buffer_size, &len);
+	  t = now () - t;
+	  if (status != SANE_STATUS_GOOD)
+	    break;
+
+	  if (len > 0 && !b->bytes)
+	    {
+	      first = now ();
+	      b->first_byte = first - done;
+	      b->first_len = len;
+	    }
+	  b->bytes += len;
+	  b->reads++;
+	  b->read_sum += t;
+	  if (t > b->read_max)
+	    b->read_max = t;
+
+	  for (i = 0; i < BENCH_SIZES - 1 && (1 << i) < len; ++i)
+	    ;
+	  b->sizes[i]++;
+	}
+      if (status != SANE_STATUS_EOF)
+	return status;
+    }
+  while (!parm.last_frame);
+
+  if (b->bytes)
+    b->read = now () - first;
+  b->cpu = (double) (clock () - cpu) / CLOCKS_PER_SEC;
+  return SANE_STATUS_GOOD;
+}
+
+/* sustained rate of BYTES after the first data in READ seconds, or -1
+   if the first sane_read returned the whole page and there is nothing
+   left to measure */
+static double
+mb_per_s (size_t bytes, double read)
+{
+  return bytes > 0 && read > 0 ? bytes / read / 1e6 : -1;
+}
+
+/* RATE for printing, NA if there is none */
+static const char *
+rate_string (double rate, const char *na)
+{
+  static char str[32];
+
+  if (rate < 0)
+    return na;
+  snprintf (str, sizeof (str), "%.3f", rate);
+  return str;
+}
+
+static void
+bench_print (int page, Bench * b)
+{
+  const char *sep = "";
+  double rate = mb_per_s (b->bytes - b->first_len, b->read);
+  int i;
+
+  switch (benchmark)
+    {
+    case BENCH_CSV:
+      printf ("%d,%.3f,%.3f,%.6f,%lu,%s,%d,%.1f,%.1f,%.3f,\"", page,
+	      b->start * 1e3, b->first_byte * 1e3, b->read,
+	      (unsigned long) b->bytes, rate_string (rate, ""), b->reads,
+	      b->reads ? b->read_sum / b->reads * 1e6 : 0, b->read_max * 1e6,
+	      b->cpu);
+      for (i = 0; i < BENCH_SIZES; ++i)
+	if (b->sizes[i])
+	  {
+	    printf ("%s%lu:%d", sep, 1UL << i, b->sizes[i]);
+	    sep = " ";
+	  }
+      printf ("\"\n");
+      break;
+
+    case BENCH_JSON:
+      printf ("%s\n    { \"page\": %d, \"start_ms\": %.3f, "
+	      "\"first_byte_ms\": %.3f, \"seconds\": %.6f, \"bytes\": %lu, "
+	      "\"mb_per_s\": %s, \"reads\": %d, \"usec_per_read\": %.1f, "
+	      "\"max_read_usec\": %.1f, \"cpu_s\": %.3f, \"read_sizes\": {",
+	      page > 1 ? "," : "", page, b->start * 1e3, b->first_byte * 1e3,
+	      b->read, (unsigned long) b->bytes, rate_string (rate, "null"),
+	      b->reads, b->reads ? b->read_sum / b->reads * 1e6 : 0,
+	      b->read_max * 1e6, b->cpu);
+      for (i = 0; i < BENCH_SIZES; ++i)
+	if (b->sizes[i])
+	  {
+	    printf ("%s\"%lu\": %d", sep, 1UL << i, b->sizes[i]);
+	    sep = ", ";
+	  }
+      printf ("} }");
+      break;
+
+    default:
+      printf ("page %d: sane_start %.3f ms, first byte after %.3f ms\n",
+	      page, b->start * 1e3, b->first_byte * 1e3);
+      printf ("page %d: %lu bytes in %.6f s, %s MB/s, cpu %.3f s\n",
+	      page, (unsigned long) b->bytes, b->read,
+	      rate_string (rate, "n/a"), b->cpu);
+      printf ("page %d: %d reads, %.1f usec each, longest %.1f usec\n",
+	      page, b->reads, b->reads ? b->read_sum / b->reads * 1e6 : 0,
+	      b->read_max * 1e6);
+      printf ("page %d: read sizes:", page);
+      for (i = 0; i < BENCH_SIZES; ++i)
+	if (b->sizes[i])
+	  printf (" <=%lu: %d", 1UL << i, b->sizes[i]);
+      printf ("\n");
+      break;
+    }
+}
+
+/* scan PAGES pages and report how long
+   sane_start and sane_read took. The image data is not saved. */
+static SANE_Status
+bench_it (const char *devname, int pages)
+{
+  SANE_Status status = SANE_STATUS_GOOD;
+  Bench b;
+  int page;
+  size_t bytes = 0;
+  double read = 0;
+  const char *c;
+
+  if (benchmark == BENCH_CSV)
+    printf ("page,start_ms,first_byte_ms,seconds,bytes,mb_per_s,reads,"
+	    "usec_per_read,max_read_usec,cpu_s,read_sizes\n");
+  else if (benchmark == BENCH_JSON)
+    {
+      printf ("{ \"device\": \"");
+      for (c = devname; *c; ++c)
+	{
+	  if (*c == '"' || *c == '\\')
+	    putchar ('\\');
+	  putchar (*c);
+	}
+      printf ("\", \"buffer_size\": %lu, \"pages\": [",
+	      (unsigned long) buffer_size);
+    }
+
+  for (page = 1; page <= pages; ++page)
+    {
+      status = bench_page (&b);
+      if (status != SANE_STATUS_GOOD)
+	{
+	  /* an empty feeder ends the run */
+	  if (status != SANE_STATUS_NO_DOCS || page == 1)
+	    fprintf (stderr, "%s: page %d: %s\n", prog_name, page,
+		     sane_strstatus (status));
+	  else
+	    status = SANE_STATUS_GOOD;
+	  break;
+	}
+      bench_print (page, &b);
+      /* pages that came in one read have no rate to add */
+      if (b.bytes > b.first_len)
+	{
+	  bytes += b.bytes - b.first_len;
+	  read += b.read;
+	}
+    }
+
+  if (benchmark == BENCH_JSON)
+    printf ("\n  ],\n  \"pages_done\": %d, \"mb_per_s\": %s }\n",
+	    page - 1, rate_string (mb_per_s (bytes, read), "null"));
+  else if (benchmark == BENCH_TEXT)
+    printf ("total: %d pages, %s MB/s\n", page - 1,
+	    rate_string (mb_per_s (bytes, read), "n/a"));
+
+  sane_cancel (device);
+  return status;
+}
+
 static int
 get_resolution (void)
 {
@@ -1800,6 +2068,20 @@ main (int argc, char **argv)
 	case OPTION_MD5:
 	  accept_only_md5_auth = 1;
 	  break;
+	case OPTION_BENCHMARK:
+	  if (!optarg || strcmp (optarg, "text") == 0)
+	    benchmark = BENCH_TEXT;
+	  else if (strcmp (optarg, "csv") == 0)
+	    benchmark = BENCH_CSV;
+	  else if (strcmp (optarg, "json") == 0)
+	    benchmark = BENCH_JSON;
+	  else
+	    {
+	      fprintf (stderr, "%s: unknown benchmark format `%s'\n",
+		       prog_name, optarg);
+	      exit (1);
+	    }
+	  break;
 	case 'L':
 	case 'f':
 	  {
@@ -1966,6 +2248,8 @@ Parameters are separated by a blank from single-character options (e.g.\n\
 -p, --progress             print progress messages\n\
 -n, --dont-scan            only set options, don't actually scan\n\
 -T, --test                 test backend thoroughly\n\
+    --benchmark[=FORMAT]   time sane_start and sane_read instead of saving\n\
+                           the image, FORMAT is text, csv or json\n\
 -A, --all-options          list all available backend options\n\
 -h, --help                 display this help message and exit\n\
 -v, --verbose              give even more status messages\n\
@@ -2224,7 +2508,12 @@ List of available devices:", prog_name);
   signal (SIGINT, sighandler);
   signal (SIGTERM, sighandler);
 
-  if (test == 0)
+  if (benchmark)
+    {
+      buffer = malloc (buffer_size);
+      status = bench_it (devname, batch_count > 0 ? batch_count : 1);
+    }
+  else if (test == 0)
     {
       int n = batch_start_at;
 
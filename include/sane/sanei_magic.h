@@ -69,8 +69,14 @@ extern void sanei_magic_init( void );
  * @param buffer contains image data
  * @param diam maximum dot diameter to remove
  *
+ * SSE2 or AVX2 kernels are used where the cpu has them; the environment
+ * variable SANE_MAGIC_SIMD (none, sse2 or avx2), read by
+ * sanei_magic_init(), limits the choice.  The result does not depend on
+ * the kernels.
+ *
  * @return
  * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
  * - SANE_STATUS_INVAL - invalid image parameters
  */
 extern SANE_Status
@@ -97,6 +103,93 @@ extern SANE_Status
 sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
   int dpiX, int dpiY, int * centerX, int * centerY, double * finSlope);
 
+/** An edge search fed while the image is read */
+typedef struct sanei_magic_edges SANEI_Magic_Edges;
+
+/** Start an edge search for an image that is still being read
+ *
+ * The rows are looked at as they are given to sanei_magic_edgesFeed(),
+ * keeping only a few rows and two ints per row.  At the end of the
+ * page sanei_magic_edgesFind() and sanei_magic_edgesSkew() answer as
+ * sanei_magic_findEdges() and sanei_magic_findSkew() would for the
+ * rows fed.
+ *
+ * @param params describes image, lines may be unknown
+ * @param[out] edges the search, for sanei_magic_edgesFeed()
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_INVAL - invalid image parameters
+ */
+extern SANE_Status
+sanei_magic_edgesStart(SANE_Parameters * params, SANEI_Magic_Edges ** edges);
+
+/** Add the next bytes of the image to an edge search
+ *
+ * @param edges the search
+ * @param buffer image data, need not end on a line boundary
+ * @param len number of bytes in buffer
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_INVAL - invalid search, or results were already asked for
+ */
+extern SANE_Status
+sanei_magic_edgesFeed(SANEI_Magic_Edges * edges, SANE_Byte * buffer,
+  size_t len);
+
+/** Find the edges of the media in the rows fed, see sanei_magic_findEdges()
+ *
+ * No more rows can be fed afterwards.
+ *
+ * @param edges the search
+ * @param dpiX horizontal resolution
+ * @param dpiY vertical resolution
+ * @param[out] top the top edge
+ * @param[out] bot the bottom edge
+ * @param[out] left the left edge
+ * @param[out] right the right edge
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_UNSUPPORTED - edges could not be determined
+ * - SANE_STATUS_INVAL - invalid search or no rows fed
+ */
+extern SANE_Status
+sanei_magic_edgesFind(SANEI_Magic_Edges * edges, int dpiX, int dpiY,
+  int * top, int * bot, int * left, int * right);
+
+/** Find the skew of the media in the rows fed, see sanei_magic_findSkew()
+ *
+ * No more rows can be fed afterwards.
+ *
+ * @param edges the search
+ * @param dpiX horizontal resolution
+ * @param dpiY vertical resolution
+ * @param[out] centerX horizontal coordinate of center of rotation
+ * @param[out] centerY vertical coordinate of center of rotation
+ * @param[out] finSlope slope of rotation
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_UNSUPPORTED - skew could not be determined
+ * - SANE_STATUS_INVAL - invalid search or no rows fed
+ */
+extern SANE_Status
+sanei_magic_edgesSkew(SANEI_Magic_Edges * edges, int dpiX, int dpiY,
+  int * centerX, int * centerY, double * finSlope);
+
+/** Free an edge search
+ *
+ * @param edges the search
+ */
+extern void
+sanei_magic_edgesFinish(SANEI_Magic_Edges * edges);
+
 /** Correct the skew of the media inside the image, via simple rotation
  *
  * @param params describes image
@@ -115,6 +208,33 @@ extern SANE_Status
 sanei_magic_rotate (SANE_Parameters * params, SANE_Byte * buffer,
   int centerX, int centerY, double slope, int bg_color);
 
+/** Correct the skew of the media inside the image, reusing memory
+ *
+ * Same as sanei_magic_rotate(), but the copy of the image that the
+ * rotation needs is kept in a buffer owned by the caller.  It is grown
+ * as needed, so a backend rotating page after page allocates it once.
+ * Free it with free() when done.  With pthreads the image is rotated in
+ * bands by several threads.
+ *
+ * @param params describes image
+ * @param buffer contains image data
+ * @param centerX horizontal coordinate of center of rotation
+ * @param centerY vertical coordinate of center of rotation
+ * @param slope slope of rotation
+ * @param bg_color the replacement color for edges exposed by rotation
+ * @param[in,out] scratch scratch buffer, may point to NULL
+ * @param[in,out] scratch_size size of the scratch buffer
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_INVAL - invalid image parameters
+ */
+extern SANE_Status
+sanei_magic_rotate2 (SANE_Parameters * params, SANE_Byte * buffer,
+  int centerX, int centerY, double slope, int bg_color,
+  SANE_Byte ** scratch, size_t * scratch_size);
+
 /** Find the edges of the media inside the image, parallel to image edges
  *
  * @param params describes image
@@ -159,6 +279,8 @@ sanei_magic_crop(SANE_Parameters * params, SANE_Byte * buffer,
  * @param buffer contains image data
  * @param thresh maximum % density for blankness (0-100)
  *
+ * The check stops as soon as the density is above thresh.
+ *
  * @return
  * - SANE_STATUS_GOOD - page is not blank
  * - SANE_STATUS_NO_DOCS - page is blank
@@ -169,6 +291,58 @@ extern SANE_Status
 sanei_magic_isBlank(SANE_Parameters * params, SANE_Byte * buffer,
   double thresh);
 
+/** A blank page check fed while the image is read */
+typedef struct sanei_magic_blank SANEI_Magic_Blank;
+
+/** Start a blank page check for an image that is still being read
+ *
+ * The image data is given to sanei_magic_isBlankFeed() as it arrives.
+ * The answer is the same as sanei_magic_isBlank() on the whole image,
+ * but "not blank" is known as soon as enough dark pixels were seen,
+ * which needs params->lines to be known in advance.
+ *
+ * @param params describes image
+ * @param thresh maximum % density for blankness (0-100)
+ * @param[out] blank the check, for sanei_magic_isBlankFeed()
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_INVAL - invalid image parameters
+ */
+extern SANE_Status
+sanei_magic_isBlankStart(SANE_Parameters * params, double thresh,
+  SANEI_Magic_Blank ** blank);
+
+/** Add the next bytes of the image to a blank page check
+ *
+ * @param blank the check
+ * @param buffer image data, need not end on a line boundary
+ * @param len number of bytes in buffer
+ *
+ * @return
+ * - SANE_STATUS_GOOD - page is not blank, more data is not needed
+ * - SANE_STATUS_NO_DOCS - page is blank so far
+ * - SANE_STATUS_INVAL - invalid check
+ */
+extern SANE_Status
+sanei_magic_isBlankFeed(SANEI_Magic_Blank * blank, SANE_Byte * buffer,
+  size_t len);
+
+/** Finish a blank page check and free it
+ *
+ * Lines of the image that were not fed count as white.
+ *
+ * @param blank the check
+ *
+ * @return
+ * - SANE_STATUS_GOOD - page is not blank
+ * - SANE_STATUS_NO_DOCS - page is blank
+ * - SANE_STATUS_INVAL - invalid check
+ */
+extern SANE_Status
+sanei_magic_isBlankFinish(SANEI_Magic_Blank * blank);
+
 /** Determine coarse image rotation (90 degree increments)
  *
  * @param params describes image
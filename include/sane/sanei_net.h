@@ -22,6 +22,24 @@
 
 #define SANEI_NET_PROTOCOL_VERSION	3
 
+/* Optional protocol features.  A client requests them by or-ing the
+   flags into the build number of the SANE_NET_INIT version code; a
+   server that supports a requested feature sets the same flag in its
+   reply.  Old servers ignore the flags, and old clients never see
+   them because they don't ask.  */
+#define SANEI_NET_FEATURE_MASK		0xff00
+#define SANEI_NET_FEATURE_COMPRESSION	0x0100
+
+/* Data records with this bit set in the record length carry a
+   compressed block: the uncompressed size as a 4 byte word, followed
+   by data encoded with sanei_net_compress().  0xffffffff still marks
+   the status record.  */
+#define SANEI_NET_RECORD_COMPRESSED	0x80000000
+
+/* Largest data record saned sends.  Clients reject compressed records
+   that are, or decompress to, more than this.  */
+#define SANEI_NET_MAX_RECORD		(16 * 1024 * 1024)
+
 typedef enum
   {
     SANE_NET_LITTLE_ENDIAN = 0x1234,
@@ -141,4 +159,14 @@ extern void sanei_w_get_parameters_reply (Wire *w,
 extern void sanei_w_start_reply (Wire *w, SANE_Start_Reply *reply);
 extern void sanei_w_authorization_req (Wire *w, SANE_Authorization_Req *req);
 
+/* Compress LEN bytes at SRC into DST, which holds DST_SIZE bytes.
+   Returns the compressed size, or 0 if the result wouldn't fit.  */
+extern size_t sanei_net_compress (const SANE_Byte *src, size_t len,
+				  SANE_Byte *dst, size_t dst_size);
+
+/* Decompress LEN bytes at SRC into DST, which holds DST_SIZE bytes.
+   Returns the decompressed size, or -1 if the data is corrupt.  */
+extern long sanei_net_decompress (const SANE_Byte *src, size_t len,
+				  SANE_Byte *dst, size_t dst_size);
+
 #endif /* sanei_net_h */
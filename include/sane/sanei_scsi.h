@@ -319,6 +319,93 @@ extern void sanei_scsi_req_flush_all (void);
  */
 extern void sanei_scsi_req_flush_all_extended (int fd);
 
+/** Build a read command
+ *
+ * Used by sanei_scsi_readahead_start() to build the command block of
+ * each read.
+ *
+ * @param arg argument passed to sanei_scsi_readahead_start()
+ * @param length number of bytes the command must request
+ * @param cmd buffer of 16 zeroed bytes for the command block
+ *
+ * @return the length of the command block
+ */
+typedef size_t (*SANEI_SCSI_Read_Cmd) (void *arg, size_t length,
+				       u_char * cmd);
+
+/** Read-ahead state, see sanei_scsi_readahead_start() */
+typedef struct sanei_scsi_readahead SANEI_SCSI_Readahead;
+
+/** Start reading ahead
+ *
+ * Keeps up to DEPTH read commands queued with sanei_scsi_req_enter2(),
+ * so the device can go on sending data while the backend processes
+ * the previous block.  The blocks are handed back in order by
+ * sanei_scsi_readahead_next().
+ *
+ * If TOTAL is 0, reads are issued until one fails with
+ * SANE_STATUS_EOF or returns less than asked for, so the device must
+ * cope with up to DEPTH - 1 reads past the end of the data.  If TOTAL
+ * is known, exactly TOTAL bytes are requested: every block is
+ * BLOCK_SIZE bytes except for the last one.
+ *
+ * On platforms without a request queue the reads are done one at a
+ * time.
+ *
+ * @param fd file descriptor
+ * @param make_cmd builds the read command for a block
+ * @param arg argument for make_cmd
+ * @param total number of bytes to read or 0 if not known
+ * @param block_size number of bytes per read, at most
+ *   sanei_scsi_max_request_size
+ * @param depth number of reads to keep queued
+ * @param rap where to store the read-ahead state
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_NO_MEM - if the buffers could not be allocated
+ * - SANE_STATUS_INVAL - on invalid arguments
+ *
+ * @sa sanei_scsi_readahead_next(), sanei_scsi_readahead_stop()
+ */
+extern SANE_Status sanei_scsi_readahead_start (int fd,
+					       SANEI_SCSI_Read_Cmd make_cmd,
+					       void *arg, size_t total,
+					       size_t block_size, int depth,
+					       SANEI_SCSI_Readahead ** rap);
+
+/** Get the next block
+ *
+ * Waits for the oldest queued read and queues the next one in place
+ * of the block handed back by the previous call.  The data stays valid
+ * until the next call of sanei_scsi_readahead_next() or
+ * sanei_scsi_readahead_stop().
+ *
+ * @param ra read-ahead state
+ * @param data set to the data of the block
+ * @param size set to the number of bytes in the block
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_EOF - if all data has been read
+ * - any other status returned by the read; errors are sticky
+ */
+extern SANE_Status sanei_scsi_readahead_next (SANEI_SCSI_Readahead * ra,
+					      const u_char ** data,
+					      size_t * size);
+
+/** Stop reading ahead
+ *
+ * Drops the queued reads with sanei_scsi_req_flush_all_extended(),
+ * which also drops any other commands pending on the file descriptor,
+ * and frees RA.  At debug level 3 the number of reads, the average
+ * queue depth, the time the device had no read queued and the time
+ * spent waiting for data are printed.
+ *
+ * @param ra read-ahead state, may be NULL
+ */
+extern void sanei_scsi_readahead_stop (SANEI_SCSI_Readahead * ra);
+
 /** Close a SCSI device
  *
  * @param fd file descriptor
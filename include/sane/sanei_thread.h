@@ -161,4 +161,158 @@ extern SANE_Pid sanei_thread_waitpid (SANE_Pid pid, int *status);
  */
 extern SANE_Status sanei_thread_get_status (SANE_Pid pid);
 
+/** @name Reader task with a ring buffer
+ *
+ * These functions replace the usual reader task that writes the image
+ * data into a pipe.  With threads, the data goes through a ring buffer
+ * in memory instead of through the kernel, the task runs on a thread
+ * from a pool that is kept across scans, and a file descriptor that is
+ * readable while there is data (or the end of it) is offered for
+ * sane_get_select_fd().  With processes, the ring is a pipe and the
+ * task a child process, so backends need only one code path.
+ *
+ * The task ends when its function returns.  sanei_thread_ring_stop()
+ * asks it to end: sanei_thread_ring_write() returns
+ * SANE_STATUS_CANCELLED from then on, and the task should return
+ * promptly.  With processes, the child gets SIGTERM as before.
+ */
+/* @{ */
+
+/** A ring buffer and the reader task filling it. */
+typedef struct sanei_thread_ring SANEI_Thread_Ring;
+
+/** Create a ring buffer.
+ *
+ * @param size - bytes the ring holds, ignored with processes
+ * @param ring - returns the new ring
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_NO_MEM - if memory or file descriptors ran out
+ */
+extern SANE_Status sanei_thread_ring_new (size_t size,
+					  SANEI_Thread_Ring ** ring);
+
+/** Stop the task if it still runs and free the ring.
+ *
+ * @param ring - the ring
+ */
+extern void sanei_thread_ring_free (SANEI_Thread_Ring * ring);
+
+/** Start a reader task for the next image.
+ *
+ * The ring is emptied and func(args) runs on a pool thread (or in a
+ * child process).  Its return value becomes the status the reader
+ * gets after the data, see sanei_thread_ring_read().  The ring is in
+ * blocking mode again.
+ *
+ * @param ring - the ring, with no task running
+ * @param func - the reader function
+ * @param args - its argument
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_INVAL - if a task is already running
+ * - SANE_STATUS_NO_MEM - if the task couldn't be started
+ */
+extern SANE_Status sanei_thread_ring_start (SANEI_Thread_Ring * ring,
+					    int (*func) (void *args),
+					    void *args);
+
+/** Add data to the ring, from the reader task.
+ *
+ * Waits while the ring is full.
+ *
+ * @param ring - the ring
+ * @param data - the data
+ * @param size - its size
+ *
+ * @return
+ * - SANE_STATUS_GOOD - if all the data was added
+ * - SANE_STATUS_CANCELLED - if the ring was stopped
+ * - SANE_STATUS_IO_ERROR - if writing to the pipe failed
+ */
+extern SANE_Status sanei_thread_ring_write (SANEI_Thread_Ring * ring,
+					    const SANE_Byte * data,
+					    size_t size);
+
+/** Take data from the ring.
+ *
+ * Waits for data unless the ring is in non-blocking mode, where
+ * *length is 0 if there is none yet.
+ *
+ * @param ring - the ring
+ * @param data - where to put the data
+ * @param max_length - at most this many bytes
+ * @param length - returns the number of bytes read
+ *
+ * @return
+ * - SANE_STATUS_GOOD - if data was read, or none is there yet
+ * - SANE_STATUS_EOF - if the task returned SANE_STATUS_GOOD and all of
+ *   its data was read
+ * - the status the task returned, if not SANE_STATUS_GOOD, after all
+ *   of its data
+ * - SANE_STATUS_IO_ERROR - if reading from the pipe failed
+ */
+extern SANE_Status sanei_thread_ring_read (SANEI_Thread_Ring * ring,
+					   SANE_Byte * data,
+					   size_t max_length, size_t * length);
+
+/** Get the number of bytes waiting in the ring.
+ *
+ * Only a snapshot, the task may add data right after.  For statistics
+ * like how far a reader task is ahead.
+ *
+ * @param ring - the ring
+ *
+ * @return
+ * - the bytes in the ring, or in the pipe where that can be told, else 0
+ */
+extern size_t sanei_thread_ring_fill (SANEI_Thread_Ring * ring);
+
+/** Stop the reader task and wait until it has ended.
+ *
+ * Data still in the ring is dropped.
+ *
+ * @param ring - the ring
+ *
+ * @return
+ * - the status the task returned, SANE_STATUS_GOOD if none is running
+ */
+extern SANE_Status sanei_thread_ring_stop (SANEI_Thread_Ring * ring);
+
+/** Set blocking or non-blocking mode for sanei_thread_ring_read().
+ *
+ * @param ring - the ring
+ * @param non_blocking - SANE_TRUE for non-blocking mode
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_IO_ERROR - if the mode of the pipe couldn't be set
+ */
+extern SANE_Status sanei_thread_ring_set_io_mode (SANEI_Thread_Ring * ring,
+						  SANE_Bool non_blocking);
+
+/** Get a file descriptor that is readable while data can be read.
+ *
+ * Only select() or poll() it; the data comes from
+ * sanei_thread_ring_read().  Get it again after each
+ * sanei_thread_ring_start(), with processes it is a new pipe.
+ *
+ * @param ring - the ring
+ *
+ * @return
+ * - the file descriptor
+ */
+extern int sanei_thread_ring_get_select_fd (SANEI_Thread_Ring * ring);
+
+/** End the idle threads of the pool.
+ *
+ * Call this from sane_exit(), after all rings have been freed, so no
+ * thread is left in code that is about to be unloaded.
+ */
+extern void sanei_thread_pool_exit (void);
+
+/* @} */
+
 #endif /* sanei_thread_h */
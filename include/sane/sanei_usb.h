@@ -331,6 +331,108 @@ extern SANE_Status sanei_usb_reset (SANE_Int dn);
 extern SANE_Status
 sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size);
 
+/** Start streaming from the bulk-in endpoint.
+ *
+ * Keeps up to @a transfers bulk transfers of @a transfer_size bytes in
+ * flight, so the bus doesn't sit idle between two reads of the backend.
+ * No more than @a total bytes are requested from the device in all; a
+ * @a total of 0 streams until the device ends a transfer early, which is
+ * only safe if it doesn't send anything else afterwards.  Every transfer
+ * is a multiple of 512 bytes except the last one.  Where asynchronous
+ * transfers are not available (libusb-0.1, kernel scanner driver), the
+ * stream reads synchronously, one transfer at a time, and only adds a
+ * copy; check sanei_usb_stream_async() first.  A transfer that ends
+ * short ends the stream.
+ *
+ * Only one stream per device can be active.  Don't mix
+ * sanei_usb_read_bulk() with an active stream.
+ *
+ * @param dn device number
+ * @param total number of bytes the device is going to send, or 0
+ * @param transfer_size size of each transfer, rounded down to a multiple
+ * of 512 bytes
+ * @param transfers number of transfers in flight
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_NO_MEM - if the buffers couldn't be allocated
+ * - SANE_STATUS_IO_ERROR - if the first transfers couldn't be submitted
+ * - SANE_STATUS_INVAL - on every other error
+ *
+ * @sa sanei_usb_stream_read(), sanei_usb_stream_stop()
+ */
+extern SANE_Status
+sanei_usb_stream_start (SANE_Int dn, size_t total, size_t transfer_size,
+			SANE_Int transfers);
+
+/** Read from a stream.
+ *
+ * Waits until @a size bytes have arrived or the stream has ended.  After
+ * the read, size contains the number of bytes actually read, which is
+ * less than requested only at the end of the stream.
+ *
+ * @param dn device number
+ * @param buffer buffer to store read data in
+ * @param size size of the data
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_EOF - if the stream has ended and zero bytes have been read
+ * - SANE_STATUS_IO_ERROR - if a transfer failed; the stream must be stopped
+ * - SANE_STATUS_INVAL - if no stream was started
+ */
+extern SANE_Status
+sanei_usb_stream_read (SANE_Int dn, SANE_Byte * buffer, size_t * size);
+
+/** Stop a stream.
+ *
+ * Cancels the transfers still in flight and frees the buffers.  Data that
+ * has been received but not read is lost.
+ *
+ * @param dn device number
+ */
+extern void sanei_usb_stream_stop (SANE_Int dn);
+
+/** Check if streams of a device overlap their transfers.
+ *
+ * @param dn device number
+ *
+ * @return SANE_TRUE if the device is accessed through libusb-1.0, which
+ * keeps the transfers of a stream in flight at the same time
+ */
+extern SANE_Bool sanei_usb_stream_async (SANE_Int dn);
+
+/** Check if sanei_usb_stream_start() and friends are available.
+ */
+#define HAVE_SANEI_USB_STREAM
+
+/** Callback of a loopback device.
+ *
+ * Called for every bulk-in transfer with the buffer and its size.  Store
+ * the number of bytes "received" in size.
+ *
+ * @sa sanei_usb_testing_open_loopback()
+ */
+typedef SANE_Status (*sanei_usb_loopback_func) (void *arg, SANE_Byte * buffer,
+						size_t * size);
+
+/** Open a loopback device for test programs.
+ *
+ * The device has no hardware behind it: sanei_usb_read_bulk() and the
+ * stream functions call @a read instead.  Close it with sanei_usb_close().
+ *
+ * @param read called for every bulk-in transfer
+ * @param arg passed to @a read
+ * @param dn device number of the new device
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_NO_MEM - if there is no room for another device
+ */
+extern SANE_Status
+sanei_usb_testing_open_loopback (sanei_usb_loopback_func read, void *arg,
+				 SANE_Int * dn);
+
 /** Initiate a bulk transfer write.
  *
  * Write up to size bytes from buffer to the device. After the write size
@@ -56,8 +56,10 @@ typedef enum
 WireDirection;
 
 struct Wire;
+struct WireArena;
 
 typedef void (*WireCodecFunc) (struct Wire *w, void *val_ptr);
+typedef void (*WireBulkFunc) (struct Wire *w, void *val_ptr, size_t count);
 typedef ssize_t (*WireReadFunc) (int fd, void * buf, size_t len);
 typedef ssize_t (*WireWriteFunc) (int fd, const void * buf, size_t len);
 
@@ -73,6 +75,9 @@ typedef struct Wire
 	WireCodecFunc w_char;
 	WireCodecFunc w_word;
 	WireCodecFunc w_string;
+	/* optional: transfer COUNT bytes (chars) or words in one go */
+	WireBulkFunc w_bytes;
+	WireBulkFunc w_words;
       }
     codec;
     struct
@@ -90,9 +95,22 @@ typedef struct Wire
 	WireWriteFunc write;
       }
     io;
+    struct
+      {
+	int enabled;		/* codec allocates nothing on its own */
+	int depth;		/* nesting level of the value being transferred */
+	struct WireArena *live;	/* one arena per decoded top-level value */
+	struct WireArena *curr;	/* arena of the value being decoded */
+      }
+    arena;
   }
 Wire;
 
+/* If the codec enables arenas, everything that is decoded below one
+   top-level array or pointer is allocated from a single arena.
+   sanei_w_free() on that value releases the whole arena at once;
+   sanei_w_exit() releases all arenas that are still alive, so decoded
+   values must not be used after it.  */
 extern void sanei_w_init (Wire *w, void (*codec_init)(Wire *));
 extern void sanei_w_exit (Wire *w);
 extern void sanei_w_space (Wire *w, size_t howmuch);
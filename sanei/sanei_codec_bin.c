@@ -129,6 +129,86 @@ bin_w_word (Wire *w, void *v)
     }
 }
 
+/* Make sure at least one element of ELEMENT_SIZE bytes fits into (or
+   can be taken from) the buffer, and return how many elements do.  */
+static size_t
+bin_w_avail (Wire *w, size_t count, size_t element_size)
+{
+  size_t avail = (w->buffer.end - w->buffer.curr) / element_size;
+
+  if (avail == 0)
+    {
+      avail = count * element_size;
+      if (avail > w->buffer.size)
+	avail = w->buffer.size;
+      sanei_w_space (w, avail);
+      if (w->status)
+	return 0;
+      avail = (w->buffer.end - w->buffer.curr) / element_size;
+    }
+  return avail < count ? avail : count;
+}
+
+static void
+bin_w_bytes (Wire *w, void *v, size_t count)
+{
+  SANE_Byte *b = v;
+  size_t n;
+
+  if (w->direction == WIRE_FREE)
+    return;
+
+  while (count > 0)
+    {
+      n = bin_w_avail (w, count, 1);
+      if (w->status)
+	return;
+      if (w->direction == WIRE_ENCODE)
+	memcpy (w->buffer.curr, b, n);
+      else
+	memcpy (b, w->buffer.curr, n);
+      w->buffer.curr += n;
+      b += n;
+      count -= n;
+    }
+}
+
+static void
+bin_w_words (Wire *w, void *v, size_t count)
+{
+  SANE_Word val, *word = v;
+  unsigned char *p;
+  size_t i, n;
+
+  if (w->direction == WIRE_FREE)
+    return;
+
+  while (count > 0)
+    {
+      n = bin_w_avail (w, count, 4);
+      if (w->status)
+	return;
+      p = (unsigned char *) w->buffer.curr;
+      if (w->direction == WIRE_ENCODE)
+	for (i = 0; i < n; ++i, p += 4)
+	  {
+	    val = word[i];
+	    /* store in bigendian byte-order: */
+	    p[0] = (val >> 24) & 0xff;
+	    p[1] = (val >> 16) & 0xff;
+	    p[2] = (val >>  8) & 0xff;
+	    p[3] = (val >>  0) & 0xff;
+	  }
+      else
+	for (i = 0; i < n; ++i, p += 4)
+	  word[i] = (((SANE_Word) p[0] << 24) | (p[1] << 16)
+		     | (p[2] << 8) | p[3]);
+      w->buffer.curr += 4 * n;
+      word += n;
+      count -= n;
+    }
+}
+
 void
 sanei_codec_bin_init (Wire *w)
 {
@@ -136,4 +216,8 @@ sanei_codec_bin_init (Wire *w)
   w->codec.w_char = bin_w_byte;
   w->codec.w_word = bin_w_word;
   w->codec.w_string = bin_w_string;
+  w->codec.w_bytes = bin_w_bytes;
+  w->codec.w_words = bin_w_words;
+  /* all decoded memory comes from sanei_w_array() and sanei_w_ptr() */
+  w->arena.enabled = 1;
 }
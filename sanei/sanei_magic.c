@@ -50,6 +50,13 @@
 #include <errno.h>
 #include <math.h>
 
+#ifdef USE_PTHREAD
+# include <pthread.h>
+# include <unistd.h>
+#endif
+
+#include "../include/_stdint.h"
+
 #define BACKEND_NAME sanei_magic      /* name of this module for debugging */
 
 #include "../include/sane/sane.h"
@@ -74,253 +81,522 @@ static SANE_Status getLine (int height, int width, int * buff,
   int offsets, int minOffset, int maxOffset,
   double * finSlope, int * finOffset, int * finDensity);
 
+static int transX (SANE_Parameters * params, SANE_Byte * row, int left);
+
+static void transFilter (int * buff, int len, int dpi, int lastLine);
+
+static void magic_select (void);
+
 void
 sanei_magic_init( void )
 {
   DBG_INIT();
+  magic_select();
 }
 
-/* find small spots and replace them with image background color */
-SANE_Status
-sanei_magic_despeck (SANE_Parameters * params, SANE_Byte * buffer,
-  SANE_Int diam)
-{
+/* Despeckle works on rows of pixel values: the byte for gray, the sum
+ * of the channels for color and 1 for white or 0 for black in lineart.
+ * For each band of DIAM rows the column minimums are kept, from which
+ * the minimum of every window and of the columns left and right of it
+ * follow.  The rows above and below the band do not change while it is
+ * processed, so their minimums over DIAM+2 pixels are computed once per
+ * band.  The output is the same as that of the plain window walk. */
 
-  SANE_Status ret = SANE_STATUS_GOOD;
+#define DESPECK_COLOR   0
+#define DESPECK_GRAY    1
+#define DESPECK_LINEART 2
 
-  int pw = params->pixels_per_line;
-  int bw = params->bytes_per_line;
-  int h  = params->lines;
-  int bt = bw*h;
+/* dst[x] = minimum of rows[0..nrows-1][x] for x < n */
+typedef void (*despeck_min_rows_func) (short * dst, short ** rows,
+  int nrows, int n);
 
-  int i,j,k,l,n;
+/* dst[x] = minimum of src[x..x+span-1] for x < n */
+typedef void (*despeck_min_span_func) (short * dst, const short * src,
+  int n, int span);
 
-  DBG (10, "sanei_magic_despeck: start\n");
+static void
+despeck_min_rows_c (short * dst, short ** rows, int nrows, int n)
+{
+  int r, x;
 
-  if(params->format == SANE_FRAME_RGB){
+  memcpy (dst, rows[0], n * sizeof (short));
+  for(r=1; r<nrows; r++){
+    for(x=0; x<n; x++){
+      if(rows[r][x] < dst[x])
+        dst[x] = rows[r][x];
+    }
+  }
+}
 
-    for(i=bw; i<bt-bw-(bw*diam); i+=bw){
-      for(j=1; j<pw-1-diam; j++){
+static void
+despeck_min_span_c (short * dst, const short * src, int n, int span)
+{
+  int x, l;
 
-        int thresh = 255*3;
-        int outer[] = {0,0,0};
-        int hits = 0;
+  for(x=0; x<n; x++){
+    short m = src[x];
+    for(l=1; l<span; l++){
+      if(src[x+l] < m)
+        m = src[x+l];
+    }
+    dst[x] = m;
+  }
+}
 
-        /* loop over rows and columns in window */
-        /* find darkest pixel */
-        for(k=0; k<diam; k++){
-          for(l=0; l<diam; l++){
-            int tmp = 0;
+#if defined (__GNUC__) && (__GNUC__ >= 5 || defined (__clang__)) \
+  && (defined (__x86_64__) || defined (__i386__))
+# define MAGIC_X86
+# include <immintrin.h>
+#endif
 
-            for(n=0; n<3; n++){
-              tmp += buffer[i + j*3 + k*bw + l*3 + n];
-            }
+#ifdef MAGIC_X86
 
-            if(tmp < thresh)
-              thresh = tmp;
-          }
-        }
+__attribute__ ((target ("sse2"))) static void
+despeck_min_rows_sse2 (short * dst, short ** rows, int nrows, int n)
+{
+  int r, x;
 
-        /* convert darkest pixel into a brighter threshold */
-        thresh = (thresh + 255*3 + 255*3)/3;
-  
-        /*loop over rows and columns around window */
-        for(k=-1; k<diam+1; k++){
-          for(l=-1; l<diam+1; l++){
+  for(x=0; x+8<=n; x+=8){
+    __m128i m = _mm_loadu_si128 ((const __m128i *) (rows[0] + x));
+    for(r=1; r<nrows; r++){
+      m = _mm_min_epi16 (m,
+        _mm_loadu_si128 ((const __m128i *) (rows[r] + x)));
+    }
+    _mm_storeu_si128 ((__m128i *) (dst + x), m);
+  }
+  for(; x<n; x++){
+    dst[x] = rows[0][x];
+    for(r=1; r<nrows; r++){
+      if(rows[r][x] < dst[x])
+        dst[x] = rows[r][x];
+    }
+  }
+}
 
-            int tmp[3];
-  
-            /* dont count pixels in the window */
-            if(k != -1 && k != diam && l != -1 && l != diam)
-              continue;
-  
-            for(n=0; n<3; n++){
-              tmp[n] = buffer[i + j*3 + k*bw + l*3 + n];
-              outer[n] += tmp[n];
-            }
-            if(tmp[0]+tmp[1]+tmp[2] < thresh){
-              hits++;
-              break;
-            }
-          }
-        }
+__attribute__ ((target ("sse2"))) static void
+despeck_min_span_sse2 (short * dst, const short * src, int n, int span)
+{
+  int x, l;
 
-        /*no hits, overwrite with avg surrounding color*/
-        if(!hits){
+  for(x=0; x+8<=n; x+=8){
+    __m128i m = _mm_loadu_si128 ((const __m128i *) (src + x));
+    for(l=1; l<span; l++){
+      m = _mm_min_epi16 (m,
+        _mm_loadu_si128 ((const __m128i *) (src + x + l)));
+    }
+    _mm_storeu_si128 ((__m128i *) (dst + x), m);
+  }
+  despeck_min_span_c (dst + x, src + x, n - x, span);
+}
 
-          /* per channel replacement color */
-          for(n=0; n<3; n++){
-            outer[n] /= (4*diam + 4);
-          }
+__attribute__ ((target ("avx2"))) static void
+despeck_min_rows_avx2 (short * dst, short ** rows, int nrows, int n)
+{
+  int r, x;
 
-          for(k=0; k<diam; k++){
-            for(l=0; l<diam; l++){
-              for(n=0; n<3; n++){
-                buffer[i + j*3 + k*bw + l*3 + n] = outer[n];
-              }
-            }
-          }
-        }
-      }
+  for(x=0; x+16<=n; x+=16){
+    __m256i m = _mm256_loadu_si256 ((const __m256i *) (rows[0] + x));
+    for(r=1; r<nrows; r++){
+      m = _mm256_min_epi16 (m,
+        _mm256_loadu_si256 ((const __m256i *) (rows[r] + x)));
+    }
+    _mm256_storeu_si256 ((__m256i *) (dst + x), m);
+  }
+  for(; x<n; x++){
+    dst[x] = rows[0][x];
+    for(r=1; r<nrows; r++){
+      if(rows[r][x] < dst[x])
+        dst[x] = rows[r][x];
     }
   }
+}
 
-  else if(params->format == SANE_FRAME_GRAY && params->depth == 8){
-    for(i=bw; i<bt-bw-(bw*diam); i+=bw){
-      for(j=1; j<pw-1-diam; j++){
+__attribute__ ((target ("avx2"))) static void
+despeck_min_span_avx2 (short * dst, const short * src, int n, int span)
+{
+  int x, l;
 
-        int thresh = 255;
-        int outer = 0;
-        int hits = 0;
+  for(x=0; x+16<=n; x+=16){
+    __m256i m = _mm256_loadu_si256 ((const __m256i *) (src + x));
+    for(l=1; l<span; l++){
+      m = _mm256_min_epi16 (m,
+        _mm256_loadu_si256 ((const __m256i *) (src + x + l)));
+    }
+    _mm256_storeu_si256 ((__m256i *) (dst + x), m);
+  }
+  despeck_min_span_c (dst + x, src + x, n - x, span);
+}
 
-        for(k=0; k<diam; k++){
-          for(l=0; l<diam; l++){
-            if(buffer[i + j + k*bw + l] < thresh)
-              thresh = buffer[i + j + k*bw + l];
-          }
-        }
+#endif /* MAGIC_X86 */
 
-        /* convert darkest pixel into a brighter threshold */
-        thresh = (thresh + 255 + 255)/3;
-  
-        /*loop over rows and columns around window */
-        for(k=-1; k<diam+1; k++){
-          for(l=-1; l<diam+1; l++){
+/* isBlank sums the bytes of gray and color rows and counts the set
+ * pixels of lineart rows */
 
-            int tmp = 0;
+/* sum of src[0..n-1] */
+typedef unsigned long (*blank_sum_func) (const SANE_Byte * src, int n);
 
-            /* dont count pixels in the window */
-            if(k != -1 && k != diam && l != -1 && l != diam)
-              continue;
-  
-            tmp = buffer[i + j + k*bw + l];
+/* number of set bits in the first n pixels of src */
+typedef int (*blank_bits_func) (const SANE_Byte * src, int n);
 
-            if(tmp < thresh){
-              hits++;
-              break;
-            }
+static unsigned long
+blank_sum_c (const SANE_Byte * src, int n)
+{
+  unsigned long sum = 0;
+  int x;
 
-            outer += tmp;
-          }
-        }
+  for(x=0; x<n; x++){
+    sum += src[x];
+  }
+  return sum;
+}
 
-        /*no hits, overwrite with avg surrounding color*/
-        if(!hits){
-          /* replacement color */
-          outer /= (4*diam + 4);
+static int
+blank_bits_c (const SANE_Byte * src, int n)
+{
+  int count = 0;
+  int x;
 
-          for(k=0; k<diam; k++){
-            for(l=0; l<diam; l++){
-              buffer[i + j + k*bw + l] = outer;
-            }
-          }
-        }
-      }
-    }
+  for(x=0; x+32<=n; x+=32){
+    uint32_t v = (uint32_t) src[x/8] << 24 | (uint32_t) src[x/8+1] << 16
+      | (uint32_t) src[x/8+2] << 8 | src[x/8+3];
+
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    v = (v + (v >> 4)) & 0x0f0f0f0f;
+    count += (v * 0x01010101) >> 24;
+  }
+  for(; x<n; x++){
+    count += src[x/8] >> (7-(x%8)) & 1;
   }
+  return count;
+}
 
-  else if(params->format == SANE_FRAME_GRAY && params->depth == 1){
-    for(i=bw; i<bt-bw-(bw*diam); i+=bw){
-      for(j=1; j<pw-1-diam; j++){
-        
-        int curr = 0;
-        int hits = 0;
+#ifdef MAGIC_X86
 
-        for(k=0; k<diam; k++){
-          for(l=0; l<diam; l++){
-            curr += buffer[i + k*bw + (j+l)/8] >> (7-(j+l)%8) & 1;
-          }
-        }
+__attribute__ ((target ("sse2"))) static unsigned long
+blank_sum_sse2 (const SANE_Byte * src, int n)
+{
+  __m128i zero = _mm_setzero_si128 ();
+  __m128i acc = zero;
+  uint64_t part[2];
+  int x;
 
-        if(!curr)
-          continue;
+  for(x=0; x+16<=n; x+=16){
+    acc = _mm_add_epi64 (acc, _mm_sad_epu8 (zero,
+      _mm_loadu_si128 ((const __m128i *) (src + x))));
+  }
+  _mm_storeu_si128 ((__m128i *) part, acc);
+  return part[0] + part[1] + blank_sum_c (src + x, n - x);
+}
 
-        /*loop over rows and columns around window */
-        for(k=-1; k<diam+1; k++){
-          for(l=-1; l<diam+1; l++){
+__attribute__ ((target ("avx2"))) static unsigned long
+blank_sum_avx2 (const SANE_Byte * src, int n)
+{
+  __m256i zero = _mm256_setzero_si256 ();
+  __m256i acc = zero;
+  uint64_t part[4];
+  int x;
+
+  for(x=0; x+32<=n; x+=32){
+    acc = _mm256_add_epi64 (acc, _mm256_sad_epu8 (zero,
+      _mm256_loadu_si256 ((const __m256i *) (src + x))));
+  }
+  _mm256_storeu_si256 ((__m256i *) part, acc);
+  return part[0] + part[1] + part[2] + part[3]
+    + blank_sum_c (src + x, n - x);
+}
 
-            /* dont count pixels in the window */
-            if(k != -1 && k != diam && l != -1 && l != diam)
-              continue;
-  
-            hits += buffer[i + k*bw + (j+l)/8] >> (7-(j+l)%8) & 1;
+__attribute__ ((target ("popcnt"))) static int
+blank_bits_popcnt (const SANE_Byte * src, int n)
+{
+  int count = 0;
+  int x;
 
-            if(hits)
-              break;
-          }
-        }
+  for(x=0; x+64<=n; x+=64){
+    uint64_t v;
+    memcpy (&v, src + x/8, sizeof (v));
+    count += __builtin_popcountll (v);
+  }
+  return count + blank_bits_c (src + x/8, n - x);
+}
 
-        /*no hits, overwrite with white*/
-        if(!hits){
-          for(k=0; k<diam; k++){
-            for(l=0; l<diam; l++){
-              buffer[i + k*bw + (j+l)/8] &= ~(1 << (7-(j+l)%8));
-            }
-          }
-        }
+#endif /* MAGIC_X86 */
+
+static despeck_min_rows_func despeck_min_rows = NULL;
+static despeck_min_span_func despeck_min_span = NULL;
+static blank_sum_func blank_sum = NULL;
+static blank_bits_func blank_bits = NULL;
+
+/* pick the kernels for this cpu, SANE_MAGIC_SIMD=none|sse2|avx2
+ * limits the choice */
+static void
+magic_select (void)
+{
+  const char * limit = getenv ("SANE_MAGIC_SIMD");
+  const char * name = "none";
+
+  despeck_min_rows = despeck_min_rows_c;
+  despeck_min_span = despeck_min_span_c;
+  blank_sum = blank_sum_c;
+  blank_bits = blank_bits_c;
+
+#ifdef MAGIC_X86
+  __builtin_cpu_init ();
+
+  if(limit && !strcmp (limit, "none"))
+    ;
+  else if(__builtin_cpu_supports ("avx2")
+    && (!limit || !strcmp (limit, "avx2"))){
+    despeck_min_rows = despeck_min_rows_avx2;
+    despeck_min_span = despeck_min_span_avx2;
+    blank_sum = blank_sum_avx2;
+    name = "avx2";
+  }
+  else if(__builtin_cpu_supports ("sse2")){
+    despeck_min_rows = despeck_min_rows_sse2;
+    despeck_min_span = despeck_min_span_sse2;
+    blank_sum = blank_sum_sse2;
+    name = "sse2";
+  }
+
+  if(blank_sum != blank_sum_c && __builtin_cpu_supports ("popcnt"))
+    blank_bits = blank_bits_popcnt;
+#endif
+
+  DBG (15, "magic_select: using %s kernels (limit %s)\n", name,
+    limit ? limit : "none set");
+}
+
+/* convert row Y of the image into pixel values */
+static void
+despeck_load (SANE_Parameters * params, SANE_Byte * buffer, int kind,
+  int y, short * row)
+{
+  SANE_Byte * p = buffer + y * params->bytes_per_line;
+  int pw = params->pixels_per_line;
+  int x;
+
+  if(kind == DESPECK_COLOR){
+    for(x=0; x<pw; x++){
+      row[x] = p[x*3] + p[x*3+1] + p[x*3+2];
+    }
+  }
+  else if(kind == DESPECK_GRAY){
+    for(x=0; x<pw; x++){
+      row[x] = p[x];
+    }
+  }
+  else{
+    for(x=0; x<pw; x++){
+      row[x] = !(p[x/8] >> (7-x%8) & 1);
+    }
+  }
+}
+
+/* overwrite the window at column J of the band at row Y with the average
+ * of the pixels around it, return its new pixel value */
+static short
+despeck_fill (SANE_Parameters * params, SANE_Byte * buffer, int kind,
+  int y, int j, int diam)
+{
+  int bw = params->bytes_per_line;
+  int chans = (kind == DESPECK_COLOR) ? 3 : 1;
+  int outer[] = {0,0,0};
+  short value = 0;
+  int k,l,n;
+
+  if(kind == DESPECK_LINEART){
+    for(k=0; k<diam; k++){
+      for(l=0; l<diam; l++){
+        buffer[(y+k)*bw + (j+l)/8] &= ~(1 << (7-(j+l)%8));
       }
     }
+    return 1;
   }
 
-  else{
-    DBG (5, "sanei_magic_despeck: unsupported format/depth\n");
-    ret = SANE_STATUS_INVAL;
+  for(n=0; n<chans; n++){
+    SANE_Byte * top = buffer + (y-1)*bw + (j-1)*chans + n;
+    SANE_Byte * bot = buffer + (y+diam)*bw + (j-1)*chans + n;
+
+    for(l=0; l<diam+2; l++){
+      outer[n] += top[l*chans] + bot[l*chans];
+    }
+    for(k=0; k<diam; k++){
+      outer[n] += buffer[(y+k)*bw + (j-1)*chans + n]
+        + buffer[(y+k)*bw + (j+diam)*chans + n];
+    }
+    outer[n] /= (4*diam + 4);
+    value += outer[n];
   }
 
-  DBG (10, "sanei_magic_despeck: finish\n");
-  return ret;
+  for(k=0; k<diam; k++){
+    SANE_Byte * p = buffer + (y+k)*bw + j*chans;
+    if(chans == 1){
+      memset (p, outer[0], diam);
+      continue;
+    }
+    for(l=0; l<diam; l++){
+      for(n=0; n<chans; n++){
+        *p++ = outer[n];
+      }
+    }
+  }
+  return value;
 }
 
-/* find likely edges of media inside image background color */
+/* find small spots and replace them with image background color */
 SANE_Status
-sanei_magic_findEdges(SANE_Parameters * params, SANE_Byte * buffer,
-  int dpiX, int dpiY, int * top, int * bot, int * left, int * right)
+sanei_magic_despeck (SANE_Parameters * params, SANE_Byte * buffer,
+  SANE_Int diam)
 {
 
   SANE_Status ret = SANE_STATUS_GOOD;
 
-  int width = params->pixels_per_line;
-  int height = params->lines;
+  int pw = params->pixels_per_line;
+  int h  = params->lines;
+  int kind, maxval;
+  int ring = diam + 2;
+  int lastY = h-1-diam;  /* windows start on rows 1 .. lastY-1 */
+  int lastX = pw-1-diam; /* and columns 1 .. lastX-1 */
 
-  int * topBuf = NULL, * botBuf = NULL;
-  int * leftBuf = NULL, * rightBuf = NULL;
+  short * mem = NULL;
+  short ** band = NULL;
+  short * colmin, * winmin, * topmin, * botmin;
 
-  int topCount = 0, botCount = 0;
-  int leftCount = 0, rightCount = 0;
+  int y,j,k,l;
 
-  int i;
+  DBG (10, "sanei_magic_despeck: start\n");
 
-  DBG (10, "sanei_magic_findEdges: start\n");
+  if(params->format == SANE_FRAME_RGB){
+    kind = DESPECK_COLOR;
+    maxval = 255*3;
+  }
+  else if(params->format == SANE_FRAME_GRAY && params->depth == 8){
+    kind = DESPECK_GRAY;
+    maxval = 255;
+  }
+  else if(params->format == SANE_FRAME_GRAY && params->depth == 1){
+    kind = DESPECK_LINEART;
+    maxval = 1;
+  }
+  else{
+    DBG (5, "sanei_magic_despeck: unsupported format/depth\n");
+    ret = SANE_STATUS_INVAL;
+    goto finish;
+  }
 
-  /* get buffers to find sides and bottom */
-  topBuf = sanei_magic_getTransY(params,dpiY,buffer,1);
-  if(!topBuf){
-    DBG (5, "sanei_magic_findEdges: no topBuf\n");
-    ret = SANE_STATUS_NO_MEM;
-    goto cleanup;
+  /* nothing fits */
+  if(diam < 1 || lastY < 2 || lastX < 2){
+    goto finish;
   }
 
-  botBuf = sanei_magic_getTransY(params,dpiY,buffer,0);
-  if(!botBuf){
-    DBG (5, "sanei_magic_findEdges: no botBuf\n");
-    ret = SANE_STATUS_NO_MEM;
-    goto cleanup;
+  if(!despeck_min_rows){
+    magic_select ();
   }
 
-  leftBuf = sanei_magic_getTransX(params,dpiX,buffer,1);
-  if(!leftBuf){
-    DBG (5, "sanei_magic_findEdges: no leftBuf\n");
+  mem = malloc ((ring + 4) * pw * sizeof (short));
+  band = malloc (diam * sizeof (short *));
+  if(!mem || !band){
+    DBG (5, "sanei_magic_despeck: no mem\n");
     ret = SANE_STATUS_NO_MEM;
-    goto cleanup;
+    goto finish;
   }
+  colmin = mem + ring * pw;
+  winmin = colmin + pw;
+  topmin = winmin + pw;
+  botmin = topmin + pw;
 
-  rightBuf = sanei_magic_getTransX(params,dpiX,buffer,0);
-  if(!rightBuf){
-    DBG (5, "sanei_magic_findEdges: no rightBuf\n");
-    ret = SANE_STATUS_NO_MEM;
-    goto cleanup;
+  /* row Y is kept in slot Y % ring */
+  for(y=0; y<ring; y++){
+    despeck_load (params, buffer, kind, y, mem + y * pw);
+  }
+
+  for(y=1; y<lastY; y++){
+    short * top = mem + ((y-1) % ring) * pw;
+    short * bot = mem + ((y+diam) % ring) * pw;
+
+    if(y > 1){
+      despeck_load (params, buffer, kind, y+diam, bot);
+    }
+
+    for(k=0; k<diam; k++){
+      band[k] = mem + ((y+k) % ring) * pw;
+    }
+
+    despeck_min_rows (colmin, band, diam, pw);
+    despeck_min_span (winmin, colmin, pw - diam + 1, diam);
+    despeck_min_span (topmin, top, pw - diam - 1, diam + 2);
+    despeck_min_span (botmin, bot, pw - diam - 1, diam + 2);
+
+    for(j=1; j<lastX; j++){
+
+      int thresh;
+      short value, m;
+
+      /* lineart: only windows with black in them, which have no black
+       * around. other: a window brighter than anything can only be
+       * replaced by the same color */
+      if(kind == DESPECK_LINEART){
+        if(winmin[j])
+          continue;
+        thresh = 1;
+      }
+      else{
+        if(winmin[j] == maxval)
+          continue;
+
+        /* convert darkest pixel into a brighter threshold */
+        thresh = (winmin[j] + maxval + maxval)/3;
+      }
+
+      if(topmin[j-1] < thresh || botmin[j-1] < thresh
+        || colmin[j-1] < thresh || colmin[j+diam] < thresh)
+        continue;
+
+      value = despeck_fill (params, buffer, kind, y, j, diam);
+
+      /* the window is one color now */
+      for(k=0; k<diam; k++){
+        for(l=0; l<diam; l++){
+          band[k][j+l] = value;
+        }
+      }
+      for(l=0; l<diam; l++){
+        colmin[j+l] = value;
+      }
+
+      /* the windows overlapping this one on the right */
+      m = value;
+      for(l=j+1; l<j+diam && l<lastX; l++){
+        if(colmin[l+diam-1] < m)
+          m = colmin[l+diam-1];
+        winmin[l] = m;
+      }
+    }
   }
 
+  finish:
+  free (band);
+  free (mem);
+
+  DBG (10, "sanei_magic_despeck: finish\n");
+  return ret;
+}
+
+/* find the edges of the media from the transitions in each row and
+ * column, shared by findEdges and the fed edge search */
+static SANE_Status
+edges_find(int width, int height, int * topBuf, int * botBuf,
+  int * leftBuf, int * rightBuf, int * top, int * bot, int * left,
+  int * right)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+
+  int topCount = 0, botCount = 0;
+  int leftCount = 0, rightCount = 0;
+
+  int i;
+
   /* loop thru left and right lists, look for top and bottom extremes */
   *top = height;
   for(i=0; i<height; i++){
@@ -362,7 +638,7 @@ sanei_magic_findEdges(SANE_Parameters * params, SANE_Byte * buffer,
   if(*top > *bot){
     DBG (5, "sanei_magic_findEdges: bad t/b edges\n");
     ret = SANE_STATUS_UNSUPPORTED;
-    goto cleanup;
+    return ret;
   }
 
   /* loop thru top and bottom lists, look for l and r extremes
@@ -412,52 +688,103 @@ sanei_magic_findEdges(SANE_Parameters * params, SANE_Byte * buffer,
   if(*left > *right){
     DBG (5, "sanei_magic_findEdges: bad l/r edges\n");
     ret = SANE_STATUS_UNSUPPORTED;
-    goto cleanup;
+    return ret;
   }
 
   DBG (15, "sanei_magic_findEdges: t:%d b:%d l:%d r:%d\n",
     *top,*bot,*left,*right);
 
-  cleanup:
-  if(topBuf)
-    free(topBuf);
-  if(botBuf)
-    free(botBuf);
-  if(leftBuf)
-    free(leftBuf);
-  if(rightBuf)
-    free(rightBuf);
-
-  DBG (10, "sanei_magic_findEdges: finish\n");
   return ret;
 }
 
-/* crop image to given size. updates params with new dimensions */
+/* find likely edges of media inside image background color */
 SANE_Status
-sanei_magic_crop(SANE_Parameters * params, SANE_Byte * buffer,
-  int top, int bot, int left, int right)
+sanei_magic_findEdges(SANE_Parameters * params, SANE_Byte * buffer,
+  int dpiX, int dpiY, int * top, int * bot, int * left, int * right)
 {
 
   SANE_Status ret = SANE_STATUS_GOOD;
 
-  int bwidth = params->bytes_per_line;
+  int width = params->pixels_per_line;
+  int height = params->lines;
 
-  int pixels = 0;
-  int bytes = 0;
-  unsigned char * line = NULL;
-  int pos = 0, i;
+  int * topBuf = NULL, * botBuf = NULL;
+  int * leftBuf = NULL, * rightBuf = NULL;
 
-  DBG (10, "sanei_magic_crop: start\n");
+  DBG (10, "sanei_magic_findEdges: start\n");
 
-  /*convert left and right to bytes, figure new byte and pixel width */
-  if(params->format == SANE_FRAME_RGB){
-    pixels = right-left;
-    bytes = pixels * 3;
-    left *= 3;
-    right *= 3;
-  }
-  else if(params->format == SANE_FRAME_GRAY && params->depth == 8){
-    pixels = right-left;
+  /* get buffers to find sides and bottom */
+  topBuf = sanei_magic_getTransY(params,dpiY,buffer,1);
+  if(!topBuf){
+    DBG (5, "sanei_magic_findEdges: no topBuf\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
+
+  botBuf = sanei_magic_getTransY(params,dpiY,buffer,0);
+  if(!botBuf){
+    DBG (5, "sanei_magic_findEdges: no botBuf\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
+
+  leftBuf = sanei_magic_getTransX(params,dpiX,buffer,1);
+  if(!leftBuf){
+    DBG (5, "sanei_magic_findEdges: no leftBuf\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
+
+  rightBuf = sanei_magic_getTransX(params,dpiX,buffer,0);
+  if(!rightBuf){
+    DBG (5, "sanei_magic_findEdges: no rightBuf\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
+
+  ret = edges_find(width, height, topBuf, botBuf, leftBuf, rightBuf,
+    top, bot, left, right);
+
+  cleanup:
+  if(topBuf)
+    free(topBuf);
+  if(botBuf)
+    free(botBuf);
+  if(leftBuf)
+    free(leftBuf);
+  if(rightBuf)
+    free(rightBuf);
+
+  DBG (10, "sanei_magic_findEdges: finish\n");
+  return ret;
+}
+
+/* crop image to given size. updates params with new dimensions */
+SANE_Status
+sanei_magic_crop(SANE_Parameters * params, SANE_Byte * buffer,
+  int top, int bot, int left, int right)
+{
+
+  SANE_Status ret = SANE_STATUS_GOOD;
+
+  int bwidth = params->bytes_per_line;
+
+  int pixels = 0;
+  int bytes = 0;
+  unsigned char * line = NULL;
+  int pos = 0, i;
+
+  DBG (10, "sanei_magic_crop: start\n");
+
+  /*convert left and right to bytes, figure new byte and pixel width */
+  if(params->format == SANE_FRAME_RGB){
+    pixels = right-left;
+    bytes = pixels * 3;
+    left *= 3;
+    right *= 3;
+  }
+  else if(params->format == SANE_FRAME_GRAY && params->depth == 8){
+    pixels = right-left;
     bytes = right-left;
   }
   else if(params->format == SANE_FRAME_GRAY && params->depth == 1){
@@ -500,16 +827,14 @@ sanei_magic_crop(SANE_Parameters * params, SANE_Byte * buffer,
   return ret;
 }
 
-/* find angle of media rotation against image background */
-SANE_Status
-sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
-  int dpiX, int dpiY, int * centerX, int * centerY, double * finSlope)
+/* find the skew from the top and bottom transitions of each column,
+ * shared by findSkew and the fed edge search */
+static SANE_Status
+skew_find(int pwidth, int height, int dpiY, int * topBuf, int * botBuf,
+  int * centerX, int * centerY, double * finSlope)
 {
   SANE_Status ret = SANE_STATUS_GOOD;
 
-  int pwidth = params->pixels_per_line;
-  int height = params->lines;
-
   double TSlope = 0;
   int TXInter = 0;
   int TYInter = 0;
@@ -525,33 +850,12 @@ sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
   int rotateX = 0;
   int rotateY = 0;
 
-  int * topBuf = NULL, * botBuf = NULL;
-
-  DBG (10, "sanei_magic_findSkew: start\n");
-
-  dpiX=dpiX;
-
-  /* get buffers for edge detection */
-  topBuf = sanei_magic_getTransY(params,dpiY,buffer,1);
-  if(!topBuf){
-    DBG (5, "sanei_magic_findSkew: cant gTY\n");
-    ret = SANE_STATUS_NO_MEM;
-    goto cleanup;
-  }
-
-  botBuf = sanei_magic_getTransY(params,dpiY,buffer,0);
-  if(!botBuf){
-    DBG (5, "sanei_magic_findSkew: cant gTY\n");
-    ret = SANE_STATUS_NO_MEM;
-    goto cleanup;
-  }
-
   /* find best top line */
   ret = getTopEdge (pwidth, height, dpiY, topBuf,
     &TSlope, &TXInter, &TYInter);
   if(ret){
     DBG(5,"sanei_magic_findSkew: gTE error: %d",ret);
-    goto cleanup;
+    return ret;
   }
   DBG(15,"top: %04.04f %d %d\n",TSlope,TXInter,TYInter);
 
@@ -559,7 +863,7 @@ sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
   if(fabs(TSlope) < 0.0001){
     DBG(15,"sanei_magic_findSkew: slope too shallow: %0.08f\n",TSlope);
     ret = SANE_STATUS_UNSUPPORTED;
-    goto cleanup;
+    return ret;
   }
 
   /* find best left line, perpendicular to top line */
@@ -568,7 +872,7 @@ sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
     &LXInter, &LYInter);
   if(ret){
     DBG(5,"sanei_magic_findSkew: gLE error: %d",ret);
-    goto cleanup;
+    return ret;
   }
   DBG(15,"sanei_magic_findSkew: left: %04.04f %d %d\n",LSlope,LXInter,LYInter);
 
@@ -589,14 +893,601 @@ sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
   *centerY = rotateY;
   *finSlope = TSlope;
 
+  return ret;
+}
+
+/* find angle of media rotation against image background */
+SANE_Status
+sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
+  int dpiX, int dpiY, int * centerX, int * centerY, double * finSlope)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+
+  int pwidth = params->pixels_per_line;
+  int height = params->lines;
+
+  int * topBuf = NULL, * botBuf = NULL;
+
+  DBG (10, "sanei_magic_findSkew: start\n");
+
+  dpiX=dpiX;
+
+  /* get buffers for edge detection */
+  topBuf = sanei_magic_getTransY(params,dpiY,buffer,1);
+  if(!topBuf){
+    DBG (5, "sanei_magic_findSkew: cant gTY\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
+
+  botBuf = sanei_magic_getTransY(params,dpiY,buffer,0);
+  if(!botBuf){
+    DBG (5, "sanei_magic_findSkew: cant gTY\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
+
+  ret = skew_find(pwidth, height, dpiY, topBuf, botBuf,
+    centerX, centerY, finSlope);
+
   cleanup:
   if(topBuf)
     free(topBuf);
   if(botBuf)
     free(botBuf);
 
-  DBG (10, "sanei_magic_findSkew: finish\n");
-  return ret;
+  DBG (10, "sanei_magic_findSkew: finish\n");
+  return ret;
+}
+
+/* The fed edge search does what getTransY does for each column while
+ * the rows arrive.  It keeps the last EDGE_RING rows as column values
+ * (the sum of the channels, or the bit for lineart) and the near/far
+ * window sums.  Windows from the top are clamped to the first row,
+ * windows from the bottom to the last, so the last rows are looked at
+ * again when the page ends.  getTransX works on single rows anyway. */
+
+#define EDGE_WIN  9
+#define EDGE_RING (EDGE_WIN*2+1)
+
+struct sanei_magic_edges
+{
+  SANE_Parameters params;
+  int width;
+  int depth;              /* channels, 0 for lineart */
+  int rows;               /* rows fed */
+  int ended;              /* bottom windows at the end of page done */
+
+  int * ring;             /* column values of the last EDGE_RING rows */
+  int * first;            /* column values of row 0 */
+  int * topNear, * topFar;
+  int * botNear, * botFar;
+  int * top;              /* first transition from the top */
+  int * bot;              /* last transition from the bottom so far */
+  int * last[2];          /* lineart: last row with each value */
+
+  int * left, * right;    /* transitions of each row */
+  int rowsAlloc;
+
+  SANE_Byte * carry;      /* start of a row split between feeds */
+  size_t carried;
+};
+
+static int *
+edge_row (struct sanei_magic_edges * e, int row)
+{
+  if(row == 0){
+    return e->first;
+  }
+  return e->ring + (row % EDGE_RING) * e->width;
+}
+
+/* same test as getTransY */
+static int
+edge_trans (struct sanei_magic_edges * e, int near, int far)
+{
+  return abs(near - far) > 50*EDGE_WIN*e->depth - near*40/255;
+}
+
+static SANE_Status
+edge_row_add (struct sanei_magic_edges * e, SANE_Byte * buffer)
+{
+  int width = e->width;
+  int row = e->rows;
+  int * vals = edge_row (e, row);
+  int i, k;
+
+  if(row >= e->rowsAlloc){
+    int n = e->rowsAlloc ? e->rowsAlloc * 2 : 1024;
+    int * l = realloc (e->left, n * sizeof(int));
+    int * r;
+
+    if(!l){
+      return SANE_STATUS_NO_MEM;
+    }
+    e->left = l;
+    r = realloc (e->right, n * sizeof(int));
+    if(!r){
+      return SANE_STATUS_NO_MEM;
+    }
+    e->right = r;
+    e->rowsAlloc = n;
+  }
+  e->left[row] = transX (&e->params, buffer, 1);
+  e->right[row] = transX (&e->params, buffer, 0);
+
+  if(!e->depth){
+    for(i=0; i<width; i++){
+      vals[i] = buffer[i/8] >> (7-(i%8)) & 1;
+      if(row && e->top[i] < 0 && vals[i] != e->first[i]){
+        e->top[i] = row;
+      }
+      e->last[vals[i]][i] = row;
+    }
+    e->rows++;
+    return SANE_STATUS_GOOD;
+  }
+
+  for(i=0; i<width; i++){
+    int sum = 0;
+    for(k=0; k<e->depth; k++){
+      sum += buffer[i*e->depth+k];
+    }
+    vals[i] = sum;
+  }
+
+  if(row == 0){
+    for(i=0; i<width; i++){
+      e->topNear[i] = e->topFar[i] = vals[i] * EDGE_WIN;
+    }
+  }
+  else{
+    int * nearRow = edge_row (e, row < EDGE_WIN ? 0 : row-EDGE_WIN);
+    int * farRow = edge_row (e, row < 2*EDGE_WIN ? 0 : row-2*EDGE_WIN);
+
+    for(i=0; i<width; i++){
+      if(e->top[i] >= 0){
+        continue;
+      }
+      e->topFar[i] += nearRow[i] - farRow[i];
+      e->topNear[i] += vals[i] - nearRow[i];
+      if(edge_trans (e, e->topNear[i], e->topFar[i])){
+        e->top[i] = row;
+      }
+    }
+  }
+
+  /* the bottom-up windows starting at j = row-2*EDGE_WIN+1 are
+   * complete, later ones wait for the end of the page */
+  if(row == 2*EDGE_WIN-1){
+    int r;
+
+    for(i=0; i<width; i++){
+      e->botNear[i] = e->botFar[i] = 0;
+    }
+    for(r=0; r<EDGE_WIN; r++){
+      int * v = edge_row (e, r);
+      int * w = edge_row (e, r+EDGE_WIN);
+      for(i=0; i<width; i++){
+        e->botNear[i] += v[i];
+        e->botFar[i] += w[i];
+      }
+    }
+    for(i=0; i<width; i++){
+      if(edge_trans (e, e->botNear[i], e->botFar[i])){
+        e->bot[i] = 0;
+      }
+    }
+  }
+  else if(row >= 2*EDGE_WIN){
+    int j = row-2*EDGE_WIN+1;
+    int * gone = edge_row (e, j-1);
+    int * mid = edge_row (e, j+EDGE_WIN-1);
+
+    for(i=0; i<width; i++){
+      e->botNear[i] += mid[i] - gone[i];
+      e->botFar[i] += vals[i] - mid[i];
+      if(edge_trans (e, e->botNear[i], e->botFar[i])){
+        e->bot[i] = j;
+      }
+    }
+  }
+
+  e->rows++;
+  return SANE_STATUS_GOOD;
+}
+
+/* look at the bottom-up windows that reach past the last row */
+static void
+edge_end (struct sanei_magic_edges * e)
+{
+  int height = e->rows;
+  int width = e->width;
+  int first = height-2*EDGE_WIN+1;
+  int i, j, r;
+
+  if(e->ended){
+    return;
+  }
+  e->ended = 1;
+
+  if(!e->depth){
+    int * lastRow = edge_row (e, height-1);
+    for(i=0; i<width; i++){
+      e->bot[i] = e->last[!lastRow[i]][i];
+    }
+    return;
+  }
+
+  if(first < 0){
+    first = 0;
+  }
+
+  for(i=0; i<width; i++){
+    for(j=height-2; j>=first; j--){
+      int near = 0, far = 0;
+
+      for(r=j; r<j+EDGE_WIN; r++){
+        near += edge_row (e, r < height ? r : height-1)[i];
+      }
+      for(; r<j+2*EDGE_WIN; r++){
+        far += edge_row (e, r < height ? r : height-1)[i];
+      }
+      if(edge_trans (e, near, far)){
+        e->bot[i] = j;
+        break;
+      }
+    }
+  }
+}
+
+SANE_Status
+sanei_magic_edgesStart (SANE_Parameters * params, SANEI_Magic_Edges ** edges)
+{
+  struct sanei_magic_edges * e;
+  int width = params->pixels_per_line;
+  int i;
+
+  DBG (10, "sanei_magic_edgesStart: start\n");
+
+  *edges = NULL;
+
+  if(!(params->format == SANE_FRAME_RGB
+    || (params->format == SANE_FRAME_GRAY && params->depth == 8)
+    || (params->format == SANE_FRAME_GRAY && params->depth == 1))
+    || width <= 0 || params->bytes_per_line <= 0){
+    DBG (5, "sanei_magic_edgesStart: unsupported format/depth\n");
+    return SANE_STATUS_INVAL;
+  }
+
+  e = calloc (1, sizeof(*e));
+  if(!e){
+    DBG (5, "sanei_magic_edgesStart: no e\n");
+    return SANE_STATUS_NO_MEM;
+  }
+
+  e->params = *params;
+  e->width = width;
+  e->depth = (params->depth == 1) ? 0 :
+    (params->format == SANE_FRAME_RGB) ? 3 : 1;
+
+  e->ring = malloc (EDGE_RING * width * sizeof(int));
+  e->first = malloc (width * sizeof(int));
+  e->topNear = malloc (width * sizeof(int));
+  e->topFar = malloc (width * sizeof(int));
+  e->botNear = malloc (width * sizeof(int));
+  e->botFar = malloc (width * sizeof(int));
+  e->top = malloc (width * sizeof(int));
+  e->bot = malloc (width * sizeof(int));
+  e->carry = malloc (params->bytes_per_line);
+  if(!e->ring || !e->first || !e->topNear || !e->topFar || !e->botNear
+    || !e->botFar || !e->top || !e->bot || !e->carry){
+    DBG (5, "sanei_magic_edgesStart: no buffers\n");
+    sanei_magic_edgesFinish (e);
+    return SANE_STATUS_NO_MEM;
+  }
+
+  /* lineart keeps the last row of each value in the window sums */
+  e->last[0] = e->botNear;
+  e->last[1] = e->botFar;
+
+  for(i=0; i<width; i++){
+    e->top[i] = -1;
+    e->bot[i] = -1;
+    e->last[0][i] = -1;
+    e->last[1][i] = -1;
+  }
+
+  *edges = e;
+
+  DBG (10, "sanei_magic_edgesStart: finish\n");
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_magic_edgesFeed (SANEI_Magic_Edges * e, SANE_Byte * buffer,
+  size_t len)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+  size_t bwidth;
+
+  if(!e || e->ended){
+    return SANE_STATUS_INVAL;
+  }
+  bwidth = e->params.bytes_per_line;
+
+  while(len && (e->params.lines <= 0 || e->rows < e->params.lines)){
+
+    /* finish a row started by the last feed, or keep a partial one */
+    if(e->carried || len < bwidth){
+      size_t n = bwidth - e->carried;
+
+      if(n > len){
+        n = len;
+      }
+      memcpy (e->carry + e->carried, buffer, n);
+      e->carried += n;
+      buffer += n;
+      len -= n;
+
+      if(e->carried < bwidth){
+        break;
+      }
+      e->carried = 0;
+      ret = edge_row_add (e, e->carry);
+    }
+    else{
+      ret = edge_row_add (e, buffer);
+      buffer += bwidth;
+      len -= bwidth;
+    }
+
+    if(ret){
+      DBG (5, "sanei_magic_edgesFeed: no rows\n");
+      break;
+    }
+  }
+
+  return ret;
+}
+
+/* the column transitions as getTransY returns them */
+static void
+edge_copy (struct sanei_magic_edges * e, int * topBuf, int * botBuf,
+  int dpiY)
+{
+  int i;
+
+  for(i=0; i<e->width; i++){
+    topBuf[i] = (e->top[i] < 0) ? e->rows : e->top[i];
+    botBuf[i] = e->bot[i];
+  }
+  transFilter (topBuf, e->width, dpiY, e->rows);
+  transFilter (botBuf, e->width, dpiY, -1);
+}
+
+SANE_Status
+sanei_magic_edgesFind (SANEI_Magic_Edges * e, int dpiX, int dpiY,
+  int * top, int * bot, int * left, int * right)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+  int width, height;
+  int * topBuf = NULL, * botBuf = NULL;
+  int * leftBuf = NULL, * rightBuf = NULL;
+
+  DBG (10, "sanei_magic_edgesFind: start\n");
+
+  if(!e || !e->rows){
+    return SANE_STATUS_INVAL;
+  }
+  width = e->width;
+  height = e->rows;
+  edge_end (e);
+
+  topBuf = malloc (width * sizeof(int));
+  botBuf = malloc (width * sizeof(int));
+  leftBuf = malloc (height * sizeof(int));
+  rightBuf = malloc (height * sizeof(int));
+  if(!topBuf || !botBuf || !leftBuf || !rightBuf){
+    DBG (5, "sanei_magic_edgesFind: no buffers\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
+
+  edge_copy (e, topBuf, botBuf, dpiY);
+  memcpy (leftBuf, e->left, height * sizeof(int));
+  memcpy (rightBuf, e->right, height * sizeof(int));
+  transFilter (leftBuf, height, dpiX, width);
+  transFilter (rightBuf, height, dpiX, -1);
+
+  ret = edges_find (width, height, topBuf, botBuf, leftBuf, rightBuf,
+    top, bot, left, right);
+
+  cleanup:
+  free (topBuf);
+  free (botBuf);
+  free (leftBuf);
+  free (rightBuf);
+
+  DBG (10, "sanei_magic_edgesFind: finish\n");
+  return ret;
+}
+
+SANE_Status
+sanei_magic_edgesSkew (SANEI_Magic_Edges * e, int dpiX, int dpiY,
+  int * centerX, int * centerY, double * finSlope)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+  int * topBuf = NULL, * botBuf = NULL;
+
+  DBG (10, "sanei_magic_edgesSkew: start\n");
+
+  dpiX=dpiX;
+
+  if(!e || !e->rows){
+    return SANE_STATUS_INVAL;
+  }
+  edge_end (e);
+
+  topBuf = malloc (e->width * sizeof(int));
+  botBuf = malloc (e->width * sizeof(int));
+  if(!topBuf || !botBuf){
+    DBG (5, "sanei_magic_edgesSkew: no buffers\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
+
+  edge_copy (e, topBuf, botBuf, dpiY);
+
+  ret = skew_find (e->width, e->rows, dpiY, topBuf, botBuf,
+    centerX, centerY, finSlope);
+
+  cleanup:
+  free (topBuf);
+  free (botBuf);
+
+  DBG (10, "sanei_magic_edgesSkew: finish\n");
+  return ret;
+}
+
+void
+sanei_magic_edgesFinish (SANEI_Magic_Edges * e)
+{
+  if(!e){
+    return;
+  }
+  free (e->ring);
+  free (e->first);
+  free (e->topNear);
+  free (e->topFar);
+  free (e->botNear);
+  free (e->botFar);
+  free (e->top);
+  free (e->bot);
+  free (e->left);
+  free (e->right);
+  free (e->carry);
+  free (e);
+}
+
+/* Rotation walks each output row with the source coordinates in fixed
+ * point, stepping by cos and sin.  The result must match converting the
+ * exact products with (int), so coordinates that land within ROT_NEAR
+ * of an integer are recomputed in floating point.  The rows are split
+ * into bands, one per thread. */
+
+#define ROT_SHIFT 40
+#define ROT_ONE   ((int64_t) 1 << ROT_SHIFT)
+#define ROT_MASK  (ROT_ONE - 1)
+#define ROT_NEAR  ((int64_t) 1 << (ROT_SHIFT - 20))
+
+/* bands are at least this many rows, and there are at most this many */
+#define ROT_MIN_ROWS 64
+#define ROT_MAX_BANDS 8
+
+typedef struct
+{
+  SANE_Parameters * params;
+  SANE_Byte * in;
+  SANE_Byte * out;
+  int centerX;
+  int centerY;
+  double slopeSin;
+  double slopeCos;
+  int bg_color;
+  int first;
+  int last;
+}
+rotate_band;
+
+/* (int) of the fixed point value V */
+static int
+rotate_trunc (int64_t v)
+{
+  if(v < 0)
+    return -(int)((-v) >> ROT_SHIFT);
+  return (int)(v >> ROT_SHIFT);
+}
+
+static int
+rotate_near (int64_t v)
+{
+  return ((v + ROT_NEAR) & ROT_MASK) < 2 * ROT_NEAR;
+}
+
+static void *
+rotate_rows (void * arg)
+{
+  rotate_band * b = arg;
+
+  int pwidth = b->params->pixels_per_line;
+  int bwidth = b->params->bytes_per_line;
+  int height = b->params->lines;
+  int depth = (b->params->format == SANE_FRAME_RGB) ? 3 : 1;
+  int lineart = (b->params->depth == 1);
+  int centerX = b->centerX;
+  int centerY = b->centerY;
+  double slopeSin = b->slopeSin;
+  double slopeCos = b->slopeCos;
+  const SANE_Byte * in = b->in;
+
+  int64_t stepX = (int64_t) floor (slopeCos * ROT_ONE + 0.5);
+  int64_t stepY = (int64_t) floor (slopeSin * ROT_ONE + 0.5);
+  int i, j;
+
+  for (i=b->first; i<b->last; i++) {
+    int shiftY = centerY - i;
+    SANE_Byte * out = b->out + i*bwidth;
+
+    /* the terms for column 0, then one step per column */
+    int64_t fixX = (int64_t) floor (
+      (centerX * slopeCos + shiftY * slopeSin) * ROT_ONE + 0.5);
+    int64_t fixY = (int64_t) floor (
+      (-shiftY * slopeCos + centerX * slopeSin) * ROT_ONE + 0.5);
+
+    memset(out, b->bg_color, bwidth);
+
+    for (j=0; j<pwidth; j++, fixX -= stepX, fixY -= stepY) {
+      int shiftX = centerX - j;
+      int sourceX, sourceY;
+      const SANE_Byte * src;
+
+      if (rotate_near(fixX))
+        sourceX = centerX - (int)(shiftX * slopeCos + shiftY * slopeSin);
+      else
+        sourceX = centerX - rotate_trunc(fixX);
+      if (sourceX < 0 || sourceX >= pwidth)
+        continue;
+
+      if (rotate_near(fixY))
+        sourceY = centerY + (int)(-shiftY * slopeCos + shiftX * slopeSin);
+      else
+        sourceY = centerY + rotate_trunc(fixY);
+      if (sourceY < 0 || sourceY >= height)
+        continue;
+
+      src = in + sourceY*bwidth;
+
+      if (lineart) {
+        /* wipe out old bit */
+        out[j/8] &= ~(1 << (7-(j%8)));
+
+        /* fill in new bit */
+        out[j/8] |=
+          ((src[sourceX/8] >> (7-(sourceX%8))) & 1) << (7-(j%8));
+      }
+      else if (depth == 3) {
+        src += sourceX*3;
+        out[j*3] = src[0];
+        out[j*3+1] = src[1];
+        out[j*3+2] = src[2];
+      }
+      else
+        out[j] = src[sourceX];
+    }
+  }
+
+  return NULL;
 }
 
 /* function to do a simple rotation by a given slope, around
@@ -607,176 +1498,335 @@ SANE_Status
 sanei_magic_rotate (SANE_Parameters * params, SANE_Byte * buffer,
   int centerX, int centerY, double slope, int bg_color)
 {
+  SANE_Byte * scratch = NULL;
+  size_t scratch_size = 0;
+  SANE_Status ret;
+
+  ret = sanei_magic_rotate2 (params, buffer, centerX, centerY, slope,
+    bg_color, &scratch, &scratch_size);
+
+  free (scratch);
+  return ret;
+}
+
+SANE_Status
+sanei_magic_rotate2 (SANE_Parameters * params, SANE_Byte * buffer,
+  int centerX, int centerY, double slope, int bg_color,
+  SANE_Byte ** scratch, size_t * scratch_size)
+{
 
   SANE_Status ret = SANE_STATUS_GOOD;
 
   double slopeRad = -atan(slope);
-  double slopeSin = sin(slopeRad);
-  double slopeCos = cos(slopeRad);
 
-  int pwidth = params->pixels_per_line;
   int bwidth = params->bytes_per_line;
   int height = params->lines;
-  int depth = 1;
+  size_t size = (size_t) bwidth * height;
 
-  unsigned char * outbuf;
-  int i, j, k;
+  rotate_band bands[ROT_MAX_BANDS];
+  int nbands = 1;
+  int i;
+
+#ifdef USE_PTHREAD
+  pthread_t threads[ROT_MAX_BANDS];
+  int started[ROT_MAX_BANDS];
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
 
   DBG(10,"sanei_magic_rotate: start: %d %d\n",centerX,centerY);
 
-  outbuf = malloc(bwidth*height);
-  if(!outbuf){
-    DBG(15,"sanei_magic_rotate: no outbuf\n");
-    ret = SANE_STATUS_NO_MEM;
+  if(params->format == SANE_FRAME_RGB ||
+    (params->format == SANE_FRAME_GRAY && params->depth == 8)
+  ){
+    /* fine as it is */
+  }
+  else if(params->format == SANE_FRAME_GRAY && params->depth == 1){
+    if(bg_color)
+      bg_color = 0xff;
+  }
+  else{
+    DBG (5, "sanei_magic_rotate: unsupported format/depth\n");
+    ret = SANE_STATUS_INVAL;
     goto cleanup;
   }
 
-  if(params->format == SANE_FRAME_RGB || 
-    (params->format == SANE_FRAME_GRAY && params->depth == 8)
-  ){
+  /* the rotated image is built from a copy of the original */
+  if(!*scratch || *scratch_size < size){
+    SANE_Byte * mem = realloc(*scratch, size);
+    if(!mem){
+      DBG(15,"sanei_magic_rotate: no scratch\n");
+      ret = SANE_STATUS_NO_MEM;
+      goto cleanup;
+    }
+    *scratch = mem;
+    *scratch_size = size;
+  }
+  memcpy(*scratch, buffer, size);
+
+#ifdef USE_PTHREAD
+  nbands = height / ROT_MIN_ROWS;
+  if(nbands > cpus)
+    nbands = cpus;
+  if(nbands > ROT_MAX_BANDS)
+    nbands = ROT_MAX_BANDS;
+  if(nbands < 1)
+    nbands = 1;
+#endif
+
+  for(i=0; i<nbands; i++){
+    bands[i].params = params;
+    bands[i].in = *scratch;
+    bands[i].out = buffer;
+    bands[i].centerX = centerX;
+    bands[i].centerY = centerY;
+    bands[i].slopeSin = sin(slopeRad);
+    bands[i].slopeCos = cos(slopeRad);
+    bands[i].bg_color = bg_color;
+    bands[i].first = (int)((long) height * i / nbands);
+    bands[i].last = (int)((long) height * (i+1) / nbands);
+  }
+
+#ifdef USE_PTHREAD
+  /* the first band is done by this thread, and any band whose
+   * thread could not be started too */
+  for(i=1; i<nbands; i++){
+    started[i] = !pthread_create(&threads[i], NULL, rotate_rows, &bands[i]);
+  }
+  rotate_rows(&bands[0]);
+  for(i=1; i<nbands; i++){
+    if(started[i])
+      pthread_join(threads[i], NULL);
+    else
+      rotate_rows(&bands[i]);
+  }
+#else
+  rotate_rows(&bands[0]);
+#endif
+
+  DBG(15,"sanei_magic_rotate: %d bands\n",nbands);
 
-    if(params->format == SANE_FRAME_RGB)
-      depth = 3;
+  cleanup:
 
-    memset(outbuf,bg_color,bwidth*height);
+  DBG(10,"sanei_magic_rotate: finish\n");
 
-    for (i=0; i<height; i++) {
-      int shiftY = centerY - i;
-    
-      for (j=0; j<pwidth; j++) {
-        int shiftX = centerX - j;
-        int sourceX, sourceY;
-    
-        sourceX = centerX - (int)(shiftX * slopeCos + shiftY * slopeSin);
-        if (sourceX < 0 || sourceX >= pwidth)
-          continue;
-    
-        sourceY = centerY + (int)(-shiftY * slopeCos + shiftX * slopeSin);
-        if (sourceY < 0 || sourceY >= height)
-          continue;
-    
-        for (k=0; k<depth; k++) {
-          outbuf[i*bwidth+j*depth+k]
-            = buffer[sourceY*bwidth+sourceX*depth+k];
-        }
-      }
-    }
+  return ret;
+}
+
+/* A blank page check in progress.  Rows are summed in the order
+ * isBlank always did, and the sum only grows, so once the density
+ * is above the threshold the page cannot become blank any more. */
+struct sanei_magic_blank
+{
+  SANE_Parameters params;
+  double thresh;          /* 0-1 */
+  double imagesum;        /* sum of the row densities */
+  int rows;               /* rows summed */
+  int full;               /* density went above thresh */
+  SANE_Byte * carry;      /* start of a row split between feeds */
+  size_t carried;
+};
+
+static SANE_Status
+blank_init (struct sanei_magic_blank * b, SANE_Parameters * params,
+  double thresh)
+{
+  memset (b, 0, sizeof (*b));
+
+  if(!(params->format == SANE_FRAME_RGB
+    || (params->format == SANE_FRAME_GRAY && params->depth == 8)
+    || (params->format == SANE_FRAME_GRAY && params->depth == 1))
+    || params->bytes_per_line <= 0 || params->pixels_per_line <= 0){
+    DBG (5, "sanei_magic_isBlank: unsupported format/depth\n");
+    return SANE_STATUS_INVAL;
   }
 
-  else if(params->format == SANE_FRAME_GRAY && params->depth == 1){
+  if(!blank_sum){
+    magic_select ();
+  }
 
-    if(bg_color)
-      bg_color = 0xff;
+  b->params = *params;
 
-    memset(outbuf,bg_color,bwidth*height);
+  /*convert thresh from percent (0-100) to 0-1 range*/
+  b->thresh = thresh / 100;
 
-    for (i=0; i<height; i++) {
-      int shiftY = centerY - i;
-    
-      for (j=0; j<pwidth; j++) {
-        int shiftX = centerX - j;
-        int sourceX, sourceY;
-    
-        sourceX = centerX - (int)(shiftX * slopeCos + shiftY * slopeSin);
-        if (sourceX < 0 || sourceX >= pwidth)
-          continue;
-    
-        sourceY = centerY + (int)(-shiftY * slopeCos + shiftX * slopeSin);
-        if (sourceY < 0 || sourceY >= height)
-          continue;
+  return SANE_STATUS_GOOD;
+}
 
-        /* wipe out old bit */
-        outbuf[i*bwidth + j/8] &= ~(1 << (7-(j%8)));
+/* add whole rows to the sum, stop once the page is not blank */
+static void
+blank_rows (struct sanei_magic_blank * b, const SANE_Byte * buffer,
+  int rows)
+{
+  int bwidth = b->params.bytes_per_line;
+  int pwidth = b->params.pixels_per_line;
+  int i;
 
-        /* fill in new bit */
-        outbuf[i*bwidth + j/8] |= 
-          ((buffer[sourceY*bwidth + sourceX/8]
-          >> (7-(sourceX%8))) & 1) << (7-(j%8));
-      }
+  for(i=0; i<rows && !b->full; i++){
+    const SANE_Byte * ptr = buffer + bwidth*i;
+    int rowsum;
+
+    /* sum the 'darkness' of the pixels, or count the set pixels */
+    if(b->params.depth == 1){
+      rowsum = blank_bits (ptr, pwidth);
+      b->imagesum += (double)rowsum/pwidth;
+    }
+    else{
+      rowsum = 255 * bwidth - (int) blank_sum (ptr, bwidth);
+      b->imagesum += (double)rowsum/bwidth/255;
+    }
+    b->rows++;
+
+    if(b->params.lines > 0 && b->imagesum/b->params.lines > b->thresh){
+      b->full = 1;
     }
   }
-  else{
-    DBG (5, "sanei_magic_rotate: unsupported format/depth\n");
-    ret = SANE_STATUS_INVAL;
-    goto cleanup;
-  }
+}
 
-  memcpy(buffer,outbuf,bwidth*height);
+static SANE_Status
+blank_result (struct sanei_magic_blank * b)
+{
+  int lines = (b->params.lines > 0) ? b->params.lines : b->rows;
 
-  cleanup:
+  DBG (5, "sanei_magic_isBlank: sum:%f lines:%d rows:%d thresh:%f "
+    "density:%f\n", b->imagesum, lines, b->rows, b->thresh,
+    lines ? b->imagesum/lines : 0);
 
-  if(outbuf)
-    free(outbuf);
+  if(b->full){
+    return SANE_STATUS_GOOD;
+  }
 
-  DBG(10,"sanei_magic_rotate: finish\n");
+  if(lines && b->imagesum/lines <= b->thresh){
+    DBG (5, "sanei_magic_isBlank: blank!\n");
+    return SANE_STATUS_NO_DOCS;
+  }
 
-  return 0;
+  return SANE_STATUS_GOOD;
 }
 
 SANE_Status
 sanei_magic_isBlank (SANE_Parameters * params, SANE_Byte * buffer,
   double thresh)
 {
-  SANE_Status ret = SANE_STATUS_GOOD;
-  double imagesum = 0;
-  int i, j;
+  struct sanei_magic_blank b;
+  SANE_Status ret;
 
   DBG(10,"sanei_magic_isBlank: start: %f\n",thresh);
 
-  /*convert thresh from percent (0-100) to 0-1 range*/
-  thresh /= 100;
+  ret = blank_init (&b, params, thresh);
+  if(ret){
+    goto cleanup;
+  }
 
-  if(params->format == SANE_FRAME_RGB || 
-    (params->format == SANE_FRAME_GRAY && params->depth == 8)
-  ){
+  blank_rows (&b, buffer, params->lines);
+  ret = blank_result (&b);
 
-    /* loop over all rows, find density of each */
-    for(i=0; i<params->lines; i++){
-      int rowsum = 0;
-      SANE_Byte * ptr = buffer + params->bytes_per_line*i;
+  cleanup:
 
-      /* loop over all columns, sum the 'darkness' of the pixels */
-      for(j=0; j<params->bytes_per_line; j++){
-        rowsum += 255 - ptr[j];
-      }
+  DBG(10,"sanei_magic_isBlank: finish\n");
 
-      imagesum += (double)rowsum/params->bytes_per_line/255;
-    }
+  return ret;
+}
+
+SANE_Status
+sanei_magic_isBlankStart (SANE_Parameters * params, double thresh,
+  SANEI_Magic_Blank ** blank)
+{
+  struct sanei_magic_blank * b;
+  SANE_Status ret;
+
+  DBG(10,"sanei_magic_isBlankStart: start: %f\n",thresh);
+
+  *blank = NULL;
 
+  b = malloc (sizeof (*b));
+  if(!b){
+    DBG (5, "sanei_magic_isBlankStart: no b\n");
+    return SANE_STATUS_NO_MEM;
   }
-  else if(params->format == SANE_FRAME_GRAY && params->depth == 1){
 
-    /* loop over all rows, find density of each */
-    for(i=0; i<params->lines; i++){
-      int rowsum = 0;
-      SANE_Byte * ptr = buffer + params->bytes_per_line*i;
+  ret = blank_init (b, params, thresh);
+  if(ret){
+    free (b);
+    return ret;
+  }
 
-      /* loop over all columns, sum the pixels */
-      for(j=0; j<params->pixels_per_line; j++){
-        rowsum += ptr[j/8] >> (7-(j%8)) & 1;
-      }
+  b->carry = malloc (params->bytes_per_line);
+  if(!b->carry){
+    DBG (5, "sanei_magic_isBlankStart: no carry\n");
+    free (b);
+    return SANE_STATUS_NO_MEM;
+  }
+
+  *blank = b;
+
+  DBG(10,"sanei_magic_isBlankStart: finish\n");
+
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_magic_isBlankFeed (SANEI_Magic_Blank * b, SANE_Byte * buffer,
+  size_t len)
+{
+  size_t bwidth;
+  size_t rows;
+
+  if(!b){
+    return SANE_STATUS_INVAL;
+  }
+  if(b->full){
+    return SANE_STATUS_GOOD;
+  }
+  bwidth = b->params.bytes_per_line;
+
+  /* finish a row started by the last feed */
+  if(b->carried){
+    size_t n = bwidth - b->carried;
 
-      imagesum += (double)rowsum/params->pixels_per_line;
+    if(n > len){
+      n = len;
     }
+    memcpy (b->carry + b->carried, buffer, n);
+    b->carried += n;
+    buffer += n;
+    len -= n;
 
+    if(b->carried < bwidth){
+      return SANE_STATUS_NO_DOCS;
+    }
+    blank_rows (b, b->carry, 1);
+    b->carried = 0;
   }
-  else{
-    DBG (5, "sanei_magic_isBlank: unsupported format/depth\n");
-    ret = SANE_STATUS_INVAL;
-    goto cleanup;
+
+  rows = len / bwidth;
+  if(b->params.lines > 0 && rows > (size_t) (b->params.lines - b->rows)){
+    rows = b->params.lines - b->rows;
   }
+  blank_rows (b, buffer, rows);
+  len -= rows * bwidth;
 
-  DBG (5, "sanei_magic_isBlank: sum:%f lines:%d thresh:%f density:%f\n",
-    imagesum,params->lines,thresh,imagesum/params->lines);
+  if(len && !b->full
+    && (b->params.lines <= 0 || b->rows < b->params.lines)){
+    memcpy (b->carry, buffer + rows * bwidth, len < bwidth ? len : bwidth);
+    b->carried = len < bwidth ? len : bwidth;
+  }
 
-  if(imagesum/params->lines <= thresh){
-    DBG (5, "sanei_magic_isBlank: blank!\n");
-    ret = SANE_STATUS_NO_DOCS;
+  return b->full ? SANE_STATUS_GOOD : SANE_STATUS_NO_DOCS;
+}
+
+SANE_Status
+sanei_magic_isBlankFinish (SANEI_Magic_Blank * b)
+{
+  SANE_Status ret;
+
+  if(!b){
+    return SANE_STATUS_INVAL;
   }
 
-  cleanup:
+  ret = blank_result (b);
 
-  DBG(10,"sanei_magic_isBlank: finish\n");
+  free (b->carry);
+  free (b);
 
   return ret;
 }
@@ -1686,16 +2736,7 @@ sanei_magic_getTransY (
     return NULL;
   }
 
-  /* ignore transitions with few neighbors within .5 inch */
-  for(i=0;i<width-7;i++){
-    int sum = 0;
-    for(j=1;j<=7;j++){
-      if(abs(buff[i+j] - buff[i]) < dpi/2)
-        sum++;
-    }
-    if(sum < 2)
-      buff[i] = lastLine;
-  }
+  transFilter (buff, width, dpi, lastLine);
 
   DBG (10, "sanei_magic_getTransY: finish\n");
 
@@ -1710,127 +2751,145 @@ sanei_magic_getTransX (
 {
   int * buff;
 
-  int i, j, k;
-  int winLen = 9;
+  int i;
 
   int bwidth = params->bytes_per_line;
   int width = params->pixels_per_line;
   int height = params->lines;
-  int depth = 1;
 
   /* defaults for right-first */
-  int firstCol = width-1;
   int lastCol = -1;
-  int direction = -1;
 
   DBG (10, "sanei_magic_getTransX: start\n");
 
   /* override for left-first*/
   if(left){
-    firstCol = 0;
     lastCol = width;
-    direction = 1;
   }
 
-  /* build output and preload with impossible value */
+  if(!(params->format == SANE_FRAME_RGB
+    || (params->format == SANE_FRAME_GRAY && params->depth == 8)
+    || (params->format == SANE_FRAME_GRAY && params->depth == 1))){
+    DBG (5, "sanei_magic_getTransX: unsupported format/depth\n");
+    return NULL;
+  }
+
+  /* build output */
   buff = calloc(height,sizeof(int));
   if(!buff){
     DBG (5, "sanei_magic_getTransX: no buff\n");
     return NULL;
   }
-  for(i=0; i<height; i++)
-    buff[i] = lastCol;
 
-  /* load the buff array with x value for first color change from edge
-   * gray/color uses a different algo from binary/halftone */
+  /* load the buff array with x value for first color change from edge */
+  for(i=0; i<height; i++){
+    buff[i] = transX (params, buffer + i*bwidth, left);
+  }
+
+  transFilter (buff, height, dpi, lastCol);
+
+  DBG (10, "sanei_magic_getTransX: finish\n");
+
+  return buff;
+}
+
+/* Look for the first color change in one row, from the left or right.
+ * gray/color uses a different algo from binary/halftone */
+static int
+transX (SANE_Parameters * params, SANE_Byte * row, int left)
+{
+  int j, k;
+  int winLen = 9;
+
+  int width = params->pixels_per_line;
+  int depth = 1;
+
+  /* defaults for right-first */
+  int firstCol = width-1;
+  int lastCol = -1;
+  int direction = -1;
+
+  /* override for left-first*/
+  if(left){
+    firstCol = 0;
+    lastCol = width;
+    direction = 1;
+  }
+
   if(params->format == SANE_FRAME_RGB || 
     (params->format == SANE_FRAME_GRAY && params->depth == 8)
   ){
 
+    int near = 0;
+    int far = 0;
+
     if(params->format == SANE_FRAME_RGB)
       depth = 3;
 
-    /* loop over all columns, find first transition */
-    for(i=0; i<height; i++){
+    /* load the near and far windows with repeated copy of first pixel */
+    for(k=0; k<depth; k++){
+      near += row[k];
+    }
+    near *= winLen;
+    far = near;
 
-      int near = 0;
-      int far = 0;
+    /* move windows, check delta */
+    for(j=firstCol+direction; j!=lastCol; j+=direction){
 
-      /* load the near and far windows with repeated copy of first pixel */
-      for(k=0; k<depth; k++){
-        near += buffer[i*bwidth + k];
+      int farCol = j-winLen*2*direction;
+      int nearCol = j-winLen*direction;
+
+      if(farCol < 0 || farCol >= width){
+        farCol = firstCol;
+      }
+      if(nearCol < 0 || nearCol >= width){
+        nearCol = firstCol;
       }
-      near *= winLen;
-      far = near;
-  
-      /* move windows, check delta */
-      for(j=firstCol+direction; j!=lastCol; j+=direction){
-  
-        int farCol = j-winLen*2*direction;
-        int nearCol = j-winLen*direction;
 
-        if(farCol < 0 || farCol >= width){
-          farCol = firstCol;
-        }
-        if(nearCol < 0 || nearCol >= width){
-          nearCol = firstCol;
-        }
+      for(k=0; k<depth; k++){
+        far -= row[farCol*depth + k];
+        far += row[nearCol*depth + k];
 
-        for(k=0; k<depth; k++){
-          far -= buffer[i*bwidth + farCol*depth + k];
-          far += buffer[i*bwidth + nearCol*depth + k];
+        near -= row[nearCol*depth + k];
+        near += row[j*depth + k];
+      }
 
-          near -= buffer[i*bwidth + nearCol*depth + k];
-          near += buffer[i*bwidth + j*depth + k];
-        }
-  
-        if(abs(near - far) > 50*winLen*depth - near*40/255){
-          buff[i] = j;
-          break;
-        }
+      if(abs(near - far) > 50*winLen*depth - near*40/255){
+        return j;
       }
     }
   }
 
-  else if (params->format == SANE_FRAME_GRAY && params->depth == 1){
+  else{
 
-    int near = 0;
+    /* load the near window with first pixel */
+    int near = row[firstCol/8] >> (7-(firstCol%8)) & 1;
 
-    for(i=0; i<height; i++){
-  
-      /* load the near window with first pixel */
-      near = buffer[i*bwidth + firstCol/8] >> (7-(firstCol%8)) & 1;
-  
-      /* move */
-      for(j=firstCol+direction; j!=lastCol; j+=direction){
-        if((buffer[i*bwidth + j/8] >> (7-(j%8)) & 1) != near){
-          buff[i] = j;
-          break;
-        }
+    /* move */
+    for(j=firstCol+direction; j!=lastCol; j+=direction){
+      if((row[j/8] >> (7-(j%8)) & 1) != near){
+        return j;
       }
     }
   }
 
-  /* some other format? */
-  else{
-    DBG (5, "sanei_magic_getTransX: unsupported format/depth\n");
-    free(buff);
-    return NULL;
-  }
+  return lastCol;
+}
 
-  /* ignore transitions with few neighbors within .5 inch */
-  for(i=0;i<height-7;i++){
+/* ignore transitions with few neighbors within .5 inch */
+static void
+transFilter (int * buff, int len, int dpi, int lastLine)
+{
+  int i, j;
+
+  for(i=0;i<len-7;i++){
     int sum = 0;
     for(j=1;j<=7;j++){
       if(abs(buff[i+j] - buff[i]) < dpi/2)
         sum++;
     }
     if(sum < 2)
-      buff[i] = lastCol;
+      buff[i] = lastLine;
   }
-
-  DBG (10, "sanei_magic_getTransX: finish\n");
-
-  return buff;
 }
 
@@ -42,6 +42,7 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../include/sane/sane.h"
 #include "../include/sane/sanei_net.h"
@@ -184,3 +185,199 @@ sanei_w_authorization_req (Wire *w, SANE_Authorization_Req *req)
   sanei_w_string (w, &req->username);
   sanei_w_string (w, &req->password);
 }
+
+/* A simple LZ77 codec for the image data records, in the spirit of
+   LZ4: a block is a sequence of (literal run, match) pairs.  Each pair
+   starts with a token byte whose high nibble is the number of literals
+   and whose low nibble is the match length minus 4.  A nibble of 15 is
+   continued by bytes that are added to it, as long as they are 255.
+   The literals follow, then a 2 byte little endian match offset.  The
+   last pair has no match and ends the block.  Runs of identical pixels
+   become overlapping matches, which is what makes scanned pages
+   compress well.  */
+
+#define LZ_HASH_BITS	12
+#define LZ_MIN_MATCH	4
+#define LZ_MAX_OFFSET	65535
+
+static unsigned int
+lz_read32 (const SANE_Byte *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static unsigned int
+lz_hash (unsigned int v)
+{
+  return ((v * 2654435761U) >> (32 - LZ_HASH_BITS))
+    & ((1 << LZ_HASH_BITS) - 1);
+}
+
+/* store a length that didn't fit into a nibble */
+static SANE_Byte *
+lz_put_length (SANE_Byte *op, size_t n)
+{
+  while (n >= 255)
+    {
+      *op++ = 255;
+      n -= 255;
+    }
+  *op++ = n;
+  return op;
+}
+
+/* Emit one sequence; MLEN is 0 for the final literal run.  */
+static SANE_Byte *
+lz_put_sequence (SANE_Byte *op, SANE_Byte *op_end, const SANE_Byte *lit,
+		 size_t lit_len, size_t offset, size_t mlen)
+{
+  SANE_Byte *token = op;
+
+  if ((size_t) (op_end - op) < 1 + lit_len / 255 + 1 + lit_len
+      + 2 + mlen / 255 + 1)
+    return NULL;
+
+  op++;
+  if (lit_len >= 15)
+    {
+      *token = 15 << 4;
+      op = lz_put_length (op, lit_len - 15);
+    }
+  else
+    *token = lit_len << 4;
+
+  memcpy (op, lit, lit_len);
+  op += lit_len;
+
+  if (mlen)
+    {
+      *op++ = offset & 0xff;
+      *op++ = (offset >> 8) & 0xff;
+      mlen -= LZ_MIN_MATCH;
+      if (mlen >= 15)
+	{
+	  *token |= 15;
+	  op = lz_put_length (op, mlen - 15);
+	}
+      else
+	*token |= mlen;
+    }
+  return op;
+}
+
+size_t
+sanei_net_compress (const SANE_Byte *src, size_t len,
+		    SANE_Byte *dst, size_t dst_size)
+{
+  size_t table[1 << LZ_HASH_BITS];
+  size_t ip = 0, anchor = 0;
+  SANE_Byte *op = dst, *op_end = dst + dst_size;
+
+  memset (table, 0, sizeof (table));
+
+  while (ip + LZ_MIN_MATCH <= len)
+    {
+      unsigned int v = lz_read32 (src + ip);
+      unsigned int h = lz_hash (v);
+      size_t ref = table[h];
+      size_t mlen;
+
+      table[h] = ip;
+      if (ref >= ip || ip - ref > LZ_MAX_OFFSET
+	  || lz_read32 (src + ref) != v)
+	{
+	  ip++;
+	  continue;
+	}
+
+      mlen = LZ_MIN_MATCH;
+      while (ip + mlen < len && src[ref + mlen] == src[ip + mlen])
+	mlen++;
+
+      op = lz_put_sequence (op, op_end, src + anchor, ip - anchor,
+			    ip - ref, mlen);
+      if (!op)
+	return 0;
+
+      ip += mlen;
+      anchor = ip;
+    }
+
+  op = lz_put_sequence (op, op_end, src + anchor, len - anchor, 0, 0);
+  if (!op)
+    return 0;
+
+  return op - dst;
+}
+
+long
+sanei_net_decompress (const SANE_Byte *src, size_t len,
+		      SANE_Byte *dst, size_t dst_size)
+{
+  const SANE_Byte *ip = src, *ip_end = src + len;
+  size_t op = 0;
+
+  while (ip < ip_end)
+    {
+      unsigned int token = *ip++;
+      size_t n, offset;
+      SANE_Byte b;
+
+      /* literal run */
+      n = token >> 4;
+      if (n == 15)
+	do
+	  {
+	    if (ip >= ip_end)
+	      return -1;
+	    b = *ip++;
+	    n += b;
+	  }
+	while (b == 255);
+
+      if (n > (size_t) (ip_end - ip) || n > dst_size - op)
+	return -1;
+      memcpy (dst + op, ip, n);
+      ip += n;
+      op += n;
+
+      if (ip == ip_end)
+	break;
+
+      /* match */
+      if (ip_end - ip < 2)
+	return -1;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > op)
+	return -1;
+
+      n = token & 15;
+      if (n == 15)
+	do
+	  {
+	    if (ip >= ip_end)
+	      return -1;
+	    b = *ip++;
+	    n += b;
+	  }
+	while (b == 255);
+      n += LZ_MIN_MATCH;
+
+      if (n > dst_size - op)
+	return -1;
+      if (offset >= n)
+	memcpy (dst + op, dst + op - offset, n);
+      else
+	{
+	  /* overlapping copy repeats the last OFFSET bytes */
+	  size_t i;
+
+	  for (i = 0; i < n; i++)
+	    dst[op + i] = dst[op + i - offset];
+	}
+      op += n;
+    }
+
+  return op;
+}
@@ -61,6 +61,11 @@
 #endif
 #include <sys/param.h>
 #include <sys/types.h>
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
 
 #if defined (HAVE_WINDOWS_H)
 # include <windows.h>
@@ -6171,6 +6176,263 @@ sanei_scsi_find_devices (const char *findvendor, const char *findmodel,
 
 
 
+/* Read-ahead: keep several READ commands queued with
+   sanei_scsi_req_enter2() and hand the buffers back in order.  On
+   platforms without a request queue sanei_scsi_req_enter2() runs each
+   command synchronously, so the reads still happen in order, just
+   without overlap.  */
+
+#define READAHEAD_CDB_MAX 16
+
+typedef struct
+{
+  u_char *buffer;
+  size_t length;		/* requested */
+  size_t size;			/* received */
+  void *id;
+  SANE_Status status;		/* of sanei_scsi_req_enter2 */
+}
+readahead_slot;
+
+struct sanei_scsi_readahead
+{
+  int fd;
+  SANEI_SCSI_Read_Cmd make_cmd;
+  void *arg;
+  readahead_slot *slots;
+  int num_slots;
+  int head;			/* oldest queued slot */
+  int queued;
+  size_t block_size;
+  size_t remaining;		/* not requested yet, if bounded */
+  SANE_Bool bounded;
+  SANE_Bool stalled;		/* don't queue any more commands */
+  SANE_Bool ended;
+  SANE_Status status;		/* sticky error */
+  /* statistics */
+  u_long commands;
+  u_long bytes;
+  u_long waits;
+  u_long depth_sum;		/* commands queued, summed over the waits */
+  double started;
+  double idle_since;		/* no command queued since, if not 0 */
+  double idle;			/* seconds with no command queued */
+  double blocked;		/* seconds spent in sanei_scsi_req_wait */
+};
+
+static double
+readahead_now (void)
+{
+#ifdef HAVE_SYS_TIME_H
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+#else
+  return time (NULL);
+#endif
+}
+
+static void
+readahead_submit (SANEI_SCSI_Readahead * ra)
+{
+  readahead_slot *slot;
+  u_char cmd[READAHEAD_CDB_MAX];
+  size_t cmd_size;
+
+  while (ra->queued < ra->num_slots && !ra->stalled && !ra->ended
+	 && (!ra->bounded || ra->remaining > 0))
+    {
+      slot = &ra->slots[(ra->head + ra->queued) % ra->num_slots];
+      slot->length = ra->block_size;
+      if (ra->bounded && slot->length > ra->remaining)
+	slot->length = ra->remaining;
+      slot->size = slot->length;
+      slot->id = NULL;
+
+      memset (cmd, 0, sizeof (cmd));
+      cmd_size = (*ra->make_cmd) (ra->arg, slot->length, cmd);
+
+      if (ra->idle_since > 0)
+	{
+	  ra->idle += readahead_now () - ra->idle_since;
+	  ra->idle_since = 0;
+	}
+      slot->status = sanei_scsi_req_enter2 (ra->fd, cmd, cmd_size, NULL, 0,
+					    slot->buffer, &slot->size,
+					    &slot->id);
+      if (slot->status != SANE_STATUS_GOOD)
+	ra->stalled = SANE_TRUE;	/* report it when its turn comes */
+
+      if (ra->bounded)
+	ra->remaining -= slot->length;
+      ra->queued++;
+      ra->commands++;
+    }
+}
+
+/* Drops the queued commands, with all other commands pending on the
+   file descriptor.  */
+static void
+readahead_cancel (SANEI_SCSI_Readahead * ra)
+{
+  if (ra->queued == 0)
+    return;
+  DBG (4, "sanei_scsi_readahead: dropping %d queued commands\n", ra->queued);
+  sanei_scsi_req_flush_all_extended (ra->fd);
+  ra->queued = 0;
+}
+
+SANE_Status
+sanei_scsi_readahead_start (int fd, SANEI_SCSI_Read_Cmd make_cmd, void *arg,
+			    size_t total, size_t block_size, int depth,
+			    SANEI_SCSI_Readahead ** rap)
+{
+  SANEI_SCSI_Readahead *ra;
+  u_char *memory;
+  int i;
+
+  *rap = NULL;
+  if (!make_cmd || block_size == 0 || depth < 1)
+    {
+      DBG (1, "sanei_scsi_readahead_start: invalid arguments\n");
+      return SANE_STATUS_INVAL;
+    }
+  if (block_size > (size_t) sanei_scsi_max_request_size)
+    {
+      DBG (1, "sanei_scsi_readahead_start: blocks of %lu bytes exceed the "
+	   "maximum request size of %d bytes\n", (u_long) block_size,
+	   sanei_scsi_max_request_size);
+      return SANE_STATUS_INVAL;
+    }
+  if (total && (size_t) depth > (total + block_size - 1) / block_size)
+    depth = (total + block_size - 1) / block_size;
+
+  ra = calloc (1, sizeof (*ra) + depth * sizeof (readahead_slot));
+  memory = malloc (depth * block_size);
+  if (!ra || !memory)
+    {
+      DBG (1, "sanei_scsi_readahead_start: not enough memory for %d x %lu "
+	   "bytes\n", depth, (u_long) block_size);
+      free (ra);
+      free (memory);
+      return SANE_STATUS_NO_MEM;
+    }
+
+  ra->fd = fd;
+  ra->make_cmd = make_cmd;
+  ra->arg = arg;
+  ra->slots = (readahead_slot *) (ra + 1);
+  ra->num_slots = depth;
+  for (i = 0; i < depth; ++i)
+    ra->slots[i].buffer = memory + i * block_size;
+  ra->block_size = block_size;
+  ra->remaining = total;
+  ra->bounded = total > 0;
+  ra->status = SANE_STATUS_GOOD;
+  ra->started = readahead_now ();
+
+  DBG (4, "sanei_scsi_readahead_start: fd %d, %lu bytes in blocks of %lu, "
+       "%d queued\n", fd, (u_long) total, (u_long) block_size, depth);
+
+  readahead_submit (ra);
+  *rap = ra;
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_scsi_readahead_next (SANEI_SCSI_Readahead * ra, const u_char ** data,
+			   size_t * size)
+{
+  readahead_slot *slot;
+  SANE_Status status;
+  double start;
+
+  *data = NULL;
+  *size = 0;
+  if (ra->status != SANE_STATUS_GOOD)
+    return ra->status;
+
+  /* the buffer handed out last time is free again */
+  readahead_submit (ra);
+  if (ra->queued == 0)
+    return SANE_STATUS_EOF;
+
+  slot = &ra->slots[ra->head];
+  ra->head = (ra->head + 1) % ra->num_slots;
+  ra->depth_sum += ra->queued;
+  ra->waits++;
+  ra->queued--;
+
+  status = slot->status;
+  if (status == SANE_STATUS_GOOD)
+    {
+      start = readahead_now ();
+      status = sanei_scsi_req_wait (slot->id);
+      ra->blocked += readahead_now () - start;
+    }
+  if (ra->queued == 0)
+    ra->idle_since = readahead_now ();
+
+  if (status == SANE_STATUS_EOF)
+    {
+      /* the size is not updated for commands that fail */
+      slot->size = 0;
+      ra->ended = SANE_TRUE;
+    }
+  else if (status != SANE_STATUS_GOOD)
+    {
+      DBG (1, "sanei_scsi_readahead_next: read failed with status %d\n",
+	   status);
+      ra->status = status;
+      readahead_cancel (ra);
+      return status;
+    }
+  else if (slot->size == 0)
+    ra->ended = SANE_TRUE;
+  else if (slot->size < slot->length)
+    {
+      /* a bounded read asks for the rest later, an unbounded one is
+         over */
+      if (ra->bounded)
+	ra->remaining += slot->length - slot->size;
+      else
+	ra->ended = SANE_TRUE;
+    }
+  if (ra->ended)
+    readahead_cancel (ra);
+
+  ra->bytes += slot->size;
+  if (slot->size == 0)
+    return SANE_STATUS_EOF;
+  *data = slot->buffer;
+  *size = slot->size;
+  return SANE_STATUS_GOOD;
+}
+
+void
+sanei_scsi_readahead_stop (SANEI_SCSI_Readahead * ra)
+{
+  double elapsed;
+
+  if (!ra)
+    return;
+  readahead_cancel (ra);
+
+  elapsed = readahead_now () - ra->started;
+  if (ra->idle_since > 0)
+    ra->idle += readahead_now () - ra->idle_since;
+  DBG (3, "sanei_scsi_readahead_stop: %lu commands, %lu bytes in %.3f s, "
+       "average queue depth %.2f of %d\n", ra->commands, ra->bytes, elapsed,
+       ra->waits ? (double) ra->depth_sum / ra->waits : 0.0, ra->num_slots);
+  DBG (3, "sanei_scsi_readahead_stop: device idle %.3f s, waited for data "
+       "%.3f s\n", ra->idle, ra->blocked);
+
+  free (ra->slots[0].buffer);
+  free (ra);
+}
+
+
 #ifndef WE_HAVE_FIND_DEVICES
 
   void
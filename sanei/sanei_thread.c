@@ -60,6 +60,9 @@
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
 #endif
+#ifdef HAVE_FCNTL_H
+# include <fcntl.h>
+#endif
 #ifdef HAVE_OS2_H
 # define INCL_DOSPROCESS
 # include <os2.h>
@@ -71,8 +74,14 @@
 #if !defined USE_PTHREAD && !defined HAVE_OS2_H && !defined __BEOS__
 # include <sys/wait.h>
 #endif
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
 #if defined USE_PTHREAD
 # include <pthread.h>
+# ifdef HAVE_SYS_EVENTFD_H
+#  include <sys/eventfd.h>
+# endif
 #endif
 
 #define BACKEND_NAME sanei_thread      /**< name of this module for debugging */
@@ -547,4 +556,586 @@ sanei_thread_get_status( SANE_Pid pid )
 #endif
 }
 
+/* reader task with a ring buffer ..........................................*/
+
+#ifdef USE_PTHREAD
+
+struct sanei_thread_ring {
+
+	SANE_Byte        *buf;
+	size_t            size;
+	size_t            head;       /* next byte to read                   */
+	size_t            fill;       /* bytes in the ring                   */
+	SANE_Bool         running;    /* the task hasn't returned yet        */
+	SANE_Bool         stopped;    /* the reader wants no more data       */
+	SANE_Bool         non_blocking;
+	SANE_Bool         signaled;   /* the select fd is readable           */
+	SANE_Status       status;     /* returned by the task                */
+	int             (*func)( void* );
+	void             *args;
+	int               fd[2];      /* an eventfd in both, or a pipe       */
+	pthread_mutex_t   lock;
+	pthread_cond_t    cond;       /* fill or running changed             */
+	SANEI_Thread_Ring *next;      /* in the job queue of the pool        */
+};
+
+/* the pool: threads that wait for rings to run the task of, the idle
+ * ones are those not running a task */
+static pthread_mutex_t    pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t     pool_cond = PTHREAD_COND_INITIALIZER;
+static SANEI_Thread_Ring *pool_jobs;
+static pthread_t         *pool_threads;
+static int                pool_size;
+static int                pool_idle;
+static SANE_Bool          pool_exiting;
+
+/* makes the select fd readable or not, call with ring->lock held */
+static void
+ring_signal( SANEI_Thread_Ring *ring, SANE_Bool on )
+{
+	int rc;
+#ifdef HAVE_SYS_EVENTFD_H
+	eventfd_t value;
+
+	if( ring->signaled == on )
+		return;
+	if( on )
+		rc = eventfd_write( ring->fd[1], 1 );
+	else
+		rc = eventfd_read( ring->fd[0], &value );
+#else
+	char c = 0;
+
+	if( ring->signaled == on )
+		return;
+	if( on )
+		rc = write( ring->fd[1], &c, 1 );
+	else
+		rc = read( ring->fd[0], &c, 1 );
+#endif
+	if( rc < 0 )
+		DBG( 1, "ring_signal: %s\n", strerror(errno));
+	ring->signaled = on;
+}
+
+static void*
+pool_thread( void *arg )
+{
+	SANEI_Thread_Ring *ring;
+	int                status;
+
+	_VAR_NOT_USED( arg );
+
+	pthread_mutex_lock( &pool_lock );
+	for(;;) {
+
+		while( !pool_jobs && !pool_exiting )
+			pthread_cond_wait( &pool_cond, &pool_lock );
+		if( !pool_jobs )
+			break;
+
+		ring      = pool_jobs;
+		pool_jobs = ring->next;
+		pool_idle--;
+		pthread_mutex_unlock( &pool_lock );
+
+		DBG( 2, "pool thread: running the task of ring %p\n", (void*)ring );
+		status = ring->func( ring->args );
+		DBG( 2, "pool thread: task done - status = %d\n", status );
+
+		/* idle before the reader learns the task is done, so the
+		 * task of the next page finds this thread */
+		pthread_mutex_lock( &pool_lock );
+		pool_idle++;
+		pthread_mutex_unlock( &pool_lock );
+
+		pthread_mutex_lock( &ring->lock );
+		ring->status  = status;
+		ring->running = SANE_FALSE;
+		ring_signal( ring, SANE_TRUE );
+		pthread_cond_broadcast( &ring->cond );
+		pthread_mutex_unlock( &ring->lock );
+
+		pthread_mutex_lock( &pool_lock );
+	}
+	pthread_mutex_unlock( &pool_lock );
+	return NULL;
+}
+
+SANE_Status
+sanei_thread_ring_new( size_t size, SANEI_Thread_Ring **ring )
+{
+	SANEI_Thread_Ring *r;
+
+	r = calloc( 1, sizeof(*r));
+	if( !r )
+		return SANE_STATUS_NO_MEM;
+
+	r->size = size ? size : 1;
+	r->buf  = malloc( r->size );
+	if( !r->buf ) {
+		free( r );
+		return SANE_STATUS_NO_MEM;
+	}
+#ifdef HAVE_SYS_EVENTFD_H
+	r->fd[0] = r->fd[1] = eventfd( 0, EFD_NONBLOCK );
+	if( r->fd[0] < 0 ) {
+#else
+	if( pipe( r->fd ) < 0 ) {
+#endif
+		DBG( 1, "sanei_thread_ring_new: no select fd (%s)\n",
+		     strerror(errno));
+		free( r->buf );
+		free( r );
+		return SANE_STATUS_NO_MEM;
+	}
+#ifndef HAVE_SYS_EVENTFD_H
+	fcntl( r->fd[0], F_SETFL, O_NONBLOCK );
+#endif
+	pthread_mutex_init( &r->lock, NULL );
+	pthread_cond_init( &r->cond, NULL );
+
+	DBG( 2, "sanei_thread_ring_new: %lu bytes\n", (unsigned long)r->size );
+	*ring = r;
+	return SANE_STATUS_GOOD;
+}
+
+void
+sanei_thread_ring_free( SANEI_Thread_Ring *ring )
+{
+	if( !ring )
+		return;
+
+	sanei_thread_ring_stop( ring );
+	close( ring->fd[0] );
+	if( ring->fd[1] != ring->fd[0] )
+		close( ring->fd[1] );
+	pthread_cond_destroy( &ring->cond );
+	pthread_mutex_destroy( &ring->lock );
+	free( ring->buf );
+	free( ring );
+}
+
+SANE_Status
+sanei_thread_ring_start( SANEI_Thread_Ring *ring,
+                         int (*func)(void *args), void *args )
+{
+	SANEI_Thread_Ring **job;
+	pthread_t          *threads;
+	int                 queued = 0, result;
+
+	pthread_mutex_lock( &ring->lock );
+	if( ring->running ) {
+		pthread_mutex_unlock( &ring->lock );
+		DBG( 1, "sanei_thread_ring_start: task still running\n" );
+		return SANE_STATUS_INVAL;
+	}
+	ring->head         = 0;
+	ring->fill         = 0;
+	ring->stopped      = SANE_FALSE;
+	ring->non_blocking = SANE_FALSE;
+	ring->status       = SANE_STATUS_GOOD;
+	ring->func         = func;
+	ring->args         = args;
+	ring->running      = SANE_TRUE;
+	ring_signal( ring, SANE_FALSE );
+	pthread_mutex_unlock( &ring->lock );
+
+	pthread_mutex_lock( &pool_lock );
+	ring->next = NULL;
+	for( job = &pool_jobs; *job; job = &(*job)->next )
+		queued++;
+	*job = ring;
+	queued++;
+
+	if( pool_idle >= queued ) {
+		pthread_cond_signal( &pool_cond );
+	} else {
+		threads = realloc( pool_threads, (pool_size + 1) * sizeof(pthread_t));
+		result  = threads ? pthread_create( &threads[pool_size], NULL,
+		                                    pool_thread, NULL ) : ENOMEM;
+		if( threads )
+			pool_threads = threads;
+		if( result != 0 ) {
+			DBG( 1, "pthread_create() failed with %d\n", result );
+			*job = NULL;
+			pthread_mutex_unlock( &pool_lock );
+			pthread_mutex_lock( &ring->lock );
+			ring->running = SANE_FALSE;
+			pthread_mutex_unlock( &ring->lock );
+			return SANE_STATUS_NO_MEM;
+		}
+		pool_size++;
+		pool_idle++;
+		DBG( 2, "sanei_thread_ring_start: %d threads in the pool\n",
+		     pool_size );
+	}
+	pthread_mutex_unlock( &pool_lock );
+	return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_thread_ring_write( SANEI_Thread_Ring *ring,
+                         const SANE_Byte *data, size_t size )
+{
+	size_t tail, n;
+
+	while( size > 0 ) {
+
+		pthread_mutex_lock( &ring->lock );
+		while( ring->fill == ring->size && !ring->stopped )
+			pthread_cond_wait( &ring->cond, &ring->lock );
+		if( ring->stopped ) {
+			pthread_mutex_unlock( &ring->lock );
+			return SANE_STATUS_CANCELLED;
+		}
+		tail = (ring->head + ring->fill) % ring->size;
+		n    = ring->size - ring->fill;
+		pthread_mutex_unlock( &ring->lock );
+
+		/* only the reader moves the head, the space stays ours */
+		if( n > ring->size - tail )
+			n = ring->size - tail;
+		if( n > size )
+			n = size;
+		memcpy( ring->buf + tail, data, n );
+
+		pthread_mutex_lock( &ring->lock );
+		ring->fill += n;
+		ring_signal( ring, SANE_TRUE );
+		pthread_cond_broadcast( &ring->cond );
+		pthread_mutex_unlock( &ring->lock );
+
+		data += n;
+		size -= n;
+	}
+	return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_thread_ring_read( SANEI_Thread_Ring *ring, SANE_Byte *data,
+                        size_t max_length, size_t *length )
+{
+	SANE_Status status;
+	size_t      head, n, first;
+
+	*length = 0;
+
+	pthread_mutex_lock( &ring->lock );
+	while( ring->fill == 0 && ring->running ) {
+		if( ring->non_blocking ) {
+			pthread_mutex_unlock( &ring->lock );
+			return SANE_STATUS_GOOD;
+		}
+		pthread_cond_wait( &ring->cond, &ring->lock );
+	}
+	if( ring->fill == 0 ) {
+		status = ring->status;
+		pthread_mutex_unlock( &ring->lock );
+		return (status == SANE_STATUS_GOOD) ? SANE_STATUS_EOF : status;
+	}
+	head = ring->head;
+	n    = ring->fill;
+	pthread_mutex_unlock( &ring->lock );
+
+	/* only the writer adds data, what is there stays */
+	if( n > max_length )
+		n = max_length;
+	first = ring->size - head;
+	if( first > n )
+		first = n;
+	memcpy( data, ring->buf + head, first );
+	memcpy( data + first, ring->buf, n - first );
+
+	pthread_mutex_lock( &ring->lock );
+	ring->head  = (head + n) % ring->size;
+	ring->fill -= n;
+	if( ring->fill == 0 && ring->running )
+		ring_signal( ring, SANE_FALSE );
+	pthread_cond_broadcast( &ring->cond );
+	pthread_mutex_unlock( &ring->lock );
+
+	*length = n;
+	return SANE_STATUS_GOOD;
+}
+
+size_t
+sanei_thread_ring_fill( SANEI_Thread_Ring *ring )
+{
+	size_t fill;
+
+	pthread_mutex_lock( &ring->lock );
+	fill = ring->fill;
+	pthread_mutex_unlock( &ring->lock );
+	return fill;
+}
+
+SANE_Status
+sanei_thread_ring_stop( SANEI_Thread_Ring *ring )
+{
+	SANE_Status status;
+
+	pthread_mutex_lock( &ring->lock );
+	ring->stopped = SANE_TRUE;
+	pthread_cond_broadcast( &ring->cond );
+	while( ring->running )
+		pthread_cond_wait( &ring->cond, &ring->lock );
+	ring->fill = 0;
+	status     = ring->status;
+	pthread_mutex_unlock( &ring->lock );
+
+	DBG( 2, "sanei_thread_ring_stop: task status = %d\n", status );
+	return status;
+}
+
+SANE_Status
+sanei_thread_ring_set_io_mode( SANEI_Thread_Ring *ring, SANE_Bool non_blocking )
+{
+	pthread_mutex_lock( &ring->lock );
+	ring->non_blocking = non_blocking;
+	pthread_mutex_unlock( &ring->lock );
+	return SANE_STATUS_GOOD;
+}
+
+void
+sanei_thread_pool_exit( void )
+{
+	int i;
+
+	pthread_mutex_lock( &pool_lock );
+	pool_exiting = SANE_TRUE;
+	pthread_cond_broadcast( &pool_cond );
+	pthread_mutex_unlock( &pool_lock );
+
+	for( i = 0; i < pool_size; i++ )
+		pthread_join( pool_threads[i], NULL );
+
+	DBG( 2, "sanei_thread_pool_exit: %d threads ended\n", pool_size );
+	free( pool_threads );
+	pool_threads = NULL;
+	pool_size    = 0;
+	pool_idle    = 0;
+	pool_exiting = SANE_FALSE;
+}
+
+#else /* USE_PTHREAD */
+
+/* without pthreads the ring is a pipe and the task a process (or a
+ * thread on OS/2 and BeOS), like a reader task in the backends */
+struct sanei_thread_ring {
+
+	int           fd[2];          /* the pipe, -1 if closed              */
+	SANE_Pid      pid;
+	SANE_Status   status;         /* returned by the task                */
+	int         (*func)( void* );
+	void         *args;
+};
+
+static int
+ring_task( void *arg )
+{
+	SANEI_Thread_Ring *ring = (SANEI_Thread_Ring*)arg;
+	int                status;
+#if !defined HAVE_OS2_H && !defined __BEOS__
+	struct sigaction   act;
+
+	/* a child process, SIGTERM shouldn't run the handler of the frontend */
+	memset( &act, 0, sizeof(act));
+	sigaction( SIGTERM, &act, 0 );
+	close( ring->fd[0] );
+#endif
+
+	status = ring->func( ring->args );
+
+	/* end of data */
+	close( ring->fd[1] );
+	ring->fd[1] = -1;
+	return status;
+}
+
+static void
+ring_close( SANEI_Thread_Ring *ring )
+{
+	int i;
+
+	for( i = 0; i < 2; i++ ) {
+		if( ring->fd[i] >= 0 )
+			close( ring->fd[i] );
+		ring->fd[i] = -1;
+	}
+}
+
+/* collects the status of the task */
+static void
+ring_reap( SANEI_Thread_Ring *ring, SANE_Bool kill_it )
+{
+	int status;
+
+	if( sanei_thread_is_invalid( ring->pid ))
+		return;
+	if( kill_it )
+		sanei_thread_kill( ring->pid );
+	sanei_thread_waitpid( ring->pid, &status );
+	ring->status = status;
+	sanei_thread_set_invalid( &ring->pid );
+
+	/* a killed thread left its end open */
+	if( ring->fd[1] >= 0 ) {
+		close( ring->fd[1] );
+		ring->fd[1] = -1;
+	}
+}
+
+SANE_Status
+sanei_thread_ring_new( size_t size, SANEI_Thread_Ring **ring )
+{
+	SANEI_Thread_Ring *r;
+
+	_VAR_NOT_USED( size );
+
+	r = calloc( 1, sizeof(*r));
+	if( !r )
+		return SANE_STATUS_NO_MEM;
+	r->fd[0]  = -1;
+	r->fd[1]  = -1;
+	r->status = SANE_STATUS_GOOD;
+	sanei_thread_set_invalid( &r->pid );
+
+	*ring = r;
+	return SANE_STATUS_GOOD;
+}
+
+void
+sanei_thread_ring_free( SANEI_Thread_Ring *ring )
+{
+	if( !ring )
+		return;
+
+	sanei_thread_ring_stop( ring );
+	ring_close( ring );
+	free( ring );
+}
+
+SANE_Status
+sanei_thread_ring_start( SANEI_Thread_Ring *ring,
+                         int (*func)(void *args), void *args )
+{
+	if( !sanei_thread_is_invalid( ring->pid )) {
+		DBG( 1, "sanei_thread_ring_start: task still running\n" );
+		return SANE_STATUS_INVAL;
+	}
+
+	ring_close( ring );
+	if( pipe( ring->fd ) < 0 ) {
+		DBG( 1, "sanei_thread_ring_start: pipe failed (%s)\n",
+		     strerror(errno));
+		return SANE_STATUS_NO_MEM;
+	}
+	ring->status = SANE_STATUS_GOOD;
+	ring->func   = func;
+	ring->args   = args;
+
+	ring->pid = sanei_thread_begin( ring_task, ring );
+	if( sanei_thread_is_invalid( ring->pid )) {
+		ring_close( ring );
+		return SANE_STATUS_NO_MEM;
+	}
+	if( sanei_thread_is_forked()) {
+		close( ring->fd[1] );
+		ring->fd[1] = -1;
+	}
+	return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_thread_ring_write( SANEI_Thread_Ring *ring,
+                         const SANE_Byte *data, size_t size )
+{
+	ssize_t n;
+
+	while( size > 0 ) {
+		n = write( ring->fd[1], data, size );
+		if( n < 0 ) {
+			if( errno == EINTR )
+				continue;
+			DBG( 1, "sanei_thread_ring_write: %s\n", strerror(errno));
+			return (errno == EPIPE) ? SANE_STATUS_CANCELLED
+			                        : SANE_STATUS_IO_ERROR;
+		}
+		data += n;
+		size -= n;
+	}
+	return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_thread_ring_read( SANEI_Thread_Ring *ring, SANE_Byte *data,
+                        size_t max_length, size_t *length )
+{
+	ssize_t n;
+
+	*length = 0;
+	if( ring->fd[0] < 0 )
+		return SANE_STATUS_EOF;
+
+	n = read( ring->fd[0], data, max_length );
+	if( n < 0 ) {
+		if( errno == EAGAIN || errno == EINTR )
+			return SANE_STATUS_GOOD;
+		DBG( 1, "sanei_thread_ring_read: %s\n", strerror(errno));
+		return SANE_STATUS_IO_ERROR;
+	}
+	if( n == 0 ) {
+		ring_reap( ring, SANE_FALSE );
+		return (ring->status == SANE_STATUS_GOOD) ? SANE_STATUS_EOF
+		                                          : ring->status;
+	}
+	*length = n;
+	return SANE_STATUS_GOOD;
+}
+
+size_t
+sanei_thread_ring_fill( SANEI_Thread_Ring *ring )
+{
+#ifdef FIONREAD
+	int n;
+
+	if( ring->fd[0] >= 0 && ioctl( ring->fd[0], FIONREAD, &n ) == 0 && n > 0 )
+		return n;
+#else
+	(void)ring;
+#endif
+	return 0;
+}
+
+SANE_Status
+sanei_thread_ring_stop( SANEI_Thread_Ring *ring )
+{
+	ring_reap( ring, SANE_TRUE );
+	return ring->status;
+}
+
+SANE_Status
+sanei_thread_ring_set_io_mode( SANEI_Thread_Ring *ring, SANE_Bool non_blocking )
+{
+	if( fcntl( ring->fd[0], F_SETFL, non_blocking ? O_NONBLOCK : 0 ) < 0 ) {
+		DBG( 1, "sanei_thread_ring_set_io_mode: %s\n", strerror(errno));
+		return SANE_STATUS_IO_ERROR;
+	}
+	return SANE_STATUS_GOOD;
+}
+
+void
+sanei_thread_pool_exit( void )
+{
+}
+
+#endif /* USE_PTHREAD */
+
+int
+sanei_thread_ring_get_select_fd( SANEI_Thread_Ring *ring )
+{
+	return ring->fd[0];
+}
+
 /* END sanei_thread.c .......................................................*/
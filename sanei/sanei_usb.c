@@ -123,10 +123,51 @@ typedef enum
 					   (Linux, BSD) */
   sanei_usb_method_libusb,
 
-  sanei_usb_method_usbcalls
+  sanei_usb_method_usbcalls,
+
+  sanei_usb_method_loopback	/* test programs, no hardware */
 }
 sanei_usb_access_method_type;
 
+/**
+ * one buffer of a stream, see sanei_usb_stream_start() */
+typedef struct
+{
+  SANE_Byte *buffer;
+  size_t size;			/* bytes requested */
+  size_t length;		/* bytes received */
+  size_t pos;			/* bytes handed out by sanei_usb_stream_read */
+  int state;
+#ifdef HAVE_LIBUSB_1_0
+  struct libusb_transfer *transfer;
+#endif				/* HAVE_LIBUSB_1_0 */
+}
+stream_slot_type;
+
+enum
+{
+  STREAM_IDLE = 0,
+  STREAM_SUBMITTED,
+  STREAM_DONE,
+  STREAM_FAILED
+};
+
+typedef struct
+{
+  stream_slot_type *slots;
+  SANE_Byte *memory;
+  int num_slots;
+  int head;			/* slot to read from next */
+  int in_flight;		/* submitted slots following head */
+  size_t transfer_size;
+  size_t remaining;		/* bytes not requested yet */
+  SANE_Bool bounded;		/* remaining is meaningful */
+  SANE_Bool ended;		/* no more transfers to submit */
+  SANE_Status status;		/* first error */
+  unsigned long transfers, bytes, waits;
+}
+stream_type;
+
 typedef struct
 {
   SANE_Bool open;
@@ -153,6 +194,9 @@ typedef struct
   libusb_device *lu_device;
   libusb_device_handle *lu_handle;
 #endif /* HAVE_LIBUSB_1_0 */
+  sanei_usb_loopback_func loopback;
+  void *loopback_arg;
+  stream_type *stream;
 }
 device_list_type;
 
@@ -366,6 +410,10 @@ store_device (device_list_type device)
 
   if(pos > -1){
     DBG (3, "store_device: overwrite dn %d with %s\n", pos, device.devname);
+    /* backends may keep the name handed to their attach function, so
+       only a loopback device's name, which never leaves here, is freed */
+    if (devices[pos].method == sanei_usb_method_loopback)
+      free (devices[pos].devname);
   }
   else{
     if(device_number >= MAX_DEVICES){
@@ -2000,8 +2048,15 @@ sanei_usb_close (SANE_Int dn)
 	   dn);
       return;
     }
+  if (devices[dn].stream)
+    sanei_usb_stream_stop (dn);
   if (devices[dn].method == sanei_usb_method_scanner_driver)
     close (devices[dn].fd);
+  else if (devices[dn].method == sanei_usb_method_loopback)
+    {
+      /* there is nothing to close, the device number can be reused */
+      devices[dn].missing = 2;
+    }
   else if (devices[dn].method == sanei_usb_method_usbcalls)
     {
 #ifdef HAVE_USBCALLS
@@ -2213,6 +2268,16 @@ sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
       return SANE_STATUS_UNSUPPORTED;
     }
 #endif /* not HAVE_LIBUSB */
+  else if (devices[dn].method == sanei_usb_method_loopback)
+    {
+      size_t n = *size;
+
+      if ((*devices[dn].loopback) (devices[dn].loopback_arg, buffer, &n)
+	  != SANE_STATUS_GOOD)
+	read_size = -1;
+      else
+	read_size = n;
+    }
   else if (devices[dn].method == sanei_usb_method_usbcalls)
   {
 #ifdef HAVE_USBCALLS
@@ -2283,6 +2348,435 @@ sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
   return SANE_STATUS_GOOD;
 }
 
+/* Bulk transfers of a stream are multiples of the largest bulk packet
+   size of high speed devices, except the last one: a device sending a
+   full packet into a shorter buffer would overflow it. */
+#define STREAM_PACKET 512
+
+#ifdef HAVE_LIBUSB_1_0
+static void
+stream_callback (struct libusb_transfer *transfer)
+{
+  stream_slot_type *slot = transfer->user_data;
+
+  slot->length = transfer->actual_length;
+  if (transfer->status == LIBUSB_TRANSFER_COMPLETED)
+    slot->state = STREAM_DONE;
+  else
+    {
+      if (transfer->status != LIBUSB_TRANSFER_CANCELLED)
+	DBG (1, "stream_callback: transfer failed with status %d\n",
+	     transfer->status);
+      slot->state = STREAM_FAILED;
+    }
+}
+
+static SANE_Bool
+stream_async (SANE_Int dn)
+{
+  return devices[dn].method == sanei_usb_method_libusb;
+}
+
+/* Lets libusb call stream_callback() until no slot is SUBMITTED any
+   more or, if HEAD_ONLY, the head slot isn't.  Gives up after
+   libusb_timeout. */
+static SANE_Status
+stream_handle_events (SANE_Int dn, SANE_Bool head_only)
+{
+  stream_type *stream = devices[dn].stream;
+  struct timeval tv;
+  time_t deadline;
+  int i, ret, busy;
+
+  deadline = time (NULL) + (libusb_timeout + 999) / 1000;
+  for (;;)
+    {
+      if (head_only)
+	busy = (stream->slots[stream->head].state == STREAM_SUBMITTED);
+      else
+	for (i = busy = 0; i < stream->num_slots; ++i)
+	  busy |= (stream->slots[i].state == STREAM_SUBMITTED);
+      if (!busy)
+	return SANE_STATUS_GOOD;
+      if (time (NULL) > deadline)
+	{
+	  DBG (1, "stream_handle_events: timeout\n");
+	  return SANE_STATUS_IO_ERROR;
+	}
+
+      tv.tv_sec = 1;
+      tv.tv_usec = 0;
+      ret = libusb_handle_events_timeout (sanei_usb_ctx, &tv);
+      if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED)
+	{
+	  DBG (1, "stream_handle_events: %s\n", sanei_libusb_strerror (ret));
+	  return SANE_STATUS_IO_ERROR;
+	}
+    }
+}
+#endif /* HAVE_LIBUSB_1_0 */
+
+/* Submits the next transfer into the slot after the ones in flight. */
+static SANE_Status
+stream_submit (SANE_Int dn)
+{
+  stream_type *stream = devices[dn].stream;
+  stream_slot_type *slot;
+  size_t size;
+
+  slot = &stream->slots[(stream->head + stream->in_flight)
+			% stream->num_slots];
+
+  size = stream->transfer_size;
+  if (stream->bounded && size >= stream->remaining)
+    {
+      size = stream->remaining;
+      if (size > STREAM_PACKET)
+	size -= size % STREAM_PACKET;
+    }
+  slot->size = size;
+  slot->length = 0;
+  slot->pos = 0;
+  slot->state = STREAM_SUBMITTED;
+
+#ifdef HAVE_LIBUSB_1_0
+  if (stream_async (dn))
+    {
+      int ret;
+
+      /* no timeout here: a transfer waits behind the ones before it,
+         stream_handle_events() times out the head of the stream */
+      libusb_fill_bulk_transfer (slot->transfer, devices[dn].lu_handle,
+				 devices[dn].bulk_in_ep, slot->buffer,
+				 (int) size, stream_callback, slot, 0);
+      ret = libusb_submit_transfer (slot->transfer);
+      if (ret < 0)
+	{
+	  DBG (1, "stream_submit: submitting transfer failed: %s\n",
+	       sanei_libusb_strerror (ret));
+	  slot->state = STREAM_IDLE;
+	  return SANE_STATUS_IO_ERROR;
+	}
+    }
+#endif /* HAVE_LIBUSB_1_0 */
+
+  if (stream->bounded)
+    {
+      stream->remaining -= size;
+      if (!stream->remaining)
+	stream->ended = SANE_TRUE;
+    }
+  stream->in_flight++;
+  stream->transfers++;
+  return SANE_STATUS_GOOD;
+}
+
+/* Waits for the transfer into the head slot. */
+static SANE_Status
+stream_wait (SANE_Int dn)
+{
+  stream_type *stream = devices[dn].stream;
+  stream_slot_type *slot = &stream->slots[stream->head];
+  SANE_Status status;
+
+  if (slot->state != STREAM_SUBMITTED)
+    return SANE_STATUS_GOOD;
+
+#ifdef HAVE_LIBUSB_1_0
+  if (stream_async (dn))
+    {
+      stream->waits++;
+      return stream_handle_events (dn, SANE_TRUE);
+    }
+#endif /* HAVE_LIBUSB_1_0 */
+
+  /* without asynchronous transfers, do the transfer now */
+  slot->length = slot->size;
+  status = sanei_usb_read_bulk (dn, slot->buffer, &slot->length);
+  if (status == SANE_STATUS_EOF)
+    slot->length = 0;
+  slot->state = (status == SANE_STATUS_GOOD || status == SANE_STATUS_EOF)
+    ? STREAM_DONE : STREAM_FAILED;
+  return SANE_STATUS_GOOD;
+}
+
+/* Cancels the transfers in flight and waits for them to finish. */
+static SANE_Status
+stream_cancel (SANE_Int dn)
+{
+  stream_type *stream = devices[dn].stream;
+  SANE_Status status = SANE_STATUS_GOOD;
+  int i;
+
+#ifdef HAVE_LIBUSB_1_0
+  if (stream_async (dn))
+    {
+      for (i = 0; i < stream->num_slots; ++i)
+	if (stream->slots[i].state == STREAM_SUBMITTED)
+	  libusb_cancel_transfer (stream->slots[i].transfer);
+      status = stream_handle_events (dn, SANE_FALSE);
+    }
+#endif /* HAVE_LIBUSB_1_0 */
+
+  for (i = 0; i < stream->num_slots; ++i)
+    if (stream->slots[i].state != STREAM_SUBMITTED)
+      stream->slots[i].state = STREAM_IDLE;
+  stream->in_flight = 0;
+  stream->ended = SANE_TRUE;
+  return status;
+}
+
+SANE_Bool
+sanei_usb_stream_async (SANE_Int dn)
+{
+  if (dn >= device_number || dn < 0)
+    {
+      DBG (1, "sanei_usb_stream_async: dn >= device number || dn < 0\n");
+      return SANE_FALSE;
+    }
+#ifdef HAVE_LIBUSB_1_0
+  return stream_async (dn);
+#else
+  return SANE_FALSE;
+#endif /* HAVE_LIBUSB_1_0 */
+}
+
+SANE_Status
+sanei_usb_stream_start (SANE_Int dn, size_t total, size_t transfer_size,
+			SANE_Int transfers)
+{
+  stream_type *stream;
+  SANE_Status status;
+  int i;
+
+  if (dn >= device_number || dn < 0)
+    {
+      DBG (1, "sanei_usb_stream_start: dn >= device number || dn < 0\n");
+      return SANE_STATUS_INVAL;
+    }
+  if (!devices[dn].open || devices[dn].stream)
+    {
+      DBG (1, "sanei_usb_stream_start: device %d not open or already "
+	   "streaming\n", dn);
+      return SANE_STATUS_INVAL;
+    }
+  transfer_size -= transfer_size % STREAM_PACKET;
+  if (transfers < 1 || transfer_size == 0)
+    {
+      DBG (1, "sanei_usb_stream_start: invalid transfers (%d) or "
+	   "transfer_size (%lu)\n", transfers, (unsigned long) transfer_size);
+      return SANE_STATUS_INVAL;
+    }
+  if (devices[dn].method == sanei_usb_method_libusb
+      && !devices[dn].bulk_in_ep)
+    {
+      DBG (1, "sanei_usb_stream_start: can't read without a bulk-in "
+	   "endpoint\n");
+      return SANE_STATUS_INVAL;
+    }
+
+  /* don't allocate more than the whole stream needs */
+  if (total && (size_t) transfers * transfer_size > total)
+    transfers = (total + transfer_size - 1) / transfer_size;
+
+  stream = calloc (1, sizeof (*stream));
+  if (!stream)
+    return SANE_STATUS_NO_MEM;
+  stream->slots = calloc (transfers, sizeof (*stream->slots));
+  stream->memory = malloc (transfers * transfer_size);
+  if (!stream->slots || !stream->memory)
+    {
+      free (stream->slots);
+      free (stream->memory);
+      free (stream);
+      return SANE_STATUS_NO_MEM;
+    }
+  stream->num_slots = transfers;
+  stream->transfer_size = transfer_size;
+  stream->remaining = total;
+  stream->bounded = (total != 0);
+  stream->status = SANE_STATUS_GOOD;
+  for (i = 0; i < transfers; ++i)
+    stream->slots[i].buffer = stream->memory + i * transfer_size;
+  devices[dn].stream = stream;
+
+#ifdef HAVE_LIBUSB_1_0
+  if (stream_async (dn))
+    for (i = 0; i < transfers; ++i)
+      {
+	stream->slots[i].transfer = libusb_alloc_transfer (0);
+	if (!stream->slots[i].transfer)
+	  {
+	    sanei_usb_stream_stop (dn);
+	    return SANE_STATUS_NO_MEM;
+	  }
+      }
+#endif /* HAVE_LIBUSB_1_0 */
+
+  for (i = 0; i < transfers && !stream->ended; ++i)
+    {
+      status = stream_submit (dn);
+      if (status != SANE_STATUS_GOOD)
+	{
+	  if (i > 0)
+	    break;		/* go on with fewer transfers in flight */
+	  sanei_usb_stream_stop (dn);
+	  return status;
+	}
+    }
+
+  DBG (3, "sanei_usb_stream_start: %lu bytes, %d transfers of %lu bytes "
+       "in flight\n", (unsigned long) total, stream->in_flight,
+       (unsigned long) transfer_size);
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_usb_stream_read (SANE_Int dn, SANE_Byte * buffer, size_t * size)
+{
+  stream_type *stream;
+  stream_slot_type *slot;
+  SANE_Status status;
+  size_t wanted, n;
+
+  if (!size)
+    {
+      DBG (1, "sanei_usb_stream_read: size == NULL\n");
+      return SANE_STATUS_INVAL;
+    }
+  if (dn >= device_number || dn < 0 || !devices[dn].stream)
+    {
+      DBG (1, "sanei_usb_stream_read: no stream on device %d\n", dn);
+      return SANE_STATUS_INVAL;
+    }
+  stream = devices[dn].stream;
+
+  wanted = *size;
+  *size = 0;
+  while (*size < wanted && stream->in_flight
+	 && stream->status == SANE_STATUS_GOOD)
+    {
+      slot = &stream->slots[stream->head];
+      status = stream_wait (dn);
+      if (status == SANE_STATUS_GOOD && slot->state == STREAM_FAILED)
+	status = SANE_STATUS_IO_ERROR;
+      if (status != SANE_STATUS_GOOD)
+	{
+	  stream->status = status;
+	  stream_cancel (dn);
+	  break;
+	}
+
+      n = slot->length - slot->pos;
+      if (n > wanted - *size)
+	n = wanted - *size;
+      memcpy (buffer + *size, slot->buffer + slot->pos, n);
+      slot->pos += n;
+      *size += n;
+      if (slot->pos < slot->length)
+	break;
+
+      /* the slot is empty, reuse it for the next transfer */
+      stream->bytes += slot->length;
+      slot->state = STREAM_IDLE;
+      stream->head = (stream->head + 1) % stream->num_slots;
+      stream->in_flight--;
+      if (slot->length < slot->size)
+	{
+	  if (stream->bounded)
+	    DBG (1, "sanei_usb_stream_read: short transfer, %lu bytes "
+		 "missing\n", (unsigned long) (slot->size - slot->length
+					       + stream->remaining));
+	  stream_cancel (dn);
+	}
+      else if (!stream->ended)
+	{
+	  status = stream_submit (dn);
+	  if (status != SANE_STATUS_GOOD && !stream->in_flight)
+	    stream->status = status;
+	}
+    }
+
+  DBG (5, "sanei_usb_stream_read: wanted %lu bytes, got %lu bytes\n",
+       (unsigned long) wanted, (unsigned long) *size);
+  if (*size > 0)
+    return SANE_STATUS_GOOD;
+  if (stream->status != SANE_STATUS_GOOD)
+    return stream->status;
+  return wanted ? SANE_STATUS_EOF : SANE_STATUS_GOOD;
+}
+
+void
+sanei_usb_stream_stop (SANE_Int dn)
+{
+  stream_type *stream;
+  SANE_Status status;
+  int i;
+
+  if (dn >= device_number || dn < 0 || !devices[dn].stream)
+    {
+      DBG (1, "sanei_usb_stream_stop: no stream on device %d\n", dn);
+      return;
+    }
+  stream = devices[dn].stream;
+
+  status = stream_cancel (dn);
+  DBG (3, "sanei_usb_stream_stop: %lu transfers, %lu bytes, waited %lu "
+       "times\n", stream->transfers, stream->bytes, stream->waits);
+
+  if (status != SANE_STATUS_GOOD)
+    {
+      /* libusb still owns some of the buffers, better leak them */
+      DBG (1, "sanei_usb_stream_stop: transfers still pending\n");
+      devices[dn].stream = NULL;
+      return;
+    }
+#ifdef HAVE_LIBUSB_1_0
+  for (i = 0; i < stream->num_slots; ++i)
+    if (stream->slots[i].transfer)
+      libusb_free_transfer (stream->slots[i].transfer);
+#else
+  (void) i;
+#endif /* HAVE_LIBUSB_1_0 */
+  free (stream->memory);
+  free (stream->slots);
+  free (stream);
+  devices[dn].stream = NULL;
+}
+
+SANE_Status
+sanei_usb_testing_open_loopback (sanei_usb_loopback_func read, void *arg,
+				 SANE_Int * dn)
+{
+  static int count;
+  device_list_type device;
+  char devname[32];
+  int i;
+
+  snprintf (devname, sizeof (devname), "loopback:%d", count++);
+  memset (&device, 0, sizeof (device));
+  device.devname = strdup (devname);
+  if (!device.devname)
+    return SANE_STATUS_NO_MEM;
+  device.method = sanei_usb_method_loopback;
+  device.loopback = read;
+  device.loopback_arg = arg;
+  store_device (device);
+
+  for (i = 0; i < device_number; i++)
+    if (devices[i].method == sanei_usb_method_loopback
+	&& strcmp (devices[i].devname, devname) == 0)
+      {
+	devices[i].open = SANE_TRUE;
+	*dn = i;
+	DBG (3, "sanei_usb_testing_open_loopback: opened %s as dn %d\n",
+	     devname, i);
+	return SANE_STATUS_GOOD;
+      }
+  free (device.devname);
+  return SANE_STATUS_NO_MEM;
+}
+
 SANE_Status
 sanei_usb_write_bulk (SANE_Int dn, const SANE_Byte * buffer, size_t * size)
 {
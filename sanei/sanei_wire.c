@@ -52,6 +52,166 @@
 #define BACKEND_NAME	sanei_wire
 #include "../include/sane/sanei_backend.h"
 
+/* Decoded values live in arenas: the first allocation made at nesting
+   depth 0 opens a new arena, everything decoded below it is carved out
+   of the same arena, and freeing the top-level value drops the arena
+   as a whole instead of walking all of its elements.  */
+#define WIRE_ARENA_ALIGN	16
+#define WIRE_ARENA_MIN		512
+#define WIRE_ARENA_MAX		(64 * 1024)
+
+#define WIRE_ROUND(n) \
+  (((n) + WIRE_ARENA_ALIGN - 1) & ~(size_t) (WIRE_ARENA_ALIGN - 1))
+
+typedef struct WireChunk
+  {
+    struct WireChunk *next;
+  }
+WireChunk;
+
+struct WireArena
+  {
+    struct WireArena *next;	/* next live arena of this wire */
+    WireChunk *chunks;		/* chunks beyond the one holding the arena */
+    char *curr;
+    char *end;
+    size_t chunk_size;		/* size of the next chunk to allocate */
+    size_t used;		/* bytes handed out (for allocated_memory) */
+    void *first;		/* the top-level value owning this arena */
+  };
+
+#define WIRE_ARENA_HEAD		WIRE_ROUND (sizeof (struct WireArena))
+#define WIRE_CHUNK_HEAD		WIRE_ROUND (sizeof (WireChunk))
+
+static void *
+arena_take (struct WireArena *a, size_t size)
+{
+  WireChunk *c;
+  size_t csize;
+  void *p;
+
+  size = WIRE_ROUND (size);
+  if ((size_t) (a->end - a->curr) < size)
+    {
+      csize = a->chunk_size;
+      if (csize < size)
+	csize = size;
+      c = malloc (WIRE_CHUNK_HEAD + csize);
+      if (c == 0)
+	return 0;
+      c->next = a->chunks;
+      a->chunks = c;
+      a->curr = (char *) c + WIRE_CHUNK_HEAD;
+      a->end = a->curr + csize;
+      if (a->chunk_size < WIRE_ARENA_MAX)
+	a->chunk_size *= 2;
+    }
+  p = a->curr;
+  a->curr += size;
+  return p;
+}
+
+static void
+arena_destroy (struct WireArena *a)
+{
+  WireChunk *c, *next;
+
+  for (c = a->chunks; c; c = next)
+    {
+      next = c->next;
+      free (c);
+    }
+  free (a);
+}
+
+/* Allocate SIZE zeroed bytes for a value being decoded.  */
+static void *
+wire_alloc (Wire * w, size_t size)
+{
+  struct WireArena *a = w->arena.curr;
+  size_t csize;
+  void *p;
+
+  if (!w->arena.enabled)
+    {
+      p = malloc (size);
+      if (p == 0)
+	return 0;
+      memset (p, 0, size);
+      w->allocated_memory += size;
+      return p;
+    }
+
+  if (w->arena.depth == 0 || a == 0)
+    {
+      csize = WIRE_ROUND (size);
+      if (csize < WIRE_ARENA_MIN)
+	csize = WIRE_ARENA_MIN;
+      a = malloc (WIRE_ARENA_HEAD + csize);
+      if (a == 0)
+	return 0;
+      memset (a, 0, sizeof (*a));
+      a->curr = (char *) a + WIRE_ARENA_HEAD;
+      a->end = a->curr + csize;
+      a->chunk_size = 2 * WIRE_ARENA_MIN;
+      a->first = p = arena_take (a, size);
+      a->next = w->arena.live;
+      w->arena.live = a;
+      w->arena.curr = a;
+      DBG (4, "wire_alloc: new arena %p for %lu bytes\n", (void *) a,
+	   (u_long) size);
+    }
+  else
+    {
+      p = arena_take (a, size);
+      if (p == 0)
+	return 0;
+    }
+  memset (p, 0, size);
+  a->used += size;
+  w->allocated_memory += size;
+  return p;
+}
+
+/* Release the arena whose top-level value is V.  Returns 0 if V is not
+   the top-level value of a live arena.  */
+static int
+wire_release (Wire * w, void *v)
+{
+  struct WireArena **ap, *a;
+
+  for (ap = &w->arena.live; (a = *ap) != 0; ap = &a->next)
+    if (a->first == v)
+      {
+	*ap = a->next;
+	if (w->arena.curr == a)
+	  w->arena.curr = 0;
+	DBG (4, "wire_release: releasing arena %p (%lu bytes)\n", (void *) a,
+	     (u_long) a->used);
+	w->allocated_memory -= a->used;
+	arena_destroy (a);
+	return 1;
+      }
+  return 0;
+}
+
+/* Arrays of bytes, chars and words can be handed to the codec in one
+   go, if it supports that, and need no per-element work when freed.  */
+static WireBulkFunc
+bulk_func (Wire * w, WireCodecFunc w_element, size_t element_size)
+{
+  if (element_size == sizeof (SANE_Byte)
+      && (w_element == (WireCodecFunc) sanei_w_byte
+	  || w_element == (WireCodecFunc) sanei_w_char
+	  || w_element == w->codec.w_byte || w_element == w->codec.w_char))
+    return w->codec.w_bytes;
+  if (element_size == sizeof (SANE_Word)
+      && (w_element == (WireCodecFunc) sanei_w_word
+	  || w_element == w->codec.w_word))
+    return w->codec.w_words;
+  return 0;
+}
+
 void
 sanei_w_space (Wire * w, size_t howmuch)
 {
@@ -160,26 +320,39 @@ sanei_w_array (Wire * w, SANE_Word * len_ptr, void **v,
 	       WireCodecFunc w_element, size_t element_size)
 {
   SANE_Word len;
+  WireBulkFunc w_bulk;
   char *val;
   int i;
 
   DBG (3, "sanei_w_array: wire %d, elements of size %lu\n", w->io.fd,
        (u_long) element_size);
 
+  w_bulk = bulk_func (w, w_element, element_size);
+
   if (w->direction == WIRE_FREE)
     {
       if (*len_ptr && *v)
 	{
-	  DBG (4, "sanei_w_array: FREE: freeing array (%d elements)\n",
-	       *len_ptr);
-	  val = *v;
-	  for (i = 0; i < *len_ptr; ++i)
+	  if (w->arena.depth == 0 && wire_release (w, *v))
+	    DBG (4, "sanei_w_array: FREE: released array arena\n");
+	  else
 	    {
-	      (*w_element) (w, val);
-	      val += element_size;
+	      DBG (4, "sanei_w_array: FREE: freeing array (%d elements)\n",
+		   *len_ptr);
+	      if (!w_bulk)
+		{
+		  val = *v;
+		  ++w->arena.depth;
+		  for (i = 0; i < *len_ptr; ++i)
+		    {
+		      (*w_element) (w, val);
+		      val += element_size;
+		    }
+		  --w->arena.depth;
+		}
+	      free (*v);
+	      w->allocated_memory -= (*len_ptr * element_size);
 	    }
-	  free (*v);
-	  w->allocated_memory -= (*len_ptr * element_size);
 	}
       else
 	DBG (1, "sanei_w_array: FREE: tried to free array but *len_ptr or *v "
@@ -217,7 +390,7 @@ sanei_w_array (Wire * w, SANE_Word * len_ptr, void **v,
 	      w->status = ENOMEM;
 	      return;
 	    }
-	  *v = malloc (len * element_size);
+	  *v = wire_alloc (w, len * element_size);
 	  if (*v == 0)
 	    {
 	      /* Malloc failed, so return an error. */
@@ -225,15 +398,23 @@ sanei_w_array (Wire * w, SANE_Word * len_ptr, void **v,
 	      w->status = ENOMEM;
 	      return;
 	    }
-	  memset (*v, 0, len * element_size);
-	  w->allocated_memory += (len * element_size);
 	}
       else
 	*v = 0;
     }
 
   val = *v;
+  if (w_bulk && len > 0)
+    {
+      DBG (4, "sanei_w_array: transferring %d elements in bulk\n", len);
+      (*w_bulk) (w, val, len);
+      if (w->status)
+	DBG (1, "sanei_w_array: bad status: %d\n", w->status);
+      return;
+    }
+
   DBG (4, "sanei_w_array: transferring array elements\n");
+  ++w->arena.depth;
   for (i = 0; i < len; ++i)
     {
       (*w_element) (w, val);
@@ -241,9 +422,10 @@ sanei_w_array (Wire * w, SANE_Word * len_ptr, void **v,
       if (w->status)
 	{
 	  DBG (1, "sanei_w_array: bad status: %d\n", w->status);
-	  return;
+	  break;
 	}
     }
+  --w->arena.depth;
   DBG (4, "sanei_w_array: done\n");
 }
 
@@ -259,10 +441,17 @@ sanei_w_ptr (Wire * w, void **v, WireCodecFunc w_value, size_t value_size)
     {
       if (*v && value_size)
 	{
-	  DBG (4, "sanei_w_ptr: FREE: freeing value\n");
-	  (*w_value) (w, *v);
-	  free (*v);
-	  w->allocated_memory -= value_size;
+	  if (w->arena.depth == 0 && wire_release (w, *v))
+	    DBG (4, "sanei_w_ptr: FREE: released value arena\n");
+	  else
+	    {
+	      DBG (4, "sanei_w_ptr: FREE: freeing value\n");
+	      ++w->arena.depth;
+	      (*w_value) (w, *v);
+	      --w->arena.depth;
+	      free (*v);
+	      w->allocated_memory -= value_size;
+	    }
 	}
       else
 	DBG (1, "sanei_w_ptr: FREE: tried to free value but *v or value_size "
@@ -297,7 +486,7 @@ sanei_w_ptr (Wire * w, void **v, WireCodecFunc w_value, size_t value_size)
 	      return;
 	    }
 
-	  *v = malloc (value_size);
+	  *v = wire_alloc (w, value_size);
 	  if (*v == 0)
 	    {
 	      /* Malloc failed, so return an error. */
@@ -305,10 +494,10 @@ sanei_w_ptr (Wire * w, void **v, WireCodecFunc w_value, size_t value_size)
 	      w->status = ENOMEM;
 	      return;
 	    }
-	  w->allocated_memory += value_size;
-	  memset (*v, 0, value_size);
 	}
+      ++w->arena.depth;
       (*w_value) (w, *v);
+      --w->arena.depth;
     }
   else if (w->direction == WIRE_DECODE)
     *v = 0;
@@ -589,6 +778,7 @@ sanei_w_set_dir (Wire * w, WireDirection dir)
 	 (u_long) (w->buffer.end - w->buffer.curr));
   flush (w);
   w->direction = dir;
+  w->arena.depth = 0;
   DBG (4, "sanei_w_set_dir: direction changed\n");
   flush (w);
   DBG (3, "sanei_w_set_dir: wire %d, new direction WIRE_%s\n", w->io.fd, 
@@ -644,6 +834,7 @@ sanei_w_free (Wire * w, WireCodecFunc w_reply, void *reply)
   DBG (3, "sanei_w_free: wire %d\n", w->io.fd);
 
   w->direction = WIRE_FREE;
+  w->arena.depth = 0;
   (*w_reply) (w, reply);
   w->direction = saved_dir;
 
@@ -672,6 +863,12 @@ sanei_w_init (Wire * w, void (*codec_init_func) (Wire *))
 
   w->buffer.curr = w->buffer.start;
   w->buffer.end = w->buffer.start + w->buffer.size;
+  w->arena.enabled = 0;
+  w->arena.depth = 0;
+  w->arena.live = 0;
+  w->arena.curr = 0;
+  w->codec.w_bytes = 0;
+  w->codec.w_words = 0;
   if (codec_init_func != 0)
     {
       DBG (4, "sanei_w_init: initializing codec\n");
@@ -692,5 +889,7 @@ sanei_w_exit (Wire * w)
     }
   w->buffer.start = 0;
   w->buffer.size = 0;
+  while (w->arena.live)
+    wire_release (w, w->arena.live->first);
   DBG (4, "sanei_w_exit: done\n");
 }
@@ -0,0 +1,810 @@
+#include "../include/sane/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <math.h>
+
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/sane/sanei_magic.h"
+
+/* The window walk sanei_magic_despeck() used before it kept running
+   minimums.  Its output is the reference.  */
+static void
+despeck_reference (SANE_Parameters * params, SANE_Byte * buffer, int diam)
+{
+  int pw = params->pixels_per_line;
+  int bw = params->bytes_per_line;
+  int h = params->lines;
+  int bt = bw * h;
+  int i, j, k, l, n;
+
+  if (params->format == SANE_FRAME_RGB)
+    {
+      for (i = bw; i < bt - bw - (bw * diam); i += bw)
+	for (j = 1; j < pw - 1 - diam; j++)
+	  {
+	    int thresh = 255 * 3;
+	    int outer[] = { 0, 0, 0 };
+	    int hits = 0;
+
+	    for (k = 0; k < diam; k++)
+	      for (l = 0; l < diam; l++)
+		{
+		  int tmp = 0;
+		  for (n = 0; n < 3; n++)
+		    tmp += buffer[i + j * 3 + k * bw + l * 3 + n];
+		  if (tmp < thresh)
+		    thresh = tmp;
+		}
+	    thresh = (thresh + 255 * 3 + 255 * 3) / 3;
+
+	    for (k = -1; k < diam + 1; k++)
+	      for (l = -1; l < diam + 1; l++)
+		{
+		  int tmp[3];
+		  if (k != -1 && k != diam && l != -1 && l != diam)
+		    continue;
+		  for (n = 0; n < 3; n++)
+		    {
+		      tmp[n] = buffer[i + j * 3 + k * bw + l * 3 + n];
+		      outer[n] += tmp[n];
+		    }
+		  if (tmp[0] + tmp[1] + tmp[2] < thresh)
+		    {
+		      hits++;
+		      break;
+		    }
+		}
+
+	    if (!hits)
+	      {
+		for (n = 0; n < 3; n++)
+		  outer[n] /= (4 * diam + 4);
+		for (k = 0; k < diam; k++)
+		  for (l = 0; l < diam; l++)
+		    for (n = 0; n < 3; n++)
+		      buffer[i + j * 3 + k * bw + l * 3 + n] = outer[n];
+	      }
+	  }
+    }
+  else if (params->depth == 8)
+    {
+      for (i = bw; i < bt - bw - (bw * diam); i += bw)
+	for (j = 1; j < pw - 1 - diam; j++)
+	  {
+	    int thresh = 255;
+	    int outer = 0;
+	    int hits = 0;
+
+	    for (k = 0; k < diam; k++)
+	      for (l = 0; l < diam; l++)
+		if (buffer[i + j + k * bw + l] < thresh)
+		  thresh = buffer[i + j + k * bw + l];
+	    thresh = (thresh + 255 + 255) / 3;
+
+	    for (k = -1; k < diam + 1; k++)
+	      for (l = -1; l < diam + 1; l++)
+		{
+		  int tmp;
+		  if (k != -1 && k != diam && l != -1 && l != diam)
+		    continue;
+		  tmp = buffer[i + j + k * bw + l];
+		  if (tmp < thresh)
+		    {
+		      hits++;
+		      break;
+		    }
+		  outer += tmp;
+		}
+
+	    if (!hits)
+	      {
+		outer /= (4 * diam + 4);
+		for (k = 0; k < diam; k++)
+		  for (l = 0; l < diam; l++)
+		    buffer[i + j + k * bw + l] = outer;
+	      }
+	  }
+    }
+  else
+    {
+      for (i = bw; i < bt - bw - (bw * diam); i += bw)
+	for (j = 1; j < pw - 1 - diam; j++)
+	  {
+	    int curr = 0;
+	    int hits = 0;
+
+	    for (k = 0; k < diam; k++)
+	      for (l = 0; l < diam; l++)
+		curr += buffer[i + k * bw + (j + l) / 8] >> (7 - (j + l) % 8) & 1;
+	    if (!curr)
+	      continue;
+
+	    for (k = -1; k < diam + 1; k++)
+	      for (l = -1; l < diam + 1; l++)
+		{
+		  if (k != -1 && k != diam && l != -1 && l != diam)
+		    continue;
+		  hits += buffer[i + k * bw + (j + l) / 8] >> (7 - (j + l) % 8) & 1;
+		  if (hits)
+		    break;
+		}
+
+	    if (!hits)
+	      for (k = 0; k < diam; k++)
+		for (l = 0; l < diam; l++)
+		  buffer[i + k * bw + (j + l) / 8] &= ~(1 << (7 - (j + l) % 8));
+	  }
+    }
+}
+
+/* The floating point rotation sanei_magic_rotate() used before it
+   stepped through the rows in fixed point.  */
+static void
+rotate_reference (SANE_Parameters * params, SANE_Byte * buffer,
+		  int centerX, int centerY, double slope, int bg_color)
+{
+  double slopeRad = -atan (slope);
+  double slopeSin = sin (slopeRad);
+  double slopeCos = cos (slopeRad);
+  int pwidth = params->pixels_per_line;
+  int bwidth = params->bytes_per_line;
+  int height = params->lines;
+  int depth = (params->format == SANE_FRAME_RGB) ? 3 : 1;
+  SANE_Byte *outbuf;
+  int i, j, k;
+
+  outbuf = malloc (bwidth * height);
+  if (!outbuf)
+    return;
+  if (params->depth == 1 && bg_color)
+    bg_color = 0xff;
+  memset (outbuf, bg_color, bwidth * height);
+
+  for (i = 0; i < height; i++)
+    {
+      int shiftY = centerY - i;
+
+      for (j = 0; j < pwidth; j++)
+	{
+	  int shiftX = centerX - j;
+	  int sourceX, sourceY;
+
+	  sourceX = centerX - (int) (shiftX * slopeCos + shiftY * slopeSin);
+	  if (sourceX < 0 || sourceX >= pwidth)
+	    continue;
+	  sourceY = centerY + (int) (-shiftY * slopeCos + shiftX * slopeSin);
+	  if (sourceY < 0 || sourceY >= height)
+	    continue;
+
+	  if (params->depth == 1)
+	    {
+	      outbuf[i * bwidth + j / 8] &= ~(1 << (7 - (j % 8)));
+	      outbuf[i * bwidth + j / 8] |=
+		((buffer[sourceY * bwidth + sourceX / 8]
+		  >> (7 - (sourceX % 8))) & 1) << (7 - (j % 8));
+	    }
+	  else
+	    for (k = 0; k < depth; k++)
+	      outbuf[i * bwidth + j * depth + k]
+		= buffer[sourceY * bwidth + sourceX * depth + k];
+	}
+    }
+
+  memcpy (buffer, outbuf, bwidth * height);
+  free (outbuf);
+}
+
+/* The row loop sanei_magic_isBlank() used before it summed rows with
+   kernels.  */
+static SANE_Status
+blank_reference (SANE_Parameters * params, SANE_Byte * buffer,
+		 double thresh)
+{
+  double imagesum = 0;
+  int i, j;
+
+  thresh /= 100;
+  for (i = 0; i < params->lines; i++)
+    {
+      int rowsum = 0;
+      SANE_Byte *ptr = buffer + params->bytes_per_line * i;
+
+      if (params->depth == 1)
+	{
+	  for (j = 0; j < params->pixels_per_line; j++)
+	    rowsum += ptr[j / 8] >> (7 - (j % 8)) & 1;
+	  imagesum += (double) rowsum / params->pixels_per_line;
+	}
+      else
+	{
+	  for (j = 0; j < params->bytes_per_line; j++)
+	    rowsum += 255 - ptr[j];
+	  imagesum += (double) rowsum / params->bytes_per_line / 255;
+	}
+    }
+  if (imagesum / params->lines <= thresh)
+    return SANE_STATUS_NO_DOCS;
+  return SANE_STATUS_GOOD;
+}
+
+static unsigned long seed = 1;
+
+static int
+rnd (int n)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % n;
+}
+
+/* A page with white paper, noisy paper, a gray wedge, dark specks of
+   various sizes and some lines, so both replaced and kept spots
+   occur.  */
+static SANE_Byte *
+make_page (SANE_Parameters * params, SANE_Frame format, int depth,
+	   int width, int height)
+{
+  SANE_Byte *buffer;
+  int chans = (format == SANE_FRAME_RGB) ? 3 : 1;
+  int x, y, n, i;
+
+  params->format = format;
+  params->depth = depth;
+  params->pixels_per_line = width;
+  params->lines = height;
+  params->bytes_per_line = (depth == 1) ? (width + 7) / 8 : width * chans;
+  params->last_frame = SANE_TRUE;
+
+  buffer = malloc (params->bytes_per_line * height);
+  if (!buffer)
+    return NULL;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+	int v;
+
+	if (x < width / 3)
+	  v = 255;
+	else if (x < 2 * width / 3)
+	  v = 255 - rnd (24);
+	else
+	  v = 120 + (y * 135) / height;
+
+	if (depth == 1)
+	  {
+	    SANE_Byte *p = buffer + y * params->bytes_per_line + x / 8;
+	    if (rnd (200) == 0)
+	      *p |= 0x80 >> (x % 8);
+	    else
+	      *p &= ~(0x80 >> (x % 8));
+	  }
+	else
+	  for (n = 0; n < chans; n++)
+	    buffer[y * params->bytes_per_line + x * chans + n] =
+	      (v - rnd (4) * n) & 0xff;
+      }
+
+  /* specks and lines */
+  for (i = 0; i < width * height / 300; i++)
+    {
+      int size = 1 + rnd (5);
+      int x0 = rnd (width), y0 = rnd (height);
+      int dark = rnd (160);
+
+      if (rnd (10) == 0)
+	size = 1 + rnd (40);
+      for (y = y0; y < y0 + size && y < height; y++)
+	for (x = x0; x < x0 + (size > 5 ? 2 : size) && x < width; x++)
+	  {
+	    if (depth == 1)
+	      buffer[y * params->bytes_per_line + x / 8] |= 0x80 >> (x % 8);
+	    else
+	      for (n = 0; n < chans; n++)
+		buffer[y * params->bytes_per_line + x * chans + n] =
+		  dark + rnd (30) * n;
+	  }
+    }
+  return buffer;
+}
+
+static const char *simd[] = { "none", "sse2", "avx2" };
+
+static int
+test_page (SANE_Frame format, int depth, int width, int height, int diam)
+{
+  SANE_Parameters params;
+  SANE_Byte *page, *ref, *out;
+  size_t size;
+  int s, bad = 0;
+
+  page = make_page (&params, format, depth, width, height);
+  if (!page)
+    return 1;
+  size = params.bytes_per_line * height;
+  ref = malloc (size);
+  out = malloc (size);
+  if (!ref || !out)
+    return 1;
+
+  memcpy (ref, page, size);
+  despeck_reference (&params, ref, diam);
+
+  for (s = 0; s < (int) NELEMS (simd); s++)
+    {
+      setenv ("SANE_MAGIC_SIMD", simd[s], 1);
+      sanei_magic_init ();
+      memcpy (out, page, size);
+      if (sanei_magic_despeck (&params, out, diam) != SANE_STATUS_GOOD
+	  || memcmp (out, ref, size))
+	{
+	  fprintf (stderr, "despeck %s of %dx%d %s/%d, diam %d differs\n",
+		   simd[s], width, height,
+		   format == SANE_FRAME_RGB ? "color" : "gray", depth, diam);
+	  bad = 1;
+	}
+    }
+
+  free (page);
+  free (ref);
+  free (out);
+  return bad;
+}
+
+/* Nearly blank pages: paper with DOTS dark dots.  */
+static SANE_Byte *
+make_blankish (SANE_Parameters * params, SANE_Frame format, int depth,
+	       int width, int height, int dots)
+{
+  SANE_Byte *buffer;
+  int i;
+
+  buffer = make_page (params, format, depth, width, height);
+  if (!buffer)
+    return NULL;
+  memset (buffer, depth == 1 ? 0 : 255, params->bytes_per_line * height);
+  for (i = 0; i < dots; i++)
+    {
+      int x = rnd (width), y = rnd (height);
+
+      if (depth == 1)
+	buffer[y * params->bytes_per_line + x / 8] |= 0x80 >> (x % 8);
+      else
+	buffer[y * params->bytes_per_line + x * (format ==
+						 SANE_FRAME_RGB ? 3 : 1)] =
+	  rnd (256);
+    }
+  return buffer;
+}
+
+/* isBlank and a blank check fed in uneven pieces against the old row
+   loop, for every kernel set.  */
+static int
+test_blank (SANE_Frame format, int depth, int width, int height, int dots)
+{
+  static const double threshs[] = { 0, 0.01, 0.1, 0.5, 1, 5, 20, 50, 100 };
+  SANE_Parameters params;
+  SANE_Byte *page;
+  size_t size;
+  int s, t, bad = 0;
+
+  if (dots < 0)
+    page = make_page (&params, format, depth, width, height);
+  else
+    page = make_blankish (&params, format, depth, width, height, dots);
+  if (!page)
+    return 1;
+  size = params.bytes_per_line * height;
+
+  for (s = 0; s < (int) NELEMS (simd); s++)
+    {
+      setenv ("SANE_MAGIC_SIMD", simd[s], 1);
+      sanei_magic_init ();
+
+      for (t = 0; t < (int) NELEMS (threshs); t++)
+	{
+	  SANE_Status ref = blank_reference (&params, page, threshs[t]);
+	  SANE_Status whole, fed, early = SANE_STATUS_NO_DOCS;
+	  SANEI_Magic_Blank *blank;
+	  size_t done = 0;
+
+	  whole = sanei_magic_isBlank (&params, page, threshs[t]);
+
+	  if (sanei_magic_isBlankStart (&params, threshs[t], &blank)
+	      != SANE_STATUS_GOOD)
+	    return 1;
+	  while (done < size)
+	    {
+	      size_t len = 1 + rnd (3 * params.bytes_per_line);
+
+	      if (len > size - done)
+		len = size - done;
+	      early = sanei_magic_isBlankFeed (blank, page + done, len);
+	      if (early == SANE_STATUS_GOOD)
+		break;
+	      done += len;
+	    }
+	  fed = sanei_magic_isBlankFinish (blank);
+
+	  if (whole != ref || fed != ref
+	      || (early == SANE_STATUS_GOOD && ref != SANE_STATUS_GOOD))
+	    {
+	      fprintf (stderr, "isBlank %s of %dx%d %s/%d with %d dots at "
+		       "%g%%: %d, fed %d, old %d\n", simd[s], width, height,
+		       format == SANE_FRAME_RGB ? "color" : "gray", depth,
+		       dots, threshs[t], whole, fed, ref);
+	      bad = 1;
+	    }
+	}
+    }
+
+  free (page);
+  return bad;
+}
+
+/* A sheet of paper turned by SLOPE on a dark background, with some
+   print on it.  */
+static SANE_Byte *
+make_sheet (SANE_Parameters * params, SANE_Frame format, int depth,
+	    int width, int height, double slope)
+{
+  SANE_Byte *buffer;
+  int chans = (format == SANE_FRAME_RGB) ? 3 : 1;
+  double c = cos (atan (slope)), s = sin (atan (slope));
+  int x, y, n;
+
+  buffer = make_page (params, format, depth, width, height);
+  if (!buffer)
+    return NULL;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+	double dx = x - width / 2.0, dy = y - height / 2.0;
+	double u = dx * c + dy * s, v = -dx * s + dy * c;
+	int paper = fabs (u) < width * 0.4 && fabs (v) < height * 0.4;
+	int value = paper ? 240 + rnd (16) : 20 + rnd (20);
+
+	if (paper && rnd (50) == 0)
+	  value = rnd (100);
+	if (depth == 1)
+	  {
+	    SANE_Byte *p = buffer + y * params->bytes_per_line + x / 8;
+	    if (value < 128)
+	      *p |= 0x80 >> (x % 8);
+	    else
+	      *p &= ~(0x80 >> (x % 8));
+	  }
+	else
+	  for (n = 0; n < chans; n++)
+	    buffer[y * params->bytes_per_line + x * chans + n] = value;
+      }
+  return buffer;
+}
+
+/* Feed PAGE to an edge search in uneven pieces.  */
+static SANEI_Magic_Edges *
+feed_edges (SANE_Parameters * params, SANE_Byte * page, SANE_Bool known)
+{
+  SANE_Parameters p = *params;
+  SANEI_Magic_Edges *edges;
+  size_t size = params->bytes_per_line * params->lines, done = 0;
+
+  if (!known)
+    p.lines = -1;
+  if (sanei_magic_edgesStart (&p, &edges) != SANE_STATUS_GOOD)
+    return NULL;
+  while (done < size)
+    {
+      size_t len = 1 + rnd (5 * params->bytes_per_line);
+
+      if (len > size - done)
+	len = size - done;
+      if (sanei_magic_edgesFeed (edges, page + done, len)
+	  != SANE_STATUS_GOOD)
+	{
+	  sanei_magic_edgesFinish (edges);
+	  return NULL;
+	}
+      done += len;
+    }
+  return edges;
+}
+
+/* findEdges and findSkew against the fed edge search.  */
+static int
+test_edges (SANE_Frame format, int depth, int width, int height,
+	    double slope, SANE_Bool known)
+{
+  SANE_Parameters params;
+  SANEI_Magic_Edges *edges;
+  SANE_Byte *page;
+  SANE_Status ret[2];
+  int e[2][4], cx[2], cy[2];
+  double sl[2];
+  int bad = 0;
+
+  page = make_sheet (&params, format, depth, width, height, slope);
+  if (!page)
+    return 1;
+
+  memset (e, 0, sizeof (e));
+  ret[0] = sanei_magic_findEdges (&params, page, 150, 100,
+				  &e[0][0], &e[0][1], &e[0][2], &e[0][3]);
+  edges = feed_edges (&params, page, known);
+  if (!edges)
+    return 1;
+  ret[1] = sanei_magic_edgesFind (edges, 150, 100,
+				  &e[1][0], &e[1][1], &e[1][2], &e[1][3]);
+  sanei_magic_edgesFinish (edges);
+  if (ret[0] != ret[1] || (ret[0] == SANE_STATUS_GOOD
+			   && memcmp (e[0], e[1], sizeof (e[0]))))
+    {
+      fprintf (stderr, "edges of %dx%d %s/%d at %g: %d %d,%d,%d,%d, "
+	       "fed %d %d,%d,%d,%d\n", width, height,
+	       format == SANE_FRAME_RGB ? "color" : "gray", depth, slope,
+	       ret[0], e[0][0], e[0][1], e[0][2], e[0][3],
+	       ret[1], e[1][0], e[1][1], e[1][2], e[1][3]);
+      bad = 1;
+    }
+
+  cx[0] = cx[1] = cy[0] = cy[1] = 0;
+  sl[0] = sl[1] = 0;
+  ret[0] = sanei_magic_findSkew (&params, page, 150, 100,
+				 &cx[0], &cy[0], &sl[0]);
+  edges = feed_edges (&params, page, known);
+  if (!edges)
+    return 1;
+  ret[1] = sanei_magic_edgesSkew (edges, 150, 100, &cx[1], &cy[1], &sl[1]);
+  sanei_magic_edgesFinish (edges);
+  if (ret[0] != ret[1] || (ret[0] == SANE_STATUS_GOOD
+			   && (cx[0] != cx[1] || cy[0] != cy[1]
+			       || sl[0] != sl[1])))
+    {
+      fprintf (stderr, "skew of %dx%d %s/%d at %g: %d %d,%d,%g, "
+	       "fed %d %d,%d,%g\n", width, height,
+	       format == SANE_FRAME_RGB ? "color" : "gray", depth, slope,
+	       ret[0], cx[0], cy[0], sl[0], ret[1], cx[1], cy[1], sl[1]);
+      bad = 1;
+    }
+
+  free (page);
+  return bad;
+}
+
+/* Rotate pages the same way backends do, reusing one scratch buffer.  */
+static int
+test_rotate (SANE_Frame format, int depth, int width, int height)
+{
+  static const double slopes[] = { 0, 0.001, -0.01, 0.0523, -0.3, 1.7 };
+  static SANE_Byte *scratch = NULL;
+  static size_t scratch_size = 0;
+  SANE_Parameters params;
+  SANE_Byte *page, *ref, *out;
+  size_t size;
+  int s, c, bad = 0;
+
+  page = make_page (&params, format, depth, width, height);
+  if (!page)
+    return 1;
+  size = params.bytes_per_line * height;
+  ref = malloc (size);
+  out = malloc (size);
+  if (!ref || !out)
+    return 1;
+
+  for (s = 0; s < (int) NELEMS (slopes); s++)
+    for (c = 0; c < 3; c++)
+      {
+	int centerX = (c == 0) ? width / 2 : (c == 1) ? -width / 3 : 7;
+	int centerY = (c == 0) ? height / 2 : (c == 1) ? height + 40 : 3;
+	int bg = c & 1;
+
+	memcpy (ref, page, size);
+	rotate_reference (&params, ref, centerX, centerY, slopes[s], bg);
+	memcpy (out, page, size);
+	if (sanei_magic_rotate2 (&params, out, centerX, centerY, slopes[s],
+				 bg, &scratch, &scratch_size)
+	    != SANE_STATUS_GOOD || memcmp (out, ref, size))
+	  {
+	    fprintf (stderr, "rotate of %dx%d %s/%d by %g around %d,%d "
+		     "differs\n", width, height,
+		     format == SANE_FRAME_RGB ? "color" : "gray", depth,
+		     slopes[s], centerX, centerY);
+	    bad = 1;
+	  }
+      }
+
+  free (page);
+  free (ref);
+  free (out);
+  return bad;
+}
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Time the reference and every kernel set on a letter/A4 sized page.  */
+static void
+benchmark (int dpi, int diam)
+{
+  static const SANE_Frame formats[] = { SANE_FRAME_RGB, SANE_FRAME_GRAY,
+    SANE_FRAME_GRAY };
+  static const int depths[] = { 8, 8, 1 };
+  SANE_Parameters params;
+  SANE_Byte *page, *out;
+  size_t size;
+  double start, reference;
+  int f, s, blank;
+
+  for (f = 0; f < (int) NELEMS (formats); f++)
+    {
+      page = make_page (&params, formats[f], depths[f], dpi * 827 / 100,
+			dpi * 1169 / 100);
+      if (!page)
+	return;
+      size = params.bytes_per_line * params.lines;
+      out = malloc (size);
+      if (!out)
+	return;
+
+      memcpy (out, page, size);
+      start = now ();
+      despeck_reference (&params, out, diam);
+      reference = now () - start;
+      printf ("%s/%d %dx%d diam %d: reference %.3f s",
+	      formats[f] == SANE_FRAME_RGB ? "color" : "gray", depths[f],
+	      params.pixels_per_line, params.lines, diam, reference);
+
+      for (s = 0; s < (int) NELEMS (simd); s++)
+	{
+	  setenv ("SANE_MAGIC_SIMD", simd[s], 1);
+	  sanei_magic_init ();
+	  memcpy (out, page, size);
+	  start = now ();
+	  sanei_magic_despeck (&params, out, diam);
+	  printf (", %s %.3f s", simd[s], now () - start);
+	}
+      printf ("\n");
+
+      memcpy (out, page, size);
+      start = now ();
+      rotate_reference (&params, out, params.pixels_per_line / 2,
+			params.lines / 2, 0.02, 0);
+      reference = now () - start;
+      memcpy (out, page, size);
+      start = now ();
+      sanei_magic_rotate (&params, out, params.pixels_per_line / 2,
+			  params.lines / 2, 0.02, 0);
+      printf ("%s/%d rotate: reference %.3f s, now %.3f s\n",
+	      formats[f] == SANE_FRAME_RGB ? "color" : "gray", depths[f],
+	      reference, now () - start);
+
+      memset (out, depths[f] == 1 ? 0 : 255, size);
+      start = now ();
+      blank = blank_reference (&params, out, 1);
+      reference = now () - start;
+      start = now ();
+      blank += sanei_magic_isBlank (&params, out, 1);
+      printf ("%s/%d isBlank: reference %.4f s, now %.4f s%s\n",
+	      formats[f] == SANE_FRAME_RGB ? "color" : "gray", depths[f],
+	      reference, now () - start, blank ? "" : " (not blank?)");
+      free (out);
+      free (page);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  static const int sizes[][2] = { {1, 1}, {4, 4}, {7, 9}, {33, 20},
+  {61, 47}, {200, 150}
+  };
+  /* lineart widths are whole bytes, which findEdges expects */
+  static const int sheets[][2] = { {8, 1}, {16, 10}, {40, 17}, {64, 18},
+  {64, 19}, {200, 37}, {400, 300}, {824, 1100}
+  };
+  static const double slopes[] = { 0, 0.02, -0.05, 0.2 };
+  /* -1 for a busy page */
+  static const int dots[] = { -1, 0, 1, 10, 100, 1000 };
+  int i, d, diam, failed = 0, count = 0;
+
+  if (argc > 1 && !strncmp (argv[1], "--benchmark", 11))
+    {
+      int dpi = 300, d = 3;
+
+      if (argv[1][11] == '=')
+	dpi = atoi (argv[1] + 12);
+      if (argc > 2)
+	d = atoi (argv[2]);
+      benchmark (dpi, d);
+      return 0;
+    }
+
+  for (i = 0; i < (int) NELEMS (sizes); i++)
+    for (diam = 0; diam <= 9; diam++)
+      {
+	failed += test_page (SANE_FRAME_RGB, 8, sizes[i][0], sizes[i][1],
+			     diam);
+	failed += test_page (SANE_FRAME_GRAY, 8, sizes[i][0], sizes[i][1],
+			     diam);
+	failed += test_page (SANE_FRAME_GRAY, 1, sizes[i][0], sizes[i][1],
+			     diam);
+	count += 3;
+      }
+
+  if (failed)
+    {
+      fprintf (stderr, "%d of %d despeck tests failed\n", failed, count);
+      return 1;
+    }
+  printf ("%d despeck tests successful\n", count);
+
+  count = 0;
+  for (i = 0; i < (int) NELEMS (sizes); i++)
+    {
+      failed += test_rotate (SANE_FRAME_RGB, 8, sizes[i][0], sizes[i][1]);
+      failed += test_rotate (SANE_FRAME_GRAY, 8, sizes[i][0], sizes[i][1]);
+      failed += test_rotate (SANE_FRAME_GRAY, 1, sizes[i][0], sizes[i][1]);
+      count += 3;
+    }
+  failed += test_rotate (SANE_FRAME_GRAY, 8, 2000, 1500);
+  failed += test_rotate (SANE_FRAME_GRAY, 1, 2000, 1500);
+  count += 2;
+
+  if (failed)
+    {
+      fprintf (stderr, "%d of %d rotate tests failed\n", failed, count);
+      return 1;
+    }
+  printf ("%d rotate tests successful\n", count);
+
+  count = 0;
+  for (i = 0; i < (int) NELEMS (sizes); i++)
+    for (d = 0; d < (int) NELEMS (dots); d++)
+      {
+	failed += test_blank (SANE_FRAME_RGB, 8, sizes[i][0], sizes[i][1],
+			      dots[d]);
+	failed += test_blank (SANE_FRAME_GRAY, 8, sizes[i][0], sizes[i][1],
+			      dots[d]);
+	failed += test_blank (SANE_FRAME_GRAY, 1, sizes[i][0], sizes[i][1],
+			      dots[d]);
+	count += 3;
+      }
+
+  if (failed)
+    {
+      fprintf (stderr, "%d of %d isBlank tests failed\n", failed, count);
+      return 1;
+    }
+  printf ("%d isBlank tests successful\n", count);
+
+  count = 0;
+  for (i = 0; i < (int) NELEMS (sheets); i++)
+    for (d = 0; d < (int) NELEMS (slopes); d++)
+      {
+	failed += test_edges (SANE_FRAME_RGB, 8, sheets[i][0], sheets[i][1],
+			      slopes[d], i & 1);
+	failed += test_edges (SANE_FRAME_GRAY, 8, sheets[i][0], sheets[i][1],
+			      slopes[d], !(i & 1));
+	failed += test_edges (SANE_FRAME_GRAY, 1, sheets[i][0], sheets[i][1],
+			      slopes[d], i & 1);
+	count += 3;
+      }
+
+  if (failed)
+    {
+      fprintf (stderr, "%d of %d edge tests failed\n", failed, count);
+      return 1;
+    }
+  printf ("%d edge tests successful\n", count);
+  return 0;
+}
@@ -0,0 +1,305 @@
+#include "../include/sane/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#include <sys/time.h>
+
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/sane/sanei_thread.h"
+
+/* What the reader task sends: TOTAL bytes of a known pattern (endlessly
+   if TOTAL is 0) in pieces of CHUNK bytes, after DELAY microseconds,
+   then it returns STATUS. */
+typedef struct
+{
+  SANEI_Thread_Ring *ring;
+  size_t total;
+  size_t chunk;
+  long delay;
+  SANE_Status status;
+}
+Job;
+
+static SANE_Byte
+pattern (size_t i)
+{
+  return (SANE_Byte) (i * 7 + (i >> 9));
+}
+
+static int
+task (void *arg)
+{
+  Job *job = arg;
+  SANE_Byte *buffer;
+  SANE_Status status = SANE_STATUS_GOOD;
+  size_t sent = 0, n, i;
+
+  buffer = malloc (job->chunk);
+  if (!buffer)
+    return SANE_STATUS_NO_MEM;
+  if (job->delay)
+    usleep (job->delay);
+  while (!job->total || sent < job->total)
+    {
+      n = job->chunk;
+      if (job->total && n > job->total - sent)
+	n = job->total - sent;
+      for (i = 0; i < n; ++i)
+	buffer[i] = pattern (sent + i);
+      status = sanei_thread_ring_write (job->ring, buffer, n);
+      if (status != SANE_STATUS_GOOD)
+	break;
+      sent += n;
+    }
+  free (buffer);
+  return status != SANE_STATUS_GOOD ? status : job->status;
+}
+
+/* Reads until the end in pieces of CHUNK bytes and checks the data.
+   Returns the number of bytes read or -1. */
+static long
+drain (SANEI_Thread_Ring * ring, size_t chunk, SANE_Status * last)
+{
+  SANE_Byte *buffer;
+  SANE_Status status;
+  size_t got, total = 0, i;
+
+  buffer = malloc (chunk);
+  if (!buffer)
+    return -1;
+  while ((status = sanei_thread_ring_read (ring, buffer, chunk, &got))
+	 == SANE_STATUS_GOOD)
+    {
+      for (i = 0; i < got; ++i)
+	if (buffer[i] != pattern (total + i))
+	  {
+	    fprintf (stderr, "wrong byte at offset %lu\n",
+		     (unsigned long) (total + i));
+	    free (buffer);
+	    return -1;
+	  }
+      total += got;
+    }
+  free (buffer);
+  *last = status;
+  return total;
+}
+
+static int
+test_stream (size_t size, size_t total, size_t chunk, size_t read_chunk)
+{
+  SANEI_Thread_Ring *ring;
+  SANE_Status last = SANE_STATUS_GOOD;
+  Job job;
+  long got = -1;
+
+  if (sanei_thread_ring_new (size, &ring) != SANE_STATUS_GOOD)
+    return 1;
+  memset (&job, 0, sizeof (job));
+  job.ring = ring;
+  job.total = total;
+  job.chunk = chunk;
+  job.status = SANE_STATUS_GOOD;
+  if (sanei_thread_ring_start (ring, task, &job) == SANE_STATUS_GOOD)
+    got = drain (ring, read_chunk, &last);
+  sanei_thread_ring_free (ring);
+
+  if (got != (long) total || last != SANE_STATUS_EOF)
+    {
+      fprintf (stderr, "%lu bytes through a ring of %lu, written by %lu, "
+	       "read by %lu: got %ld bytes, status %d\n",
+	       (unsigned long) total, (unsigned long) size,
+	       (unsigned long) chunk, (unsigned long) read_chunk, got,
+	       (int) last);
+      return 1;
+    }
+  return 0;
+}
+
+/* The task fails: its data arrives, then its status sticks. */
+static int
+test_error (void)
+{
+  SANEI_Thread_Ring *ring;
+  SANE_Status last = SANE_STATUS_GOOD;
+  SANE_Byte buffer[16];
+  size_t size;
+  Job job;
+  long got = -1;
+  int bad = 0;
+
+  if (sanei_thread_ring_new (4096, &ring) != SANE_STATUS_GOOD)
+    return 1;
+  memset (&job, 0, sizeof (job));
+  job.ring = ring;
+  job.total = 10000;
+  job.chunk = 1000;
+  job.status = SANE_STATUS_JAMMED;
+  if (sanei_thread_ring_start (ring, task, &job) == SANE_STATUS_GOOD)
+    got = drain (ring, 3000, &last);
+  if (got != 10000 || last != SANE_STATUS_JAMMED
+      || sanei_thread_ring_read (ring, buffer, sizeof (buffer), &size)
+      != SANE_STATUS_JAMMED)
+    {
+      fprintf (stderr, "failing task: got %ld bytes, status %d\n", got,
+	       (int) last);
+      bad = 1;
+    }
+  sanei_thread_ring_free (ring);
+  return bad;
+}
+
+/* Many pages through one ring, each stopped in the middle or read to
+   the end. */
+static int
+test_pages (void)
+{
+  SANEI_Thread_Ring *ring;
+  SANE_Status last;
+  SANE_Byte buffer[1000];
+  size_t size;
+  Job job;
+  int page, bad = 0;
+
+  if (sanei_thread_ring_new (8192, &ring) != SANE_STATUS_GOOD)
+    return 1;
+  memset (&job, 0, sizeof (job));
+  job.ring = ring;
+  job.chunk = 3000;
+  job.status = SANE_STATUS_GOOD;
+
+  for (page = 0; page < 20 && !bad; ++page)
+    {
+      job.total = (page % 2) ? 50000 : 0;
+      if (sanei_thread_ring_start (ring, task, &job) != SANE_STATUS_GOOD)
+	{
+	  fprintf (stderr, "page %d didn't start\n", page);
+	  bad = 1;
+	  break;
+	}
+      if (sanei_thread_ring_start (ring, task, &job) != SANE_STATUS_INVAL)
+	bad = 1, fprintf (stderr, "second task started\n");
+
+      if (job.total)
+	{
+	  if (drain (ring, 777, &last) != 50000 || last != SANE_STATUS_EOF)
+	    bad = 1, fprintf (stderr, "page %d incomplete\n", page);
+	}
+      else
+	{
+	  /* endless, stop after a few reads */
+	  if (sanei_thread_ring_read (ring, buffer, sizeof (buffer), &size)
+	      != SANE_STATUS_GOOD || size == 0 || buffer[0] != pattern (0))
+	    bad = 1, fprintf (stderr, "page %d: read failed\n", page);
+	}
+      sanei_thread_ring_stop (ring);
+    }
+  sanei_thread_ring_free (ring);
+  return bad;
+}
+
+/* Non-blocking reads and the select fd. */
+static int
+test_select (void)
+{
+  SANEI_Thread_Ring *ring;
+  SANE_Status last;
+  SANE_Byte buffer[100];
+  struct timeval timeout;
+  fd_set fds;
+  size_t size;
+  Job job;
+  int fd, bad = 0;
+
+  if (sanei_thread_ring_new (4096, &ring) != SANE_STATUS_GOOD)
+    return 1;
+  memset (&job, 0, sizeof (job));
+  job.ring = ring;
+  job.total = 100;
+  job.chunk = 100;
+  job.delay = 200000;
+  job.status = SANE_STATUS_GOOD;
+  if (sanei_thread_ring_start (ring, task, &job) != SANE_STATUS_GOOD
+      || sanei_thread_ring_set_io_mode (ring, SANE_TRUE) != SANE_STATUS_GOOD)
+    {
+      sanei_thread_ring_free (ring);
+      return 1;
+    }
+
+  size = 1;
+  if (sanei_thread_ring_read (ring, buffer, sizeof (buffer), &size)
+      != SANE_STATUS_GOOD || size != 0)
+    bad = 1, fprintf (stderr, "non-blocking read got data too early\n");
+
+  fd = sanei_thread_ring_get_select_fd (ring);
+  FD_ZERO (&fds);
+  FD_SET (fd, &fds);
+  timeout.tv_sec = 5;
+  timeout.tv_usec = 0;
+  if (select (fd + 1, &fds, 0, 0, &timeout) != 1)
+    bad = 1, fprintf (stderr, "select fd didn't become readable\n");
+  if (sanei_thread_ring_fill (ring) != 100)
+    bad = 1, fprintf (stderr, "%lu bytes waiting instead of 100\n",
+		      (unsigned long) sanei_thread_ring_fill (ring));
+
+  sanei_thread_ring_set_io_mode (ring, SANE_FALSE);
+  if (drain (ring, sizeof (buffer), &last) != 100 || last != SANE_STATUS_EOF)
+    bad = 1, fprintf (stderr, "data after select missing\n");
+
+  /* at the end the fd stays readable */
+  FD_ZERO (&fds);
+  FD_SET (fd, &fds);
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 0;
+  if (select (fd + 1, &fds, 0, 0, &timeout) != 1)
+    bad = 1, fprintf (stderr, "select fd not readable at the end\n");
+
+  sanei_thread_ring_free (ring);
+  return bad;
+}
+
+int
+main (void)
+{
+  static const size_t sizes[] = { 1, 100, 4096, 65536 };
+  static const size_t totals[] = { 1, 4095, 4096, 100000, 1000003 };
+  static const size_t chunks[] = { 1, 1000, 65536 };
+  int s, t, c, r;
+  int failed = 0, count = 0;
+
+  sanei_thread_init ();
+
+  for (s = 0; s < NELEMS (sizes); ++s)
+    for (t = 0; t < NELEMS (totals); ++t)
+      for (c = 0; c < NELEMS (chunks); ++c)
+	for (r = 0; r < NELEMS (chunks); ++r)
+	  {
+	    if ((chunks[c] == 1 || chunks[r] == 1 || sizes[s] == 1)
+		&& totals[t] > 4096)
+	      continue;
+	    failed += test_stream (sizes[s], totals[t], chunks[c], chunks[r]);
+	    count++;
+	  }
+  printf ("%d streams through a %s, %d failed\n", count,
+	  sanei_thread_is_forked ()? "pipe" : "ring", failed);
+
+  failed += test_error ();
+  failed += test_pages ();
+  failed += test_select ();
+  sanei_thread_pool_exit ();
+
+  if (failed)
+    {
+      fprintf (stderr, "%d thread ring tests failed\n", failed);
+      return 1;
+    }
+  printf ("thread ring tests successful\n");
+  return 0;
+}
@@ -0,0 +1,350 @@
+#include "../include/sane/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/sane/sanei_usb.h"
+
+/* A loopback device that sends TOTAL bytes of a known pattern (or
+   endlessly if TOTAL is 0) and checks the transfers it gets asked
+   for. */
+typedef struct
+{
+  size_t total;
+  size_t end;			/* stop sending here if not 0 */
+  size_t fail_at;		/* fail the transfer reaching this if not 0 */
+  size_t short_at;		/* end the transfer reaching this early, but
+				   go on sending afterwards */
+  size_t sent;
+  int transfers;
+  int overruns;			/* transfers asking for more than announced */
+  int odd_sizes;		/* transfers not a multiple of 512 other than
+				   a last one shorter than 512 bytes */
+  size_t last_size;
+}
+Fake;
+
+static SANE_Byte
+pattern (size_t i)
+{
+  return (SANE_Byte) (i * 7 + (i >> 9));
+}
+
+static SANE_Status
+fake_read (void *arg, SANE_Byte * buffer, size_t * size)
+{
+  Fake *fake = arg;
+  size_t n, i, limit;
+
+  fake->transfers++;
+  if (fake->last_size % 512)
+    fake->odd_sizes++;		/* an odd transfer that wasn't the last */
+  if (*size % 512 && *size > 512)
+    fake->odd_sizes++;
+  fake->last_size = *size;
+  if (fake->total && fake->sent + *size > fake->total)
+    fake->overruns++;
+
+  limit = fake->end ? fake->end : fake->total;
+  n = *size;
+  if (limit && n > limit - fake->sent)
+    n = limit - fake->sent;
+  if (fake->fail_at && fake->sent + n >= fake->fail_at)
+    return SANE_STATUS_IO_ERROR;
+  if (fake->short_at > fake->sent && fake->sent + n > fake->short_at)
+    n = fake->short_at - fake->sent;
+
+  for (i = 0; i < n; ++i)
+    buffer[i] = pattern (fake->sent + i);
+  fake->sent += n;
+  *size = n;
+  return SANE_STATUS_GOOD;
+}
+
+/* Reads the stream in pieces of CHUNK bytes until it ends and checks
+   the data.  Returns the number of bytes read or -1. */
+static long
+drain (SANE_Int dn, size_t chunk, SANE_Status * last)
+{
+  SANE_Byte *buffer;
+  SANE_Status status;
+  size_t got, total = 0, i;
+
+  buffer = malloc (chunk);
+  if (!buffer)
+    return -1;
+  for (;;)
+    {
+      got = chunk;
+      status = sanei_usb_stream_read (dn, buffer, &got);
+      if (status != SANE_STATUS_GOOD)
+	break;
+      for (i = 0; i < got; ++i)
+	if (buffer[i] != pattern (total + i))
+	  {
+	    fprintf (stderr, "wrong byte at offset %lu\n",
+		     (unsigned long) (total + i));
+	    free (buffer);
+	    return -1;
+	  }
+      total += got;
+      if (got < chunk)
+	{
+	  /* only at the end of the stream */
+	  got = chunk;
+	  status = sanei_usb_stream_read (dn, buffer, &got);
+	  if (status == SANE_STATUS_GOOD)
+	    {
+	      fprintf (stderr, "data after a short read\n");
+	      free (buffer);
+	      return -1;
+	    }
+	  break;
+	}
+    }
+  free (buffer);
+  *last = status;
+  return total;
+}
+
+static int
+test_stream (size_t total, size_t transfer_size, int transfers, size_t chunk)
+{
+  SANE_Status status, last;
+  SANE_Int dn;
+  Fake fake;
+  long got;
+
+  memset (&fake, 0, sizeof (fake));
+  fake.total = total;
+  if (sanei_usb_testing_open_loopback (fake_read, &fake, &dn)
+      != SANE_STATUS_GOOD)
+    return 1;
+
+  status = sanei_usb_stream_start (dn, total, transfer_size, transfers);
+  got = (status == SANE_STATUS_GOOD) ? drain (dn, chunk, &last) : -1;
+  sanei_usb_close (dn);
+
+  if (got != (long) total || last != SANE_STATUS_EOF || fake.overruns
+      || fake.odd_sizes || fake.sent != total)
+    {
+      fprintf (stderr, "stream of %lu bytes in %d x %lu, read by %lu: "
+	       "got %ld bytes, status %d, %d overruns, %d odd transfers\n",
+	       (unsigned long) total, transfers,
+	       (unsigned long) transfer_size, (unsigned long) chunk, got,
+	       (int) last, fake.overruns, fake.odd_sizes);
+      return 1;
+    }
+  return 0;
+}
+
+/* The device ends the data early. */
+static int
+test_short (SANE_Bool bounded)
+{
+  SANE_Status last = SANE_STATUS_GOOD;
+  SANE_Int dn;
+  Fake fake;
+  long got;
+
+  memset (&fake, 0, sizeof (fake));
+  fake.total = 100000;
+  fake.end = 70000;
+  if (sanei_usb_testing_open_loopback (fake_read, &fake, &dn)
+      != SANE_STATUS_GOOD)
+    return 1;
+  if (sanei_usb_stream_start (dn, bounded ? fake.total : 0, 8192, 4)
+      != SANE_STATUS_GOOD)
+    return 1;
+  got = drain (dn, 3000, &last);
+  sanei_usb_close (dn);
+
+  if (got != 70000 || last != SANE_STATUS_EOF)
+    {
+      fprintf (stderr, "short %s stream: got %ld bytes, status %d\n",
+	       bounded ? "bounded" : "unbounded", got, (int) last);
+      return 1;
+    }
+  return 0;
+}
+
+/* A transfer ends short in the middle of the data.  The stream ends
+   there, and plain bulk reads get the rest, like gl843_bulk_read_data()
+   does. */
+static int
+test_resume (void)
+{
+  static SANE_Byte buffer[100000];
+  SANE_Int dn;
+  size_t size, got, i;
+  Fake fake;
+  int bad = 0;
+
+  memset (&fake, 0, sizeof (fake));
+  fake.total = sizeof (buffer);
+  fake.short_at = 30000;
+  if (sanei_usb_testing_open_loopback (fake_read, &fake, &dn)
+      != SANE_STATUS_GOOD)
+    return 1;
+  if (sanei_usb_stream_start (dn, fake.total, 8192, 4) != SANE_STATUS_GOOD)
+    return 1;
+  got = sizeof (buffer);
+  if (sanei_usb_stream_read (dn, buffer, &got) != SANE_STATUS_GOOD)
+    got = 0;
+  sanei_usb_stream_stop (dn);
+  if (got != fake.short_at)
+    {
+      fprintf (stderr, "stream with a short transfer: got %lu bytes\n",
+	       (unsigned long) got);
+      bad = 1;
+    }
+
+  while (got < sizeof (buffer) && !bad)
+    {
+      size = sizeof (buffer) - got;
+      if (size > 8192)
+	size = 8192;
+      if (sanei_usb_read_bulk (dn, buffer + got, &size) != SANE_STATUS_GOOD)
+	bad = 1;
+      got += size;
+    }
+  for (i = 0; i < sizeof (buffer) && !bad; ++i)
+    if (buffer[i] != pattern (i))
+      {
+	fprintf (stderr, "resumed stream: wrong data at byte %lu\n",
+		 (unsigned long) i);
+	bad = 1;
+      }
+  sanei_usb_close (dn);
+  return bad;
+}
+
+/* A transfer fails: the data before it arrives, then the error
+   sticks. */
+static int
+test_error (void)
+{
+  SANE_Status last = SANE_STATUS_GOOD;
+  SANE_Byte buffer[16];
+  SANE_Int dn;
+  size_t size;
+  Fake fake;
+  long got;
+  int bad = 0;
+
+  memset (&fake, 0, sizeof (fake));
+  fake.total = 100000;
+  fake.fail_at = 50000;
+  if (sanei_usb_testing_open_loopback (fake_read, &fake, &dn)
+      != SANE_STATUS_GOOD)
+    return 1;
+  if (sanei_usb_stream_start (dn, fake.total, 4096, 3) != SANE_STATUS_GOOD)
+    return 1;
+  got = drain (dn, 1000, &last);
+  size = sizeof (buffer);
+  if (got != 49152 || last != SANE_STATUS_IO_ERROR
+      || sanei_usb_stream_read (dn, buffer, &size) != SANE_STATUS_IO_ERROR)
+    {
+      fprintf (stderr, "failing stream: got %ld bytes, status %d\n", got,
+	       (int) last);
+      bad = 1;
+    }
+  sanei_usb_close (dn);
+  return bad;
+}
+
+/* Misuse, stopping in the middle, restarting and plain bulk reads. */
+static int
+test_api (void)
+{
+  SANE_Byte buffer[1000];
+  SANE_Status last;
+  SANE_Int dn;
+  size_t size;
+  Fake fake;
+  int bad = 0;
+
+  memset (&fake, 0, sizeof (fake));
+  if (sanei_usb_testing_open_loopback (fake_read, &fake, &dn)
+      != SANE_STATUS_GOOD)
+    return 1;
+
+  if (sanei_usb_stream_async (dn))
+    bad = 1, fprintf (stderr, "loopback device streams asynchronously\n");
+  size = sizeof (buffer);
+  if (sanei_usb_stream_read (dn, buffer, &size) != SANE_STATUS_INVAL)
+    bad = 1, fprintf (stderr, "read without a stream succeeded\n");
+  if (sanei_usb_stream_start (dn, 0, 100, 4) != SANE_STATUS_INVAL)
+    bad = 1, fprintf (stderr, "transfers below 512 bytes accepted\n");
+
+  /* endless device, stop after a few reads */
+  if (sanei_usb_stream_start (dn, 0, 4096, 4) != SANE_STATUS_GOOD)
+    return 1;
+  if (sanei_usb_stream_start (dn, 0, 4096, 4) != SANE_STATUS_INVAL)
+    bad = 1, fprintf (stderr, "second stream accepted\n");
+  size = sizeof (buffer);
+  if (sanei_usb_stream_read (dn, buffer, &size) != SANE_STATUS_GOOD
+      || size != sizeof (buffer) || buffer[999] != pattern (999))
+    bad = 1, fprintf (stderr, "endless stream read failed\n");
+  sanei_usb_stream_stop (dn);
+
+  /* the transfers in flight are lost, the rest of the data follows */
+  fake.total = fake.sent + 5000;
+  size = sizeof (buffer);
+  if (sanei_usb_read_bulk (dn, buffer, &size) != SANE_STATUS_GOOD
+      || size != sizeof (buffer) || buffer[0] != pattern (fake.total - 5000))
+    bad = 1, fprintf (stderr, "bulk read after the stream failed\n");
+
+  fake.total = 0;
+  fake.sent = 0;
+  fake.end = 7000;
+  if (sanei_usb_stream_start (dn, 0, 1024, 2) != SANE_STATUS_GOOD
+      || drain (dn, 700, &last) != 7000 || last != SANE_STATUS_EOF)
+    bad = 1, fprintf (stderr, "restarted stream failed\n");
+  sanei_usb_close (dn);
+
+  return bad;
+}
+
+int
+main (void)
+{
+  static const size_t totals[] =
+    { 1, 511, 512, 513, 4096, 61440, 100000, 1000003 };
+  static const size_t sizes[] = { 512, 1000, 4096, 0xf000 };
+  static const int transfers[] = { 1, 4 };
+  static const size_t chunks[] = { 1, 100, 4096, 65536, 2000000 };
+  int t, s, n, c;
+  int failed = 0, count = 0;
+
+  sanei_usb_init ();
+
+  for (t = 0; t < NELEMS (totals); ++t)
+    for (s = 0; s < NELEMS (sizes); ++s)
+      for (n = 0; n < NELEMS (transfers); ++n)
+	for (c = 0; c < NELEMS (chunks); ++c)
+	  {
+	    if (chunks[c] == 1 && totals[t] > 100000)
+	      continue;
+	    failed += test_stream (totals[t], sizes[s], transfers[n],
+				   chunks[c]);
+	    count++;
+	  }
+  printf ("%d streams from a loopback device, %d failed\n", count, failed);
+
+  failed += test_short (SANE_TRUE);
+  failed += test_short (SANE_FALSE);
+  failed += test_resume ();
+  failed += test_error ();
+  failed += test_api ();
+
+  if (failed)
+    {
+      fprintf (stderr, "%d usb stream tests failed\n", failed);
+      return 1;
+    }
+  printf ("usb stream tests successful\n");
+  return 0;
+}
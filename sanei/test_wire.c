@@ -3,12 +3,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 #include <sys/fcntl.h>
 
 #include "../include/sane/sane.h"
 #include "../include/sane/sanei.h"
 #include "../include/sane/sanei_wire.h"
+#include "../include/sane/sanei_net.h"
 #include "../include/sane/sanei_codec_ascii.h"
 #include "../include/sane/sanei_codec_bin.h"
 
@@ -25,10 +27,358 @@ static SANE_String_Const mode_list[] =
     "Lineart", "Grayscale", "Color", 0
   };
 
+#define BIG_WORDS	5000
+#define BIG_STRING	20000
+#define BENCH_DESCS	64
+#define BENCH_WORDS	256
+#define LZ_DATA		5000
+
+static SANE_Word big_word_list[1 + BIG_WORDS];
+static char big_string[BIG_STRING];
+
 static char *program_name;
 static char *default_codec = "bin";
 static char *default_outfile = "test_wire.out";
 
+static int
+str_differ (SANE_String_Const a, SANE_String_Const b)
+{
+  if (!a || !b)
+    return a != b;
+  return strcmp (a, b) != 0;
+}
+
+static int
+descs_differ (SANE_Option_Descriptor *a, SANE_Option_Descriptor *b,
+	      SANE_Word len)
+{
+  SANE_Word i, j;
+
+  for (i = 0; i < len; ++i, ++a, ++b)
+    {
+      if (str_differ (a->name, b->name) || str_differ (a->title, b->title)
+	  || str_differ (a->desc, b->desc) || a->type != b->type
+	  || a->unit != b->unit || a->size != b->size || a->cap != b->cap
+	  || a->constraint_type != b->constraint_type)
+	return 1;
+      switch (a->constraint_type)
+	{
+	case SANE_CONSTRAINT_WORD_LIST:
+	  for (j = 0; j <= a->constraint.word_list[0]; ++j)
+	    if (a->constraint.word_list[j] != b->constraint.word_list[j])
+	      return 1;
+	  break;
+	case SANE_CONSTRAINT_STRING_LIST:
+	  for (j = 0; a->constraint.string_list[j]; ++j)
+	    if (str_differ (a->constraint.string_list[j],
+			    b->constraint.string_list[j]))
+	      return 1;
+	  if (b->constraint.string_list[j])
+	    return 1;
+	  break;
+	default:
+	  break;
+	}
+    }
+  return 0;
+}
+
+/* Encode LEN descriptors to the output file, decode them again, compare
+   and free them.  Returns the number of bytes on the wire or -1.  */
+static long
+round_trip (SANE_Option_Descriptor *desc, SANE_Word len,
+	    double *encode_time, double *decode_time)
+{
+  SANE_Option_Descriptor *desc_ptr = desc;
+  SANE_Word dec_len;
+  struct timeval start, stop;
+  long nbytes;
+  int differ;
+
+  lseek (w.io.fd, 0, SEEK_SET);
+  gettimeofday (&start, 0);
+  sanei_w_set_dir (&w, WIRE_ENCODE);
+  w.status = 0;
+  sanei_w_array (&w, &len, (void **) &desc_ptr,
+		 (WireCodecFunc) sanei_w_option_descriptor, sizeof (desc[0]));
+  sanei_w_set_dir (&w, WIRE_DECODE);
+  gettimeofday (&stop, 0);
+  if (w.status)
+    return -1;
+  *encode_time += (stop.tv_sec - start.tv_sec)
+    + (stop.tv_usec - start.tv_usec) / 1000000.0;
+  nbytes = lseek (w.io.fd, 0, SEEK_CUR);
+
+  lseek (w.io.fd, 0, SEEK_SET);
+  gettimeofday (&start, 0);
+  w.status = 0;
+  sanei_w_array (&w, &dec_len, (void **) &desc_ptr,
+		 (WireCodecFunc) sanei_w_option_descriptor, sizeof (desc[0]));
+  gettimeofday (&stop, 0);
+  if (w.status)
+    return -1;
+  *decode_time += (stop.tv_sec - start.tv_sec)
+    + (stop.tv_usec - start.tv_usec) / 1000000.0;
+  differ = (dec_len != len || descs_differ (desc, desc_ptr, len));
+
+  gettimeofday (&start, 0);
+  sanei_w_set_dir (&w, WIRE_FREE);
+  sanei_w_array (&w, &dec_len, (void **) &desc_ptr,
+		 (WireCodecFunc) sanei_w_option_descriptor, sizeof (desc[0]));
+  gettimeofday (&stop, 0);
+  *decode_time += (stop.tv_sec - start.tv_sec)
+    + (stop.tv_usec - start.tv_usec) / 1000000.0;
+
+  if (differ || w.status || w.allocated_memory != 0)
+    return -1;
+  return nbytes;
+}
+
+/* Transfer values larger than the wire buffer so arrays cross buffer
+   boundaries.  */
+static int
+test_big_values (char *codec)
+{
+  SANE_Option_Descriptor desc;
+  double t_enc = 0, t_dec = 0;
+  int i;
+
+  big_word_list[0] = BIG_WORDS;
+  for (i = 1; i <= BIG_WORDS; ++i)
+    big_word_list[i] = (i * 2654435761U) ^ (i & 1 ? -1 : 0);
+  for (i = 0; i < BIG_STRING - 1; ++i)
+    big_string[i] = 'a' + (i * 7) % 26;
+  big_string[BIG_STRING - 1] = '\0';
+
+  memset (&desc, 0, sizeof (desc));
+  desc.name = "big";
+  desc.desc = big_string;
+  desc.type = SANE_TYPE_INT;
+  desc.size = sizeof (SANE_Word);
+  desc.constraint_type = SANE_CONSTRAINT_WORD_LIST;
+  desc.constraint.word_list = big_word_list;
+
+  if (round_trip (&desc, 1, &t_enc, &t_dec) < 0)
+    {
+      fprintf (stderr, "%s: %s big value round trip failed\n",
+	       program_name, codec);
+      return 1;
+    }
+  printf ("%s big value round trip successful\n", codec);
+  return 0;
+}
+
+/* Compress LEN bytes and decompress them again, into buffers of the
+   exact size so that overruns show up under valgrind or ASan.  */
+static int
+lz_round_trip (const char *what, const SANE_Byte *src, size_t len)
+{
+  size_t bound = len + len / 255 + 16, comp_len, i;
+  SANE_Byte *comp = malloc (bound), *out, *small;
+  long out_len;
+  int bad = 0;
+
+  comp_len = sanei_net_compress (src, len, comp, bound);
+  if (comp_len == 0)
+    {
+      fprintf (stderr, "%s: compress of %s failed\n", program_name, what);
+      free (comp);
+      return 1;
+    }
+
+  out = malloc (len + 1);
+  out_len = sanei_net_decompress (comp, comp_len, out, len);
+  if (out_len != (long) len || memcmp (out, src, len) != 0)
+    {
+      fprintf (stderr, "%s: %s differs after decompress\n",
+	       program_name, what);
+      bad = 1;
+    }
+
+  /* one byte less room than the data needs */
+  if (len > 0 && sanei_net_decompress (comp, comp_len, out, len - 1) != -1)
+    {
+      fprintf (stderr, "%s: decompress of %s overflowed its buffer\n",
+	       program_name, what);
+      bad = 1;
+    }
+
+  /* a cut off stream is rejected, or decodes to the start of the data
+     if it ends between two sequences */
+  for (i = 0; i < comp_len && !bad; ++i)
+    {
+      out_len = sanei_net_decompress (comp, i, out, len);
+      if (out_len != -1
+	  && (out_len > (long) len || memcmp (out, src, out_len) != 0))
+	{
+	  fprintf (stderr, "%s: %s truncated to %lu bytes decoded to %ld\n",
+		   program_name, what, (unsigned long) i, out_len);
+	  bad = 1;
+	}
+    }
+
+  /* compress must give up rather than write past a short buffer */
+  for (i = 0; i < comp_len && !bad; ++i)
+    {
+      small = malloc (i + 1);
+      if (sanei_net_compress (src, len, small, i) != 0)
+	{
+	  fprintf (stderr, "%s: compress of %s into %lu bytes didn't fail\n",
+		   program_name, what, (unsigned long) i);
+	  bad = 1;
+	}
+      free (small);
+    }
+
+  free (out);
+  free (comp);
+  return bad;
+}
+
+/* Round trips of sanei_net_compress() and sanei_net_decompress(), and
+   streams the decompressor has to reject.  */
+static int
+test_compress (void)
+{
+  static const struct
+  {
+    const char *what;
+    SANE_Byte data[8];
+    size_t len;
+    size_t dst_size;
+  }
+  corrupt[] =
+  {
+    {"missing literal length", {0xf0}, 1, 64},
+    {"unterminated literal length", {0xf0, 255}, 2, 512},
+    {"short literal run", {0x30, 'a'}, 2, 64},
+    {"half an offset", {0x10, 'a', 0x01}, 3, 64},
+    {"zero offset", {0x10, 'a', 0x00, 0x00}, 4, 64},
+    {"offset before the start", {0x10, 'a', 0x02, 0x00}, 4, 64},
+    {"missing match length", {0x1f, 'a', 0x01, 0x00}, 4, 64},
+    {"unterminated match length", {0x1f, 'a', 0x01, 0x00, 255}, 5, 512},
+    {"match past the buffer", {0x10, 'a', 0x01, 0x00}, 4, 4},
+    {"literals past the buffer", {0x40, 'a', 'b', 'c', 'd'}, 5, 3}
+  };
+  static SANE_Byte data[LZ_DATA], dec[LZ_DATA];
+  static SANE_Byte comp[LZ_DATA + LZ_DATA / 255 + 16];
+  SANE_Byte out[512];
+  unsigned int seed = 1;
+  size_t comp_len, i;
+  int status = 0;
+
+  status |= lz_round_trip ("empty input", data, 0);
+
+  memcpy (data, "abc", 3);
+  for (i = 1; i < 4; ++i)
+    status |= lz_round_trip ("input shorter than a match", data, i);
+
+  /* random bytes: a single literal run, with several 255 length bytes */
+  for (i = 0; i < LZ_DATA; ++i)
+    {
+      seed = seed * 1103515245 + 12345;
+      data[i] = seed >> 16;
+    }
+  status |= lz_round_trip ("incompressible input", data, LZ_DATA);
+  /* that is one sequence, so every cut falls inside it */
+  comp_len = sanei_net_compress (data, LZ_DATA, comp, sizeof (comp));
+  for (i = 1; i < comp_len; ++i)
+    if (sanei_net_decompress (comp, i, dec, LZ_DATA) != -1)
+      {
+	fprintf (stderr, "%s: decompress accepted a stream cut to %lu bytes\n",
+		 program_name, (unsigned long) i);
+	status = 1;
+	break;
+      }
+  /* literal lengths of exactly 15, and of 15 + 255 */
+  status |= lz_round_trip ("15 byte literal run", data, 15);
+  status |= lz_round_trip ("270 byte literal run", data, 270);
+
+  /* one literal byte, then one long match */
+  memset (data, 0x55, LZ_DATA);
+  status |= lz_round_trip ("long match", data, LZ_DATA);
+  /* match lengths of exactly 4 + 15, and of 4 + 15 + 255 */
+  status |= lz_round_trip ("19 byte match", data, 1 + 19);
+  status |= lz_round_trip ("274 byte match", data, 1 + 274);
+
+  /* alternating runs, with matches that overlap their source */
+  for (i = 0; i < LZ_DATA; ++i)
+    if ((i / 300) & 1)
+      data[i] = "scan"[i % 4];
+    else
+      data[i] = (i * 7) ^ (i >> 3);
+  status |= lz_round_trip ("mixed runs", data, LZ_DATA);
+
+  for (i = 0; i < (size_t) NELEMS (corrupt); ++i)
+    if (sanei_net_decompress (corrupt[i].data, corrupt[i].len,
+			      out, corrupt[i].dst_size) != -1)
+      {
+	fprintf (stderr, "%s: decompress accepted %s\n",
+		 program_name, corrupt[i].what);
+	status = 1;
+      }
+
+  if (status == 0)
+    printf ("compression round trip successful\n");
+  return status;
+}
+
+static int
+benchmark (char *codec, int rounds)
+{
+  static SANE_Option_Descriptor desc[BENCH_DESCS];
+  static SANE_Word word_list[1 + BENCH_WORDS];
+  static char text[200];
+  double t_enc = 0, t_dec = 0;
+  long nbytes = 0;
+  int i;
+
+  word_list[0] = BENCH_WORDS;
+  for (i = 1; i <= BENCH_WORDS; ++i)
+    word_list[i] = i * 300;
+  memset (text, 'x', sizeof (text) - 1);
+
+  for (i = 0; i < BENCH_DESCS; ++i)
+    {
+      desc[i].name = "option-name";
+      desc[i].title = "Option title";
+      desc[i].desc = text;
+      desc[i].unit = SANE_UNIT_DPI;
+      desc[i].size = sizeof (SANE_Word);
+      desc[i].cap = SANE_CAP_SOFT_SELECT | SANE_CAP_SOFT_DETECT;
+      if (i & 1)
+	{
+	  desc[i].type = SANE_TYPE_STRING;
+	  desc[i].constraint_type = SANE_CONSTRAINT_STRING_LIST;
+	  desc[i].constraint.string_list = mode_list;
+	}
+      else
+	{
+	  desc[i].type = SANE_TYPE_FIXED;
+	  desc[i].constraint_type = SANE_CONSTRAINT_WORD_LIST;
+	  desc[i].constraint.word_list = word_list;
+	}
+    }
+
+  for (i = 0; i < rounds; ++i)
+    {
+      nbytes = round_trip (desc, BENCH_DESCS, &t_enc, &t_dec);
+      if (nbytes < 0)
+	{
+	  fprintf (stderr, "%s: %s benchmark round trip failed\n",
+		   program_name, codec);
+	  return 1;
+	}
+    }
+
+  printf ("%s benchmark: %d rounds of %ld bytes\n", codec, rounds, nbytes);
+  if (t_enc > 0 && t_dec > 0)
+    printf ("%s benchmark: encode %.1f MB/s, decode+free %.1f MB/s\n",
+	    codec, (double) nbytes * rounds / t_enc / 1e6,
+	    (double) nbytes * rounds / t_dec / 1e6);
+  return 0;
+}
+
 static int
 usage (int code)
 {
@@ -38,6 +388,8 @@ usage (int code)
 \n\
 Test the SANE wire manipulation library.\n\
 \n\
+    --benchmark[=ROUNDS] time encoding and decoding of a set of option\n\
+                         descriptors [default=1000 rounds]\n\
     --codec=CODEC        set the codec [default=%s]\n\
     --help               display this message and exit\n\
 -o, --output=FILE        set the output file [default=%s]\n\
@@ -64,6 +416,8 @@ main (int argc, char ** argv)
   char *codec = default_codec;
   char *outfile = default_outfile;
   int readonly = 0;
+  int rounds = 0;
+  int status = 0;
 
   program_name = argv[0];
   argv ++;
@@ -85,6 +439,14 @@ main (int argc, char ** argv)
 	{
 	  codec = *argv + 8;
 	}
+      else if (!strcmp (*argv, "--benchmark"))
+	{
+	  rounds = 1000;
+	}
+      else if (!strncmp (*argv, "--benchmark=", 12))
+	{
+	  rounds = atoi (*argv + 12);
+	}
       else if (!strcmp (*argv, "--help"))
 	{
 	  usage (0);
@@ -233,7 +595,16 @@ main (int argc, char ** argv)
     fprintf (stderr, "%s: free error %d: %s\n",
 	     program_name, w.status, strerror (w.status));
 
+  if (!readonly)
+    {
+      status |= test_big_values (codec);
+      status |= test_compress ();
+      if (rounds > 0)
+	status |= benchmark (codec, rounds);
+    }
+
   close (w.io.fd);
+  sanei_w_exit (&w);
 
-  return 0;
+  return status;
 }
@@ -0,0 +1,433 @@
+/* sane - Scanner Access Now Easy.
+
+   genesys_bench
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA.
+
+   Replays raw scan lines through the line conversion filters of the
+   genesys backend, once through the staged filters (reorder, reverse
+   ccd, shrink, each into its own buffer) and once through the fused
+   single-pass filter, checks that both give the same image and reports
+   how fast each one is.
+*/
+
+#include "../include/sane/config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/time.h>
+
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/_stdint.h"
+
+#define SINGLE_BYTE
+#define BYTES_PER_COMPONENT 1
+#define COMPONENT_TYPE uint8_t
+#define FUNC_NAME(f) f ## _8
+#include "../backend/genesys_conv_hlp.c"
+#undef FUNC_NAME
+#undef COMPONENT_TYPE
+#undef BYTES_PER_COMPONENT
+#undef SINGLE_BYTE
+
+#define DOUBLE_BYTE
+#define BYTES_PER_COMPONENT 2
+#define COMPONENT_TYPE uint16_t
+#define FUNC_NAME(f) f ## _16
+#include "../backend/genesys_conv_hlp.c"
+#undef FUNC_NAME
+#undef COMPONENT_TYPE
+#undef BYTES_PER_COMPONENT
+#undef DOUBLE_BYTE
+
+typedef struct
+{
+  unsigned int src_pixels;
+  unsigned int dst_pixels;
+  unsigned int channels;
+  unsigned int depth;
+  int is_cis;
+  int is_bgr;
+  unsigned int shift[3];	/* line distance of r, g, b */
+  unsigned int stagger;
+}
+Setup;
+
+static unsigned int
+max_shift (Setup * setup)
+{
+  unsigned int i, max = 0;
+
+  for (i = 0; i < setup->channels; i++)
+    if (setup->shift[i] > max)
+      max = setup->shift[i];
+  return max + setup->stagger;
+}
+
+static unsigned int
+fill_ccd_shift (Setup * setup, unsigned int *ccd_shift)
+{
+  if (setup->channels == 1)
+    {
+      ccd_shift[0] = 0;
+      ccd_shift[1] = setup->stagger;
+      return 2;
+    }
+  ccd_shift[0] = setup->shift[0];
+  ccd_shift[1] = setup->shift[1];
+  ccd_shift[2] = setup->shift[2];
+  ccd_shift[3] = ccd_shift[0] + setup->stagger;
+  ccd_shift[4] = ccd_shift[1] + setup->stagger;
+  ccd_shift[5] = ccd_shift[2] + setup->stagger;
+  return 6;
+}
+
+/* what genesys_read_staged_data does to LINES lines, without the buffer
+   bookkeeping; lines_buf and shrink_buf hold LINES + max_shift lines */
+static void
+run_staged (Setup * setup, uint8_t * raw, uint8_t * lines_buf,
+	    uint8_t * shrink_buf, uint8_t * out, unsigned int lines)
+{
+  unsigned int ccd_shift[6], shift_count, all;
+  unsigned int components = setup->src_pixels * setup->channels;
+  uint8_t *src = raw;
+  int wide = setup->depth == 16;
+
+  shift_count = fill_ccd_shift (setup, ccd_shift);
+  all = lines + max_shift (setup);
+
+  if (setup->channels == 3 && (setup->is_cis || setup->is_bgr))
+    {
+      if (setup->is_cis && setup->is_bgr)
+	(wide ? genesys_reorder_components_cis_bgr_16 :
+	 genesys_reorder_components_cis_bgr_8) (src, lines_buf, all,
+						setup->src_pixels);
+      else if (setup->is_cis)
+	(wide ? genesys_reorder_components_cis_16 :
+	 genesys_reorder_components_cis_8) (src, lines_buf, all,
+					    setup->src_pixels);
+      else
+	(wide ? genesys_reorder_components_bgr_16 :
+	 genesys_reorder_components_bgr_8) (src, lines_buf, all,
+					    setup->src_pixels);
+      src = lines_buf;
+    }
+#ifdef WORDS_BIGENDIAN
+  else if (wide)
+    {
+      genesys_reorder_components_endian_16 (src, lines_buf, all,
+					    setup->src_pixels,
+					    setup->channels);
+      src = lines_buf;
+    }
+#endif
+
+  if (max_shift (setup) > 0)
+    {
+      (wide ? genesys_reverse_ccd_16 : genesys_reverse_ccd_8)
+	(src, shrink_buf, lines, components, ccd_shift, shift_count);
+      src = shrink_buf;
+    }
+
+  if (setup->src_pixels != setup->dst_pixels)
+    (wide ? genesys_shrink_lines_16 : genesys_shrink_lines_8)
+      (src, out, lines, setup->src_pixels, setup->dst_pixels,
+       setup->channels);
+  else
+    memcpy (out, src, (size_t) lines * components * setup->depth / 8);
+}
+
+static void
+run_fused (Setup * setup, uint8_t * raw, uint8_t * out, unsigned int lines)
+{
+  unsigned int ccd_shift[6], shift_count;
+
+  shift_count = fill_ccd_shift (setup, ccd_shift);
+  (setup->depth == 16 ? genesys_fused_lines_16 : genesys_fused_lines_8)
+    (raw, out, lines, setup->src_pixels, setup->dst_pixels,
+     setup->channels, max_shift (setup) > 0 ? ccd_shift : NULL,
+     shift_count, setup->is_cis, setup->is_bgr);
+}
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Converts the raw data in blocks of BLOCK lines, like the backend does
+   with its 8 line buffers, for at least a second.  Returns MB of output
+   per second. */
+static double
+bench (Setup * setup, uint8_t * raw, unsigned int raw_lines,
+       unsigned int block, SANE_Bool fused, uint8_t * lines_buf,
+       uint8_t * shrink_buf, uint8_t * out)
+{
+  size_t src_bpl = (size_t) setup->src_pixels * setup->channels
+    * setup->depth / 8;
+  size_t dst_bpl = (size_t) setup->dst_pixels * setup->channels
+    * setup->depth / 8;
+  unsigned int lines = raw_lines - max_shift (setup);
+  unsigned int y, n;
+  double start, elapsed;
+  size_t bytes = 0;
+
+  start = now ();
+  do
+    {
+      for (y = 0; y < lines; y += n)
+	{
+	  n = lines - y < block ? lines - y : block;
+	  if (fused)
+	    run_fused (setup, raw + y * src_bpl, out + y * dst_bpl, n);
+	  else
+	    run_staged (setup, raw + y * src_bpl, lines_buf, shrink_buf,
+			out + y * dst_bpl, n);
+	}
+      bytes += lines * dst_bpl;
+      elapsed = now () - start;
+    }
+  while (elapsed < 1.0);
+
+  return bytes / elapsed / (1024 * 1024);
+}
+
+/* Returns 1 if the outputs differ. */
+static int
+compare (Setup * setup, uint8_t * raw, unsigned int raw_lines,
+	 unsigned int block)
+{
+  size_t src_bpl = (size_t) setup->src_pixels * setup->channels
+    * setup->depth / 8;
+  size_t dst_bpl = (size_t) setup->dst_pixels * setup->channels
+    * setup->depth / 8;
+  unsigned int lines = raw_lines - max_shift (setup);
+  unsigned int y;
+  uint8_t *lines_buf, *shrink_buf, *staged, *fused;
+  double staged_rate, fused_rate;
+  int differ;
+
+  lines_buf = malloc ((block + max_shift (setup)) * src_bpl);
+  shrink_buf = malloc (block * src_bpl);
+  staged = malloc (lines * dst_bpl);
+  fused = malloc (lines * dst_bpl);
+  if (!lines_buf || !shrink_buf || !staged || !fused)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (1);
+    }
+
+  staged_rate = bench (setup, raw, raw_lines, block, SANE_FALSE, lines_buf,
+		       shrink_buf, staged);
+  fused_rate = bench (setup, raw, raw_lines, block, SANE_TRUE, lines_buf,
+		      shrink_buf, fused);
+
+  /* genesys_shrink_lines doesn't skip the source pixels left over at the
+     end of a line, so the lines after the first of a block shift; the
+     fused filter has to match the staged filters run a line at a time */
+  for (y = 0; y < lines; y++)
+    run_staged (setup, raw + y * src_bpl, lines_buf, shrink_buf,
+		staged + y * dst_bpl, 1);
+  differ = memcmp (staged, fused, lines * dst_bpl) != 0;
+
+  printf ("%-5s %2u bit%s%s %5u -> %5u px, shift %u/%u/%u+%u: "
+	  "staged %7.1f MB/s, fused %7.1f MB/s, %s\n",
+	  setup->channels == 3 ? "color" : "gray", setup->depth,
+	  setup->is_cis ? " cis" : "", setup->is_bgr ? " bgr" : "",
+	  setup->src_pixels, setup->dst_pixels, setup->shift[0],
+	  setup->shift[1], setup->shift[2], setup->stagger, staged_rate,
+	  fused_rate, differ ? "OUTPUT DIFFERS" : "same output");
+
+  free (lines_buf);
+  free (shrink_buf);
+  free (staged);
+  free (fused);
+  return differ;
+}
+
+static uint8_t *
+make_lines (Setup * setup, unsigned int lines)
+{
+  size_t i, size = (size_t) lines * setup->src_pixels * setup->channels
+    * setup->depth / 8;
+  uint8_t *raw = malloc (size);
+
+  if (!raw)
+    return NULL;
+  for (i = 0; i < size; i++)
+    raw[i] = (uint8_t) (i * 7 + (i >> 9) + (i >> 13) * 31);
+  return raw;
+}
+
+static void
+usage (const char *name)
+{
+  printf ("Usage: %s [-f raw-file] [-p pixels] [-o output-pixels] "
+	  "[-c channels]\n"
+	  "       [-d depth] [-r r,g,b-line-distance] [-s stagger] [-C] [-B]\n"
+	  "       [-b block-lines]\n\n"
+	  "Without -f, synthetic lines are run through a set of typical "
+	  "setups.\n"
+	  "With -f, the raw lines from the file are run through the setup\n"
+	  "given by the other options.  -C: planar (cis) color data, "
+	  "-B: bgr order.\n", name);
+}
+
+int
+main (int argc, char **argv)
+{
+  static Setup setups[] = {
+    /* pixels, out, channels, depth, cis, bgr, r/g/b shift, stagger */
+    {5100, 5100, 3, 8, 0, 0, {0, 4, 8}, 0},
+    {5100, 2550, 3, 8, 0, 1, {0, 4, 8}, 4},
+    {5100, 5100, 3, 16, 0, 0, {0, 4, 8}, 4},
+    {5100, 1700, 3, 16, 0, 1, {0, 8, 16}, 0},
+    {2550, 2550, 3, 8, 1, 0, {0, 0, 0}, 0},
+    {2550, 1275, 3, 16, 1, 1, {0, 0, 0}, 0},
+    {2550, 5100, 3, 8, 0, 0, {0, 2, 4}, 0},
+    {10200, 10200, 1, 8, 0, 0, {0, 0, 0}, 4},
+    {10200, 5100, 1, 16, 0, 0, {0, 0, 0}, 0},
+    {10200, 3400, 1, 8, 0, 0, {0, 0, 0}, 0}
+  };
+  Setup setup;
+  const char *file = NULL;
+  unsigned int block = 8, lines;
+  uint8_t *raw;
+  int i, opt, failed = 0;
+
+  memset (&setup, 0, sizeof (setup));
+  setup.src_pixels = 5100;
+  setup.channels = 3;
+  setup.depth = 8;
+
+  while ((opt = getopt (argc, argv, "f:p:o:c:d:r:s:CBb:h")) != -1)
+    {
+      switch (opt)
+	{
+	case 'f':
+	  file = optarg;
+	  break;
+	case 'p':
+	  setup.src_pixels = atoi (optarg);
+	  break;
+	case 'o':
+	  setup.dst_pixels = atoi (optarg);
+	  break;
+	case 'c':
+	  setup.channels = atoi (optarg);
+	  break;
+	case 'd':
+	  setup.depth = atoi (optarg);
+	  break;
+	case 'r':
+	  if (sscanf (optarg, "%u,%u,%u", &setup.shift[0], &setup.shift[1],
+		      &setup.shift[2]) != 3)
+	    {
+	      usage (argv[0]);
+	      return 1;
+	    }
+	  break;
+	case 's':
+	  setup.stagger = atoi (optarg);
+	  break;
+	case 'C':
+	  setup.is_cis = 1;
+	  break;
+	case 'B':
+	  setup.is_bgr = 1;
+	  break;
+	case 'b':
+	  block = atoi (optarg);
+	  break;
+	default:
+	  usage (argv[0]);
+	  return opt == 'h' ? 0 : 1;
+	}
+    }
+  if (block == 0)
+    block = 1;
+
+  if (!file)
+    {
+      for (i = 0; i < NELEMS (setups); i++)
+	{
+	  lines = 200 + max_shift (&setups[i]);
+	  raw = make_lines (&setups[i], lines);
+	  if (!raw)
+	    return 1;
+	  failed += compare (&setups[i], raw, lines, block);
+	  free (raw);
+	}
+    }
+  else
+    {
+      FILE *fp;
+      long size;
+      size_t bpl;
+
+      if (!setup.dst_pixels)
+	setup.dst_pixels = setup.src_pixels;
+      if ((setup.channels != 1 && setup.channels != 3)
+	  || (setup.depth != 8 && setup.depth != 16) || !setup.src_pixels)
+	{
+	  fprintf (stderr, "only 1 or 3 channels of 8 or 16 bit data\n");
+	  return 1;
+	}
+      if (setup.channels == 1)
+	setup.is_cis = setup.is_bgr = 0;
+
+      fp = fopen (file, "rb");
+      if (!fp)
+	{
+	  perror (file);
+	  return 1;
+	}
+      fseek (fp, 0, SEEK_END);
+      size = ftell (fp);
+      rewind (fp);
+      bpl = (size_t) setup.src_pixels * setup.channels * setup.depth / 8;
+      lines = size / bpl;
+      if (lines <= max_shift (&setup))
+	{
+	  fprintf (stderr, "%s: not enough lines of %lu bytes\n", file,
+		   (unsigned long) bpl);
+	  fclose (fp);
+	  return 1;
+	}
+      raw = malloc (lines * bpl);
+      if (!raw || fread (raw, bpl, lines, fp) != lines)
+	{
+	  fprintf (stderr, "%s: read failed\n", file);
+	  fclose (fp);
+	  return 1;
+	}
+      fclose (fp);
+      failed = compare (&setup, raw, lines, block);
+      free (raw);
+    }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,484 @@
+/* sane - Scanner Access Now Easy.
+
+   gt68xx_bench
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA.
+
+   Runs synthetic lines through the shading correction of the gt68xx
+   calibrator, once with a division per value as it used to be done and
+   once with the multipliers computed at setup, checks that both give
+   the same values and clip counts and reports how fast each one is.
+   Does the same for the unpacking of the scanner data, with and without
+   the vector kernels.  Build with -DGT68XX_16BIT_SAMPLES to measure
+   16 bit samples.
+*/
+
+#include "../include/sane/config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/time.h>
+
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/_stdint.h"
+
+/* as in backend/gt68xx_mid.h */
+#ifdef GT68XX_16BIT_SAMPLES
+typedef uint16_t GT68xx_Sample;
+#else
+typedef unsigned int GT68xx_Sample;
+#endif
+
+#include "../backend/gt68xx_shading.c"
+#include "../backend/gt68xx_unpack.c"
+
+typedef struct
+{
+  int width;
+  unsigned int white_level;
+  unsigned int black;		/* highest black level */
+  unsigned int white;		/* lowest white level */
+}
+Setup;
+
+typedef struct
+{
+  unsigned int *k_white;
+  unsigned int *k_black;
+  uint64_t *k_factor;
+}
+Calibration;
+
+static unsigned int seed = 1;
+
+static unsigned int
+random_value (unsigned int range)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % range;
+}
+
+/* black and white points like gt68xx_calibrator_finish_setup makes them
+   from averaged calibration lines, with a few dead pixels */
+static void
+make_calibration (Setup * setup, Calibration * cal)
+{
+  int i;
+
+  for (i = 0; i < setup->width; i++)
+    {
+      unsigned int black = random_value (setup->black + 1);
+      unsigned int white = setup->white + random_value (65536 - setup->white);
+      unsigned int diff = (white > black) ? white - black : 1;
+
+      if (i % 509 == 0)
+	diff = 1 + random_value (64);
+      cal->k_white[i] = diff;
+      cal->k_black[i] = black;
+    }
+  gt68xx_shading_factors (cal->k_factor, cal->k_white, setup->width,
+			  setup->white_level);
+}
+
+/* scanned values: mostly between black and white, some beyond */
+static void
+make_lines (Setup * setup, GT68xx_Sample * lines, int count)
+{
+  size_t i, size = (size_t) setup->width * count;
+
+  for (i = 0; i < size; i++)
+    lines[i] = random_value (65536);
+}
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Corrects copies of the lines over and over for at least a second.
+   Returns million values per second. */
+static double
+bench (Setup * setup, Calibration * cal, GT68xx_Sample * lines, int count,
+       GT68xx_Sample * work, SANE_Bool factors, int *min_clip, int *max_clip)
+{
+  double start, elapsed;
+  size_t values = 0;
+  int y;
+
+  start = now ();
+  do
+    {
+      *min_clip = *max_clip = 0;
+      for (y = 0; y < count; y++)
+	{
+	  GT68xx_Sample *line = work + (size_t) y * setup->width;
+
+	  memcpy (line, lines + (size_t) y * setup->width,
+		  setup->width * sizeof (GT68xx_Sample));
+	  if (factors)
+	    gt68xx_shading_line (line, cal->k_black, cal->k_factor,
+				 setup->width, min_clip, max_clip);
+	  else
+	    gt68xx_shading_line_div (line, cal->k_black, cal->k_white,
+				     setup->width, setup->white_level,
+				     min_clip, max_clip);
+	}
+      values += (size_t) count *setup->width;
+      elapsed = now () - start;
+    }
+  while (elapsed < 1.0);
+  return values / elapsed / 1000000.0;
+}
+
+/* Returns 1 if the results differ. */
+static int
+compare (Setup * setup, int count)
+{
+  Calibration cal;
+  GT68xx_Sample *lines, *old, *new;
+  int old_min, old_max, new_min, new_max, differ;
+  double old_rate, new_rate;
+  size_t size = (size_t) setup->width * count;
+
+  cal.k_white = malloc (setup->width * sizeof (unsigned int));
+  cal.k_black = malloc (setup->width * sizeof (unsigned int));
+  cal.k_factor = malloc (setup->width * sizeof (uint64_t));
+  lines = malloc (size * sizeof (GT68xx_Sample));
+  old = malloc (size * sizeof (GT68xx_Sample));
+  new = malloc (size * sizeof (GT68xx_Sample));
+  if (!cal.k_white || !cal.k_black || !cal.k_factor || !lines || !old
+      || !new)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (1);
+    }
+  make_calibration (setup, &cal);
+  make_lines (setup, lines, count);
+
+  old_rate = bench (setup, &cal, lines, count, old, SANE_FALSE, &old_min,
+		    &old_max);
+  new_rate = bench (setup, &cal, lines, count, new, SANE_TRUE, &new_min,
+		    &new_max);
+  differ = memcmp (old, new, size * sizeof (GT68xx_Sample)) != 0
+    || old_min != new_min || old_max != new_max;
+
+  printf ("%5d px, white level %5u, black <= %5u, white >= %5u: "
+	  "division %7.1f, multiplier %7.1f Mvalues/s, clipped %d/%d, %s\n",
+	  setup->width, setup->white_level, setup->black, setup->white,
+	  old_rate, new_rate, new_min, new_max,
+	  differ ? "RESULTS DIFFER" : "same results");
+
+  free (cal.k_white);
+  free (cal.k_black);
+  free (cal.k_factor);
+  free (lines);
+  free (old);
+  free (new);
+  return differ;
+}
+
+/* Every value through every divisor. Returns the number of mismatches. */
+static long
+check_all (unsigned int white_level)
+{
+  unsigned int k_white[256], k_black[256];
+  GT68xx_Sample line[256], ref[256];
+  uint64_t k_factor[256];
+  unsigned int k, n, i;
+  int min_clip = 0, max_clip = 0;
+  long bad = 0;
+
+  memset (k_black, 0, sizeof (k_black));
+  for (k = 1; k <= 65535; k += 256)
+    {
+      for (i = 0; i < 256; i++)
+	k_white[i] = k + i > 65535 ? 65535 : k + i;
+      gt68xx_shading_factors (k_factor, k_white, 256, white_level);
+      for (n = 0; n <= 65535; n++)
+	{
+	  for (i = 0; i < 256; i++)
+	    line[i] = ref[i] = n;
+	  gt68xx_shading_line (line, k_black, k_factor, 256, &min_clip,
+			       &max_clip);
+	  gt68xx_shading_line_div (ref, k_black, k_white, 256, white_level,
+				   &min_clip, &max_clip);
+	  if (memcmp (line, ref, sizeof (line)))
+	    bad++;
+	}
+    }
+  printf ("all values through all white points, white level %u: "
+	  "%ld mismatches\n", white_level, bad);
+  return bad;
+}
+
+static void
+unpack_12_le_rgb_all (SANE_Byte * src, GT68xx_Sample * dst,
+		      SANE_Int pixels_per_line)
+{
+  unpack_12_le_rgb (src, dst, dst + pixels_per_line,
+		    dst + 2 * pixels_per_line, pixels_per_line);
+}
+
+typedef struct
+{
+  const char *name;
+  void (*unpack) (SANE_Byte * src, GT68xx_Sample * dst,
+		  SANE_Int pixels_per_line);
+  int source;			/* bytes of data for 2 pixels */
+  int channel;			/* step between the channels of a pixel */
+  int values;			/* values unpacked per pixel */
+}
+Unpacker;
+
+static Unpacker unpackers[] = {
+  {"8 bit gray", unpack_8_mono, 2, 0, 1},
+  {"8 bit rgb", unpack_8_rgb, 6, 1, 1},
+  {"12 bit gray", unpack_12_le_mono, 3, 0, 1},
+  {"12 bit rgb", unpack_12_le_rgb_all, 9, 0, 3},
+  {"16 bit gray", unpack_16_le_mono, 4, 0, 1},
+  {"16 bit rgb", unpack_16_le_rgb, 12, 2, 1}
+};
+
+/* Unpacks a line of random data, like the line readers do, and stores
+   the result at dst.  Returns the number of values. */
+static size_t
+unpack_line (Unpacker * u, SANE_Byte * src, GT68xx_Sample * dst, int width)
+{
+  int c;
+
+  if (!u->channel)
+    {
+      u->unpack (src, dst, width);
+      return (size_t) width * u->values;
+    }
+  for (c = 0; c < 3; c++)
+    u->unpack (src + c * u->channel, dst + c * width, width);
+  return (size_t) width * 3;
+}
+
+/* Returns 1 if the vector kernels give other values than the plain C
+   loops for any width up to max_width.  The source buffers have the
+   exact size of the line, so that memory checkers see overruns. */
+static int
+check_unpack (Unpacker * u, int use, int max_width)
+{
+  GT68xx_Sample *plain, *vector;
+  SANE_Byte *src;
+  size_t size, values, i;
+  int width, differ = 0;
+
+  plain = malloc (3 * max_width * sizeof (GT68xx_Sample));
+  vector = malloc (3 * max_width * sizeof (GT68xx_Sample));
+  if (!plain || !vector)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (1);
+    }
+  for (width = 2; width <= max_width && !differ; width += 2)
+    {
+      size = (size_t) width / 2 * u->source;
+      src = malloc (size);
+      if (!src)
+	{
+	  fprintf (stderr, "out of memory\n");
+	  exit (1);
+	}
+      for (i = 0; i < size; i++)
+	src[i] = random_value (256);
+      gt68xx_unpack_use = 0;
+      values = unpack_line (u, src, plain, width);
+      gt68xx_unpack_use = use;
+      unpack_line (u, src, vector, width);
+      if (memcmp (plain, vector, values * sizeof (GT68xx_Sample)))
+	{
+	  printf ("%s: vector unpacking differs at width %d\n", u->name,
+		  width);
+	  differ = 1;
+	}
+      free (src);
+    }
+  free (plain);
+  free (vector);
+  return differ;
+}
+
+/* Unpacks count lines over and over for at least a second.  Returns
+   million pixels per second. */
+static double
+bench_unpack (Unpacker * u, int use, SANE_Byte * src, GT68xx_Sample * dst,
+	      int width, int count)
+{
+  size_t line = (size_t) width / 2 * u->source;
+  double start, elapsed;
+  size_t pixels = 0;
+  int y;
+
+  gt68xx_unpack_use = use;
+  start = now ();
+  do
+    {
+      for (y = 0; y < count; y++)
+	unpack_line (u, src + y * line, dst, width);
+      pixels += (size_t) count * width;
+      elapsed = now () - start;
+    }
+  while (elapsed < 1.0);
+  return pixels / elapsed / 1000000.0;
+}
+
+/* Returns the number of unpackers that gave wrong values. */
+static int
+compare_unpack (int width, int count)
+{
+  GT68xx_Sample *dst;
+  SANE_Byte *src;
+  size_t size, i;
+  int use, n, failed = 0;
+
+  use = gt68xx_unpack_init ();
+  printf ("unpacking with%s%s%s%s, %d bit samples\n",
+	  (use & GT68XX_UNPACK_USE_SSE2) ? " SSE2" : "",
+	  (use & GT68XX_UNPACK_USE_AVX2) ? " AVX2" : "",
+	  (use & GT68XX_UNPACK_USE_NEON) ? " NEON" : "",
+	  use ? "" : " plain C only", (int) sizeof (GT68xx_Sample) * 8);
+
+  width &= ~1;
+  size = (size_t) width / 2 * 12 * count;
+  src = malloc (size);
+  dst = malloc (3 * width * sizeof (GT68xx_Sample));
+  if (!src || !dst)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (1);
+    }
+  for (i = 0; i < size; i++)
+    src[i] = random_value (256);
+
+  for (n = 0; n < NELEMS (unpackers); n++)
+    {
+      Unpacker *u = &unpackers[n];
+      int differ = check_unpack (u, use, 200);
+
+      printf ("%-11s %5d px: plain %7.1f, vector %7.1f Mpixels/s, %s\n",
+	      u->name, width, bench_unpack (u, 0, src, dst, width, count),
+	      bench_unpack (u, use, src, dst, width, count),
+	      differ ? "RESULTS DIFFER" : "same results");
+      failed += differ;
+    }
+  free (src);
+  free (dst);
+  return failed;
+}
+
+static void
+usage (const char *name)
+{
+  printf ("Usage: %s [-p pixels] [-l lines] [-w white-level] "
+	  "[-k black,white] [-S seed] [-x]\n\n"
+	  "Without -p, synthetic lines are run through a set of typical "
+	  "setups and\nunpacked at 5100 pixels.\n"
+	  "-k gives the highest black and lowest white level of the "
+	  "calibration.\n"
+	  "-x checks every 16 bit value against every white point "
+	  "(takes a while).\n", name);
+}
+
+int
+main (int argc, char **argv)
+{
+  static Setup setups[] = {
+    /* pixels, white level, black, white */
+    {2550, 65535, 4000, 40000},
+    {5100, 65535, 4000, 40000},
+    {10200, 65535, 4000, 40000},
+    {10200, 65535, 20000, 30000},
+    {5100, 50000, 1000, 60000},
+    {5100, 255, 4000, 40000}
+  };
+  Setup setup;
+  int i, opt, count = 64, failed = 0, check = 0;
+
+  memset (&setup, 0, sizeof (setup));
+  setup.white_level = 65535;
+  setup.black = 4000;
+  setup.white = 40000;
+
+  while ((opt = getopt (argc, argv, "p:l:w:k:S:xh")) != -1)
+    {
+      switch (opt)
+	{
+	case 'p':
+	  setup.width = atoi (optarg);
+	  break;
+	case 'l':
+	  count = atoi (optarg);
+	  break;
+	case 'w':
+	  setup.white_level = atoi (optarg);
+	  break;
+	case 'k':
+	  if (sscanf (optarg, "%u,%u", &setup.black, &setup.white) != 2)
+	    {
+	      usage (argv[0]);
+	      return 1;
+	    }
+	  break;
+	case 'S':
+	  seed = atoi (optarg);
+	  break;
+	case 'x':
+	  check = 1;
+	  break;
+	case 'h':
+	  usage (argv[0]);
+	  return 0;
+	default:
+	  usage (argv[0]);
+	  return 1;
+	}
+    }
+  if (count < 1 || setup.white_level < 1 || setup.white_level > 65535
+      || setup.white > 65535 || setup.black > 65535)
+    {
+      usage (argv[0]);
+      return 1;
+    }
+
+  if (setup.width > 0)
+    failed += compare (&setup, count);
+  else
+    for (i = 0; i < NELEMS (setups); i++)
+      failed += compare (&setups[i], count);
+  failed += compare_unpack (setup.width > 1 ? setup.width : 5100, count);
+
+  if (check)
+    {
+      failed += check_all (65535) != 0;
+      failed += check_all (setup.white_level) != 0;
+    }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,440 @@
+/* sane - Scanner Access Now Easy.
+
+   net_swap_bench
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA.
+
+   Times the byte swapping of 16 bit data in the net backend when client
+   and server have different byte order: the swap of one pair at a time
+   with the memmove for an odd byte as sane_read used to do it, against
+   swap_16 with the odd byte read in front of the data.  Checks that both
+   return the bytes of the stream swapped pair by pair.  The old way gets
+   this wrong when an odd number of bytes follows a held back odd byte:
+   it then returns a byte unswapped and is off by one from there on.  That
+   is reported but only a wrong result of the new way fails.
+*/
+
+#include "../include/sane/config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/time.h>
+
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/_stdint.h"
+
+#include "../backend/net_swap.c"
+
+/* The data as it comes from saned, at most chunk bytes per read. */
+typedef struct
+{
+  SANE_Byte *data;
+  size_t size;
+  size_t pos;
+  size_t chunk;
+}
+Stream;
+
+/* The odd byte state of one handle */
+typedef struct
+{
+  int hang_over;
+  int left_over;
+}
+Carry;
+
+static unsigned int seed = 1;
+
+static unsigned int
+random_value (unsigned int range)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % range;
+}
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static SANE_Int
+stream_read (Stream * stream, SANE_Byte * data, SANE_Int max_length)
+{
+  size_t n = stream->size - stream->pos;
+
+  if (n > stream->chunk)
+    n = stream->chunk;
+  if (n > (size_t) max_length)
+    n = max_length;
+  memcpy (data, stream->data + stream->pos, n);
+  stream->pos += n;
+  return n;
+}
+
+/* Swaps pair by pair, like the old sane_read did. */
+static void
+swap_pairs (SANE_Byte * data, SANE_Int n)
+{
+  SANE_Byte swap_buf;
+  SANE_Int cnt;
+
+  for (cnt = 0; cnt < n - 1; cnt += 2)
+    {
+      swap_buf = *(data + cnt);
+      *(data + cnt) = *(data + cnt + 1);
+      *(data + cnt + 1) = swap_buf;
+    }
+}
+
+/* sane_read as it used to be */
+static SANE_Status
+old_read (Stream * stream, Carry * c, SANE_Byte * data, SANE_Int max_length,
+	  SANE_Int * length)
+{
+  SANE_Int nread, start_cnt, end_cnt, is_even;
+  SANE_Byte temp_hang_over;
+
+  *length = 0;
+  if (c->left_over > -1)
+    {
+      *data = (SANE_Byte) c->left_over;
+      c->left_over = -1;
+      *length = 1;
+      return SANE_STATUS_GOOD;
+    }
+  if (stream->pos >= stream->size)
+    return SANE_STATUS_EOF;
+
+  nread = stream_read (stream, data, max_length);
+  *length = nread;
+
+  if ((nread == 1) && (c->hang_over > -1))
+    {
+      c->left_over = c->hang_over;
+      c->hang_over = -1;
+      return SANE_STATUS_GOOD;
+    }
+  is_even = (nread % 2) == 0;
+  if ((nread > 1) && (c->hang_over > -1))
+    {
+      temp_hang_over = *(data + nread - 1);
+      memmove (data + 1, data, nread - 1);
+      *data = (SANE_Byte) c->hang_over;
+      if (is_even)
+	{
+	  c->left_over = *(data + nread - 1);
+	  *(data + nread - 1) = temp_hang_over;
+	  c->hang_over = -1;
+	  start_cnt = 0;
+	  end_cnt = nread - 2;
+	}
+      else
+	{
+	  c->hang_over = temp_hang_over;
+	  c->left_over = -1;
+	  start_cnt = 0;
+	  end_cnt = nread - 1;
+	}
+    }
+  else if (nread == 1)
+    {
+      c->hang_over = (int) *data;
+      *length = 0;
+      return SANE_STATUS_GOOD;
+    }
+  else
+    {
+      if (is_even)
+	{
+	  start_cnt = 0;
+	  end_cnt = *length;
+	}
+      else
+	{
+	  start_cnt = 0;
+	  c->hang_over = *(data + *length - 1);
+	  *length -= 1;
+	  end_cnt = *length;
+	}
+    }
+  swap_pairs (data + start_cnt, end_cnt - start_cnt);
+  return SANE_STATUS_GOOD;
+}
+
+/* sane_read as it is now */
+static SANE_Status
+new_read (Stream * stream, Carry * c, SANE_Byte * data, SANE_Int max_length,
+	  SANE_Int * length)
+{
+  SANE_Int offset, nread;
+
+  *length = 0;
+  if (c->left_over > -1)
+    {
+      *data = (SANE_Byte) c->left_over;
+      c->left_over = -1;
+      *length = 1;
+      return SANE_STATUS_GOOD;
+    }
+  if (stream->pos >= stream->size)
+    return SANE_STATUS_EOF;
+
+  offset = 0;
+  if (c->hang_over > -1)
+    {
+      if (max_length < 2)
+	{
+	  *data = stream->data[stream->pos++];
+	  c->left_over = c->hang_over;
+	  c->hang_over = -1;
+	  *length = 1;
+	  return SANE_STATUS_GOOD;
+	}
+      *data = (SANE_Byte) c->hang_over;
+      offset = 1;
+    }
+
+  nread = stream_read (stream, data + offset, max_length - offset);
+  nread += offset;
+  c->hang_over = -1;
+  if (nread % 2)
+    {
+      c->hang_over = data[nread - 1];
+      nread--;
+    }
+  swap_16 (data, nread);
+  *length = nread;
+  return SANE_STATUS_GOOD;
+}
+
+typedef SANE_Status (*Reader) (Stream * stream, Carry * c, SANE_Byte * data,
+			       SANE_Int max_length, SANE_Int * length);
+
+/* Reads the whole stream with buffers of max_length bytes into out.
+   Returns the number of bytes. */
+static size_t
+read_all (Reader reader, Stream * stream, SANE_Byte * out, SANE_Int max_length)
+{
+  Carry c;
+  SANE_Int len;
+  size_t total = 0;
+
+  c.hang_over = c.left_over = -1;
+  stream->pos = 0;
+  while (reader (stream, &c, out + total, max_length, &len)
+	 == SANE_STATUS_GOOD)
+    total += len;
+  return total;
+}
+
+/* Reads the stream over and over for at least a second.  Returns
+   megabytes per second. */
+static double
+bench (Reader reader, Stream * stream, SANE_Byte * out, SANE_Int max_length)
+{
+  double start, elapsed;
+  double bytes = 0;
+
+  start = now ();
+  do
+    {
+      bytes += read_all (reader, stream, out, max_length);
+      elapsed = now () - start;
+    }
+  while (elapsed < 1.0);
+  return bytes / elapsed / 1000000.0;
+}
+
+/* Returns 1 if the new reads don't give the swapped stream. */
+static int
+compare (Stream * stream, SANE_Int max_length, SANE_Byte * expected)
+{
+  SANE_Byte *old, *new;
+  size_t old_size, new_size;
+  double old_rate, new_rate;
+  int old_wrong, new_wrong;
+
+  /* room for the longest read behind the end of the data */
+  old = malloc (stream->size + max_length);
+  new = malloc (stream->size + max_length);
+  if (!old || !new)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (1);
+    }
+
+  old_size = read_all (old_read, stream, old, max_length);
+  new_size = read_all (new_read, stream, new, max_length);
+  old_wrong = old_size != stream->size
+    || memcmp (old, expected, stream->size) != 0;
+  new_wrong = new_size != stream->size
+    || memcmp (new, expected, stream->size) != 0;
+
+  old_rate = bench (old_read, stream, old, max_length);
+  new_rate = bench (new_read, stream, new, max_length);
+  printf ("%8lu bytes, chunks of %6lu, reads of %6d: per pair %7.1f, "
+	  "swap_16 %7.1f MB/s, %s\n", (unsigned long) stream->size,
+	  (unsigned long) stream->chunk, max_length, old_rate, new_rate,
+	  new_wrong ? "NEW RESULTS WRONG"
+	  : old_wrong ? "old results wrong" : "same results");
+
+  free (old);
+  free (new);
+  return new_wrong;
+}
+
+/* Swaps data in place over and over for at least a second.  Returns
+   megabytes per second. */
+static double
+bench_swap (void (*swap) (SANE_Byte * data, SANE_Int n), SANE_Byte * data,
+	    SANE_Int n)
+{
+  double start, elapsed;
+  double bytes = 0;
+
+  start = now ();
+  do
+    {
+      swap (data, n);
+      bytes += n;
+      elapsed = now () - start;
+    }
+  while (elapsed < 1.0);
+  return bytes / elapsed / 1000000.0;
+}
+
+/* The swap alone, without reading.  Returns 1 if swap_16 gives other
+   data than the pair by pair swap. */
+static int
+compare_swap (Stream * stream)
+{
+  SANE_Byte *old, *new;
+  double old_rate, new_rate;
+  int differ;
+
+  old = malloc (stream->size);
+  new = malloc (stream->size);
+  if (!old || !new)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (1);
+    }
+  memcpy (old, stream->data, stream->size);
+  memcpy (new, stream->data, stream->size);
+  swap_pairs (old, stream->size);
+  swap_16 (new, stream->size);
+  differ = memcmp (old, new, stream->size) != 0;
+
+  old_rate = bench_swap (swap_pairs, old, stream->size);
+  new_rate = bench_swap (swap_16, new, stream->size);
+  printf ("%8lu bytes swapped in place: per pair %7.1f, swap_16 %7.1f "
+	  "MB/s, %s\n", (unsigned long) stream->size, old_rate, new_rate,
+	  differ ? "RESULTS DIFFER" : "same results");
+
+  free (old);
+  free (new);
+  return differ;
+}
+
+static void
+usage (const char *name)
+{
+  printf ("Usage: %s [-s size] [-c chunk] [-r read-length] [-S seed]\n\n"
+	  "Without -r, the data is read with a set of typical even and odd "
+	  "lengths.\n"
+	  "-c is the most bytes a read gets from the network.\n", name);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const SANE_Int lengths[] = { 1, 3, 4095, 4096, 32767, 65536 };
+  Stream stream;
+  SANE_Byte *expected;
+  size_t i;
+  int opt, length = 0, failed = 0;
+
+  memset (&stream, 0, sizeof (stream));
+  stream.size = 4 * 1024 * 1024;
+  stream.chunk = 32768;
+
+  while ((opt = getopt (argc, argv, "s:c:r:S:h")) != -1)
+    {
+      switch (opt)
+	{
+	case 's':
+	  stream.size = atol (optarg);
+	  break;
+	case 'c':
+	  stream.chunk = atol (optarg);
+	  break;
+	case 'r':
+	  length = atoi (optarg);
+	  break;
+	case 'S':
+	  seed = atoi (optarg);
+	  break;
+	case 'h':
+	  usage (argv[0]);
+	  return 0;
+	default:
+	  usage (argv[0]);
+	  return 1;
+	}
+    }
+  /* an odd byte at the end is never returned */
+  stream.size &= ~(size_t) 1;
+  if (stream.size < 2 || stream.chunk < 1 || length < 0)
+    {
+      usage (argv[0]);
+      return 1;
+    }
+
+  stream.data = malloc (stream.size);
+  expected = malloc (stream.size);
+  if (!stream.data || !expected)
+    {
+      fprintf (stderr, "out of memory\n");
+      return 1;
+    }
+  for (i = 0; i < stream.size; i += 2)
+    {
+      stream.data[i] = expected[i + 1] = random_value (256);
+      stream.data[i + 1] = expected[i] = random_value (256);
+    }
+
+  failed += compare_swap (&stream);
+  if (length > 0)
+    failed += compare (&stream, length, expected);
+  else
+    for (i = 0; i < NELEMS (lengths); i++)
+      failed += compare (&stream, lengths[i], expected);
+
+  free (stream.data);
+  free (expected);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/perl -w
+
+# Measures how long a client has to wait for saned: the time from
+# opening the control connection until the reply to SANE_NET_INIT
+# arrives, which includes forking (or handing over to a pool worker)
+# and initializing the backends.  With --devices the time until the
+# reply to the first SANE_NET_GET_DEVICES is measured instead, which
+# also covers loading and probing the backends behind the dll backend.
+#
+# saned-latency.pl [--host=HOST] [--port=PORT] [--count=N] [--user=NAME]
+#                  [--devices]
+#
+# This file is part of the SANE package.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 2 of the
+# License, or (at your option) any later version.
+
+use strict;
+use warnings;
+
+use Getopt::Long;
+use IO::Socket::INET;
+use Time::HiRes qw(time);
+
+my $host = "localhost";
+my $port = 6566;
+my $count = 10;
+my $user = "saned-latency";
+my $devices = 0;
+
+# SANE_VERSION_CODE (1, 0, 3), protocol version 3
+my $version_code = 0x01000003;
+
+my $SANE_NET_INIT = 0;
+my $SANE_NET_GET_DEVICES = 1;
+my $SANE_NET_EXIT = 10;
+
+GetOptions ("host=s" => \$host,
+	    "port=i" => \$port,
+	    "count=i" => \$count,
+	    "user=s" => \$user,
+	    "devices" => \$devices)
+    or die "usage: $0 [--host=HOST] [--port=PORT] [--count=N] [--user=NAME] "
+    . "[--devices]\n";
+
+sub read_exact {
+	my ($sock, $len) = @_;
+	my $buf = "";
+
+	while (length ($buf) < $len) {
+		my $n = sysread ($sock, $buf, $len - length ($buf), length ($buf));
+		die "connection closed by saned\n" unless $n;
+	}
+	return $buf;
+}
+
+sub read_word {
+	my ($sock) = @_;
+
+	return unpack ("N", read_exact ($sock, 4));
+}
+
+# Skips the device list of a SANE_NET_GET_DEVICES reply and returns
+# the number of devices.
+sub read_device_list {
+	my ($sock) = @_;
+	my $ndevs = 0;
+
+	my $len = read_word ($sock);
+	for my $i (1 .. $len) {
+		next if read_word ($sock);	# NULL pointer
+		for my $field (1 .. 4) {	# name, vendor, model, type
+			my $slen = read_word ($sock);
+			read_exact ($sock, $slen) if $slen;
+		}
+		$ndevs++;
+	}
+	return $ndevs;
+}
+
+my @times;
+
+for my $i (1 .. $count) {
+	my $start = time;
+
+	my $sock = IO::Socket::INET->new (PeerAddr => $host,
+					  PeerPort => $port,
+					  Proto => "tcp")
+	    or die "cannot connect to $host:$port: $!\n";
+
+	# procedure number, version code, user name (length includes NUL)
+	syswrite ($sock, pack ("N N N a* x", $SANE_NET_INIT, $version_code,
+			       length ($user) + 1, $user));
+
+	my ($status, $version) = unpack ("N N", read_exact ($sock, 8));
+	my $elapsed = (time - $start) * 1000;
+
+	die "SANE_NET_INIT failed with status $status\n" if $status != 0;
+
+	if ($devices) {
+		syswrite ($sock, pack ("N", $SANE_NET_GET_DEVICES));
+		$status = read_word ($sock);
+		my $ndevs = read_device_list ($sock);
+		$elapsed = (time - $start) * 1000;
+		die "SANE_NET_GET_DEVICES failed with status $status\n"
+		    if $status != 0;
+	}
+
+	syswrite ($sock, pack ("N", $SANE_NET_EXIT));
+	close ($sock);
+
+	printf "connection %d: %.2f ms\n", $i, $elapsed;
+	push @times, $elapsed;
+}
+
+my @sorted = sort { $a <=> $b } @times;
+my $sum = 0;
+$sum += $_ for @sorted;
+
+printf "min %.2f ms, median %.2f ms, mean %.2f ms, max %.2f ms\n",
+    $sorted[0], $sorted[$#sorted / 2], $sum / @sorted, $sorted[-1];